@@ -0,0 +1,108 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/base/common/background_thread.h"
+
+#include "gears/base/common/common.h"
+
+Mutex BackgroundThread::instances_mutex_;
+std::vector<BackgroundThread**> BackgroundThread::instances_;
+bool BackgroundThread::is_stopping_all_ = false;
+
+BackgroundThread::BackgroundThread()
+    : is_started_(false), is_stopping_(false) {
+}
+
+bool BackgroundThread::Wake() {
+  MutexLock lock(&mutex_);
+  if (is_stopping_) {
+    return false;
+  }
+  if (!is_started_) {
+    if (!Start()) {
+      LOG(("BackgroundThread failed to start\n"));
+      return false;
+    }
+    is_started_ = true;
+  }
+  wake_event_.Signal();
+  return true;
+}
+
+bool BackgroundThread::IsStopping() {
+  MutexLock lock(&mutex_);
+  return is_stopping_;
+}
+
+bool BackgroundThread::Pause(int millis) {
+  wake_event_.WaitWithTimeout(millis);
+  return !IsStopping();
+}
+
+void BackgroundThread::Run() {
+  while (!IsStopping()) {
+    wake_event_.Wait();
+    if (IsStopping()) {
+      break;
+    }
+    DoWork();
+  }
+}
+
+void BackgroundThread::Stop() {
+  bool is_started;
+  {
+    MutexLock lock(&mutex_);
+    is_stopping_ = true;
+    is_started = is_started_;
+  }
+  if (is_started) {
+    wake_event_.Signal();
+    Join();
+  }
+}
+
+// static
+void BackgroundThread::StopAll() {
+  // The instances are taken out of their slots first, so that a thread
+  // that is being stopped does not find itself, or create a new instance,
+  // through GetInstance().
+  std::vector<BackgroundThread*> threads;
+  {
+    MutexLock lock(&instances_mutex_);
+    is_stopping_all_ = true;
+    for (size_t i = 0; i < instances_.size(); ++i) {
+      threads.push_back(*instances_[i]);
+      *instances_[i] = NULL;
+    }
+    instances_.clear();
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Stop();
+    delete threads[i];
+  }
+  MutexLock lock(&instances_mutex_);
+  is_stopping_all_ = false;
+}
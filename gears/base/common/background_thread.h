@@ -0,0 +1,115 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// A thread that is started the first time it is woken, and then sleeps until
+// woken again to do another round of work. Used for background work that
+// does not belong to any one caller, such as collecting garbage.
+//
+// There is one instance of each BackgroundThread subclass, see GetInstance.
+// StopAll() stops and joins all of them, and must be called before the
+// module is unloaded, so that no thread is left waiting in code that is
+// about to be unmapped. An instance that is needed again afterwards is
+// created and started anew.
+
+#ifndef GEARS_BASE_COMMON_BACKGROUND_THREAD_H__
+#define GEARS_BASE_COMMON_BACKGROUND_THREAD_H__
+
+#include <vector>
+#include "gears/base/common/basictypes.h"
+#include "gears/base/common/event.h"
+#include "gears/base/common/mutex.h"
+#include "gears/base/common/thread.h"
+
+class BackgroundThread : public Thread {
+ public:
+  // Returns the instance of T, creating it if necessary. Returns NULL while
+  // StopAll() is running.
+  template<class T>
+  static T *GetInstance();
+
+  // Wakes the thread, starting it first if needed. Returns false if it could
+  // not be started or is being stopped.
+  bool Wake();
+
+  // Stops and joins every instance, and then deletes them. Must not be
+  // called from a BackgroundThread.
+  static void StopAll();
+
+ protected:
+  BackgroundThread();
+  virtual ~BackgroundThread() {}
+
+  // Called on the thread each time it is woken. Work that can take long
+  // should return early once IsStopping() is true.
+  virtual void DoWork() = 0;
+
+  bool IsStopping();
+
+  // Sleeps for up to 'millis', or until woken or stopped. Returns false if
+  // the thread is being stopped.
+  bool Pause(int millis);
+
+ private:
+  // Holds the instance of T.
+  template<class T>
+  struct Instance {
+    static BackgroundThread *thread;
+  };
+
+  virtual void Run();
+  void Stop();
+
+  Mutex mutex_;
+  Event wake_event_;
+  bool is_started_;
+  bool is_stopping_;
+
+  // Guard the instances of all subclasses.
+  static Mutex instances_mutex_;
+  static std::vector<BackgroundThread**> instances_;
+  static bool is_stopping_all_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(BackgroundThread);
+};
+
+template<class T>
+BackgroundThread *BackgroundThread::Instance<T>::thread = NULL;
+
+// static
+template<class T>
+T *BackgroundThread::GetInstance() {
+  MutexLock lock(&instances_mutex_);
+  if (is_stopping_all_) {
+    return NULL;
+  }
+  BackgroundThread *&thread = Instance<T>::thread;
+  if (!thread) {
+    thread = new T;
+    instances_.push_back(&thread);
+  }
+  return static_cast<T*>(thread);
+}
+
+#endif  // GEARS_BASE_COMMON_BACKGROUND_THREAD_H__
@@ -0,0 +1,104 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifdef USING_CCTESTS
+
+#include "gears/base/common/background_thread.h"
+#include "gears/base/common/common.h"
+
+// Counts its rounds of work. A round can be made to pause until the thread
+// is stopped, like a long garbage collection pass.
+class CountingBackgroundThread : public BackgroundThread {
+ public:
+  Event round_started_;
+  int rounds_;
+  bool pause_until_stopped_;
+
+ private:
+  friend class BackgroundThread;
+  CountingBackgroundThread()
+      : rounds_(0), pause_until_stopped_(false) {}
+
+  virtual void DoWork() {
+    // Read before signalling, so the test can set it for the next round.
+    bool pause = pause_until_stopped_;
+    ++rounds_;
+    round_started_.Signal();
+    if (pause) {
+      while (Pause(10)) {
+      }
+    }
+  }
+};
+
+bool TestBackgroundThread(std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestBackgroundThread - failed (%d)\n", __LINE__)); \
+    assert(error); \
+    *error += STRING16(L"TestBackgroundThread - failed. "); \
+    return false; \
+  } \
+}
+
+  const int kTimeoutMillis = 5000;
+
+  // There is one instance, started by the first wake
+  CountingBackgroundThread *thread =
+      BackgroundThread::GetInstance<CountingBackgroundThread>();
+  TEST_ASSERT(thread);
+  TEST_ASSERT(thread ==
+              BackgroundThread::GetInstance<CountingBackgroundThread>());
+  TEST_ASSERT(!thread->IsRunning());
+  TEST_ASSERT(thread->Wake());
+  TEST_ASSERT(thread->round_started_.WaitWithTimeout(kTimeoutMillis));
+  TEST_ASSERT(thread->Wake());
+  TEST_ASSERT(thread->round_started_.WaitWithTimeout(kTimeoutMillis));
+  TEST_ASSERT(thread->IsRunning());
+
+  // StopAll() interrupts a round in progress and joins the thread, so it
+  // would not return if the pause ignored it. This also stops the other
+  // background threads, which start again when next woken.
+  thread->pause_until_stopped_ = true;
+  TEST_ASSERT(thread->Wake());
+  TEST_ASSERT(thread->round_started_.WaitWithTimeout(kTimeoutMillis));
+  TEST_ASSERT(thread->rounds_ == 3);
+  BackgroundThread::StopAll();
+
+  // A new instance is created and started when needed again
+  thread = BackgroundThread::GetInstance<CountingBackgroundThread>();
+  TEST_ASSERT(thread);
+  TEST_ASSERT(thread->rounds_ == 0);
+  TEST_ASSERT(thread->Wake());
+  TEST_ASSERT(thread->round_started_.WaitWithTimeout(kTimeoutMillis));
+  TEST_ASSERT(thread->rounds_ == 1);
+
+  LOG(("TestBackgroundThread - passed\n"));
+  return true;
+}
+
+#endif  // USING_CCTESTS
@@ -0,0 +1,340 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/base/common/buffer_pool.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "gears/base/common/atomic_ops.h"
+#include "gears/base/common/memory_accounting.h"
+#include "gears/base/common/mutex.h"
+#include "gears/base/common/thread_locals.h"
+
+// Size classes run from kMinPooledSize (2^12) to kMaxPooledSize (2^20).
+static const int kMinSizeClassShift = 12;
+static const int kNumSizeClasses = 9;
+
+// The number of operations on a thread cache between updates of the global
+// counters.
+static const int kThreadCacheFlushInterval = 64;
+
+typedef std::vector<uint8*> FreeList;
+
+static AtomicWord system_allocations = 0;
+static AtomicWord cached_allocations = 0;
+static AtomicWord cached_bytes = 0;
+
+static Mutex shared_cache_mutex;
+// Guarded by shared_cache_mutex.
+static FreeList shared_cache[kNumSizeClasses];
+static int64 shared_cache_bytes = 0;
+
+static const ThreadLocals::Slot kThreadCacheKey = ThreadLocals::Alloc();
+
+static int64 GetSizeClassCapacity(int size_class) {
+  return static_cast<int64>(1) << (kMinSizeClassShift + size_class);
+}
+
+// Adds to the counters of cached memory.
+static void AccountCachedBuffers(int64 bytes, int buffers) {
+  if (bytes == 0 && buffers == 0) {
+    return;
+  }
+  AtomicIncrement(&cached_bytes, static_cast<AtomicWord>(bytes));
+  MemoryAccounting::Add(MEMORY_ACCOUNTING_TYPE_BufferPool,
+                        MemoryAccounting::kUnattributedOrigin,
+                        bytes, buffers);
+}
+
+// Takes a buffer of the size class from the shared cache, or returns NULL.
+static uint8 *TakeFromSharedCache(int size_class) {
+  int64 capacity = GetSizeClassCapacity(size_class);
+  uint8 *buffer = NULL;
+  {
+    MutexLock lock(&shared_cache_mutex);
+    FreeList &list = shared_cache[size_class];
+    if (list.empty()) {
+      return NULL;
+    }
+    buffer = list.back();
+    list.pop_back();
+    shared_cache_bytes -= capacity;
+  }
+  AccountCachedBuffers(-capacity, -1);
+  AtomicIncrement(&cached_allocations, 1);
+  return buffer;
+}
+
+// Puts a buffer of the size class in the shared cache, or frees it if the
+// cache is full.
+static void ReturnToSharedCache(uint8 *buffer, int size_class) {
+  int64 capacity = GetSizeClassCapacity(size_class);
+  bool cached = false;
+  {
+    MutexLock lock(&shared_cache_mutex);
+    if (shared_cache_bytes + capacity <= BufferPool::kMaxSharedCacheBytes) {
+      shared_cache[size_class].push_back(buffer);
+      shared_cache_bytes += capacity;
+      cached = true;
+    }
+  }
+  if (cached) {
+    AccountCachedBuffers(capacity, 1);
+  } else {
+    free(buffer);
+  }
+}
+
+// The buffers cached by one thread. Only that thread uses it, except when
+// the thread exits and its buffers move to the shared cache. So that cache
+// hits need no atomic operations, its changes to the counters are gathered
+// here and added to the global ones every kThreadCacheFlushInterval
+// operations.
+class BufferPool::ThreadCache {
+ public:
+  ThreadCache()
+      : bytes_(0), pending_bytes_(0), pending_buffers_(0),
+        pending_allocations_(0), pending_operations_(0) {}
+
+  ~ThreadCache() {
+    Clear(false);
+  }
+
+  // Returns the current thread's cache, creating it if 'create_if_needed'.
+  static ThreadCache *GetCurrent(bool create_if_needed) {
+    ThreadCache *cache = reinterpret_cast<ThreadCache*>(
+        ThreadLocals::GetValue(kThreadCacheKey));
+    if (!cache && create_if_needed) {
+      cache = new ThreadCache;
+      ThreadLocals::SetValue(kThreadCacheKey, cache, &DestroyCache);
+    }
+    return cache;
+  }
+
+  uint8 *Take(int size_class) {
+    FreeList &list = lists_[size_class];
+    if (list.empty()) {
+      return NULL;
+    }
+    uint8 *buffer = list.back();
+    list.pop_back();
+    int64 capacity = GetSizeClassCapacity(size_class);
+    bytes_ -= capacity;
+    pending_bytes_ -= capacity;
+    --pending_buffers_;
+    ++pending_allocations_;
+    CountOperation();
+    return buffer;
+  }
+
+  // Returns false if the cache has no room for the buffer.
+  bool Put(uint8 *buffer, int size_class) {
+    int64 capacity = GetSizeClassCapacity(size_class);
+    if (bytes_ + capacity > BufferPool::kMaxThreadCacheBytes) {
+      return false;
+    }
+    lists_[size_class].push_back(buffer);
+    bytes_ += capacity;
+    pending_bytes_ += capacity;
+    ++pending_buffers_;
+    CountOperation();
+    return true;
+  }
+
+  // Moves the cached buffers to the shared cache, or frees them if
+  // 'free_buffers' is set.
+  void Clear(bool free_buffers) {
+    for (int i = 0; i < kNumSizeClasses; ++i) {
+      FreeList &list = lists_[i];
+      for (size_t j = 0; j < list.size(); ++j) {
+        pending_bytes_ -= GetSizeClassCapacity(i);
+        --pending_buffers_;
+        if (free_buffers) {
+          free(list[j]);
+        } else {
+          ReturnToSharedCache(list[j], i);
+        }
+      }
+      list.clear();
+    }
+    bytes_ = 0;
+    Flush();
+  }
+
+  // Adds the gathered changes to the global counters.
+  void Flush() {
+    AccountCachedBuffers(pending_bytes_, pending_buffers_);
+    if (pending_allocations_) {
+      AtomicIncrement(&cached_allocations,
+                      static_cast<AtomicWord>(pending_allocations_));
+    }
+    pending_bytes_ = 0;
+    pending_buffers_ = 0;
+    pending_allocations_ = 0;
+    pending_operations_ = 0;
+  }
+
+ private:
+  static void DestroyCache(void *cache) {
+    delete reinterpret_cast<ThreadCache*>(cache);
+  }
+
+  void CountOperation() {
+    if (++pending_operations_ >= kThreadCacheFlushInterval) {
+      Flush();
+    }
+  }
+
+  FreeList lists_[kNumSizeClasses];
+  int64 bytes_;
+  int64 pending_bytes_;
+  int pending_buffers_;
+  int pending_allocations_;
+  int pending_operations_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ThreadCache);
+};
+
+// static
+int BufferPool::GetSizeClass(int64 capacity) {
+  if (capacity < kMinPooledSize || capacity > kMaxPooledSize ||
+      (capacity & (capacity - 1)) != 0) {
+    return -1;
+  }
+  int size_class = 0;
+  while (GetSizeClassCapacity(size_class) < capacity) {
+    ++size_class;
+  }
+  assert(size_class < kNumSizeClasses);
+  return size_class;
+}
+
+// static
+int64 BufferPool::RoundUpCapacity(int64 size) {
+  if (size <= 0 || size > kMaxPooledSize) {
+    return size;
+  }
+  int64 capacity = kMinPooledSize;
+  while (capacity < size) {
+    capacity *= 2;
+  }
+  // Sizes well below the smallest class are not worth pooling.
+  if (capacity == kMinPooledSize && size <= kMinPooledSize / 2) {
+    return size;
+  }
+  return capacity;
+}
+
+// static
+uint8 *BufferPool::Allocate(int64 capacity) {
+  assert(capacity >= 0);
+  int size_class = GetSizeClass(capacity);
+  if (size_class >= 0) {
+    uint8 *buffer = ThreadCache::GetCurrent(true)->Take(size_class);
+    if (!buffer) {
+      buffer = TakeFromSharedCache(size_class);
+    }
+    if (buffer) {
+      return buffer;
+    }
+  }
+  AtomicIncrement(&system_allocations, 1);
+  // malloc(0) may return NULL, which callers would take for a failure.
+  return reinterpret_cast<uint8*>(
+      malloc(static_cast<size_t>(capacity ? capacity : 1)));
+}
+
+// static
+void BufferPool::Free(uint8 *buffer, int64 capacity) {
+  if (!buffer) {
+    return;
+  }
+  int size_class = GetSizeClass(capacity);
+  if (size_class < 0) {
+    free(buffer);
+    return;
+  }
+  // A thread that has never allocated from the pool does not get a cache
+  // just to free into. This also keeps threads that are exiting, whose
+  // caches may already be gone, from creating new ones.
+  ThreadCache *cache = ThreadCache::GetCurrent(false);
+  if (!cache || !cache->Put(buffer, size_class)) {
+    ReturnToSharedCache(buffer, size_class);
+  }
+}
+
+// static
+void BufferPool::GetStats(Stats *stats) {
+  assert(stats);
+  ThreadCache *cache = ThreadCache::GetCurrent(false);
+  if (cache) {
+    cache->Flush();
+  }
+  stats->system_allocations = AtomicIncrement(&system_allocations, 0);
+  stats->cached_allocations = AtomicIncrement(&cached_allocations, 0);
+  stats->cached_bytes = AtomicIncrement(&cached_bytes, 0);
+}
+
+// static
+void BufferPool::Purge() {
+  ThreadCache *cache = ThreadCache::GetCurrent(false);
+  if (cache) {
+    cache->Clear(true);
+  }
+  int64 purged_bytes = 0;
+  int purged_buffers = 0;
+  {
+    MutexLock lock(&shared_cache_mutex);
+    for (int i = 0; i < kNumSizeClasses; ++i) {
+      FreeList &list = shared_cache[i];
+      for (size_t j = 0; j < list.size(); ++j) {
+        free(list[j]);
+        purged_bytes += GetSizeClassCapacity(i);
+        ++purged_buffers;
+      }
+      list.clear();
+    }
+    shared_cache_bytes = 0;
+  }
+  AccountCachedBuffers(-purged_bytes, -purged_buffers);
+}
+
+bool PooledBuffer::Reset(int64 size) {
+  assert(size >= 0);
+  BufferPool::Free(buffer_, capacity_);
+  capacity_ = 0;
+  buffer_ = NULL;
+  if (size > 0) {
+    int64 capacity = BufferPool::RoundUpCapacity(size);
+    buffer_ = BufferPool::Allocate(capacity);
+    if (buffer_) {
+      capacity_ = capacity;
+    }
+  }
+  memory_.SetBytes(capacity_);
+  return buffer_ != NULL || size == 0;
+}
@@ -0,0 +1,129 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Recycles the large, fixed size scratch buffers used for I/O, such as the
+// ones ByteStores use to stage file reads and writes, and the ones used to
+// copy Blobs and files. Allocating and freeing these for each operation
+// churns the heap under sustained capture and upload load. Buffers that
+// grow, such as the storage of MemoryBuffers, are left to malloc and realloc.
+//
+// Buffers of kMinPooledSize to kMaxPooledSize bytes come in power of two
+// size classes. A freed buffer of a size class is kept for reuse, first in a
+// small cache owned by the freeing thread, which needs no locking, and then
+// in a cache shared by all threads. Both caches are bounded, and buffers
+// that do not fit are returned to the system. Other sizes go straight to
+// malloc and free.
+//
+// Memory held in the caches is accounted for as
+// MEMORY_ACCOUNTING_TYPE_BufferPool.
+
+#ifndef GEARS_BASE_COMMON_BUFFER_POOL_H__
+#define GEARS_BASE_COMMON_BUFFER_POOL_H__
+
+#include "gears/base/common/basictypes.h"
+#include "gears/base/common/memory_accounting.h"
+
+class BufferPool {
+ public:
+  static const int64 kMinPooledSize = 4 * 1024;
+  static const int64 kMaxPooledSize = 1024 * 1024;
+  // The most each thread keeps cached, over all size classes.
+  static const int64 kMaxThreadCacheBytes = 1024 * 1024;
+  // The most the shared cache keeps, over all size classes.
+  static const int64 kMaxSharedCacheBytes = 2 * 1024 * 1024;
+
+  struct Stats {
+    // Buffers that were allocated from the system.
+    int64 system_allocations;
+    // Buffers that were reused from a cache.
+    int64 cached_allocations;
+    // Bytes currently held in the caches of all threads.
+    int64 cached_bytes;
+  };
+
+  // Returns the capacity that a request for 'size' bytes should use: the
+  // smallest size class that holds it, or 'size' itself if it is too small
+  // or too large to be pooled.
+  static int64 RoundUpCapacity(int64 size);
+
+  // Returns a buffer of 'capacity' bytes, or NULL if out of memory.
+  static uint8 *Allocate(int64 capacity);
+
+  // Releases a buffer returned by Allocate. 'capacity' must be the capacity
+  // it was allocated with. Does nothing if 'buffer' is NULL.
+  static void Free(uint8 *buffer, int64 capacity);
+
+  // Other threads report their cache hits every few operations, so their
+  // most recent ones may be missing.
+  static void GetStats(Stats *stats);
+
+  // Returns the buffers in the shared cache and in the current thread's
+  // cache to the system.
+  static void Purge();
+
+ private:
+  class ThreadCache;
+  friend class ThreadCache;
+
+  // Returns the size class index of 'capacity', or -1 if it is not pooled.
+  static int GetSizeClass(int64 capacity);
+
+  DISALLOW_EVIL_CONSTRUCTORS(BufferPool);
+};
+
+// A scratch buffer taken from the BufferPool, and returned to it when this
+// object is reset or destroyed. While held, its memory is accounted for as
+// the type given to the constructor.
+class PooledBuffer {
+ public:
+  // Creates a PooledBuffer that holds no buffer until Reset is called.
+  explicit PooledBuffer(MemoryAccountingType type)
+      : capacity_(0), buffer_(NULL), memory_(type) {}
+
+  PooledBuffer(int64 size, MemoryAccountingType type)
+      : capacity_(0), buffer_(NULL), memory_(type) {
+    Reset(size);
+  }
+
+  ~PooledBuffer() {
+    BufferPool::Free(buffer_, capacity_);
+  }
+
+  // Returns the current buffer to the pool and takes one of at least 'size'
+  // bytes, or none if 'size' is zero. Returns false if out of memory.
+  bool Reset(int64 size);
+
+  // Returns NULL if no buffer is held.
+  uint8 *get() const { return buffer_; }
+
+ private:
+  int64 capacity_;
+  uint8 *buffer_;
+  MemoryAccountingTag memory_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(PooledBuffer);
+};
+
+#endif  // GEARS_BASE_COMMON_BUFFER_POOL_H__
@@ -0,0 +1,180 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifdef USING_CCTESTS
+
+#include <string.h>
+#include "gears/base/common/buffer_pool.h"
+#include "gears/base/common/common.h"
+#include "gears/base/common/thread.h"
+
+// Allocates and frees a buffer on its own thread, leaving it in that
+// thread's cache until the thread exits.
+class BufferPoolTestThread : public Thread {
+ public:
+  BufferPoolTestThread() : buffer_(NULL) {}
+
+  uint8 *buffer_;
+
+ protected:
+  virtual void Run() {
+    buffer_ = BufferPool::Allocate(BufferPool::kMinPooledSize);
+    BufferPool::Free(buffer_, BufferPool::kMinPooledSize);
+  }
+};
+
+bool TestBufferPool(std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestBufferPool - failed (%d)\n", __LINE__)); \
+    assert(error); \
+    *error += STRING16(L"TestBufferPool - failed. "); \
+    BufferPool::Purge(); \
+    return false; \
+  } \
+}
+
+  const int64 kMin = BufferPool::kMinPooledSize;
+  const int64 kMax = BufferPool::kMaxPooledSize;
+
+  // Pooled sizes round up to a power of two, others are left alone.
+  TEST_ASSERT(BufferPool::RoundUpCapacity(0) == 0);
+  TEST_ASSERT(BufferPool::RoundUpCapacity(100) == 100);
+  TEST_ASSERT(BufferPool::RoundUpCapacity(kMin / 2 + 1) == kMin);
+  TEST_ASSERT(BufferPool::RoundUpCapacity(kMin) == kMin);
+  TEST_ASSERT(BufferPool::RoundUpCapacity(kMin + 1) == kMin * 2);
+  TEST_ASSERT(BufferPool::RoundUpCapacity(kMax - 1) == kMax);
+  TEST_ASSERT(BufferPool::RoundUpCapacity(kMax + 1) == kMax + 1);
+
+  // Other threads may be using the pool, so only what this thread's cache
+  // hands back is checked exactly.
+  BufferPool::Purge();
+  BufferPool::Stats before;
+  BufferPool::Stats after;
+  BufferPool::GetStats(&before);
+
+  // A freed buffer is reused by the next allocation of its size class.
+  uint8 *buffer = BufferPool::Allocate(kMin * 16);
+  TEST_ASSERT(buffer);
+  memset(buffer, 0xab, static_cast<size_t>(kMin * 16));
+  BufferPool::Free(buffer, kMin * 16);
+  uint8 *reused = BufferPool::Allocate(kMin * 16);
+  TEST_ASSERT(reused == buffer);
+  BufferPool::GetStats(&after);
+  TEST_ASSERT(after.system_allocations >= before.system_allocations + 1);
+  TEST_ASSERT(after.cached_allocations >= before.cached_allocations + 1);
+  BufferPool::Free(reused, kMin * 16);
+
+  // The thread cache only holds kMaxThreadCacheBytes. Buffers beyond that go
+  // to the shared cache, and beyond its limit, back to the system.
+  BufferPool::Purge();
+  const int kNumBuffers = static_cast<int>(
+      (BufferPool::kMaxThreadCacheBytes + BufferPool::kMaxSharedCacheBytes) /
+      kMax + 2);
+  uint8 *buffers[kNumBuffers];
+  for (int i = 0; i < kNumBuffers; ++i) {
+    buffers[i] = BufferPool::Allocate(kMax);
+    TEST_ASSERT(buffers[i]);
+  }
+  for (int i = 0; i < kNumBuffers; ++i) {
+    BufferPool::Free(buffers[i], kMax);
+  }
+  BufferPool::GetStats(&after);
+  TEST_ASSERT(after.cached_bytes <= BufferPool::kMaxThreadCacheBytes +
+                                    BufferPool::kMaxSharedCacheBytes);
+  MemoryAccounting::Usage usage;
+  MemoryAccounting::GetUsage(MemoryAccounting::kUnattributedOrigin,
+                             MEMORY_ACCOUNTING_TYPE_BufferPool, &usage);
+  TEST_ASSERT(usage.bytes >= BufferPool::kMaxThreadCacheBytes);
+  // The thread cache hands back the last buffers it took, newest first.
+  const int kThreadCached = static_cast<int>(
+      BufferPool::kMaxThreadCacheBytes / kMax);
+  uint8 *cached[kThreadCached];
+  for (int i = 0; i < kThreadCached; ++i) {
+    cached[i] = BufferPool::Allocate(kMax);
+  }
+  for (int i = 0; i < kThreadCached; ++i) {
+    BufferPool::Free(cached[i], kMax);
+    TEST_ASSERT(cached[i] == buffers[kThreadCached - 1 - i]);
+  }
+
+  // Purge returns everything cached to the system.
+  BufferPool::Purge();
+  MemoryAccounting::GetUsage(MemoryAccounting::kUnattributedOrigin,
+                             MEMORY_ACCOUNTING_TYPE_BufferPool, &usage);
+  TEST_ASSERT(usage.bytes < BufferPool::kMaxThreadCacheBytes);
+
+  // Sizes outside the pool always come from the system.
+  BufferPool::GetStats(&before);
+  uint8 *small = BufferPool::Allocate(100);
+  TEST_ASSERT(small);
+  BufferPool::Free(small, 100);
+  BufferPool::Free(NULL, kMin);
+  BufferPool::GetStats(&after);
+  TEST_ASSERT(after.system_allocations >= before.system_allocations + 1);
+
+  // A thread's cached buffers move to the shared cache when it exits.
+  BufferPoolTestThread thread;
+  TEST_ASSERT(thread.Start());
+  thread.Join();
+  TEST_ASSERT(thread.buffer_);
+  BufferPool::GetStats(&after);
+  TEST_ASSERT(after.cached_bytes >= kMin);
+
+  // PooledBuffers recycle their storage through the pool, and account for
+  // it while they hold it.
+  uint8 *storage;
+  MemoryAccounting::GetUsage(MemoryAccounting::GetCurrentOriginId(),
+                             MEMORY_ACCOUNTING_TYPE_ByteStore, &usage);
+  const int64 bytes_before = usage.bytes;
+  {
+    PooledBuffer pooled(kMin * 3, MEMORY_ACCOUNTING_TYPE_ByteStore);
+    storage = pooled.get();
+    TEST_ASSERT(storage);
+    MemoryAccounting::GetUsage(MemoryAccounting::GetCurrentOriginId(),
+                               MEMORY_ACCOUNTING_TYPE_ByteStore, &usage);
+    TEST_ASSERT(usage.bytes == bytes_before + kMin * 4);
+  }
+  MemoryAccounting::GetUsage(MemoryAccounting::GetCurrentOriginId(),
+                             MEMORY_ACCOUNTING_TYPE_ByteStore, &usage);
+  TEST_ASSERT(usage.bytes == bytes_before);
+  {
+    PooledBuffer pooled(MEMORY_ACCOUNTING_TYPE_ByteStore);
+    TEST_ASSERT(!pooled.get());
+    TEST_ASSERT(pooled.Reset(kMin * 4));
+    TEST_ASSERT(pooled.get() == storage);
+    TEST_ASSERT(pooled.Reset(0));
+    TEST_ASSERT(!pooled.get());
+    TEST_ASSERT(pooled.Reset(kMin * 4));
+    TEST_ASSERT(pooled.get() == storage);
+  }
+
+  BufferPool::Purge();
+  return true;
+}
+
+#endif  // USING_CCTESTS
@@ -25,21 +25,219 @@
 
 #include "gears/base/common/byte_store.h"
 
+#include "gears/base/common/background_thread.h"
 #include "gears/base/common/string_utils.h"
 #include "gears/blob/blob_interface.h"
 
 namespace {
-// Tune the maximum in-memory buffer size for some platforms. Mobile
-// platforms will generally want to use a very small buffer as they
-// have limited memory compared to desktop, but also have fast
-// storage.
+// Tune the buffer size used when copying to and from files, and the memory
+// budget shared by all ByteStores, for some platforms. Mobile platforms will
+// generally want to use very little memory as they have limited memory
+// compared to desktop, but also have fast storage.
 #ifdef OS_ANDROID
 const int64 kMaxBufferSize = 32 * 1024;  // 32KB
+const int64 kDefaultMemoryBudget = 256 * 1024;  // 256KB
 #else
 const int64 kMaxBufferSize = 1024 * 1024;  // 1MB
+const int64 kDefaultMemoryBudget = 32 * 1024 * 1024;  // 32MB
 #endif
 }  // namespace
 
+// Tracks the memory held by all ByteStores against a shared budget. A single
+// store may hold up to half of the budget in memory. When the total goes over
+// the budget, a background thread moves the least recently used stores to
+// temporary files, so writers are not held up by the file I/O. Writers only
+// go straight to a file once the total reaches twice the budget.
+class ByteStore::Budget {
+ public:
+  // Returns whether a store holding 'store_size' bytes in memory may add
+  // 'length' more.
+  static bool HasRoomFor(int64 store_size, int64 length);
+
+  // Records the bytes held by the store and marks it as the most recently
+  // used.
+  static void Update(ByteStore *store, int64 resident_bytes,
+                     int64 spilled_bytes, bool is_spillable);
+
+  // Marks the store as the most recently used.
+  static void Touch(const ByteStore *store);
+
+  // Stops tracking the store. Waits for the spill thread to finish with it.
+  static void Remove(ByteStore *store);
+
+  static void GetUsage(int64 *resident_bytes, int64 *spilled_bytes);
+
+  static void SetLimit(int64 bytes);
+
+ private:
+  class SpillThread;
+
+  // Spills the least recently used stores until the total is within budget
+  // or no more stores can be spilled.
+  static void SpillWhileOverBudget();
+  static void WakeSpillThread();
+
+  static Mutex mutex_;
+  // Signalled when the spill thread finishes with a store.
+  static CondVar spill_done_;
+  // The stores holding data in memory, least recently used first.
+  static std::list<ByteStore*> stores_;
+  static ByteStore *spilling_store_;
+  static int64 limit_;
+  static int64 resident_bytes_;
+  static int64 spilled_bytes_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(Budget);
+};
+
+// Spills stores to disk until the budget is met. It is woken each time the
+// resident bytes go over the limit.
+class ByteStore::Budget::SpillThread : public BackgroundThread {
+ private:
+  friend class BackgroundThread;
+  SpillThread() {}
+
+  virtual void DoWork() {
+    Budget::SpillWhileOverBudget();
+  }
+
+  DISALLOW_EVIL_CONSTRUCTORS(SpillThread);
+};
+
+Mutex ByteStore::Budget::mutex_;
+CondVar ByteStore::Budget::spill_done_;
+std::list<ByteStore*> ByteStore::Budget::stores_;
+ByteStore *ByteStore::Budget::spilling_store_ = NULL;
+int64 ByteStore::Budget::limit_ = kDefaultMemoryBudget;
+int64 ByteStore::Budget::resident_bytes_ = 0;
+int64 ByteStore::Budget::spilled_bytes_ = 0;
+
+// static
+bool ByteStore::Budget::HasRoomFor(int64 store_size, int64 length) {
+  MutexLock lock(&mutex_);
+  return (store_size + length <= limit_ / 2) &&
+         (resident_bytes_ + length <= limit_ * 2);
+}
+
+// static
+void ByteStore::Budget::Update(ByteStore *store, int64 resident_bytes,
+                               int64 spilled_bytes, bool is_spillable) {
+  bool is_over_budget;
+  {
+    MutexLock lock(&mutex_);
+    resident_bytes_ += resident_bytes - store->budget_resident_bytes_;
+    spilled_bytes_ += spilled_bytes - store->budget_spilled_bytes_;
+    store->budget_resident_bytes_ = resident_bytes;
+    store->budget_spilled_bytes_ = spilled_bytes;
+    store->is_spillable_ = is_spillable;
+    if (resident_bytes == 0) {
+      if (store->is_in_budget_list_) {
+        stores_.erase(store->budget_position_);
+        store->is_in_budget_list_ = false;
+      }
+    } else if (store->is_in_budget_list_) {
+      stores_.splice(stores_.end(), stores_, store->budget_position_);
+    } else {
+      store->budget_position_ = stores_.insert(stores_.end(), store);
+      store->is_in_budget_list_ = true;
+    }
+    is_over_budget = resident_bytes_ > limit_;
+  }
+  if (is_over_budget) {
+    WakeSpillThread();
+  }
+}
+
+// static
+void ByteStore::Budget::Touch(const ByteStore *store) {
+  MutexLock lock(&mutex_);
+  if (store->is_in_budget_list_) {
+    stores_.splice(stores_.end(), stores_, store->budget_position_);
+  }
+}
+
+// static
+void ByteStore::Budget::Remove(ByteStore *store) {
+  MutexLock lock(&mutex_);
+  while (spilling_store_ == store) {
+    spill_done_.Wait(&mutex_);
+  }
+  resident_bytes_ -= store->budget_resident_bytes_;
+  spilled_bytes_ -= store->budget_spilled_bytes_;
+  store->budget_resident_bytes_ = 0;
+  store->budget_spilled_bytes_ = 0;
+  if (store->is_in_budget_list_) {
+    stores_.erase(store->budget_position_);
+    store->is_in_budget_list_ = false;
+  }
+}
+
+// static
+void ByteStore::Budget::GetUsage(int64 *resident_bytes,
+                                 int64 *spilled_bytes) {
+  assert(resident_bytes);
+  assert(spilled_bytes);
+  MutexLock lock(&mutex_);
+  *resident_bytes = resident_bytes_;
+  *spilled_bytes = spilled_bytes_;
+}
+
+// static
+void ByteStore::Budget::SetLimit(int64 bytes) {
+  bool is_over_budget;
+  {
+    MutexLock lock(&mutex_);
+    limit_ = bytes;
+    is_over_budget = resident_bytes_ > limit_;
+  }
+  if (is_over_budget) {
+    WakeSpillThread();
+  }
+}
+
+// static
+void ByteStore::Budget::WakeSpillThread() {
+  SpillThread *thread = BackgroundThread::GetInstance<SpillThread>();
+  if (thread) {
+    thread->Wake();
+  }
+}
+
+// static
+void ByteStore::Budget::SpillWhileOverBudget() {
+  while (true) {
+    ByteStore *store = NULL;
+    {
+      MutexLock lock(&mutex_);
+      if (resident_bytes_ <= limit_) {
+        return;
+      }
+      for (std::list<ByteStore*>::iterator iter = stores_.begin();
+           iter != stores_.end();
+           ++iter) {
+        if ((*iter)->is_spillable_) {
+          store = *iter;
+          break;
+        }
+      }
+      if (!store) {
+        return;
+      }
+      // The store's destructor waits in Remove() until we're done with it.
+      spilling_store_ = store;
+    }
+    // We must not hold our mutex while taking the store's, since stores call
+    // us while holding theirs. Spill() always leaves the store unspillable,
+    // so this loop terminates.
+    store->Spill();
+    {
+      MutexLock lock(&mutex_);
+      spilling_store_ = NULL;
+    }
+    spill_done_.SignalAll();
+  }
+}
+
 // Presents a blob interface of a snapshot of a ByteStore.
 // Data can continue to be added to the ByteStore, but this blob will only
 // present the data that existed at construction time.
@@ -108,13 +306,30 @@ class ByteStore::Blob : public BlobInterface {
 
 ByteStore::ByteStore()
     : file_op_(File::WRITE), is_finalized_(false), preserve_data_(false),
-      async_add_length_(0), length_(0) {
+      write_buffer_(MEMORY_ACCOUNTING_TYPE_ByteStore),
+      async_add_length_(0), length_(0), spill_failed_(false),
+      is_in_budget_list_(false), is_spillable_(false),
+      budget_resident_bytes_(0), budget_spilled_bytes_(0) {
+  data_.SetMemoryAccountingType(MEMORY_ACCOUNTING_TYPE_ByteStore);
 }
 
 ByteStore::~ByteStore() {
+  Budget::Remove(this);
 }
 
-// We keep appending to data_ until we reach kMaxBufferSize, at which
+// static
+void ByteStore::GetUsage(int64 *resident_bytes, int64 *spilled_bytes) {
+  Budget::GetUsage(resident_bytes, spilled_bytes);
+}
+
+#ifdef USING_CCTESTS
+// static
+void ByteStore::SetMemoryBudgetForTest(int64 bytes) {
+  Budget::SetLimit(bytes ? bytes : kDefaultMemoryBudget);
+}
+#endif
+
+// We keep appending to data_ until the budget does not allow it, at which
 // point we move everything to file_.
 bool ByteStore::AddData(const void *data, int64 length) {
   if (length < 0) return false;
@@ -124,12 +339,15 @@ bool ByteStore::AddData(const void *data, int64 length) {
   assert(!is_finalized_);
   assert(async_add_length_ == 0);
 
-  if (IsUsingData() && (length + data_.Size() <= kMaxBufferSize)) {
+  bool result = true;
+  if (CanAddToMemory(length)) {
     data_.Append(static_cast<const uint8*>(data), length);
     length_ += length;
-    return true;
+  } else {
+    result = AddDataToFile(data, length);
   }
-  return AddDataToFile(data, length);
+  UpdateBudget();
+  return result;
 }
 
 int64 ByteStore::AddDataDirect(Writer *writer, int64 max_length) {
@@ -139,7 +357,7 @@ int64 ByteStore::AddDataDirect(Writer *writer, int64 max_length) {
   assert(!is_finalized_);
   assert(async_add_length_ == 0);
 
-  if (IsUsingData() && (max_length + data_.Size() <= kMaxBufferSize)) {
+  if (CanAddToMemory(max_length)) {
     int64 offset(data_.Size());
     data_.Resize(data_.Size() + max_length);
     int64 total_bytes_added(0);
@@ -147,6 +365,8 @@ int64 ByteStore::AddDataDirect(Writer *writer, int64 max_length) {
       int64 bytes_added = writer->WriteToBuffer(data_.Data(offset), max_length);
       if (bytes_added == Writer::ASYNC) {
         async_add_length_ = max_length;
+        // The writer holds a pointer into data_, so it must not be spilled.
+        UpdateBudget();
         return total_bytes_added;
       }
       assert(bytes_added >= 0);
@@ -157,34 +377,39 @@ int64 ByteStore::AddDataDirect(Writer *writer, int64 max_length) {
       length_ += bytes_added;
     }
     data_.Resize(offset);
+    UpdateBudget();
     return total_bytes_added;
   }
 
   // Too large for our memory buffer.  Write data to a temporary buffer and
-  // then copy to a file.
+  // then copy to a file.  The buffer comes from the BufferPool, and goes back
+  // to it once the data is written, rather than staying with this store.
   int64 buffer_size(std::min(max_length, kMaxBufferSize));
-  if (write_buffer_.Size() < buffer_size) {
-    write_buffer_.Resize(buffer_size);
+  if (buffer_size == 0 || !write_buffer_.Reset(buffer_size)) {
+    return 0;
   }
   int64 total_bytes_added(0);
   while (max_length > 0) {
-    int64 bytes_added = writer->WriteToBuffer(write_buffer_.Data(0),
+    int64 bytes_added = writer->WriteToBuffer(write_buffer_.get(),
                                               buffer_size);
     if (bytes_added == Writer::ASYNC) {
       // Create the file if it doesn't yet exist.
       AddDataToFile(NULL, 0);
       async_add_length_ = buffer_size;
+      UpdateBudget();
       return total_bytes_added;
     }
     assert(bytes_added >= 0);
     if (bytes_added == 0) break;
-    if (!AddDataToFile(write_buffer_.Data(0), bytes_added)) {
+    if (!AddDataToFile(write_buffer_.get(), bytes_added)) {
       break;
     }
     total_bytes_added += bytes_added;
     max_length -= bytes_added;
     buffer_size = std::min(max_length, buffer_size);
   }
+  write_buffer_.Reset(0);
+  UpdateBudget();
   return total_bytes_added;
 }
 
@@ -199,9 +424,13 @@ void ByteStore::AddDataDirectFinishAsync(int64 length) {
     data_.Resize(data_.Size() - (async_add_length_ - length));
     length_ += length;
   } else {
-    AddDataToFile(write_buffer_.Data(0), length);
+    if (length > 0) {
+      AddDataToFile(write_buffer_.get(), length);
+    }
+    write_buffer_.Reset(0);
   }
   async_add_length_ = 0;
+  UpdateBudget();
 }
 
 // Writes data to a temporary file.  Will create & open a file if not already
@@ -262,20 +491,21 @@ void ByteStore::Finalize() {
   MutexLock lock(&mutex_);
   is_finalized_ = true;
   // write_buffer_ is no longer needed, so release the memory.
-  if (write_buffer_.Capacity()) {
-    MemoryBuffer empty;
-    write_buffer_.Swap(empty);
-  }
+  write_buffer_.Reset(0);
 }
 
 void ByteStore::GetDataElement(DataElement *element) {
   assert(element);
   MutexLock lock(&mutex_);
-  if (!is_finalized_ && IsUsingData() && !preserve_data_) {
-    // We reserve space so the vector won't get reallocated as
-    // new data is added.
-    data_.Reserve(kMaxBufferSize);
+  if (IsUsingData() && !preserve_data_) {
+    if (!is_finalized_) {
+      // We reserve space so the vector won't get reallocated as
+      // new data is added.
+      data_.Reserve(kMaxBufferSize);
+    }
+    // The element points into data_, so it can no longer be spilled.
     preserve_data_ = true;
+    UpdateBudget();
   }
 
   if (IsUsingFile()) {
@@ -302,6 +532,7 @@ int64 ByteStore::Read(uint8 *destination,
   MutexLock lock(&mutex_);
 
   if (IsUsingData()) {
+    Budget::Touch(this);
     if (data_.Size() <= offset) {
       return 0;
     }
@@ -322,6 +553,7 @@ int64 ByteStore::ReadDirect(Reader *reader,
   }
   MutexLock lock(&mutex_);
   if (IsUsingData()) {
+    Budget::Touch(this);
     if (data_.Size() <= offset) {
       return 0;
     }
@@ -342,16 +574,21 @@ int64 ByteStore::ReadDirect(Reader *reader,
     return total_bytes_read;
   }
 
-  // Create a temporary buffer and call Read()
+  // Create a temporary buffer and call Read().  The buffer comes from the
+  // BufferPool, so repeated reads reuse the same memory.
   int64 buffer_size(std::min(max_length, kMaxBufferSize));
-  if (read_buffer_.Size() < static_cast<MemoryBuffer::size_type>(buffer_size)) {
-    read_buffer_.Resize(static_cast<MemoryBuffer::size_type>(buffer_size));
+  if (buffer_size == 0) {
+    return 0;
+  }
+  PooledBuffer read_buffer(buffer_size, MEMORY_ACCOUNTING_TYPE_ByteStore);
+  if (!read_buffer.get()) {
+    return 0;
   }
   int64 total_bytes_read(0);
   while (max_length > 0) {
-    int64 bytes_read1 = ReadFromFile(read_buffer_.Data(0), offset, buffer_size);
+    int64 bytes_read1 = ReadFromFile(read_buffer.get(), offset, buffer_size);
     if (bytes_read1 <= 0) break;  // No more data available, or error.
-    int64 bytes_read = reader->ReadFromBuffer(read_buffer_.Data(0),
+    int64 bytes_read = reader->ReadFromBuffer(read_buffer.get(),
                                               bytes_read1);
     assert(bytes_read >= 0);
     if (bytes_read == 0) break;
@@ -385,10 +622,43 @@ void ByteStore::Reserve(int64 length) {
     // TODO(bgarcia): Consider reserving space in the file.
     return;
   }
-  if (length > kMaxBufferSize) {
+  if (length > data_.Size() && !CanAddToMemory(length - data_.Size())) {
     // Create the file if it doesn't yet exist.
     AddDataToFile(NULL, 0);
+    UpdateBudget();
   } else {
     data_.Reserve(length);
   }
 }
+
+void ByteStore::Spill() {
+  MutexLock lock(&mutex_);
+  if (IsUsingData() && !data_.Empty() && !preserve_data_ &&
+      async_add_length_ == 0) {
+    if (AddDataToFile(NULL, 0)) {
+      LOG(("ByteStore: spilled %d bytes to a file\n",
+           static_cast<int>(length_)));
+    } else {
+      spill_failed_ = true;
+    }
+  }
+  UpdateBudget();
+}
+
+void ByteStore::UpdateBudget() {
+  bool is_spillable = IsUsingData() && !data_.Empty() && !preserve_data_ &&
+                      async_add_length_ == 0 && !spill_failed_;
+  Budget::Update(this, data_.Size(), IsUsingFile() ? length_ : 0,
+                 is_spillable);
+}
+
+bool ByteStore::CanAddToMemory(int64 length) const {
+  if (!IsUsingData()) {
+    return false;
+  }
+  if (preserve_data_ && data_.Size() + length > data_.Capacity()) {
+    // Elements point into data_, so it must not be reallocated.
+    return false;
+  }
+  return Budget::HasRoomFor(data_.Size(), length);
+}
@@ -26,7 +26,9 @@
 #ifndef GEARS_BASE_COMMON_BYTE_STORE_H_
 #define GEARS_BASE_COMMON_BYTE_STORE_H_
 
+#include <list>
 #include "gears/base/common/basictypes.h"
+#include "gears/base/common/buffer_pool.h"
 #include "gears/base/common/file.h"
 #include "gears/base/common/memory_buffer.h"
 #include "gears/base/common/mutex.h"
@@ -37,6 +39,10 @@
 class BlobInterface;
 class DataElement;
 
+// Data is held in memory until the store grows too large, or until the
+// memory held by all ByteStores in the process goes over a shared budget, at
+// which point the least recently used stores are moved to temporary files by
+// a background thread.
 class ByteStore : public RefCounted {
  public:
   ByteStore();
@@ -98,9 +104,32 @@ class ByteStore : public RefCounted {
   // Attempts to reserve memory for storage.
   void Reserve(int64 length);
 
+  // Returns the number of bytes held in memory and in temporary files by all
+  // ByteStores in the process.
+  static void GetUsage(int64 *resident_bytes, int64 *spilled_bytes);
+
+#ifdef USING_CCTESTS
+  // Sets the memory budget shared by all ByteStores, or restores the default
+  // if 'bytes' is zero.
+  static void SetMemoryBudgetForTest(int64 bytes);
+#endif
+
  private:
   ~ByteStore();
 
+  class Budget;
+  friend class Budget;
+
+  // Moves the data held in memory to a temporary file, if possible. Called
+  // by the budget's spill thread.
+  void Spill();
+  // Reports the data held in memory and in a file to the budget. Expects the
+  // caller to be holding mutex_.
+  void UpdateBudget();
+  // Returns whether 'length' more bytes can be held in memory. Expects the
+  // caller to be holding mutex_.
+  bool CanAddToMemory(int64 length) const;
+
   bool AddDataToFile(const void *data, int64 length);
   class Blob;
   void GetDataElement(DataElement *elements);
@@ -117,10 +146,20 @@ class ByteStore : public RefCounted {
   mutable Mutex mutex_;
   bool is_finalized_;
   bool preserve_data_;
-  mutable MemoryBuffer read_buffer_;
-  mutable MemoryBuffer write_buffer_;
+  // Holds the data of an asynchronous AddDataDirect that is being written
+  // to the file. Only kept while that is in progress.
+  PooledBuffer write_buffer_;
   int64 async_add_length_;
   int64 length_;
+  bool spill_failed_;
+
+  // The following members are protected by the budget's mutex.
+  std::list<ByteStore*>::iterator budget_position_;
+  bool is_in_budget_list_;
+  bool is_spillable_;
+  int64 budget_resident_bytes_;
+  int64 budget_spilled_bytes_;
+
   DISALLOW_EVIL_CONSTRUCTORS(ByteStore);
 };
 
@@ -26,6 +26,7 @@
 #ifdef USING_CCTESTS
 
 #include "gears/base/common/byte_store.h"
+#include "gears/base/common/event.h"
 #include "gears/base/common/string_utils.h"
 #include "gears/blob/blob_interface.h"
 
@@ -221,4 +222,75 @@ bool TestByteStore(std::string16 *error) {
   return ok;
 }
 
+// Waits for the spill thread to move 'bytes' more to temporary files.
+static bool WaitForSpilledBytes(int64 initial_spilled, int64 bytes) {
+  Event never_signalled;
+  for (int i = 0; i < 500; ++i) {
+    int64 resident, spilled;
+    ByteStore::GetUsage(&resident, &spilled);
+    if (spilled - initial_spilled >= bytes) {
+      return true;
+    }
+    never_signalled.WaitWithTimeout(10);
+  }
+  return false;
+}
+
+bool TestByteStoreBudget(std::string16 *error) {
+  const int kStoreSize = 48 * 1024;
+  std::string data1(kStoreSize, 'a');
+  std::string data2(kStoreSize, 'b');
+  std::string data3(kStoreSize, 'c');
+  uint8 buffer[64];
+  int64 initial_resident, initial_spilled, resident, spilled;
+  ByteStore::GetUsage(&initial_resident, &initial_spilled);
+  // Leave room for two of our stores, on top of any held by other tests.
+  ByteStore::SetMemoryBudgetForTest(initial_resident + 128 * 1024);
+
+  scoped_refptr<ByteStore> store1(new ByteStore);
+  scoped_refptr<ByteStore> store2(new ByteStore);
+  scoped_refptr<ByteStore> store3(new ByteStore);
+  TEST_ASSERT(store1->AddData(data1.data(), kStoreSize));
+  TEST_ASSERT(store2->AddData(data2.data(), kStoreSize));
+  ByteStore::GetUsage(&resident, &spilled);
+  TEST_ASSERT(resident - initial_resident == 2 * kStoreSize);
+  TEST_ASSERT(spilled == initial_spilled);
+
+  // Reading store1 makes store2 the least recently used, so adding store3
+  // takes us over budget and should spill store2.
+  TEST_ASSERT(sizeof(buffer) == store1->Read(buffer, 0, sizeof(buffer)));
+  TEST_ASSERT(store3->AddData(data3.data(), kStoreSize));
+  TEST_ASSERT(WaitForSpilledBytes(initial_spilled, kStoreSize));
+  ByteStore::GetUsage(&resident, &spilled);
+  TEST_ASSERT(resident - initial_resident == 2 * kStoreSize);
+  TEST_ASSERT(spilled - initial_spilled == kStoreSize);
+
+  // The spilled data can still be read and appended to.
+  TEST_ASSERT(32 == store2->Read(buffer, kStoreSize - 32, sizeof(buffer)));
+  TEST_ASSERT(store2->AddData(data1.data(), 32));
+  TEST_ASSERT(sizeof(buffer) == store2->Read(buffer, kStoreSize - 32,
+                                             sizeof(buffer)));
+  TEST_ASSERT(0 == memcmp(buffer, data2.data(), 32));
+  TEST_ASSERT(0 == memcmp(buffer + 32, data1.data(), 32));
+
+  // A store may hold at most half of the budget in memory.
+  scoped_refptr<ByteStore> store4(new ByteStore);
+  TEST_ASSERT(store4->AddData(data1.data(), kStoreSize));
+  TEST_ASSERT(store4->AddData(data2.data(), kStoreSize));
+  TEST_ASSERT(store4->Length() == 2 * kStoreSize);
+  TEST_ASSERT(WaitForSpilledBytes(initial_spilled,
+                                  kStoreSize + 32 + 2 * kStoreSize));
+
+  // Destroying the stores releases their usage.
+  store1.reset();
+  store2.reset();
+  store3.reset();
+  store4.reset();
+  ByteStore::SetMemoryBudgetForTest(0);
+  ByteStore::GetUsage(&resident, &spilled);
+  TEST_ASSERT(resident == initial_resident);
+  TEST_ASSERT(spilled == initial_spilled);
+  return true;
+}
+
 #endif  // USING_CCTESTS
@@ -26,9 +26,13 @@
 #ifndef GEARS_BASE_COMMON_DISPATCHER_H__
 #define GEARS_BASE_COMMON_DISPATCHER_H__
 
+#include <algorithm>
+#include <functional>
 #include <map>
+#include <vector>
 
 #include "gears/base/common/js_types.h"
+#include "gears/base/common/mutex.h"
 #include "gears/base/common/thread_locals.h"
 
 // An opaque type used to uniquely identify a method or property.
@@ -58,8 +62,15 @@ class DispatcherInterface {
 
 // The implementation of the DispatcherInterface.  Each dispatch target class
 // will have its own templated version, so that it has its own method and
-// property lookup tables.  There should be one Dispatcher<T> instance for each
+// property lookup table.  There should be one Dispatcher<T> instance for each
 // instance of class T.
+//
+// The lookup table is built once per class, when the first instance is
+// created, and is immutable from then on. Where DispatchIds are the same on
+// all threads the table is shared by all threads. With NPAPI, each thread
+// interns names in its own JS runtime, so each thread builds its own table
+// instead. Either way each instance finds its table when it is created, so
+// calls do not need any locking or thread local lookups.
 template<class T>
 class Dispatcher : public DispatcherInterface {
  public:
@@ -113,7 +124,7 @@ class Dispatcher : public DispatcherInterface {
   Dispatcher(ImplClass *impl);
   virtual ~Dispatcher() {}
 
-  // Called once per (thread, class-type) to initialize properties and methods.
+  // Called once per class-type to initialize properties and methods.
   // Note: This must be specially implemented for each class type T.
   static void Init();
 
@@ -135,43 +146,91 @@ class Dispatcher : public DispatcherInterface {
   static void RegisterMethod(const char *name, ImplCallback callback);
 
  private:
-  typedef std::map<DispatchId, ImplCallback> IDList;
-
-  struct ThreadLocalVariables {
-    bool did_init_class;
-    IDList property_getters;
-    IDList property_setters;
-    IDList methods;
-    DispatcherNameList members;
-    ThreadLocalVariables() : did_init_class(false) {}
+  // A registered method and/or property.
+  struct Member {
+    DispatchId id;
+    bool is_method;
+    bool is_property;
+    ImplCallback method;
+    ImplCallback getter;
+    ImplCallback setter;  // NULL for read only properties
   };
 
-  static void DeleteThreadLocals(void *context);
-  static ThreadLocalVariables &GetThreadLocals();
+  // Orders members by id, for binary searching.
+  struct MemberIdLess {
+    bool operator()(const Member &left, const Member &right) const {
+      return std::less<DispatchId>()(left.id, right.id);
+    }
+  };
 
-  static IDList& GetPropertyGetterList() {
-    return GetThreadLocals().property_getters;
-  }
-  static IDList& GetPropertySetterList() {
-    return GetThreadLocals().property_setters;
-  }
-  static IDList& GetMethodList() {
-    return GetThreadLocals().methods;
+  struct DispatchTable {
+    std::vector<Member> members;  // sorted by id once Init() returns
+    DispatcherNameList names;
+  };
+
+  // Returns the table for class T on this thread, building it if necessary.
+  static const DispatchTable *GetTable();
+  // Builds a new table by calling Init(). Expects the caller to be holding
+  // table_mutex_.
+  static DispatchTable *BuildTable();
+  // Returns the member being registered with the given id, adding it if new.
+  static Member *GetMemberForRegistration(const char *name);
+
+  // Returns the member with the given id, or NULL.
+  const Member *FindMember(DispatchId id) const {
+    const std::vector<Member> &members = table_for_calls_->members;
+    Member key;
+    key.id = id;
+    typename std::vector<Member>::const_iterator member =
+        std::lower_bound(members.begin(), members.end(), key, MemberIdLess());
+    if (member == members.end() || member->id != id) {
+      return NULL;
+    }
+    return &(*member);
   }
 
+  // Guards building tables.
+  static Mutex table_mutex_;
+#if BROWSER_NPAPI
+  // Holds this thread's table, which is deleted when the thread exits.
+  static void DeleteTable(void *context);
   static const ThreadLocals::Slot kThreadLocalsKey;
+#else
+  // The table shared by all threads, never deleted once published.
+  static DispatchTable *table_;
+#endif
+  // The table being filled in by Init(), only set while it runs.
+  static DispatchTable *building_table_;
 
   ImplClass *impl_;
+  // The table for this instance's thread, which it is only used on.
+  const DispatchTable *table_for_calls_;
 
   DISALLOW_EVIL_CONSTRUCTORS(Dispatcher<T>);
 };
 
+template<class T>
+Mutex Dispatcher<T>::table_mutex_;
+
+#if !BROWSER_NPAPI
+template<class T>
+typename Dispatcher<T>::DispatchTable *Dispatcher<T>::table_ = NULL;
+#endif
+
+template<class T>
+typename Dispatcher<T>::DispatchTable *Dispatcher<T>::building_table_ = NULL;
+
 // Used to set up the Dispatcher for the given class.
+#if BROWSER_NPAPI
 #define DECLARE_DISPATCHER(ImplClass) \
 class ImplClass; \
 template <> \
 const ThreadLocals::Slot Dispatcher<ImplClass>::kThreadLocalsKey = \
     ThreadLocals::Alloc()
+#else
+#define DECLARE_DISPATCHER(ImplClass) \
+class ImplClass
+#endif
 
 // Boilerplate code for constants
 
@@ -208,40 +267,34 @@ inline DispatchId GetStringIdentifier(const char *str) {
 }
 
 template<class T>
-Dispatcher<T>::Dispatcher(ImplClass *impl) : impl_(impl) {
-  // Ensure that property and method mappings are initialized.
-  ThreadLocalVariables &locals = GetThreadLocals();
-  if (!locals.did_init_class) {
-    locals.did_init_class = true;
-    Init();
-  }
+Dispatcher<T>::Dispatcher(ImplClass *impl)
+    : impl_(impl), table_for_calls_(GetTable()) {
 }
 
 template<class T>
 bool Dispatcher<T>::HasMethod(DispatchId method_id) {
-  const IDList &methods = GetMethodList();
-  return methods.find(method_id) != methods.end();
+  const Member *member = FindMember(method_id);
+  return member && member->is_method;
 }
 
 template<class T>
 bool Dispatcher<T>::HasPropertyGetter(DispatchId property_id) {
-  const IDList &properties = GetPropertyGetterList();
-  return properties.find(property_id) != properties.end();
+  const Member *member = FindMember(property_id);
+  return member && member->is_property;
 }
 
 template<class T>
 bool Dispatcher<T>::HasPropertySetter(DispatchId property_id) {
-  const IDList &properties = GetPropertySetterList();
-  return properties.find(property_id) != properties.end();
+  const Member *member = FindMember(property_id);
+  return member && member->is_property;
 }
 
 template<class T>
 bool Dispatcher<T>::CallMethod(DispatchId method_id, JsCallContext *context) {
-  const IDList &methods = GetMethodList();
-  typename IDList::const_iterator method = methods.find(method_id);
-  if (method == methods.end())
+  const Member *member = FindMember(method_id);
+  if (!member || !member->is_method)
     return false;
-  ImplCallback callback = method->second;
+  ImplCallback callback = member->method;
 
   assert(IsImplCallbackValid(callback));
   (impl_->*callback)(context);
@@ -251,11 +304,10 @@ bool Dispatcher<T>::CallMethod(DispatchId method_id, JsCallContext *context) {
 template<class T>
 bool Dispatcher<T>::GetProperty(DispatchId property_id,
                                 JsCallContext *context) {
-  const IDList &properties = GetPropertyGetterList();
-  typename IDList::const_iterator property = properties.find(property_id);
-  if (property == properties.end())
+  const Member *member = FindMember(property_id);
+  if (!member || !member->is_property)
     return false;
-  ImplCallback callback = property->second;
+  ImplCallback callback = member->getter;
 
   assert(IsImplCallbackValid(callback));
   (impl_->*callback)(context);
@@ -265,12 +317,11 @@ bool Dispatcher<T>::GetProperty(DispatchId property_id,
 template<class T>
 bool Dispatcher<T>::SetProperty(DispatchId property_id,
                                 JsCallContext *context) {
-  const IDList &properties = GetPropertySetterList();
-  typename IDList::const_iterator property = properties.find(property_id);
-  if (property == properties.end()) {
+  const Member *member = FindMember(property_id);
+  if (!member || !member->is_property) {
     return false;
   }
-  ImplCallback callback = property->second;
+  ImplCallback callback = member->setter;
   if (!IsImplCallbackValid(callback)) {  // Read only property.
     context->SetException(
                  STRING16(L"Cannot assign value to a read only property."));
@@ -283,7 +334,7 @@ bool Dispatcher<T>::SetProperty(DispatchId property_id,
 
 template<class T>
 const DispatcherNameList &Dispatcher<T>::GetMemberNames() {
-  return GetThreadLocals().members;
+  return table_for_calls_->names;
 }
 
 template<class T>
@@ -302,39 +353,88 @@ template<class T>
 void Dispatcher<T>::RegisterProperty(const char *name,
                                      ImplCallback getter, ImplCallback setter) {
   assert(IsImplCallbackValid(getter));
-  DispatchId id = GetStringIdentifier(name);
-  GetPropertyGetterList()[id] = getter;
-  GetPropertySetterList()[id] = setter;
-  GetThreadLocals().members[name] = id;
+  Member *member = GetMemberForRegistration(name);
+  member->is_property = true;
+  member->getter = getter;
+  member->setter = setter;
 }
 
 // static
 template<class T>
 void Dispatcher<T>::RegisterMethod(const char *name, ImplCallback callback) {
+  Member *member = GetMemberForRegistration(name);
+  member->is_method = true;
+  member->method = callback;
+}
+
+// static
+template<class T>
+typename Dispatcher<T>::Member *Dispatcher<T>::GetMemberForRegistration(
+    const char *name) {
+  // Registration only happens from Init(), while the table is being built
+  assert(building_table_);
   DispatchId id = GetStringIdentifier(name);
-  GetMethodList()[id] = callback;
-  GetThreadLocals().members[name] = id;
+  building_table_->names[name] = id;
+  std::vector<Member> &members = building_table_->members;
+  for (size_t i = 0; i < members.size(); ++i) {
+    if (members[i].id == id) {
+      return &members[i];
+    }
+  }
+  Member member;
+  member.id = id;
+  member.is_method = false;
+  member.is_property = false;
+  member.method = NULL;
+  member.getter = NULL;
+  member.setter = NULL;
+  members.push_back(member);
+  return &members.back();
 }
 
 // static
 template<class T>
-void Dispatcher<T>::DeleteThreadLocals(void *context) {
-  ThreadLocalVariables *locals =
-      reinterpret_cast<ThreadLocalVariables*>(context);
-  delete locals;
+typename Dispatcher<T>::DispatchTable *Dispatcher<T>::BuildTable() {
+  DispatchTable *table = new DispatchTable;
+  building_table_ = table;
+  Init();
+  building_table_ = NULL;
+  std::sort(table->members.begin(), table->members.end(), MemberIdLess());
+  return table;
 }
 
+#if BROWSER_NPAPI
 // static
 template<class T>
-typename Dispatcher<T>::ThreadLocalVariables &Dispatcher<T>::GetThreadLocals() {
+void Dispatcher<T>::DeleteTable(void *context) {
+  delete reinterpret_cast<DispatchTable*>(context);
+}
+
+// static
+template<class T>
+const typename Dispatcher<T>::DispatchTable *Dispatcher<T>::GetTable() {
   const ThreadLocals::Slot &key = kThreadLocalsKey;
-  ThreadLocalVariables *locals =
-      reinterpret_cast<ThreadLocalVariables*>(ThreadLocals::GetValue(key));
-  if (!locals) {
-    locals = new ThreadLocalVariables;
-    ThreadLocals::SetValue(key, locals, &DeleteThreadLocals);
+  DispatchTable *table =
+      reinterpret_cast<DispatchTable*>(ThreadLocals::GetValue(key));
+  if (!table) {
+    {
+      MutexLock lock(&table_mutex_);
+      table = BuildTable();
+    }
+    ThreadLocals::SetValue(key, table, &DeleteTable);
+  }
+  return table;
+}
+#else
+// static
+template<class T>
+const typename Dispatcher<T>::DispatchTable *Dispatcher<T>::GetTable() {
+  MutexLock lock(&table_mutex_);
+  if (!table_) {
+    table_ = BuildTable();
   }
-  return *locals;
+  return table_;
 }
+#endif
 
 #endif // GEARS_BASE_COMMON_DISPATCHER_H__
@@ -113,30 +113,61 @@ static null_stream devnull;
 // Based on google3/base/arena.h
 // ----------------------------------------------------------------------
 // We implement just enough of the interface to allow this module to compile.
+// Header keys and values are carved out of fixed size blocks so that
+// parsing a typical response costs a handful of allocations rather than
+// two per header. Reset() keeps the first block around for reuse.
 // ----------------------------------------------------------------------
 
 class UnsafeArena {
  public:
+  UnsafeArena() : next_(NULL), remaining_(0) {}
   ~UnsafeArena() {
     Reset();
+    if (!blocks_.empty()) {
+      delete [] blocks_[0];
+    }
   }
   char* Strdup(const char* s) {
     size_t size = strlen(s) + 1;
-    return strncpy(Alloc(size), s, size);
+    return static_cast<char*>(memcpy(Alloc(size), s, size));
   }
   char* Alloc(const size_t size) {
-    char *alloced = new char[size];
-    allocations_.push_back(alloced);
+    if (size > kMaxInlineAlloc) {
+      char *alloced = new char[size];
+      large_allocations_.push_back(alloced);
+      return alloced;
+    }
+    if (size > remaining_) {
+      blocks_.push_back(new char[kBlockSize]);
+      next_ = blocks_.back();
+      remaining_ = kBlockSize;
+    }
+    char *alloced = next_;
+    next_ += size;
+    remaining_ -= size;
     return alloced;
   }
   void Reset() {
-    for (size_t i = 0; i < allocations_.size(); ++i) {
-      delete [] allocations_[i];
+    for (size_t i = 0; i < large_allocations_.size(); ++i) {
+      delete [] large_allocations_[i];
+    }
+    large_allocations_.clear();
+    for (size_t i = 1; i < blocks_.size(); ++i) {
+      delete [] blocks_[i];
+    }
+    if (!blocks_.empty()) {
+      blocks_.resize(1);
+      next_ = blocks_[0];
+      remaining_ = kBlockSize;
     }
-    allocations_.clear();
   }
  private:
-  std::vector<char*> allocations_;
+  static const size_t kBlockSize = 2048;
+  static const size_t kMaxInlineAlloc = kBlockSize / 4;
+  std::vector<char*> blocks_;
+  std::vector<char*> large_allocations_;
+  char *next_;
+  size_t remaining_;
 };
 
 // The google3 code we've picked up uses the standard namespace
@@ -783,10 +814,19 @@ bool HTTPUtils::ParseHTTPHeaders(const char** body, uint32* bodylen,
                                      HTTPHeaders::APPEND);
           *(const_cast<char *>(line_end)) = oldval; // Restore the old value.
         } else {
-          // Can't use const_cast so we copy the line to a temporary string
-          string header_line(line, line_end);
-          header_line.c_str();
-          headers->SetHeaderFromLine(&header_line[0], HTTPHeaders::APPEND);
+          // Can't use const_cast so we copy the line to a temporary buffer,
+          // typical header lines fit on the stack.
+          char stack_line[256];
+          string heap_line;
+          char *header_line = stack_line;
+          const size_t line_len = line_end - line;
+          if (line_len >= sizeof(stack_line)) {
+            heap_line.resize(line_len + 1);
+            header_line = &heap_line[0];
+          }
+          memcpy(header_line, line, line_len);
+          header_line[line_len] = '\0';
+          headers->SetHeaderFromLine(header_line, HTTPHeaders::APPEND);
         }
       }
     }
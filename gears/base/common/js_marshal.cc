@@ -82,8 +82,51 @@ MarshaledJsToken *MarshaledJsToken::Marshal(
     JsRunnerInterface *js_runner,
     std::string16 *error_message_out) {
   AbstractJsTokenVector object_stack;  // storage used to detect cycles
-  return MarshaledJsToken::Marshal(
+  MarshaledJsToken *mjt = MarshaledJsToken::Marshal(
       token, js_runner, error_message_out, &object_stack);
+  if (mjt) {
+    mjt->memory_.reset(
+        new MemoryAccountingTag(MEMORY_ACCOUNTING_TYPE_MarshaledJsToken));
+    mjt->memory_->SetBytes(mjt->EstimateSize());
+  }
+  return mjt;
+}
+
+
+int64 MarshaledJsToken::EstimateSize() const {
+  int64 size = sizeof(*this);
+  switch (type_) {
+    case JSPARAM_STRING16:
+      size += sizeof(*value_.string_value) +
+              value_.string_value->capacity() * sizeof(char16);
+      break;
+    case JSPARAM_OBJECT:
+      size += sizeof(*value_.object_value);
+      for (std::map<std::string16, MarshaledJsToken*>::const_iterator i =
+           value_.object_value->begin(); i != value_.object_value->end();
+           ++i) {
+        // Allow four pointers for the map node's bookkeeping.
+        size += 4 * sizeof(void*) + sizeof(*i) +
+                i->first.capacity() * sizeof(char16) +
+                i->second->EstimateSize();
+      }
+      break;
+    case JSPARAM_ARRAY:
+      size += sizeof(*value_.array_value) +
+              value_.array_value->capacity() * sizeof(MarshaledJsToken*);
+      for (std::vector<MarshaledJsToken*>::const_iterator i =
+           value_.array_value->begin(); i != value_.array_value->end(); ++i) {
+        if (*i) {  // NULL for holes in the array
+          size += (*i)->EstimateSize();
+        }
+      }
+      break;
+    default:
+      // The module itself is not accounted for, it is shared with the
+      // JsToken it was marshaled from.
+      break;
+  }
+  return size;
 }
 
 
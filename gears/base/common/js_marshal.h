@@ -81,6 +81,8 @@
 #include "gears/base/common/common.h"
 #include "gears/base/common/js_runner.h"
 #include "gears/base/common/js_types.h"
+#include "gears/base/common/memory_accounting.h"
+#include "third_party/scoped_ptr/scoped_ptr.h"
 
 struct ModuleEnvironment;
 class MarshaledModule;
@@ -127,6 +129,10 @@ class MarshaledJsToken {
                            std::string16 *error_message_out,
                            AbstractJsTokenVector *object_stack);
 
+  // Returns the approximate number of bytes held by this token and its
+  // children.
+  int64 EstimateSize() const;
+
   JsParamType type_;
   union {
     bool bool_value;
@@ -138,6 +144,10 @@ class MarshaledJsToken {
     MarshaledModule *marshaled_module_value;
   } value_;
 
+  // Only set on the root of a marshaled tree, and accounts for the whole
+  // tree.
+  scoped_ptr<MemoryAccountingTag> memory_;
+
   DISALLOW_EVIL_CONSTRUCTORS(MarshaledJsToken);
 };
 
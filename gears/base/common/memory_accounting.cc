@@ -0,0 +1,187 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/base/common/memory_accounting.h"
+
+#include <assert.h>
+#include <map>
+
+#include "gears/base/common/atomic_ops.h"
+#include "gears/base/common/mutex.h"
+#include "gears/base/common/thread_locals.h"
+
+static const char16 *memory_accounting_names[] = {
+  STRING16(L"BufferPool"),
+  STRING16(L"ByteStore"),
+  STRING16(L"CanvasBitmap"),
+  STRING16(L"MarshaledJsToken"),
+  STRING16(L"MemoryBuffer"),
+  NULL
+};
+
+// Updates go to one of kNumShards copies of the counters, and queries sum
+// over all of them. Threads are assigned shards in turn the first time they
+// update, so up to kNumShards threads never share one.
+// Memory is often freed on a different thread than the one that allocated
+// it, so a single shard's counters can drift arbitrarily far from zero and
+// may wrap around. Summing them with wrap around still gives the right
+// total, as long as the total itself fits in an AtomicWord.
+static const int kNumShards = 8;  // must be a power of 2
+
+struct MemoryAccountingShard {
+  AtomicWord bytes[MemoryAccounting::kMaxOrigins][MAX_MEMORY_ACCOUNTING_TYPE];
+  AtomicWord allocations[MemoryAccounting::kMaxOrigins]
+                        [MAX_MEMORY_ACCOUNTING_TYPE];
+};
+
+static MemoryAccountingShard shards[kNumShards];
+static AtomicWord next_shard = 0;
+
+static Mutex origins_mutex;
+// Both are only appended to, and guarded by origins_mutex.
+static std::vector<std::string16> origin_urls(1);
+static std::map<std::string16, int> origin_ids;
+
+// Holds the current origin id. The default NULL value is kUnattributedOrigin.
+const ThreadLocals::Slot kCurrentOriginKey = ThreadLocals::Alloc();
+
+// Holds the current thread's shard index plus one, so that the default NULL
+// value means that none has been assigned yet.
+const ThreadLocals::Slot kShardKey = ThreadLocals::Alloc();
+
+static MemoryAccountingShard *GetShard() {
+  intptr_t index =
+      reinterpret_cast<intptr_t>(ThreadLocals::GetValue(kShardKey));
+  if (!index) {
+    index = (AtomicIncrement(&next_shard, 1) & (kNumShards - 1)) + 1;
+    ThreadLocals::SetValue(kShardKey, reinterpret_cast<void*>(index), NULL);
+  }
+  return &shards[index - 1];
+}
+
+// static
+int MemoryAccounting::GetOriginId(const std::string16 &origin_url) {
+  MutexLock lock(&origins_mutex);
+  std::map<std::string16, int>::const_iterator found =
+      origin_ids.find(origin_url);
+  if (found != origin_ids.end()) {
+    return found->second;
+  }
+  if (origin_urls.size() >= static_cast<size_t>(kMaxOrigins)) {
+    return kUnattributedOrigin;
+  }
+  int id = static_cast<int>(origin_urls.size());
+  origin_urls.push_back(origin_url);
+  origin_ids[origin_url] = id;
+  return id;
+}
+
+// static
+void MemoryAccounting::GetOrigins(std::vector<std::string16> *origins) {
+  assert(origins);
+  MutexLock lock(&origins_mutex);
+  *origins = origin_urls;
+}
+
+// static
+int MemoryAccounting::GetCurrentOriginId() {
+  return static_cast<int>(
+      reinterpret_cast<intptr_t>(ThreadLocals::GetValue(kCurrentOriginKey)));
+}
+
+// static
+void MemoryAccounting::SetCurrentOriginId(int origin_id) {
+  ThreadLocals::SetValue(kCurrentOriginKey,
+                         reinterpret_cast<void*>(origin_id), NULL);
+}
+
+// static
+const char16 *MemoryAccounting::GetTypeName(MemoryAccountingType type) {
+  // The +1 is for the NULL value at the end of memory_accounting_names.
+  assert(MAX_MEMORY_ACCOUNTING_TYPE + 1 ==
+         ARRAYSIZE(memory_accounting_names));
+  assert(type >= 0 && type < MAX_MEMORY_ACCOUNTING_TYPE);
+  return memory_accounting_names[type];
+}
+
+// static
+void MemoryAccounting::GetUsage(int origin_id, MemoryAccountingType type,
+                                Usage *usage) {
+  assert(usage);
+  assert(origin_id == kAllOrigins ||
+         (origin_id >= 0 && origin_id < kMaxOrigins));
+  assert(type >= 0 && type <= MAX_MEMORY_ACCOUNTING_TYPE);
+  int first_origin = origin_id == kAllOrigins ? 0 : origin_id;
+  int last_origin = origin_id == kAllOrigins ? kMaxOrigins - 1 : origin_id;
+  int first_type = type == MAX_MEMORY_ACCOUNTING_TYPE ? 0 : type;
+  int last_type = type == MAX_MEMORY_ACCOUNTING_TYPE ?
+      MAX_MEMORY_ACCOUNTING_TYPE - 1 : type;
+
+  usage->bytes = 0;
+  usage->allocations = 0;
+  for (int o = first_origin; o <= last_origin; ++o) {
+    for (int t = first_type; t <= last_type; ++t) {
+      uintptr_t bytes = 0;
+      uintptr_t allocations = 0;
+      for (int s = 0; s < kNumShards; ++s) {
+        bytes += static_cast<uintptr_t>(shards[s].bytes[o][t]);
+        allocations += static_cast<uintptr_t>(shards[s].allocations[o][t]);
+      }
+      usage->bytes += static_cast<AtomicWord>(bytes);
+      usage->allocations += static_cast<AtomicWord>(allocations);
+    }
+  }
+}
+
+// static
+void MemoryAccounting::Add(MemoryAccountingType type, int origin_id,
+                           int64 bytes, int allocations) {
+  assert(type >= 0 && type < MAX_MEMORY_ACCOUNTING_TYPE);
+  assert(origin_id >= 0 && origin_id < kMaxOrigins);
+  MemoryAccountingShard *shard = GetShard();
+  if (bytes != 0) {
+    AtomicIncrement(&shard->bytes[origin_id][type],
+                    static_cast<AtomicWord>(bytes));
+  }
+  if (allocations != 0) {
+    AtomicIncrement(&shard->allocations[origin_id][type], allocations);
+  }
+}
+
+void MemoryAccountingTag::SetType(MemoryAccountingType type) {
+  if (type != type_) {
+    MemoryAccounting::Add(type_, origin_id_, -bytes_, -1);
+    type_ = type;
+    MemoryAccounting::Add(type_, origin_id_, bytes_, 1);
+  }
+}
+
+void MemoryAccountingTag::SetOrigin(int origin_id) {
+  if (origin_id != origin_id_) {
+    MemoryAccounting::Add(type_, origin_id_, -bytes_, -1);
+    origin_id_ = origin_id;
+    MemoryAccounting::Add(type_, origin_id_, bytes_, 1);
+  }
+}
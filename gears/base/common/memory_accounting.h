@@ -0,0 +1,177 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Accounts for the memory held by large allocations, by the kind of object
+// holding it and by the origin it is held on behalf of. Unlike LeakCounter
+// this is always compiled in, so that the numbers can be looked at in
+// release builds. Counters are sharded so that threads updating them at the
+// same time rarely touch the same cache line.
+//
+// An object accounts for its memory by owning a MemoryAccountingTag and
+// keeping its byte count up to date:
+//
+//   class Foo {
+//    public:
+//     Foo() : memory_(MEMORY_ACCOUNTING_TYPE_Foo) {}
+//     void Grow(int64 size) { ...; memory_.SetBytes(size); }
+//    private:
+//     MemoryAccountingTag memory_;
+//   };
+//
+// A tag is counted under the origin set by the innermost ScopedMemoryOrigin
+// on the thread that first changes its byte count, unless it is given one
+// with SetOrigin.
+
+#ifndef GEARS_BASE_COMMON_MEMORY_ACCOUNTING_H__
+#define GEARS_BASE_COMMON_MEMORY_ACCOUNTING_H__
+
+#include <vector>
+#include "gears/base/common/basictypes.h"
+#include "gears/base/common/string16.h"
+
+// When adding new MemoryAccountingTypes, please keep them in alphabetical
+// order, and also update the memory_accounting_names array in
+// memory_accounting.cc.
+enum MemoryAccountingType {
+  MEMORY_ACCOUNTING_TYPE_BufferPool,
+  MEMORY_ACCOUNTING_TYPE_ByteStore,
+  MEMORY_ACCOUNTING_TYPE_CanvasBitmap,
+  MEMORY_ACCOUNTING_TYPE_MarshaledJsToken,
+  MEMORY_ACCOUNTING_TYPE_MemoryBuffer,
+  MAX_MEMORY_ACCOUNTING_TYPE
+};
+
+class MemoryAccounting {
+ public:
+  // The origin id of memory that is not attributed to any origin.
+  static const int kUnattributedOrigin = 0;
+  // The number of distinct origins that memory can be attributed to,
+  // including kUnattributedOrigin.
+  static const int kMaxOrigins = 64;
+  // Passed to GetUsage to sum over all origins.
+  static const int kAllOrigins = -1;
+
+  struct Usage {
+    int64 bytes;
+    int64 allocations;
+  };
+
+  // Returns the id to attribute memory held on behalf of the origin to,
+  // registering the origin on first use. Once kMaxOrigins ids are in use,
+  // returns kUnattributedOrigin for further origins.
+  static int GetOriginId(const std::string16 &origin_url);
+
+  // Returns the origins registered so far, indexed by their ids. The entry
+  // for kUnattributedOrigin is empty.
+  static void GetOrigins(std::vector<std::string16> *origins);
+
+  // Returns the origin set by the innermost ScopedMemoryOrigin on the
+  // current thread, or kUnattributedOrigin.
+  static int GetCurrentOriginId();
+
+  // Returns the name of the type, e.g. "ByteStore".
+  static const char16 *GetTypeName(MemoryAccountingType type);
+
+  // Returns the memory currently accounted for under the origin, or all
+  // origins if origin_id is kAllOrigins, and the type, or all types if type
+  // is MAX_MEMORY_ACCOUNTING_TYPE.
+  static void GetUsage(int origin_id, MemoryAccountingType type,
+                       Usage *usage);
+
+  // Adjusts the counters. Use a MemoryAccountingTag rather than calling this
+  // directly.
+  static void Add(MemoryAccountingType type, int origin_id,
+                  int64 bytes, int allocations);
+
+ private:
+  friend class ScopedMemoryOrigin;
+  static void SetCurrentOriginId(int origin_id);
+
+  DISALLOW_EVIL_CONSTRUCTORS(MemoryAccounting);
+};
+
+// Accounts for the memory held by one allocation. The memory stops being
+// accounted for when the tag is destroyed.
+class MemoryAccountingTag {
+ public:
+  explicit MemoryAccountingTag(MemoryAccountingType type)
+      : type_(type), origin_id_(MemoryAccounting::kUnattributedOrigin),
+        bytes_(0) {
+    MemoryAccounting::Add(type_, origin_id_, 0, 1);
+  }
+
+  ~MemoryAccountingTag() {
+    MemoryAccounting::Add(type_, origin_id_, -bytes_, -1);
+  }
+
+  int64 bytes() const { return bytes_; }
+
+  // Sets the number of bytes held.
+  void SetBytes(int64 bytes) {
+    if (bytes != bytes_) {
+      if (origin_id_ == MemoryAccounting::kUnattributedOrigin) {
+        SetOrigin(MemoryAccounting::GetCurrentOriginId());
+      }
+      MemoryAccounting::Add(type_, origin_id_, bytes - bytes_, 0);
+      bytes_ = bytes;
+    }
+  }
+
+  // Moves the allocation to another type, for example when a generic
+  // buffer is used to hold the contents of a more specific object.
+  void SetType(MemoryAccountingType type);
+
+  // Moves the allocation to another origin.
+  void SetOrigin(int origin_id);
+
+ private:
+  MemoryAccountingType type_;
+  int origin_id_;
+  int64 bytes_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(MemoryAccountingTag);
+};
+
+// Attributes unattributed tags whose byte counts change on the current thread
+// during the lifetime of this object to the origin.
+class ScopedMemoryOrigin {
+ public:
+  explicit ScopedMemoryOrigin(const std::string16 &origin_url)
+      : previous_origin_id_(MemoryAccounting::GetCurrentOriginId()) {
+    MemoryAccounting::SetCurrentOriginId(
+        MemoryAccounting::GetOriginId(origin_url));
+  }
+
+  ~ScopedMemoryOrigin() {
+    MemoryAccounting::SetCurrentOriginId(previous_origin_id_);
+  }
+
+ private:
+  int previous_origin_id_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ScopedMemoryOrigin);
+};
+
+#endif  // GEARS_BASE_COMMON_MEMORY_ACCOUNTING_H__
@@ -0,0 +1,172 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifdef USING_CCTESTS
+
+#include "gears/base/common/byte_store.h"
+#include "gears/base/common/common.h"
+#include "gears/base/common/memory_accounting.h"
+#include "gears/base/common/memory_buffer.h"
+#include "gears/base/common/string16.h"
+#include "gears/base/common/thread.h"
+#include "third_party/scoped_ptr/scoped_ptr.h"
+
+static const char16 *kTestOrigin =
+    STRING16(L"http://memory-accounting-test.example.com");
+
+// Allocates on one thread what the test frees on another.
+class MemoryAccountingTestThread : public Thread {
+ public:
+  MemoryAccountingTestThread() {
+    for (int i = 0; i < kNumTags; ++i) {
+      tags_[i] = NULL;
+    }
+  }
+
+  static const int kNumTags = 1000;
+  MemoryAccountingTag *tags_[kNumTags];
+
+ protected:
+  virtual void Run() {
+    ScopedMemoryOrigin memory_origin(kTestOrigin);
+    for (int i = 0; i < kNumTags; ++i) {
+      tags_[i] = new MemoryAccountingTag(MEMORY_ACCOUNTING_TYPE_MemoryBuffer);
+      tags_[i]->SetBytes(i + 1);
+    }
+  }
+};
+
+bool TestMemoryAccounting(std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestMemoryAccounting - failed (%d)\n", __LINE__)); \
+    assert(error); \
+    *error += STRING16(L"TestMemoryAccounting - failed. "); \
+    return false; \
+  } \
+}
+
+  TEST_ASSERT(std::string16(MemoryAccounting::GetTypeName(
+      MEMORY_ACCOUNTING_TYPE_ByteStore)) == STRING16(L"ByteStore"));
+  TEST_ASSERT(std::string16(MemoryAccounting::GetTypeName(
+      MEMORY_ACCOUNTING_TYPE_MemoryBuffer)) == STRING16(L"MemoryBuffer"));
+
+  // Origins keep their ids.
+  int origin_id = MemoryAccounting::GetOriginId(kTestOrigin);
+  TEST_ASSERT(origin_id != MemoryAccounting::kUnattributedOrigin);
+  TEST_ASSERT(origin_id == MemoryAccounting::GetOriginId(kTestOrigin));
+  std::vector<std::string16> origins;
+  MemoryAccounting::GetOrigins(&origins);
+  TEST_ASSERT(static_cast<int>(origins.size()) > origin_id);
+  TEST_ASSERT(origins[origin_id] == kTestOrigin);
+  TEST_ASSERT(origins[MemoryAccounting::kUnattributedOrigin].empty());
+
+  // Other tests may leave memory accounted to the test origin, so only
+  // differences are checked.
+  MemoryAccounting::Usage base_buffer;
+  MemoryAccounting::Usage base_store;
+  MemoryAccounting::Usage base_total;
+  MemoryAccounting::GetUsage(origin_id, MEMORY_ACCOUNTING_TYPE_MemoryBuffer,
+                             &base_buffer);
+  MemoryAccounting::GetUsage(origin_id, MEMORY_ACCOUNTING_TYPE_ByteStore,
+                             &base_store);
+  MemoryAccounting::GetUsage(origin_id, MAX_MEMORY_ACCOUNTING_TYPE,
+                             &base_total);
+  MemoryAccounting::Usage usage;
+
+  // A tag adopts the current origin when it is first given bytes, and
+  // releases its bytes when destroyed.
+  TEST_ASSERT(MemoryAccounting::GetCurrentOriginId() ==
+              MemoryAccounting::kUnattributedOrigin);
+  {
+    ScopedMemoryOrigin memory_origin(kTestOrigin);
+    TEST_ASSERT(MemoryAccounting::GetCurrentOriginId() == origin_id);
+    MemoryAccountingTag tag(MEMORY_ACCOUNTING_TYPE_MemoryBuffer);
+    tag.SetBytes(100);
+    MemoryAccounting::GetUsage(origin_id, MEMORY_ACCOUNTING_TYPE_MemoryBuffer,
+                               &usage);
+    TEST_ASSERT(usage.bytes == base_buffer.bytes + 100);
+    TEST_ASSERT(usage.allocations == base_buffer.allocations + 1);
+
+    tag.SetBytes(40);
+    tag.SetType(MEMORY_ACCOUNTING_TYPE_ByteStore);
+    MemoryAccounting::GetUsage(origin_id, MEMORY_ACCOUNTING_TYPE_MemoryBuffer,
+                               &usage);
+    TEST_ASSERT(usage.bytes == base_buffer.bytes);
+    TEST_ASSERT(usage.allocations == base_buffer.allocations);
+    MemoryAccounting::GetUsage(origin_id, MEMORY_ACCOUNTING_TYPE_ByteStore,
+                               &usage);
+    TEST_ASSERT(usage.bytes == base_store.bytes + 40);
+    TEST_ASSERT(usage.allocations == base_store.allocations + 1);
+  }
+  TEST_ASSERT(MemoryAccounting::GetCurrentOriginId() ==
+              MemoryAccounting::kUnattributedOrigin);
+  MemoryAccounting::GetUsage(origin_id, MAX_MEMORY_ACCOUNTING_TYPE, &usage);
+  TEST_ASSERT(usage.bytes == base_total.bytes);
+  TEST_ASSERT(usage.allocations == base_total.allocations);
+
+  // MemoryBuffer and ByteStore account for the memory they reserve.
+  {
+    ScopedMemoryOrigin memory_origin(kTestOrigin);
+    MemoryBuffer buffer;
+    buffer.Resize(1000);
+    MemoryAccounting::GetUsage(origin_id, MEMORY_ACCOUNTING_TYPE_MemoryBuffer,
+                               &usage);
+    TEST_ASSERT(usage.bytes == base_buffer.bytes + buffer.Capacity());
+
+    scoped_refptr<ByteStore> byte_store(new ByteStore);
+    char data[5000] = { 0 };
+    TEST_ASSERT(byte_store->AddData(data, sizeof(data)));
+    MemoryAccounting::GetUsage(origin_id, MEMORY_ACCOUNTING_TYPE_ByteStore,
+                               &usage);
+    TEST_ASSERT(usage.bytes >= base_store.bytes + 5000);
+  }
+  MemoryAccounting::GetUsage(origin_id, MAX_MEMORY_ACCOUNTING_TYPE, &usage);
+  TEST_ASSERT(usage.bytes == base_total.bytes);
+  TEST_ASSERT(usage.allocations == base_total.allocations);
+
+  // Memory allocated on one thread and freed on another nets out.
+  MemoryAccountingTestThread thread;
+  TEST_ASSERT(thread.Start());
+  thread.Join();
+  const int n = MemoryAccountingTestThread::kNumTags;
+  MemoryAccounting::GetUsage(origin_id, MEMORY_ACCOUNTING_TYPE_MemoryBuffer,
+                             &usage);
+  TEST_ASSERT(usage.bytes == base_buffer.bytes + n * (n + 1) / 2);
+  TEST_ASSERT(usage.allocations == base_buffer.allocations + n);
+  for (int i = 0; i < n; ++i) {
+    delete thread.tags_[i];
+  }
+  MemoryAccounting::GetUsage(origin_id, MAX_MEMORY_ACCOUNTING_TYPE, &usage);
+  TEST_ASSERT(usage.bytes == base_total.bytes);
+  TEST_ASSERT(usage.allocations == base_total.allocations);
+
+  LOG(("TestMemoryAccounting - passed\n"));
+  return true;
+}
+
+#endif  // USING_CCTESTS
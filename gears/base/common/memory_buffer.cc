@@ -36,11 +36,13 @@ const MemoryBuffer::size_type gInitialCapacity = 16;
 }  // namespace
 
 
-MemoryBuffer::MemoryBuffer() : capacity_(0), size_(0) {
+MemoryBuffer::MemoryBuffer()
+    : capacity_(0), size_(0), memory_(MEMORY_ACCOUNTING_TYPE_MemoryBuffer) {
 }
 
 
-MemoryBuffer::MemoryBuffer(size_type num) : capacity_(0), size_(0) {
+MemoryBuffer::MemoryBuffer(size_type num)
+    : capacity_(0), size_(0), memory_(MEMORY_ACCOUNTING_TYPE_MemoryBuffer) {
   Resize(num);
 }
 
@@ -73,6 +75,7 @@ void MemoryBuffer::Reserve(size_type num) {
     buffer_.release();
     buffer_.reset(temp);
   }
+  memory_.SetBytes(capacity_);
 }
 
 
@@ -87,4 +90,7 @@ void MemoryBuffer::Swap(MemoryBuffer &mb) {
   std::swap(capacity_, mb.capacity_);
   std::swap(size_, mb.size_);
   buffer_.swap(mb.buffer_);
+  // The tags stay with their MemoryBuffers, which may be of different types.
+  memory_.SetBytes(capacity_);
+  mb.memory_.SetBytes(mb.capacity_);
 }
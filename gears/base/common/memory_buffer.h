@@ -27,6 +27,7 @@
 #define GEARS_BASE_COMMON_MEMORY_BUFFER_H_
 
 #include "gears/base/common/basictypes.h"
+#include "gears/base/common/memory_accounting.h"
 #include "third_party/scoped_ptr/scoped_ptr.h"
 
 // This class implements a resizable array of bytes.
@@ -46,6 +47,12 @@ class MemoryBuffer {
   // Creates a MemoryBuffer of the given size.
   explicit MemoryBuffer(size_type num);
 
+  // Accounts for the buffer's memory under the given type rather than as a
+  // plain MemoryBuffer.
+  void SetMemoryAccountingType(MemoryAccountingType type) {
+    memory_.SetType(type);
+  }
+
   // Appends the provided data to the end of the MemoryBuffer.
   void Append(const value_type *data, size_type num);
 
@@ -78,6 +85,7 @@ class MemoryBuffer {
   size_type capacity_;
   size_type size_;
   scoped_ptr_malloc<value_type> buffer_;
+  MemoryAccountingTag memory_;
 };
 
 #endif  // GEARS_BASE_COMMON_MEMORY_BUFFER_H_
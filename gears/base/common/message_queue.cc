@@ -57,6 +57,7 @@ bool ThreadMessageQueue::GetRegisteredHandler(int message_type,
 bool MockThreadMessageQueue::Send(ThreadId thread_id,
                                   int message_type,
                                   MessageData *message_data) {
+  MutexLock lock(&pending_mutex_);
   if (initialized_threads_.find(thread_id) == 
       initialized_threads_.end()) {
     delete message_data;
@@ -69,21 +70,28 @@ bool MockThreadMessageQueue::Send(ThreadId thread_id,
 }
 
 void MockThreadMessageQueue::DeliverMockMessages() {
-  size_t count = pending_message_thread_ids_.size();
-  assert(count == pending_messages_.size());
+  // Messages sent by the handlers are delivered on the next call
+  std::vector<ThreadId> thread_ids;
+  std::vector<int> message_types;
+  std::vector<linked_ptr<MessageData> > messages;
+  {
+    MutexLock lock(&pending_mutex_);
+    thread_ids.swap(pending_message_thread_ids_);
+    message_types.swap(pending_message_types_);
+    messages.swap(pending_messages_);
+  }
+  size_t count = thread_ids.size();
+  assert(count == messages.size());
   for (size_t i = 0; i < count; ++i) {
-    ThreadId thread_id = pending_message_thread_ids_[i];
-    int message_type = pending_message_types_[i];
-    MessageData *message_data = pending_messages_[i].get();
+    ThreadId thread_id = thread_ids[i];
+    int message_type = message_types[i];
+    MessageData *message_data = messages[i].get();
     SetMockCurrentThreadId(thread_id);
     RegisteredHandler handler;
     if (GetRegisteredHandler(message_type, &handler)) {
       handler.Invoke(message_type, message_data);
     }
   }
-  pending_message_thread_ids_.clear();
-  pending_message_types_.clear();
-  pending_messages_.clear();
 }
 
 #endif  // USING_CCTESTS
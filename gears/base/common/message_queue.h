@@ -44,6 +44,7 @@ enum ThreadMessageTypes {
   kAsyncRouter_Call,
   kAndroidLoop_Exit,
   kSyncRouter_Call,
+  kDatabase2Interpreter_Results,
 };
 
 // A facility for sending and receiving messages asynchronously 
@@ -142,12 +143,13 @@ class AndroidMessageLoop {
 
 #ifdef USING_CCTESTS
 // A mock implementation of the ThreadMessageQueue that
-// can be used for testing.
+// can be used for testing. Messages may be sent from any thread.
 class MockThreadMessageQueue : public ThreadMessageQueue {
  public:
   MockThreadMessageQueue() : current_thread_id_(0) {}
 
   virtual bool InitThreadMessageQueue() {
+    MutexLock lock(&pending_mutex_);
     initialized_threads_.insert(current_thread_id_);
     return true;
   }
@@ -170,6 +172,7 @@ class MockThreadMessageQueue : public ThreadMessageQueue {
 
  private:
   ThreadId current_thread_id_;
+  Mutex pending_mutex_;  // guards initialized_threads_ and pending_*
   std::set<ThreadId> initialized_threads_;
   std::vector<ThreadId> pending_message_thread_ids_;
   std::vector<int> pending_message_types_;
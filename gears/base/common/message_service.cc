@@ -215,6 +215,15 @@ void MessageService::NotifyObservers(const char16 *topic,
 }
 
 
+bool MessageService::HasObservers(const char16 *topic) {
+  if (ipc_message_queue_) {
+    return true;
+  }
+  MutexLock lock(&observer_collections_mutex_);
+  return GetTopicObserverCollection(topic, false) != NULL;
+}
+
+
 void MessageService::NotifyObserversImpl(SharedNotificationData *shared_data,
                                          bool send_ipc) {
   if (send_ipc && ipc_message_queue_) {
@@ -85,6 +85,11 @@ class MessageService : public ThreadMessageQueue::HandlerInterface,
   // Upon return from this method, callers should no longer touch data.
   void NotifyObservers(const char16 *topic, NotificationData *data);
 
+  // Returns false if a notification for the given topic would not reach any
+  // observer, allowing publishers to skip the work of preparing one. When
+  // notifications are forwarded to other processes this is always true.
+  bool HasObservers(const char16 *topic);
+
  private:
   // The intent is for this class to be a singleton, but for testing
   // purposes, the constructor and destructor are made available.
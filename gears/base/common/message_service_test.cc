@@ -105,8 +105,11 @@ bool TestMessageService(std::string16 *error) {
   TestObserver observer(&mock_message_queue);
   mock_message_queue.SetMockCurrentThreadId(kThreadId1);
   // We should only be able to add the same observer once per topic per thread
+  TEST_ASSERT(!message_service.HasObservers(kTopic1));
   TEST_ASSERT(message_service.AddObserver(&observer, kTopic1));
   TEST_ASSERT(!message_service.AddObserver(&observer, kTopic1));
+  TEST_ASSERT(message_service.HasObservers(kTopic1));
+  TEST_ASSERT(!message_service.HasObservers(kTopic2));
   // We should only be able to remove from the same thread
   mock_message_queue.SetMockCurrentThreadId(kThreadId2);
   TEST_ASSERT(!message_service.RemoveObserver(&observer, kTopic1));
@@ -114,6 +117,7 @@ bool TestMessageService(std::string16 *error) {
   TEST_ASSERT(message_service.RemoveObserver(&observer, kTopic1));
   // Should not be able to remove an observer that is not registered
   TEST_ASSERT(!message_service.RemoveObserver(&observer, kTopic1));
+  TEST_ASSERT(!message_service.HasObservers(kTopic1));
   // A removed observer should not receive notifications
   message_service.NotifyObservers(kTopic1, new TestNotification("deaf ears"));
   mock_message_queue.DeliverMockMessages();
@@ -103,6 +103,34 @@ bool NameValueTable::GetInt(const char16* name, int *value) {
 }
 
 
+bool NameValueTable::LookupInt(const char16 *name, bool *found, int *value) {
+  assert(found);
+  assert(value);
+  if (!found || !value) {
+    return false;
+  }
+
+  SQLStatement statement;
+  if (!PrepareGetStatement(statement, name)) {
+    return false;
+  }
+
+  int result = statement.step();
+  if (SQLITE_ROW == result) {
+    *found = true;
+    (*value) = statement.column_int(0);
+    return true;
+  } else if (SQLITE_DONE == result) {
+    *found = false;
+    return true;
+  } else {
+    LOG(("NameValueTable::LookupInt unable to step statement: %d\n",
+         db_->GetErrorCode()));
+    return false;
+  }
+}
+
+
 bool NameValueTable::SetString(const char16 *name, const char16 *value) {
   SQLStatement statement;
   if (!PrepareSetStatement(statement, name)) {
@@ -43,6 +43,11 @@ class NameValueTable {
   // Gets an int value that was previously created with SetInt().
   bool GetInt(const char16 *name, int *value);
 
+  // Like GetInt(), but distinguishes a missing name from a failed query.
+  // Returns false only on error; *found says whether the name exists, and
+  // *value is only written when it does.
+  bool LookupInt(const char16 *name, bool *found, int *value);
+
   // Sets a string value.
   bool SetString(const char16 *name, const char16 *value);
 
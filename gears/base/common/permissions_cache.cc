@@ -0,0 +1,164 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/base/common/permissions_cache.h"
+
+#include <assert.h>
+#include "gears/base/common/thread_locals.h"
+
+const char16 *PermissionsCache::kPermissionsChangedTopic =
+                  STRING16(L"base:permissions:permissions-changed");
+
+static const ThreadLocals::Slot kThreadLocalKey = ThreadLocals::Alloc();
+
+static Mutex g_instance_lock;
+static PermissionsCache *g_instance = NULL;
+
+// static
+PermissionsCache *PermissionsCache::GetInstance() {
+  MutexLock locker(&g_instance_lock);
+  if (!g_instance) {
+    g_instance = new PermissionsCache();
+  }
+  return g_instance;
+}
+
+
+// static
+PermissionsCache::ThreadCache *PermissionsCache::GetThreadCache() {
+  ThreadCache *cache =
+      reinterpret_cast<ThreadCache*>(ThreadLocals::GetValue(kThreadLocalKey));
+  if (!cache) {
+    cache = new ThreadCache();
+    ThreadLocals::SetValue(kThreadLocalKey, cache, &DestroyThreadCache);
+  }
+  return cache;
+}
+
+
+// static
+void PermissionsCache::DestroyThreadCache(void *context) {
+  delete reinterpret_cast<ThreadCache*>(context);
+}
+
+
+AtomicWord PermissionsCache::GetGeneration() {
+  return AtomicIncrement(&generation_, 0);
+}
+
+
+bool PermissionsCache::Lookup(const std::string16 &origin_url,
+                              PermissionsDB::PermissionType type,
+                              PermissionsDB::PermissionValue *value) {
+  assert(value);
+  AtomicWord generation = GetGeneration();
+  ThreadCache *cache = GetThreadCache();
+  if (cache->generation != generation) {
+    cache->decisions.clear();
+    cache->generation = generation;
+  }
+
+  Key key(origin_url, type);
+  DecisionMap::const_iterator found = cache->decisions.find(key);
+  if (found != cache->decisions.end()) {
+    *value = found->second;
+    return true;
+  }
+
+  // Not yet seen on this thread, try the shared level. This is the only
+  // place a lookup can block, and it happens at most once per thread for
+  // each decision.
+  MutexLock lock(&shared_lock_);
+  if (shared_generation_ != generation) {
+    return false;
+  }
+  found = shared_decisions_.find(key);
+  if (found == shared_decisions_.end()) {
+    return false;
+  }
+  if (cache->decisions.size() >= kMaxCachedDecisions) {
+    cache->decisions.clear();
+  }
+  cache->decisions[key] = found->second;
+  *value = found->second;
+  return true;
+}
+
+
+void PermissionsCache::Store(const std::string16 &origin_url,
+                             PermissionsDB::PermissionType type,
+                             PermissionsDB::PermissionValue value,
+                             AtomicWord generation) {
+  if (generation != GetGeneration()) {
+    // Someone wrote a permission while our caller was reading it.
+    return;
+  }
+
+  Key key(origin_url, type);
+  ThreadCache *cache = GetThreadCache();
+  if (cache->generation != generation ||
+      cache->decisions.size() >= kMaxCachedDecisions) {
+    cache->decisions.clear();
+    cache->generation = generation;
+  }
+  cache->decisions[key] = value;
+
+  MutexLock lock(&shared_lock_);
+  if (shared_generation_ > generation) {
+    return;
+  }
+  if (shared_generation_ < generation ||
+      shared_decisions_.size() >= kMaxCachedDecisions) {
+    shared_decisions_.clear();
+    shared_generation_ = generation;
+  }
+  shared_decisions_[key] = value;
+}
+
+
+void PermissionsCache::Invalidate() {
+  AtomicIncrement(&generation_, 1);
+}
+
+
+void PermissionsCache::InvalidateAll() {
+  Invalidate();
+  MessageService::GetInstance()->NotifyObservers(kPermissionsChangedTopic,
+                                                 NULL);
+}
+
+
+void PermissionsCache::ObserveRemoteChanges() {
+  MessageService::GetInstance()->AddObserver(this, kPermissionsChangedTopic);
+}
+
+
+void PermissionsCache::OnNotify(MessageService *service,
+                                const char16 *topic,
+                                const NotificationData *data) {
+  // Notifications we sent ourselves arrive here too. Invalidating again is
+  // harmless, it only costs one extra query per decision.
+  Invalidate();
+}
@@ -0,0 +1,124 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GEARS_BASE_COMMON_PERMISSIONS_CACHE_H__
+#define GEARS_BASE_COMMON_PERMISSIONS_CACHE_H__
+
+#include <map>
+#include "gears/base/common/atomic_ops.h"
+#include "gears/base/common/message_service.h"
+#include "gears/base/common/mutex.h"
+#include "gears/base/common/permissions_db.h"
+#include "gears/base/common/string16.h"
+
+// A process-wide, read-mostly cache of permission decisions, used by
+// PermissionsDB::GetPermission() to avoid a SQLite query on every call.
+//
+// Decisions are kept at two levels. Each thread has its own map, which is
+// read without taking any locks. Behind that sits a map shared by all threads
+// and guarded by a mutex, so that new threads (workers, async tasks) can warm
+// up without touching the database. Both levels are tagged with a generation
+// number; bumping the process-wide generation atomically invalidates every
+// cached decision in every thread.
+//
+// PermissionsDB invalidates the cache whenever it writes a permission, and
+// broadcasts kPermissionsChangedTopic so that other processes sharing the
+// same permissions.db invalidate theirs as well.
+class PermissionsCache : public MessageObserverInterface {
+ public:
+  // Broadcast thru MessageService.NotifyObservers with a NULL data object
+  // whenever a permission value is written.
+  static const char16 *kPermissionsChangedTopic;
+
+  // Returns a pointer to the PermissionsCache singleton.
+  static PermissionsCache *GetInstance();
+
+  // Returns the current generation. Callers that intend to Store() a value
+  // read from the database must sample this before reading, so that a write
+  // which races with the read causes the stale value to be discarded.
+  AtomicWord GetGeneration();
+
+  // Returns true and sets *value if a decision for (origin_url, type) is
+  // cached for the current generation.
+  bool Lookup(const std::string16 &origin_url,
+              PermissionsDB::PermissionType type,
+              PermissionsDB::PermissionValue *value);
+
+  // Caches a decision that was read from the database while 'generation'
+  // was current. Does nothing if the cache has been invalidated since.
+  void Store(const std::string16 &origin_url,
+             PermissionsDB::PermissionType type,
+             PermissionsDB::PermissionValue value,
+             AtomicWord generation);
+
+  // Discards all cached decisions in this process.
+  void Invalidate();
+
+  // Invalidates this process's cache and tells other processes to do the
+  // same. Called after a permission has been written to the database.
+  void InvalidateAll();
+
+  // Registers to hear about permission changes made by other processes.
+  // Must be called on a thread that services its ThreadMessageQueue, such as
+  // the browser's main thread. Calling it more than once per thread is
+  // harmless.
+  void ObserveRemoteChanges();
+
+  // MessageObserverInterface implementation.
+  virtual void OnNotify(MessageService *service,
+                        const char16 *topic,
+                        const NotificationData *data);
+
+ private:
+  typedef std::pair<std::string16, PermissionsDB::PermissionType> Key;
+  typedef std::map<Key, PermissionsDB::PermissionValue> DecisionMap;
+
+  // The per-thread level of the cache.
+  struct ThreadCache {
+    ThreadCache() : generation(-1) {}
+    AtomicWord generation;
+    DecisionMap decisions;
+  };
+
+  PermissionsCache() : generation_(0), shared_generation_(0) {}
+
+  static ThreadCache *GetThreadCache();
+  static void DestroyThreadCache(void *context);
+
+  // Bounds the size of each level. Sites rarely have more than a handful of
+  // origins, so hitting this means something unusual is going on and we
+  // simply start over.
+  static const size_t kMaxCachedDecisions = 512;
+
+  AtomicWord generation_;
+
+  Mutex shared_lock_;
+  AtomicWord shared_generation_;  // Protected by shared_lock_.
+  DecisionMap shared_decisions_;  // Protected by shared_lock_.
+
+  DISALLOW_EVIL_CONSTRUCTORS(PermissionsCache);
+};
+
+#endif  // GEARS_BASE_COMMON_PERMISSIONS_CACHE_H__
@@ -25,8 +25,10 @@
 
 #include "gears/base/common/permissions_db.h"
 #include "gears/base/common/message_service.h"
+#include "gears/base/common/permissions_cache.h"
 #include "gears/base/common/sqlite_wrapper.h"
 #include "gears/base/common/thread_locals.h"
+#include "gears/base/common/trace_events.h"
 #include "gears/database2/database2_metadata.h"
 #include "gears/localserver/common/localserver_db.h"
 
@@ -41,6 +43,9 @@ static const char16 *kVersionKeyName = STRING16(L"Version");
 static const int kCurrentVersion = 9;
 static const int kOldestUpgradeableVersion = 1;
 
+// Set once a connection in this process has found the schema current.
+static SQLSchemaVerifiedFlag schema_verified;
+
 const char16 *PermissionsDB::kShortcutsChangedTopic = 
                   STRING16(L"base:permissions:shortcuts-changed");
 
@@ -53,6 +58,7 @@ PermissionsDB *PermissionsDB::GetDB() {
         ThreadLocals::GetValue(kThreadLocalKey));
   }
 
+  TRACE_EVENT("database", "PermissionsDB.FirstUse");
   PermissionsDB *db = new PermissionsDB();
 
   // If we can't initialize, we store NULL in the map so that we don't keep
@@ -91,13 +97,20 @@ bool PermissionsDB::Init() {
     return false;
   }
 
+  // Another connection in this process has already checked the schema.
+  if (schema_verified.IsSet()) {
+    return true;
+  }
+
   // Examine the contents of the database and determine if we have to
-  // instantiate or updgrade the schema.
+  // instantiate or updgrade the schema.  This is a plain read, so the common
+  // case of an up to date schema takes no write lock.
   int version = 0;
   settings_table_.GetInt(kVersionKeyName, &version);
 
   // if its the version we're expecting, great
   if (version == kCurrentVersion) {
+    schema_verified.Set();
     return true;
   }
 
@@ -112,6 +125,7 @@ bool PermissionsDB::Init() {
   // upgrade.
   settings_table_.GetInt(kVersionKeyName, &version);
   if (version == kCurrentVersion) {
+    schema_verified.Set();
     return true;
   } else if (version == 0) {
     // No database in place, create it.
@@ -141,7 +155,11 @@ bool PermissionsDB::Init() {
     return false;
   }
 
-  return transaction.Commit();
+  if (!transaction.Commit()) {
+    return false;
+  }
+  schema_verified.Set();
+  return true;
 }
 
 
@@ -155,10 +173,36 @@ bool PermissionsDB::ShouldSupressDialogs() {
 PermissionsDB::PermissionValue PermissionsDB::GetPermission(
     const SecurityOrigin &origin,
     PermissionType type) {
-  int retval_int = PERMISSION_NOT_SET;
+  PermissionsCache *cache = PermissionsCache::GetInstance();
+  PermissionValue value = PERMISSION_NOT_SET;
+  if (cache->Lookup(origin.url(), type, &value)) {
+    return value;
+  }
+
+  // Sample the generation before querying, so that a concurrent write
+  // causes the value we read to be discarded rather than cached.
+  AtomicWord generation = cache->GetGeneration();
+  if (!ReadPermission(origin, type, &value)) {
+    return PERMISSION_NOT_SET;
+  }
+  cache->Store(origin.url(), type, value, generation);
+  return value;
+}
+
+
+bool PermissionsDB::ReadPermission(const SecurityOrigin &origin,
+                                   PermissionType type,
+                                   PermissionValue *value) {
+  assert(value);
+  bool found = false;
+  int value_int = PERMISSION_NOT_SET;
   NameValueTable* table = GetTableForPermissionType(type);
-  table->GetInt(origin.url().c_str(), &retval_int);
-  return static_cast<PermissionsDB::PermissionValue>(retval_int);
+  if (!table->LookupInt(origin.url().c_str(), &found, &value_int)) {
+    return false;
+  }
+  *value = found ? static_cast<PermissionsDB::PermissionValue>(value_int)
+                 : PERMISSION_NOT_SET;
+  return true;
 }
 
 
@@ -180,6 +224,11 @@ void PermissionsDB::SetPermission(const SecurityOrigin &origin,
     assert(false);
   }
 
+  // SetPermission never runs inside a transaction, so the write above is
+  // already visible to other connections. Invalidating only now ensures no
+  // reader can cache the old value under the new generation.
+  PermissionsCache::GetInstance()->InvalidateAll();
+
   if ((type == PERMISSION_LOCAL_DATA) &&
       (value == PERMISSION_DENIED || value == PERMISSION_NOT_SET)) {
     // Remove Database content.
@@ -314,14 +363,24 @@ bool PermissionsDB::EnableGearsForWorker(const SecurityOrigin &worker_origin,
     }
   }
 
-  return transaction.Commit();
+  if (!transaction.Commit()) {
+    return false;
+  }
+  PermissionsCache::GetInstance()->InvalidateAll();
+  return true;
 }
 
 bool PermissionsDB::TryAllow(const SecurityOrigin &origin,
                              PermissionType type) {
 
   NameValueTable* table = GetTableForPermissionType(type);
-  switch (GetPermission(origin, type)) {
+  // This is a read-modify-write within a transaction, so read the database
+  // itself rather than a possibly stale cached value.
+  PermissionValue value = PERMISSION_NOT_SET;
+  if (!ReadPermission(origin, type, &value)) {
+    return false;
+  }
+  switch (value) {
     case PERMISSION_ALLOWED:
       return true;
     case PERMISSION_DENIED:
@@ -92,6 +92,8 @@ class PermissionsDB {
                      PermissionValue value);
 
   // Gets the Gears access level for a given SecurityOrigin and PermissionType.
+  // Answers from PermissionsCache when it can, so this is cheap enough to
+  // call for every intercepted request.
   PermissionsDB::PermissionValue GetPermission(const SecurityOrigin &origin,
                                                PermissionType type);
 
@@ -180,6 +182,7 @@ class PermissionsDB {
  private:
   // Private constructor, callers must use GetDB().
   PermissionsDB();
+  friend bool TestPermissionsDBAll(std::string16 *error);
 
   // Initializes the database. Must be called before other methods.
   bool Init();
@@ -213,6 +216,12 @@ class PermissionsDB {
   // Maps a permission type to an access table.
   NameValueTable* GetTableForPermissionType(PermissionType type);
 
+  // Reads a permission straight from the database, bypassing the cache.
+  // Returns false if the database could not be queried.
+  bool ReadPermission(const SecurityOrigin &origin,
+                      PermissionType type,
+                      PermissionValue *value);
+
   // Database we use to store capabilities information.
   SQLDatabase db_;
 
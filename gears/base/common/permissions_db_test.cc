@@ -24,8 +24,10 @@
 // ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
+#include "gears/base/common/permissions_cache.h"
 #include "gears/base/common/permissions_db.h"
 #include "gears/base/common/sqlite_wrapper.h"
+#include "gears/base/common/stopwatch.h"
 #include "gears/base/common/thread_locals.h"
 
 // For use with sort().
@@ -104,6 +106,54 @@ bool TestPermissionsDBAll(std::string16 *error) {
       bar, PermissionsDB::PERMISSION_LOCAL_DATA) ==
       PermissionsDB::PERMISSION_DENIED);
 
+  // Values written behind the cache's back are not seen until the cache is
+  // invalidated, as happens when another process changes a permission.
+  TEST_ASSERT(permissions->IsOriginAllowed(
+      foo, PermissionsDB::PERMISSION_LOCAL_DATA));
+  TEST_ASSERT(permissions->local_data_access_table_.SetInt(
+      foo.url().c_str(), PermissionsDB::PERMISSION_DENIED));
+  TEST_ASSERT(permissions->IsOriginAllowed(
+      foo, PermissionsDB::PERMISSION_LOCAL_DATA));
+  PermissionsCache::GetInstance()->OnNotify(
+      NULL, PermissionsCache::kPermissionsChangedTopic, NULL);
+  TEST_ASSERT(!permissions->IsOriginAllowed(
+      foo, PermissionsDB::PERMISSION_LOCAL_DATA));
+  TEST_ASSERT(permissions->local_data_access_table_.SetInt(
+      foo.url().c_str(), PermissionsDB::PERMISSION_ALLOWED));
+  PermissionsCache::GetInstance()->Invalidate();
+  TEST_ASSERT(permissions->IsOriginAllowed(
+      foo, PermissionsDB::PERMISSION_LOCAL_DATA));
+
+  // A value read before an invalidation must not be cached after it.
+  PermissionsCache *cache = PermissionsCache::GetInstance();
+  AtomicWord stale_generation = cache->GetGeneration();
+  cache->Invalidate();
+  cache->Store(bar.url(), PermissionsDB::PERMISSION_LOCAL_DATA,
+               PermissionsDB::PERMISSION_ALLOWED, stale_generation);
+  PermissionsDB::PermissionValue cached_value;
+  TEST_ASSERT(!cache->Lookup(bar.url(), PermissionsDB::PERMISSION_LOCAL_DATA,
+                             &cached_value));
+
+  // Microbenchmark: compare the cached lookup that WebCacheDB::ServiceImpl
+  // does for every intercepted url against a direct database query.
+  const int kNumLookups = 1000;
+  int64 start = GetTicks();
+  for (int i = 0; i < kNumLookups; ++i) {
+    PermissionsDB::PermissionValue value;
+    TEST_ASSERT(permissions->ReadPermission(
+        foo, PermissionsDB::PERMISSION_LOCAL_DATA, &value));
+  }
+  int64 uncached_micros = GetTickDeltaMicros(start, GetTicks());
+  start = GetTicks();
+  for (int i = 0; i < kNumLookups; ++i) {
+    TEST_ASSERT(permissions->IsOriginAllowed(
+        foo, PermissionsDB::PERMISSION_LOCAL_DATA));
+  }
+  int64 cached_micros = GetTickDeltaMicros(start, GetTicks());
+  LOG(("TestPermissionsDBAll - %d lookups: %d usec uncached, %d usec cached\n",
+       kNumLookups, static_cast<int>(uncached_micros),
+       static_cast<int>(cached_micros)));
+
   // Try searching for PERMISSION_NOT_SET (should not be allowed).
   std::vector<SecurityOrigin> list;
   TEST_ASSERT(!permissions->GetOriginsByValue(
@@ -26,7 +26,6 @@
 #include <assert.h>
 #include "gears/base/common/serialization.h"
 #include "gears/base/common/string_utils.h"
-#include "third_party/scoped_ptr/scoped_ptr.h"
 
 std::map<SerializableClassId, SerializableFactoryMethod>
   Serializable::constructors_;
@@ -54,28 +53,99 @@ Serializable *Serializable::CreateClass(SerializableClassId class_id) {
   }
 }
 
+// The header of a compact stream: two bytes that can not begin a legacy
+// stream, followed by the format version.
+static const uint8 kCompactSignature[] = { 0xFF, 0xFE };
+static const uint8 kCompactVersion = 1;
+static const size_t kCompactHeaderSize = sizeof(kCompactSignature) + 1;
+
+// Most messages are small, reserving this much up front means they are
+// written without reallocating the buffer as it grows.
+static const size_t kInitialReserve = 256;
+
+static const size_t kMaxVarintLength = 10;
+
+// Zigzag encoding maps signed values to unsigned values so that small
+// negative numbers also have short varint encodings.
+static inline uint64 ZigZagEncode(int64 value) {
+  return (static_cast<uint64>(value) << 1) ^ static_cast<uint64>(value >> 63);
+}
+
+static inline int64 ZigZagDecode(uint64 value) {
+  return static_cast<int64>(value >> 1) ^ -static_cast<int64>(value & 1);
+}
+
+static inline size_t EncodeVarint(uint64 value, uint8 *out) {
+  size_t length = 0;
+  while (value >= 0x80) {
+    out[length++] = static_cast<uint8>(value | 0x80);
+    value >>= 7;
+  }
+  out[length++] = static_cast<uint8>(value);
+  return length;
+}
+
+Serializer::Serializer(std::vector<uint8> *buf)
+    : buffer_(buf), format_(SERIALIZATION_FORMAT_COMPACT) {
+  Init();
+}
+
+Serializer::Serializer(std::vector<uint8> *buf, SerializationFormat format)
+    : buffer_(buf), format_(format) {
+  Init();
+}
+
+void Serializer::Init() {
+  assert(buffer_);
+  if (buffer_->capacity() - buffer_->size() < kInitialReserve) {
+    buffer_->reserve(buffer_->size() + kInitialReserve);
+  }
+  if (format_ == SERIALIZATION_FORMAT_COMPACT) {
+    WriteBytes(kCompactSignature, sizeof(kCompactSignature));
+    buffer_->push_back(kCompactVersion);
+  }
+}
+
+void Serializer::WriteVarint(uint64 value) {
+  uint8 bytes[kMaxVarintLength];
+  WriteBytes(bytes, EncodeVarint(value, bytes));
+}
+
 void Serializer::WriteBool(const bool data) {
   uint8 data_byte = data ? 1 : 0;
   WriteBytes(&data_byte, sizeof(uint8));
 }
 
 void Serializer::WriteInt(const int data) {
-  WriteBytes(&data, sizeof(int));
+  if (format_ == SERIALIZATION_FORMAT_COMPACT) {
+    WriteVarint(ZigZagEncode(data));
+  } else {
+    WriteBytes(&data, sizeof(int));
+  }
 }
 
 void Serializer::WriteInt64(const int64 data) {
-  WriteBytes(&data, sizeof(int64));
+  if (format_ == SERIALIZATION_FORMAT_COMPACT) {
+    WriteVarint(ZigZagEncode(data));
+  } else {
+    WriteBytes(&data, sizeof(int64));
+  }
 }
 
 void Serializer::WriteString(const char16 *data) {
-  std::string utf8_string;
-  if (!String16ToUTF8(data, &utf8_string)) {
+  utf8_.clear();
+  if (!AppendString16ToUTF8(data, std::char_traits<char16>::length(data),
+                            &utf8_)) {
     // If string conversion fails, insert an empty string.
-    utf8_string = "";
+    utf8_.clear();
   }
 
-  WriteInt(utf8_string.size());
-  WriteBytes(utf8_string.c_str(), utf8_string.size());
+  if (format_ == SERIALIZATION_FORMAT_COMPACT) {
+    WriteVarint(utf8_.size());
+  } else {
+    WriteInt(utf8_.size());
+  }
+  WriteBytes(utf8_.data(), utf8_.size());
 }
 
 void Serializer::WriteBytes(const void *data, size_t length) {
@@ -99,9 +169,15 @@ bool Serializer::WriteObject(const Serializable *obj) {
 
   WriteInt(class_id);
 
-  // Store the position of the size and insert a placeholder.
+  // Store the position of the size and insert a placeholder. In the compact
+  // format, the placeholder is a single byte which is widened below if the
+  // size does not fit.
   size_t size_position = buffer_->size();
-  WriteInt(0);
+  if (format_ == SERIALIZATION_FORMAT_COMPACT) {
+    buffer_->push_back(0);
+  } else {
+    WriteInt(0);
+  }
 
   size_t obj_data_position = buffer_->size();
   if (!obj->Serialize(this)) {
@@ -112,18 +188,48 @@ bool Serializer::WriteObject(const Serializable *obj) {
 
   // Store the size of the data in the serialized buffer.
   int size = static_cast<int>(buffer_->size() - obj_data_position);
-  *(reinterpret_cast<int*>(&buffer_->at(size_position))) = size;
+  if (format_ == SERIALIZATION_FORMAT_COMPACT) {
+    uint8 size_bytes[kMaxVarintLength];
+    size_t size_length = EncodeVarint(size, size_bytes);
+    if (size_length > 1) {
+      buffer_->insert(buffer_->begin() + obj_data_position, size_length - 1, 0);
+    }
+    memcpy(&buffer_->at(size_position), size_bytes, size_length);
+  } else {
+    memcpy(&buffer_->at(size_position), &size, sizeof(size));
+  }
 
   return true;
 }
 
+Deserializer::Deserializer(const uint8 *buf, size_t len)
+    : buffer_(buf), length_(len), read_pos_(0),
+      format_(SERIALIZATION_FORMAT_LEGACY), is_valid_(true) {
+  if (len >= kCompactHeaderSize &&
+      memcmp(buf, kCompactSignature, sizeof(kCompactSignature)) == 0) {
+    format_ = SERIALIZATION_FORMAT_COMPACT;
+    read_pos_ = kCompactHeaderSize;
+    if (buf[sizeof(kCompactSignature)] > kCompactVersion) {
+      LOG(("Deserializer - unsupported format version %d\n",
+           buf[sizeof(kCompactSignature)]));
+      is_valid_ = false;
+    }
+  }
+}
+
+Deserializer::Deserializer(const uint8 *buf, size_t len,
+                           SerializationFormat format)
+    : buffer_(buf), length_(len), read_pos_(0), format_(format),
+      is_valid_(true) {
+}
+
 bool Deserializer::CreateAndReadObject(Serializable **out) {
   assert(out);
 
   int class_id;
-  int size;
+  size_t size;
 
-  if (!ReadInt(&class_id) || !ReadInt(&size)) {
+  if (!ReadInt(&class_id) || !ReadSize(&size)) {
     *out = NULL;
     return false;
   }
@@ -134,6 +240,11 @@ bool Deserializer::CreateAndReadObject(Serializable **out) {
     return true;
   }
 
+  if (size > length_ - read_pos_) {
+    *out = NULL;
+    return false;
+  }
+
   // Store the object's data position, and advance the read position to the
   // next object.
   size_t object_data_position = read_pos_;
@@ -146,7 +257,7 @@ bool Deserializer::CreateAndReadObject(Serializable **out) {
 
   // Create an embedded deserializer to prevent us from reading past the end of
   // the object.
-  Deserializer deserializer(&buffer_[object_data_position], size);
+  Deserializer deserializer(buffer_ + object_data_position, size, format_);
   if ((*out)->Deserialize(&deserializer)) {
     return true;
   } else {
@@ -156,6 +267,36 @@ bool Deserializer::CreateAndReadObject(Serializable **out) {
   }
 }
 
+bool Deserializer::ReadVarint(uint64 *value) {
+  if (!is_valid_) return false;
+  uint64 result = 0;
+  for (size_t i = 0; i < kMaxVarintLength; ++i) {
+    if (read_pos_ >= length_) return false;
+    uint8 byte = buffer_[read_pos_++];
+    result |= static_cast<uint64>(byte & 0x7F) << (7 * i);
+    if (!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;  // Too long to be a valid varint
+}
+
+bool Deserializer::ReadSize(size_t *size) {
+  if (format_ == SERIALIZATION_FORMAT_COMPACT) {
+    uint64 value;
+    if (!ReadVarint(&value) || value > static_cast<uint64>(kint32max)) {
+      return false;
+    }
+    *size = static_cast<size_t>(value);
+  } else {
+    int value;
+    if (!ReadInt(&value) || value < 0) return false;
+    *size = static_cast<size_t>(value);
+  }
+  return true;
+}
+
 bool Deserializer::ReadBool(bool *output) {
   uint8 data;
   if (!ReadBytes(&data, sizeof(uint8))) return false;
@@ -164,28 +305,46 @@ bool Deserializer::ReadBool(bool *output) {
 }
 
 bool Deserializer::ReadInt(int *output) {
+  if (format_ == SERIALIZATION_FORMAT_COMPACT) {
+    uint64 value;
+    if (!ReadVarint(&value)) return false;
+    int64 decoded = ZigZagDecode(value);
+    if (decoded < kint32min || decoded > kint32max) return false;
+    *output = static_cast<int>(decoded);
+    return true;
+  }
   return ReadBytes(output, sizeof(int));
 }
 
 bool Deserializer::ReadInt64(int64 *output) {
+  if (format_ == SERIALIZATION_FORMAT_COMPACT) {
+    uint64 value;
+    if (!ReadVarint(&value)) return false;
+    *output = ZigZagDecode(value);
+    return true;
+  }
   return ReadBytes(output, sizeof(int64));
 }
 
-bool Deserializer::ReadString(std::string16 *output) {
-  int size;
-  if (!ReadInt(&size)) return false;
-
-  scoped_ptr<char> data(new char[size + 1]);
-  if (!ReadBytes(data.get(), size)) return false;
-
-  // The serialized data is not NULL terminated.
-  data.get()[size] = '\0';
+bool Deserializer::ReadStringView(const char **utf8, size_t *length) {
+  size_t size;
+  if (!ReadSize(&size) || size > length_ - read_pos_) return false;
+  *utf8 = reinterpret_cast<const char*>(buffer_ + read_pos_);
+  *length = size;
+  read_pos_ += size;
+  return true;
+}
 
-  return UTF8ToString16(data.get(), output);
+bool Deserializer::ReadString(std::string16 *output) {
+  const char *utf8;
+  size_t length;
+  if (!ReadStringView(&utf8, &length)) return false;
+  return UTF8ToString16(utf8, length, output);
 }
 
 bool Deserializer::ReadBytes(void *output, size_t length) {
-  if (read_pos_ + length > length_) return false;
+  if (!is_valid_) return false;
+  if (length > length_ - read_pos_) return false;
   memcpy(output, &buffer_[read_pos_], length);
   read_pos_ += length;
   return true;
@@ -27,6 +27,7 @@
 #define GEARS_BASE_COMMON_SERIALIZATION_H__
 
 #include <map>
+#include <string>
 #include <vector>
 #include "gears/base/common/basictypes.h"
 #include "gears/base/common/deletable.h"
@@ -45,11 +46,26 @@ enum SerializableClassId {
   SERIALIZABLE_NOTIFICATION,
   SERIALIZABLE_GEOLOCATION,
   SERIALIZABLE_DESKTOP,
+  SERIALIZABLE_CONSOLE_LOG_EVENT_BATCH,
 
   // The following value can not be changed for cross-version compatibility.
   SERIALIZABLE_DESKTOP_NOTIFICATION = 1000,
 };
 
+// The wire formats understood by Serializer and Deserializer.
+//
+// The legacy format writes ints and sizes as fixed width native integers.
+// The compact format writes them as (zigzag encoded) varints, and begins
+// with a short header that identifies it and its version. The header can
+// not be mistaken for the start of a legacy stream as long as class ids
+// stay below 0xFEFF. A Deserializer accepts either format, so only
+// writers need to know whether the reader may be an older build. Readers
+// reject compact streams with a version newer than they understand.
+enum SerializationFormat {
+  SERIALIZATION_FORMAT_LEGACY,
+  SERIALIZATION_FORMAT_COMPACT
+};
+
 class Serializable;
 class Serializer;
 class Deserializer;
@@ -80,8 +96,12 @@ class Serializable: public Deletable {
 // Wraps a buffer and manages writes to it from a serializable object.
 class Serializer {
  public:
-  // Construct a Serializer that will write data to the provided buffer.
-  Serializer(std::vector<uint8> *buf) : buffer_(buf) {}
+  // Construct a Serializer that will append compact data to the provided
+  // buffer. Gears only exchanges serialized data between processes of the
+  // same build, use SERIALIZATION_FORMAT_LEGACY if an older build may
+  // read the data.
+  Serializer(std::vector<uint8> *buf);
+  Serializer(std::vector<uint8> *buf, SerializationFormat format);
 
   // Serialize the provided object to the internal buffer.  If this is NULL,
   // SERIALIZABLE_NULL will be written with a size of 0.
@@ -94,16 +114,21 @@ class Serializer {
   void WriteBytes(const void *data, size_t length);
 
  private:
+  void Init();
+  void WriteVarint(uint64 value);
+
   std::vector<uint8> *buffer_;
+  SerializationFormat format_;
+  std::string utf8_;  // Reused for string conversions
+  DISALLOW_EVIL_CONSTRUCTORS(Serializer);
 };
 
 // Wraps a buffer and manages extracting serialized data from it.
 class Deserializer {
  public:
   // Create a Deserializer that will extract objects from the provided
-  // buffer.
-  Deserializer(const uint8 *buf, size_t len) :
-    buffer_(buf), length_(len), read_pos_(0) {}
+  // buffer, which may be in either format.
+  Deserializer(const uint8 *buf, size_t len);
 
   // Fill the provided pointer with a new object as read from the
   // serialized stream.  This can be NULL, if a NULL object was written.
@@ -115,10 +140,22 @@ class Deserializer {
   bool ReadString(std::string16 *output);
   bool ReadBytes(void *output, size_t length);
 
+  // Reads a string written by WriteString without copying it. On success,
+  // utf8 points to the UTF-8 encoded string within the buffer, which is
+  // not null terminated, and is valid for as long as the buffer is.
+  bool ReadStringView(const char **utf8, size_t *length);
+
  private:
+  Deserializer(const uint8 *buf, size_t len, SerializationFormat format);
+  bool ReadVarint(uint64 *value);
+  bool ReadSize(size_t *size);
+
   const uint8 *buffer_;
   size_t length_;
   size_t read_pos_;
+  SerializationFormat format_;
+  bool is_valid_;  // False if the format version is not supported
+  DISALLOW_EVIL_CONSTRUCTORS(Deserializer);
 };
 
 // A serializable string class
@@ -26,6 +26,7 @@
 #ifdef USING_CCTESTS
 
 #include "gears/base/common/serialization.h"
+#include "gears/base/common/stopwatch.h"
 #include "third_party/scoped_ptr/scoped_ptr.h"
 
 const int kTestBytesSize = 8;
@@ -133,6 +134,126 @@ bool TestSerialization(std::string16 *error) {
   TEST_ASSERT(*test_object != test0);
   TEST_ASSERT(*test_object == test1);
 
+  // Legacy streams are still readable, and are larger than compact ones
+  std::vector<uint8> legacy_buffer;
+  Serializer legacy_serializer(&legacy_buffer, SERIALIZATION_FORMAT_LEGACY);
+  TEST_ASSERT(legacy_serializer.WriteObject(&test0));
+  TEST_ASSERT(legacy_buffer.size() > buffer0.size());
+  Deserializer legacy_deserializer(&legacy_buffer.at(0), legacy_buffer.size());
+  TEST_ASSERT(legacy_deserializer.CreateAndReadObject(&output));
+  output_ptr.reset(output);
+  TEST_ASSERT(output);
+  test_object = static_cast<SerializationTest*>(output);
+  TEST_ASSERT(*test_object == test0);
+
+  // Boundary values round trip in both formats
+  const int ints[] = { 0, 1, -1, 63, -64, 64, 127, 128, kint32max, kint32min };
+  const int64 int64s[] = { 0, -1, kint64max, kint64min,
+                           GG_LONGLONG(1) << 40 };
+  const char16 *strings[] = {
+    STRING16(L""),
+    STRING16(L"ascii"),
+    STRING16(L"caf\x00E9 \x4E2D\x6587"),
+  };
+  for (int format = SERIALIZATION_FORMAT_LEGACY;
+       format <= SERIALIZATION_FORMAT_COMPACT; ++format) {
+    std::vector<uint8> buffer;
+    Serializer serializer(&buffer, static_cast<SerializationFormat>(format));
+    for (size_t i = 0; i < ARRAYSIZE(ints); ++i) {
+      serializer.WriteInt(ints[i]);
+    }
+    for (size_t i = 0; i < ARRAYSIZE(int64s); ++i) {
+      serializer.WriteInt64(int64s[i]);
+    }
+    for (size_t i = 0; i < ARRAYSIZE(strings); ++i) {
+      serializer.WriteString(strings[i]);
+    }
+    std::string long_utf8(300, 'x');  // a size that needs a longer varint
+    std::string16 long_string(300, 'x');
+    serializer.WriteString(long_string.c_str());
+
+    Deserializer deserializer(&buffer.at(0), buffer.size());
+    for (size_t i = 0; i < ARRAYSIZE(ints); ++i) {
+      int value;
+      TEST_ASSERT(deserializer.ReadInt(&value) && value == ints[i]);
+    }
+    for (size_t i = 0; i < ARRAYSIZE(int64s); ++i) {
+      int64 value;
+      TEST_ASSERT(deserializer.ReadInt64(&value) && value == int64s[i]);
+    }
+    for (size_t i = 0; i < ARRAYSIZE(strings); ++i) {
+      std::string16 value;
+      TEST_ASSERT(deserializer.ReadString(&value) && value == strings[i]);
+    }
+    const char *utf8;
+    size_t utf8_length;
+    TEST_ASSERT(deserializer.ReadStringView(&utf8, &utf8_length));
+    TEST_ASSERT(std::string(utf8, utf8_length) == long_utf8);
+    int value;
+    TEST_ASSERT(!deserializer.ReadInt(&value));  // at the end
+  }
+
+  // Objects whose size needs a multi-byte varint are written correctly
+  std::string16 long_string(1000, 'y');
+  SerializationTest long_test(true, 7, long_string.c_str(), test_bytes_0);
+  std::vector<uint8> long_buffer;
+  Serializer long_serializer(&long_buffer);
+  TEST_ASSERT(long_serializer.WriteObject(&long_test));
+  TEST_ASSERT(long_serializer.WriteObject(&test1));
+  TEST_ASSERT(long_serializer.WriteObject(NULL));
+  Deserializer long_deserializer(&long_buffer.at(0), long_buffer.size());
+  TEST_ASSERT(long_deserializer.CreateAndReadObject(&output));
+  output_ptr.reset(output);
+  TEST_ASSERT(output);
+  TEST_ASSERT(*static_cast<SerializationTest*>(output) == long_test);
+  TEST_ASSERT(long_deserializer.CreateAndReadObject(&output));
+  output_ptr.reset(output);
+  TEST_ASSERT(output);
+  TEST_ASSERT(*static_cast<SerializationTest*>(output) == test1);
+  TEST_ASSERT(long_deserializer.CreateAndReadObject(&output));
+  TEST_ASSERT(!output);
+
+  // Truncated streams and newer format versions are rejected
+  for (size_t length = 1; length < buffer0.size(); ++length) {
+    Deserializer truncated(&buffer0.at(0), length);
+    TEST_ASSERT(!truncated.CreateAndReadObject(&output));
+    TEST_ASSERT(!output);
+  }
+  std::vector<uint8> future_buffer(buffer0);
+  future_buffer[2] += 1;
+  Deserializer future_deserializer(&future_buffer.at(0), future_buffer.size());
+  TEST_ASSERT(!future_deserializer.CreateAndReadObject(&output));
+
+  // Compare the sizes and rates of the two formats for a typical message
+  const int kMessages = 20000;
+  SerializationTest message(true, 3, STRING16(L"Downloading files"),
+                            test_bytes_0);
+  for (int format = SERIALIZATION_FORMAT_LEGACY;
+       format <= SERIALIZATION_FORMAT_COMPACT; ++format) {
+    std::vector<uint8> buffer;
+    int64 start = GetTicks();
+    for (int i = 0; i < kMessages; ++i) {
+      buffer.clear();
+      Serializer serializer(&buffer, static_cast<SerializationFormat>(format));
+      serializer.WriteObject(&message);
+    }
+    int64 encode_micros = GetTickDeltaMicros(start, GetTicks());
+    start = GetTicks();
+    for (int i = 0; i < kMessages; ++i) {
+      Deserializer deserializer(&buffer.at(0), buffer.size());
+      TEST_ASSERT(deserializer.CreateAndReadObject(&output));
+      delete output;
+    }
+    int64 decode_micros = GetTickDeltaMicros(start, GetTicks());
+    LOG(("TestSerialization - %s: %d bytes, %d messages encoded in %dms, "
+         "decoded in %dms\n",
+         format == SERIALIZATION_FORMAT_LEGACY ? "legacy" : "compact",
+         static_cast<int>(buffer.size()), kMessages,
+         static_cast<int>(encode_micros / 1000),
+         static_cast<int>(decode_micros / 1000)));
+  }
+
+  LOG(("TestSerialization - passed\n"));
   return true;
 }
 #endif
@@ -0,0 +1,161 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/base/common/sha1.h"
+
+#include <assert.h>
+#include <string.h>
+
+// See FIPS 180-2, section 6.1.
+
+static inline uint32 RotateLeft(uint32 value, int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+Sha1::Sha1() {
+  Reset();
+}
+
+void Sha1::Reset() {
+  state_[0] = 0x67452301;
+  state_[1] = 0xefcdab89;
+  state_[2] = 0x98badcfe;
+  state_[3] = 0x10325476;
+  state_[4] = 0xc3d2e1f0;
+  length_ = 0;
+  buffer_length_ = 0;
+}
+
+void Sha1::Update(const uint8 *data, size_t length) {
+  length_ += length;
+
+  // Top up a partially filled block first
+  if (buffer_length_ > 0) {
+    size_t count = sizeof(buffer_) - buffer_length_;
+    if (count > length) {
+      count = length;
+    }
+    memcpy(buffer_ + buffer_length_, data, count);
+    buffer_length_ += count;
+    data += count;
+    length -= count;
+    if (buffer_length_ < sizeof(buffer_)) {
+      return;
+    }
+    ProcessBlock(buffer_);
+    buffer_length_ = 0;
+  }
+
+  // Process whole blocks directly from the input
+  while (length >= sizeof(buffer_)) {
+    ProcessBlock(data);
+    data += sizeof(buffer_);
+    length -= sizeof(buffer_);
+  }
+
+  memcpy(buffer_, data, length);
+  buffer_length_ = length;
+}
+
+void Sha1::Final(uint8 *digest) {
+  uint64 bit_length = length_ * 8;
+
+  // Append the '1' bit, pad with zeros to 56 mod 64 bytes, then append
+  // the message length in bits as a big-endian 64 bit number.
+  uint8 padding[sizeof(buffer_) + 8];
+  size_t padding_length =
+      (buffer_length_ < 56) ? (56 - buffer_length_) : (120 - buffer_length_);
+  memset(padding, 0, padding_length);
+  padding[0] = 0x80;
+  for (int i = 0; i < 8; ++i) {
+    padding[padding_length + i] =
+        static_cast<uint8>(bit_length >> (56 - i * 8));
+  }
+  Update(padding, padding_length + 8);
+  assert(buffer_length_ == 0);
+
+  for (int i = 0; i < kDigestSize; ++i) {
+    digest[i] = static_cast<uint8>(state_[i / 4] >> (24 - (i % 4) * 8));
+  }
+}
+
+void Sha1::FinalHex(std::string *hex) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  uint8 digest[kDigestSize];
+  Final(digest);
+  hex->resize(kDigestSize * 2);
+  for (int i = 0; i < kDigestSize; ++i) {
+    (*hex)[i * 2] = kHexDigits[digest[i] >> 4];
+    (*hex)[i * 2 + 1] = kHexDigits[digest[i] & 0x0f];
+  }
+}
+
+void Sha1::ProcessBlock(const uint8 *block) {
+  uint32 w[80];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = (static_cast<uint32>(block[i * 4]) << 24) |
+           (static_cast<uint32>(block[i * 4 + 1]) << 16) |
+           (static_cast<uint32>(block[i * 4 + 2]) << 8) |
+           static_cast<uint32>(block[i * 4 + 3]);
+  }
+  for (int i = 16; i < 80; ++i) {
+    w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  uint32 a = state_[0];
+  uint32 b = state_[1];
+  uint32 c = state_[2];
+  uint32 d = state_[3];
+  uint32 e = state_[4];
+
+  for (int i = 0; i < 80; ++i) {
+    uint32 f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+    uint32 temp = RotateLeft(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = RotateLeft(b, 30);
+    b = a;
+    a = temp;
+  }
+
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+  state_[4] += e;
+}
@@ -0,0 +1,84 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <string.h>
+#include "gears/base/common/sha1.h"
+#include "gears/base/common/common.h"
+
+#ifdef USING_CCTESTS
+
+bool TestSha1(std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestSha1 - failed (%d)\n", __LINE__)); \
+    assert(error); \
+    *error += STRING16(L"TestSha1 - failed. "); \
+    return false; \
+  } \
+}
+
+  // Test vectors from FIPS 180-2, plus the empty string
+  const struct {
+    const char *input;
+    const char *digest;
+  } kVectors[] = {
+    { "",
+      "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+    { "abc",
+      "a9993e364706816aba3e25717850c26c9cd0d89d" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+      "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+  };
+
+  Sha1 sha1;
+  std::string hex;
+  for (size_t i = 0; i < ARRAYSIZE(kVectors); ++i) {
+    sha1.Reset();
+    sha1.Update(reinterpret_cast<const uint8*>(kVectors[i].input),
+                strlen(kVectors[i].input));
+    sha1.FinalHex(&hex);
+    TEST_ASSERT(hex == kVectors[i].digest);
+  }
+
+  // One million 'a's, fed in uneven pieces to exercise the buffering
+  std::string a_block(997, 'a');
+  sha1.Reset();
+  size_t remaining = 1000000;
+  while (remaining > 0) {
+    size_t count = remaining < a_block.size() ? remaining : a_block.size();
+    sha1.Update(reinterpret_cast<const uint8*>(a_block.data()), count);
+    remaining -= count;
+  }
+  sha1.FinalHex(&hex);
+  TEST_ASSERT(hex == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+
+  LOG(("TestSha1 - passed\n"));
+  return true;
+}
+
+#endif  // USING_CCTESTS
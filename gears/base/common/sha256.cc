@@ -0,0 +1,186 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/base/common/sha256.h"
+
+#include <assert.h>
+#include <string.h>
+
+// See FIPS 180-2, section 6.2.
+
+static const uint32 kRoundConstants[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32 RotateRight(uint32 value, int bits) {
+  return (value >> bits) | (value << (32 - bits));
+}
+
+Sha256::Sha256() {
+  Reset();
+}
+
+void Sha256::Reset() {
+  state_[0] = 0x6a09e667;
+  state_[1] = 0xbb67ae85;
+  state_[2] = 0x3c6ef372;
+  state_[3] = 0xa54ff53a;
+  state_[4] = 0x510e527f;
+  state_[5] = 0x9b05688c;
+  state_[6] = 0x1f83d9ab;
+  state_[7] = 0x5be0cd19;
+  length_ = 0;
+  buffer_length_ = 0;
+}
+
+void Sha256::Update(const uint8 *data, size_t length) {
+  length_ += length;
+
+  // Top up a partially filled block first
+  if (buffer_length_ > 0) {
+    size_t count = sizeof(buffer_) - buffer_length_;
+    if (count > length) {
+      count = length;
+    }
+    memcpy(buffer_ + buffer_length_, data, count);
+    buffer_length_ += count;
+    data += count;
+    length -= count;
+    if (buffer_length_ < sizeof(buffer_)) {
+      return;
+    }
+    ProcessBlock(buffer_);
+    buffer_length_ = 0;
+  }
+
+  // Process whole blocks directly from the input
+  while (length >= sizeof(buffer_)) {
+    ProcessBlock(data);
+    data += sizeof(buffer_);
+    length -= sizeof(buffer_);
+  }
+
+  memcpy(buffer_, data, length);
+  buffer_length_ = length;
+}
+
+void Sha256::Final(uint8 *digest) {
+  uint64 bit_length = length_ * 8;
+
+  // The padding is the same as for SHA-1.
+  uint8 padding[sizeof(buffer_) + 8];
+  size_t padding_length =
+      (buffer_length_ < 56) ? (56 - buffer_length_) : (120 - buffer_length_);
+  memset(padding, 0, padding_length);
+  padding[0] = 0x80;
+  for (int i = 0; i < 8; ++i) {
+    padding[padding_length + i] =
+        static_cast<uint8>(bit_length >> (56 - i * 8));
+  }
+  Update(padding, padding_length + 8);
+  assert(buffer_length_ == 0);
+
+  for (int i = 0; i < kDigestSize; ++i) {
+    digest[i] = static_cast<uint8>(state_[i / 4] >> (24 - (i % 4) * 8));
+  }
+}
+
+void Sha256::FinalHex(std::string *hex) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  uint8 digest[kDigestSize];
+  Final(digest);
+  hex->resize(kDigestSize * 2);
+  for (int i = 0; i < kDigestSize; ++i) {
+    (*hex)[i * 2] = kHexDigits[digest[i] >> 4];
+    (*hex)[i * 2 + 1] = kHexDigits[digest[i] & 0x0f];
+  }
+}
+
+void Sha256::ProcessBlock(const uint8 *block) {
+  uint32 w[64];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = (static_cast<uint32>(block[i * 4]) << 24) |
+           (static_cast<uint32>(block[i * 4 + 1]) << 16) |
+           (static_cast<uint32>(block[i * 4 + 2]) << 8) |
+           static_cast<uint32>(block[i * 4 + 3]);
+  }
+  for (int i = 16; i < 64; ++i) {
+    uint32 s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^
+                (w[i - 15] >> 3);
+    uint32 s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^
+                (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32 a = state_[0];
+  uint32 b = state_[1];
+  uint32 c = state_[2];
+  uint32 d = state_[3];
+  uint32 e = state_[4];
+  uint32 f = state_[5];
+  uint32 g = state_[6];
+  uint32 h = state_[7];
+
+  for (int i = 0; i < 64; ++i) {
+    uint32 s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+    uint32 choose = (e & f) ^ (~e & g);
+    uint32 temp1 = h + s1 + choose + kRoundConstants[i] + w[i];
+    uint32 s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+    uint32 majority = (a & b) ^ (a & c) ^ (b & c);
+    uint32 temp2 = s0 + majority;
+    h = g;
+    g = f;
+    f = e;
+    e = d + temp1;
+    d = c;
+    c = b;
+    b = a;
+    a = temp1 + temp2;
+  }
+
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+  state_[4] += e;
+  state_[5] += f;
+  state_[6] += g;
+  state_[7] += h;
+}
@@ -0,0 +1,64 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GEARS_BASE_COMMON_SHA256_H__
+#define GEARS_BASE_COMMON_SHA256_H__
+
+#include <string>
+#include "gears/base/common/basictypes.h"
+
+// Computes the SHA-256 digest of a stream of bytes. Used the same way as
+// Sha1.
+class Sha256 {
+ public:
+  static const int kDigestSize = 32;
+
+  Sha256();
+
+  // Discards any data seen so far.
+  void Reset();
+
+  // Feeds length bytes into the digest.
+  void Update(const uint8 *data, size_t length);
+
+  // Completes the computation and writes kDigestSize bytes to digest.
+  // Reset() must be called before the object is used again.
+  void Final(uint8 *digest);
+
+  // Completes the computation and returns the digest as lower case hex.
+  void FinalHex(std::string *hex);
+
+ private:
+  void ProcessBlock(const uint8 *block);
+
+  uint32 state_[8];
+  uint64 length_;  // in bytes
+  uint8 buffer_[64];
+  size_t buffer_length_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(Sha256);
+};
+
+#endif  // GEARS_BASE_COMMON_SHA256_H__
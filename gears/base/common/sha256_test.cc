@@ -0,0 +1,88 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include <string.h>
+#include "gears/base/common/sha256.h"
+#include "gears/base/common/common.h"
+
+#ifdef USING_CCTESTS
+
+bool TestSha256(std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestSha256 - failed (%d)\n", __LINE__)); \
+    assert(error); \
+    *error += STRING16(L"TestSha256 - failed. "); \
+    return false; \
+  } \
+}
+
+  // Test vectors from FIPS 180-2, plus the empty string
+  const struct {
+    const char *input;
+    const char *digest;
+  } kVectors[] = {
+    { "",
+      "e3b0c44298fc1c149afbf4c8996fb924"
+      "27ae41e4649b934ca495991b7852b855" },
+    { "abc",
+      "ba7816bf8f01cfea414140de5dae2223"
+      "b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+      "248d6a61d20638b8e5c026930c3e6039"
+      "a33ce45964ff2167f6ecedd419db06c1" },
+  };
+
+  Sha256 sha256;
+  std::string hex;
+  for (size_t i = 0; i < ARRAYSIZE(kVectors); ++i) {
+    sha256.Reset();
+    sha256.Update(reinterpret_cast<const uint8*>(kVectors[i].input),
+                  strlen(kVectors[i].input));
+    sha256.FinalHex(&hex);
+    TEST_ASSERT(hex == kVectors[i].digest);
+  }
+
+  // One million 'a's, fed in uneven pieces to exercise the buffering
+  std::string a_block(997, 'a');
+  sha256.Reset();
+  size_t remaining = 1000000;
+  while (remaining > 0) {
+    size_t count = remaining < a_block.size() ? remaining : a_block.size();
+    sha256.Update(reinterpret_cast<const uint8*>(a_block.data()), count);
+    remaining -= count;
+  }
+  sha256.FinalHex(&hex);
+  TEST_ASSERT(hex == "cdc76e5c9914fb9281a1c7e284d73e67"
+                     "f1809a48a497200e046d39ccc7112cd0");
+
+  LOG(("TestSha256 - passed\n"));
+  return true;
+}
+
+#endif  // USING_CCTESTS
@@ -28,6 +28,7 @@
 
 #include <assert.h>
 #include <vector>
+#include "gears/base/common/atomic_ops.h"
 #include "gears/base/common/common.h"
 #include "gears/base/common/string16.h"
 #ifdef OS_ANDROID
@@ -42,6 +43,7 @@ class Mutex;
 
 // forward declarations of classes defined here
 class SQLTransaction;
+class SQLSchemaVerifiedFlag;
 class scoped_sqlite3_stmt_ptr;
 class SQLStatement;
 
@@ -289,6 +291,29 @@ class SQLTransaction {
 };
 
 
+//------------------------------------------------------------------------------
+// Records that one of our databases has been found to have the current schema
+// version.  Each thread opens its own connection, and each connection has to
+// know the schema is current before it is used.  Once one connection in the
+// process has checked, the rest can skip the check entirely, without touching
+// the database file's locks, because schema versions only ever move forward.
+// Declare instances as globals; zero-initialization means "not verified".
+//------------------------------------------------------------------------------
+class SQLSchemaVerifiedFlag {
+ public:
+  bool IsSet() {
+    // Swapping 1 for 1 is an atomic read with a full barrier.
+    return CompareAndSwap(&verified_, 1, 1) == 1;
+  }
+  void Set() {
+    AtomicExchange(&verified_, 1);
+  }
+
+ private:
+  volatile AtomicWord verified_;
+};
+
+
 //------------------------------------------------------------------------------
 // A scoped sqlite statement that finalizes when it goes out of scope.
 //------------------------------------------------------------------------------
@@ -25,7 +25,14 @@
 
 #include <limits.h>
 #include "gears/base/common/string_utils.h"
-#include "third_party/convert_utf/ConvertUTF.h"
+
+// SSE2 is always available on x86-64, and on x86 when the compiler is told it
+// may use it. Other targets use the scalar loops alone.
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEARS_UTF_USE_SSE2 1
+#endif
 
 #if defined(OS_ANDROID)
 // Android is missing wcslen. This is just a wide character strlen.
@@ -130,76 +137,320 @@ const char16 *memmatch(const char16 *haystack, size_t haylen,
                 ::memmatch(haystack, haylen, needle, neelen);
 }
 
+//------------------------------------------------------------------------------
+// UTF-8 <-> UTF-16 conversion
+//
+// These routines accept exactly the inputs that ConvertUTF's strictConversion
+// mode accepts, but they size the output with a single counting pass and copy
+// runs of ASCII a block at a time. Pages are overwhelmingly ASCII, so the block
+// path is what most calls spend their time in.
+//------------------------------------------------------------------------------
+
+static inline bool IsUTF8Trail(unsigned char c) {
+  return (c & 0xC0) == 0x80;
+}
+
+// Returns the number of UTF-16 code units needed for a valid UTF-8 input of
+// this length. For an invalid input the count is still an upper bound on
+// what the decoder writes before it fails.
+static size_t CountUTF16Units(const unsigned char *in, size_t len) {
+  size_t units = 0;
+  size_t i = 0;
+#ifdef GEARS_UTF_USE_SSE2
+  // Every byte other than a trail byte starts a unit, and four byte leads
+  // start a second one. Counts are kept per byte lane and folded into units
+  // before they can reach 256.
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i last_trail = _mm_set1_epi8(static_cast<char>(0xBF));
+  const __m128i lead_mask = _mm_set1_epi8(static_cast<char>(0xF8));
+  const __m128i four_byte_lead = _mm_set1_epi8(static_cast<char>(0xF0));
+  while (len - i >= 16) {
+    size_t chunk_end = i + 16 * std::min<size_t>((len - i) / 16, 127);
+    __m128i counts = zero;
+    for (; i < chunk_end; i += 16) {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+      // As signed bytes, trail bytes are exactly those <= (char)0xBF.
+      counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(bytes, last_trail));
+      counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(
+          _mm_and_si128(bytes, lead_mask), four_byte_lead));
+    }
+    __m128i sums = _mm_sad_epu8(counts, zero);
+    units += _mm_cvtsi128_si32(sums) +
+             _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+  }
+#endif
+  for (; i < len; ++i) {
+    unsigned char c = in[i];
+    units += !IsUTF8Trail(c) + (c >= 0xF0 && c <= 0xF7);
+  }
+  return units;
+}
+
+// Decodes [in, in + len) into out, which must have room for
+// CountUTF16Units() units. Returns the number of units written, or -1 if the
+// input is not well-formed UTF-8.
+static int DecodeUTF8(const unsigned char *in, size_t len, char16 *out) {
+  const unsigned char *p = in;
+  const unsigned char *end = in + len;
+  char16 *q = out;
+
+  while (p < end) {
+    unsigned char c = *p;
+    if (c < 0x80) {
+#ifdef GEARS_UTF_USE_SSE2
+      // Copy a run of ASCII sixteen bytes at a time. The run is only looked
+      // for once we are back in ASCII, so mostly multi-byte text does not pay
+      // for a failed block test on every character.
+      const unsigned char *run_start = p;
+      const __m128i zero = _mm_setzero_si128();
+      while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        if (_mm_movemask_epi8(bytes) != 0) break;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(q),
+                         _mm_unpacklo_epi8(bytes, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(q + 8),
+                         _mm_unpackhi_epi8(bytes, zero));
+        p += 16;
+        q += 16;
+      }
+      if (p != run_start) continue;
+#endif
+      *q++ = c;
+      ++p;
+      continue;
+    }
+
+    if (c >= 0xC2 && c <= 0xDF) {
+      if (end - p < 2 || !IsUTF8Trail(p[1])) return -1;
+      *q++ = static_cast<char16>(((c & 0x1F) << 6) | (p[1] & 0x3F));
+      p += 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+      if (end - p < 3) return -1;
+      unsigned char c1 = p[1];
+      // Reject overlong forms (E0 80..9F) and surrogates (ED A0..BF).
+      unsigned char lo = (c == 0xE0) ? 0xA0 : 0x80;
+      unsigned char hi = (c == 0xED) ? 0x9F : 0xBF;
+      if (c1 < lo || c1 > hi || !IsUTF8Trail(p[2])) return -1;
+      *q++ = static_cast<char16>(((c & 0x0F) << 12) | ((c1 & 0x3F) << 6) |
+                                 (p[2] & 0x3F));
+      p += 3;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+      if (end - p < 4) return -1;
+      unsigned char c1 = p[1];
+      // Reject overlong forms (F0 80..8F) and values above U+10FFFF.
+      unsigned char lo = (c == 0xF0) ? 0x90 : 0x80;
+      unsigned char hi = (c == 0xF4) ? 0x8F : 0xBF;
+      if (c1 < lo || c1 > hi || !IsUTF8Trail(p[2]) || !IsUTF8Trail(p[3])) {
+        return -1;
+      }
+      unsigned int ch = ((c & 0x07) << 18) | ((c1 & 0x3F) << 12) |
+                        ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+      ch -= 0x10000;
+      *q++ = static_cast<char16>(0xD800 + (ch >> 10));
+      *q++ = static_cast<char16>(0xDC00 + (ch & 0x3FF));
+      p += 4;
+    } else {
+      // Stray trail byte, overlong two byte lead (C0, C1) or F5..FF.
+      return -1;
+    }
+  }
+  return static_cast<int>(q - out);
+}
+
+// Returns the number of UTF-8 bytes needed for a valid UTF-16 input. As
+// above, this is an upper bound for invalid input.
+#ifdef GEARS_UTF_USE_SSE2
+// Adds up eight 16 bit lanes, each of which must be below 0x8000.
+static inline size_t SumLanes16(__m128i v) {
+  v = _mm_madd_epi16(v, _mm_set1_epi16(1));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+#endif
+
+static size_t CountUTF8Bytes(const char16 *in, size_t len) {
+  size_t bytes = 0;
+  size_t i = 0;
+#ifdef GEARS_UTF_USE_SSE2
+  // Start from three bytes a unit, take one off for each unit below 0x800
+  // and another for each below 0x80. A surrogate pair takes four bytes, so
+  // add one for each high surrogate and take three off for each low one.
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one_byte_mask = _mm_set1_epi16(static_cast<short>(0xFF80));
+  const __m128i two_byte_mask = _mm_set1_epi16(static_cast<short>(0xF800));
+  const __m128i surrogate_mask = _mm_set1_epi16(static_cast<short>(0xFC00));
+  const __m128i high_surrogate = _mm_set1_epi16(static_cast<short>(0xD800));
+  const __m128i low_surrogate = _mm_set1_epi16(static_cast<short>(0xDC00));
+  while (len - i >= 8) {
+    size_t chunk_units = 8 * std::min<size_t>((len - i) / 8, 8192);
+    size_t chunk_end = i + chunk_units;
+    __m128i shorter = zero;
+    __m128i highs = zero;
+    __m128i lows = zero;
+    for (; i < chunk_end; i += 8) {
+      __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+      shorter = _mm_sub_epi16(shorter, _mm_cmpeq_epi16(
+          _mm_and_si128(units, one_byte_mask), zero));
+      shorter = _mm_sub_epi16(shorter, _mm_cmpeq_epi16(
+          _mm_and_si128(units, two_byte_mask), zero));
+      __m128i surrogate_bits = _mm_and_si128(units, surrogate_mask);
+      highs = _mm_sub_epi16(highs,
+                            _mm_cmpeq_epi16(surrogate_bits, high_surrogate));
+      lows = _mm_sub_epi16(lows,
+                           _mm_cmpeq_epi16(surrogate_bits, low_surrogate));
+    }
+    bytes += 3 * chunk_units + SumLanes16(highs);
+    bytes -= SumLanes16(shorter) + 3 * SumLanes16(lows);
+  }
+#endif
+  for (; i < len; ++i) {
+    char16 c = in[i];
+    // Written without branches for the common cases; mixed ASCII and CJK
+    // text defeats branch prediction otherwise.
+    bytes += 1 + (c >= 0x80) + (c >= 0x800);
+    if ((c & 0xF800) == 0xD800) {
+      // Count all four bytes of a pair against the high surrogate and none
+      // against the low one. Unpaired surrogates fail in EncodeUTF8.
+      if (c < 0xDC00) {
+        bytes += 1;
+      } else {
+        bytes -= 3;
+      }
+    }
+  }
+  return bytes;
+}
+
+// Encodes [in, in + len) into out, which must have room for
+// CountUTF8Bytes() bytes. Returns the number of bytes written, or -1 if the
+// input contains an unpaired surrogate.
+static int EncodeUTF8(const char16 *in, size_t len, unsigned char *out) {
+  const char16 *p = in;
+  const char16 *end = in + len;
+  unsigned char *q = out;
+
+  while (p < end) {
+    unsigned int c = *p;
+    if (c < 0x80) {
+#ifdef GEARS_UTF_USE_SSE2
+      // As in DecodeUTF8, copy runs of ASCII eight units at a time.
+      const char16 *run_start = p;
+      const __m128i non_ascii = _mm_set1_epi16(static_cast<short>(0xFF80));
+      const __m128i zero = _mm_setzero_si128();
+      while (end - p >= 8) {
+        __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i high_bits = _mm_and_si128(units, non_ascii);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high_bits, zero)) != 0xFFFF) {
+          break;
+        }
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(q),
+                         _mm_packus_epi16(units, units));
+        p += 8;
+        q += 8;
+      }
+      if (p != run_start) continue;
+#endif
+      *q++ = static_cast<unsigned char>(c);
+      ++p;
+      continue;
+    }
+
+    ++p;
+    if (c < 0x800) {
+      *q++ = static_cast<unsigned char>(0xC0 | (c >> 6));
+      *q++ = static_cast<unsigned char>(0x80 | (c & 0x3F));
+    } else if ((c & 0xF800) != 0xD800) {
+      q[0] = static_cast<unsigned char>(0xE0 | (c >> 12));
+      q[1] = static_cast<unsigned char>(0x80 | ((c >> 6) & 0x3F));
+      q[2] = static_cast<unsigned char>(0x80 | (c & 0x3F));
+      q += 3;
+    } else {
+      // A high surrogate must be followed by a low one; anything else is an
+      // unpaired surrogate.
+      if (c > 0xDBFF || p == end) return -1;
+      unsigned int c2 = *p++;
+      if (c2 < 0xDC00 || c2 > 0xDFFF) return -1;
+      c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+      q[0] = static_cast<unsigned char>(0xF0 | (c >> 18));
+      q[1] = static_cast<unsigned char>(0x80 | ((c >> 12) & 0x3F));
+      q[2] = static_cast<unsigned char>(0x80 | ((c >> 6) & 0x3F));
+      q[3] = static_cast<unsigned char>(0x80 | (c & 0x3F));
+      q += 4;
+    }
+  }
+  return static_cast<int>(q - out);
+}
+
 //------------------------------------------------------------------------------
 // UTF8ToString16
 //------------------------------------------------------------------------------
-bool UTF8ToString16(const char *in, int len, std::string16 *out16) {
+bool AppendUTF8ToString16(const char *in, int len, std::string16 *out16) {
   assert(in);
   assert(len >= 0);
   assert(out16);
 
   if (len <= 0) {
-    *out16 = STRING16(L"");
     return true;
   }
 
-  const UTF8 *source_ptr = reinterpret_cast<const UTF8*>(in);
-  const UTF8 *source_end_ptr = source_ptr + len;  // should point 'beyond last'
-
-  // UTF16 string has at most as many 'characters' as UTF8 one.
-  out16->resize(len);
-  UTF16 *target_ptr = reinterpret_cast<UTF16*>(&(*out16)[0]);
-  UTF16 *target_ptr_original = target_ptr;
-  UTF16 *target_end_ptr = target_ptr + len;
-  ConversionResult result = ConvertUTF8toUTF16(&source_ptr, source_end_ptr,
-                                               &target_ptr, target_end_ptr,
-                                               strictConversion);
+  const unsigned char *source = reinterpret_cast<const unsigned char*>(in);
+  size_t units = CountUTF16Units(source, len);
+  size_t original_size = out16->size();
+  if (units > static_cast<size_t>(INT_MAX) - original_size) {  // overflow
+    return false;
+  }
 
-  // Resize to be the size of the # of converted characters.
-  // Note that stl strings always account for \0 end-of-line character
-  // automatically, so no need to do "+1" here.
-  out16->resize(result == conversionOK ? target_ptr - target_ptr_original : 0);
+  out16->resize(original_size + units);
+  int written = DecodeUTF8(source, len, &(*out16)[original_size]);
+  if (written < 0) {
+    out16->resize(original_size);
+    return false;
+  }
+  assert(static_cast<size_t>(written) == units);
+  return true;
+}
 
-  return result == conversionOK;
+bool UTF8ToString16(const char *in, int len, std::string16 *out16) {
+  assert(out16);
+  out16->clear();
+  return AppendUTF8ToString16(in, len, out16);
 }
 
 //------------------------------------------------------------------------------
 // String16ToUTF8
 //------------------------------------------------------------------------------
-bool String16ToUTF8(const char16 *in, int len, std::string *out8) {
+bool AppendString16ToUTF8(const char16 *in, int len, std::string *out8) {
   assert(in);
   assert(len >= 0);
   assert(out8);
 
   if (len <= 0) {
-    *out8 = "";
     return true;
   }
 
-  const UTF16 *source_ptr = reinterpret_cast<const UTF16*>(in);
-  const UTF16 *source_end_ptr = source_ptr + len;  // should point 'beyond last'
+  size_t bytes = CountUTF8Bytes(in, len);
+  size_t original_size = out8->size();
+  if (bytes > static_cast<size_t>(INT_MAX) - original_size) {  // overflow
+    return false;
+  }
 
-  // UTF8 string has at most 4 times as many 'characters' as UTF16 one.
-  if (len > INT_MAX / 4) {  // overflow check
-    *out8 = "";
+  out8->resize(original_size + bytes);
+  unsigned char *target =
+      reinterpret_cast<unsigned char*>(&(*out8)[0]) + original_size;
+  int written = EncodeUTF8(in, len, target);
+  if (written < 0) {
+    out8->resize(original_size);
     return false;
   }
-  int out_len = len * 4;
-
-  out8->resize(out_len);
-  UTF8 *target_ptr = reinterpret_cast<UTF8*>(&(*out8)[0]);
-  UTF8 *target_ptr_original = target_ptr;
-  UTF8 *target_end_ptr = target_ptr + out_len;
-  ConversionResult result = ConvertUTF16toUTF8(&source_ptr, source_end_ptr,
-                                               &target_ptr, target_end_ptr,
-                                               strictConversion);
-
-  // Resize to be the size of the # of converted characters.
-  // Note that stl strings always account for \0 end-of-line character
-  // automatically, so no need to do "+1" here.
-  out8->resize(result == conversionOK ? target_ptr - target_ptr_original : 0);
-
-  return result == conversionOK;
+  assert(static_cast<size_t>(written) == bytes);
+  return true;
+}
+
+bool String16ToUTF8(const char16 *in, int len, std::string *out8) {
+  assert(out8);
+  out8->clear();
+  return AppendString16ToUTF8(in, len, out8);
 }
 
 //------------------------------------------------------------------------------
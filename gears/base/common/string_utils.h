@@ -336,8 +336,15 @@ inline char IntToHex(int i) {
 // Character encoding conversions
 // ----------------------------------------------------------------------
 
+// Converts between UTF-8 and UTF-16. Ill-formed input (including overlong
+// forms, encoded surrogates and unpaired surrogates) is rejected, in which
+// case the output is left empty.
 bool UTF8ToString16(const char *in, int len, std::string16 *out16);
 
+// Like UTF8ToString16, but appends to out16 instead of replacing it. On
+// error out16 is left as it was.
+bool AppendUTF8ToString16(const char *in, int len, std::string16 *out16);
+
 inline bool UTF8ToString16(const char *in, std::string16 *out16) {
   assert(in);
   return UTF8ToString16(in, strlen(in), out16);
@@ -361,6 +368,10 @@ inline std::string16 UTF8ToString16(const std::string &in) {
 
 bool String16ToUTF8(const char16 *in, int len, std::string *out8);
 
+// Like String16ToUTF8, but appends to out8 instead of replacing it. On error
+// out8 is left as it was.
+bool AppendString16ToUTF8(const char16 *in, int len, std::string *out8);
+
 inline bool String16ToUTF8(const char16 *in, std::string *out8) {
   assert(in);
   return String16ToUTF8(in, std::char_traits<char16>::length(in), out8);
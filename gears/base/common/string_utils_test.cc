@@ -27,7 +27,9 @@
 
 #include <string>
 #include "gears/base/common/common.h"
+#include "gears/base/common/stopwatch.h"
 #include "gears/base/common/string_utils.h"
+#include "third_party/convert_utf/ConvertUTF.h"
 
 // We don't use google3/testing/base/gunit because our tests depend of
 // browser specific code that needs to run in the context of the browser.
@@ -37,6 +39,8 @@ static bool TestStrUtilsReplaceAll();
 static bool TestStringCompareIgnoreCase();
 static bool TestStringMatch();
 static bool TestUTFConversion();
+static bool TestUTFConversionEdgeCases();
+static bool TestUTFConversionThroughput();
 static bool TestStringToInteger();
 
 bool TestStringUtils(std::string16 *error) {
@@ -46,6 +50,8 @@ bool TestStringUtils(std::string16 *error) {
   ok &= TestStrUtilsReplaceAll();
   ok &= TestStringMatch();
   ok &= TestUTFConversion();
+  ok &= TestUTFConversionEdgeCases();
+  ok &= TestUTFConversionThroughput();
   ok &= TestStringToInteger();
   if (!ok) {
     assert(error); \
@@ -337,6 +343,195 @@ static bool TestUTFConversion() {
   return true;
 }
 
+static bool TestUTFConversionEdgeCases() {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestUTFConversionEdgeCases - failed (%d)\n", __LINE__)); \
+    return false; \
+  } \
+}
+  // Multi-byte characters either side of the 16 byte ASCII blocks.
+  for (int run = 0; run <= 33; ++run) {
+    std::string sample8(run, 'a');
+    sample8 += "\xE4\xBA\x8C";
+    sample8.append(run, 'b');
+    sample8 += "\xF0\x90\x8C\x82";
+    std::string16 expected16(run, 'a');
+    expected16 += static_cast<char16>(0x4E8C);
+    expected16.append(run, 'b');
+    expected16 += static_cast<char16>(0xD800);
+    expected16 += static_cast<char16>(0xDF02);
+
+    std::string16 result16;
+    TEST_ASSERT(UTF8ToString16(sample8, &result16));
+    TEST_ASSERT(expected16 == result16);
+    std::string result8;
+    TEST_ASSERT(String16ToUTF8(expected16, &result8));
+    TEST_ASSERT(sample8 == result8);
+
+    // An error past the ASCII run must still fail the whole conversion.
+    TEST_ASSERT(!UTF8ToString16(sample8 + "\x80", &result16));
+    TEST_ASSERT(result16.empty());
+    TEST_ASSERT(!String16ToUTF8(expected16 + static_cast<char16>(0xDC00),
+                                &result8));
+    TEST_ASSERT(result8.empty());
+  }
+
+  // Ill-formed UTF-8.
+  static const char *kBadUTF8[] = {
+    "\x80",              // stray trail byte
+    "\xC0\xAF",          // overlong '/'
+    "\xC1\xBF",          // overlong
+    "\xE0\x9F\xBF",      // overlong
+    "\xED\xA0\x80",      // encoded high surrogate
+    "\xED\xBF\xBF",      // encoded low surrogate
+    "\xF0\x8F\xBF\xBF",  // overlong
+    "\xF4\x90\x80\x80",  // above U+10FFFF
+    "\xF5\x80\x80\x80",  // invalid lead byte
+    "\xFE",
+    "\xD0",              // truncated sequences
+    "\xE4\xBA",
+    "\xF0\x90\x8C",
+    "\xE4" "a" "\x8C",   // ASCII in place of a trail byte
+    "\xED" "a" "\x80",
+    "\xF4" "a" "\x80\x80",
+  };
+  for (size_t i = 0; i < ARRAYSIZE(kBadUTF8); ++i) {
+    std::string16 result16;
+    TEST_ASSERT(!UTF8ToString16(kBadUTF8[i], &result16));
+  }
+
+  // The largest values of each length are accepted.
+  {
+    std::string16 result16;
+    TEST_ASSERT(UTF8ToString16("\x7F\xDF\xBF\xEF\xBF\xBF\xF4\x8F\xBF\xBF",
+                               &result16));
+    TEST_ASSERT(result16.size() == 5);
+    TEST_ASSERT(result16[0] == 0x7F && result16[1] == 0x7FF &&
+                result16[2] == 0xFFFF && result16[3] == 0xDBFF &&
+                result16[4] == 0xDFFF);
+  }
+
+  // Unpaired UTF-16 surrogates.
+  {
+    std::string result8;
+    const char16 kLowFirst[] = { 0xDC00, 0xD800, 0 };
+    const char16 kHighAtEnd[] = { 'a', 0xD800, 0 };
+    const char16 kHighThenAscii[] = { 0xDBFF, 'a', 0 };
+    TEST_ASSERT(!String16ToUTF8(kLowFirst, &result8));
+    TEST_ASSERT(!String16ToUTF8(kHighAtEnd, &result8));
+    TEST_ASSERT(!String16ToUTF8(kHighThenAscii, &result8));
+  }
+
+  // Append variants keep the existing contents, and leave them untouched on
+  // error.
+  {
+    std::string16 result16(STRING16(L"abc"));
+    TEST_ASSERT(AppendUTF8ToString16("\xD0\xB0z", 3, &result16));
+    TEST_ASSERT(result16 == STRING16(L"abc\x0430z"));
+    TEST_ASSERT(!AppendUTF8ToString16("def\xFF", 4, &result16));
+    TEST_ASSERT(result16 == STRING16(L"abc\x0430z"));
+    TEST_ASSERT(AppendUTF8ToString16("", 0, &result16));
+    TEST_ASSERT(result16 == STRING16(L"abc\x0430z"));
+
+    std::string result8("abc");
+    const std::string16 good16(STRING16(L"\x4E8Cz"));
+    TEST_ASSERT(AppendString16ToUTF8(good16.data(), good16.size(), &result8));
+    TEST_ASSERT(result8 == "abc\xE4\xBA\x8Cz");
+    const std::string16 bad16(STRING16(L"def\xD800"));
+    TEST_ASSERT(!AppendString16ToUTF8(bad16.data(), bad16.size(), &result8));
+    TEST_ASSERT(result8 == "abc\xE4\xBA\x8Cz");
+  }
+
+  LOG(("TestUTFConversionEdgeCases - passed\n"));
+  return true;
+}
+
+// Logs conversion throughput for mostly-ASCII and mostly-CJK text, next to
+// ConvertUTF's strict conversion (what these functions used to call) on the
+// same input.
+static bool TestUTFConversionThroughput() {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestUTFConversionThroughput - failed (%d)\n", __LINE__)); \
+    return false; \
+  } \
+}
+  const int kIterations = 20;
+  const char *kNames[] = { "ASCII-heavy", "CJK-heavy" };
+  std::string samples8[2];
+  // Markup with the odd non-ASCII character, and Chinese prose with the odd
+  // run of ASCII.
+  while (samples8[0].size() < 256 * 1024) {
+    samples8[0] += "<div class=\"entry\"><a href=\"/item?id=42\">Caf\xC3\xA9"
+                   "</a> posted a reply to the thread.</div>\n";
+  }
+  while (samples8[1].size() < 256 * 1024) {
+    samples8[1] += "\xE4\xB8\xAD\xE6\x96\x87\xE7\xBD\x91\xE9\xA1\xB5\xE7\x9A"
+                   "\x84\xE6\xA0\x87\xE9\xA2\x98 Gears \xE6\x95\xB0\xE6\x8D"
+                   "\xAE\xE5\xBA\x93\xE3\x80\x82";
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    const std::string &sample8 = samples8[i];
+    std::string16 sample16;
+    TEST_ASSERT(UTF8ToString16(sample8, &sample16));
+    double megabytes = kIterations * sample8.size() / (1024.0 * 1024.0);
+
+    std::string16 result16;
+    int64 start = GetTicks();
+    for (int j = 0; j < kIterations; ++j) {
+      TEST_ASSERT(UTF8ToString16(sample8, &result16));
+    }
+    int64 decode_micros = GetTickDeltaMicros(start, GetTicks());
+
+    std::string result8;
+    start = GetTicks();
+    for (int j = 0; j < kIterations; ++j) {
+      TEST_ASSERT(String16ToUTF8(sample16, &result8));
+    }
+    int64 encode_micros = GetTickDeltaMicros(start, GetTicks());
+    TEST_ASSERT(result8 == sample8);
+
+    std::string16 buffer16(sample8.size(), 0);
+    start = GetTicks();
+    for (int j = 0; j < kIterations; ++j) {
+      const UTF8 *source = reinterpret_cast<const UTF8*>(sample8.data());
+      UTF16 *target = reinterpret_cast<UTF16*>(&buffer16[0]);
+      TEST_ASSERT(ConvertUTF8toUTF16(&source, source + sample8.size(),
+                                     &target, target + buffer16.size(),
+                                     strictConversion) == conversionOK);
+    }
+    int64 baseline_decode_micros = GetTickDeltaMicros(start, GetTicks());
+
+    std::string buffer8(sample16.size() * 4, 0);
+    start = GetTicks();
+    for (int j = 0; j < kIterations; ++j) {
+      const UTF16 *source = reinterpret_cast<const UTF16*>(sample16.data());
+      UTF8 *target = reinterpret_cast<UTF8*>(&buffer8[0]);
+      TEST_ASSERT(ConvertUTF16toUTF8(&source, source + sample16.size(),
+                                     &target, target + buffer8.size(),
+                                     strictConversion) == conversionOK);
+    }
+    int64 baseline_encode_micros = GetTickDeltaMicros(start, GetTicks());
+
+    LOG(("TestUTFConversionThroughput - %s: UTF8ToString16 %.0f MB/s "
+         "(ConvertUTF %.0f MB/s), String16ToUTF8 %.0f MB/s "
+         "(ConvertUTF %.0f MB/s)\n", kNames[i],
+         megabytes * 1e6 / (decode_micros + 1),
+         megabytes * 1e6 / (baseline_decode_micros + 1),
+         megabytes * 1e6 / (encode_micros + 1),
+         megabytes * 1e6 / (baseline_encode_micros + 1)));
+  }
+
+  LOG(("TestUTFConversionThroughput - passed\n"));
+  return true;
+}
+
 static bool TestStringToInteger() {
 #undef TEST_ASSERT
 #define TEST_ASSERT(b) \
@@ -0,0 +1,260 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/base/common/trace_events.h"
+
+#if ENABLE_TRACE_EVENTS
+
+#include <stdlib.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <vector>
+
+#include "gears/base/common/file.h"
+#include "gears/base/common/mutex.h"
+#include "gears/base/common/string_utils.h"
+#include "gears/base/common/thread_locals.h"
+
+// Each thread's buffer holds this many of its most recent events. Once
+// this many threads have buffers, the buffers of exited threads are
+// reused, and if there are none, further threads are not traced.
+static const unsigned int kRecordsPerThread = 2048;  // must be a power of 2
+static const size_t kMaxThreadBuffers = 64;
+
+struct TraceRecord {
+  const char *category;
+  const char *name;
+  int64 start_ticks;
+  int64 end_ticks;
+  bool instant;
+};
+
+// Only the owning thread writes to a buffer. 'count' is the number of
+// events ever recorded into it, it is incremented after the record has
+// been written.
+struct TraceBuffer {
+  int thread_id;
+  bool in_use;  // Guarded by buffers_mutex
+  volatile unsigned int count;
+  TraceRecord records[kRecordsPerThread];
+};
+
+volatile int TraceEvents::state_ = TraceEvents::STATE_UNINITIALIZED;
+
+static Mutex buffers_mutex;
+static std::vector<TraceBuffer*> buffers;
+static int next_thread_id = 1;
+static int64 base_ticks = 0;
+static int64 base_time_millis = 0;  // GetCurrentTimeMillis() at base_ticks
+
+// Stored in thread locals for threads that could not get a buffer, so
+// that they do not try again for each event.
+static TraceBuffer no_buffer;
+
+const ThreadLocals::Slot kTraceBufferKey = ThreadLocals::Alloc();
+
+static void ReleaseBuffer(void *value) {
+  TraceBuffer *buffer = reinterpret_cast<TraceBuffer*>(value);
+  MutexLock lock(&buffers_mutex);
+  buffer->in_use = false;
+}
+
+static TraceBuffer *AcquireBuffer() {
+  TraceBuffer *buffer = NULL;
+  {
+    MutexLock lock(&buffers_mutex);
+    if (buffers.size() < kMaxThreadBuffers) {
+      buffer = new TraceBuffer;
+      buffers.push_back(buffer);
+    } else {
+      for (size_t i = 0; i < buffers.size(); ++i) {
+        if (!buffers[i]->in_use) {
+          buffer = buffers[i];
+          break;
+        }
+      }
+    }
+    if (buffer) {
+      buffer->thread_id = next_thread_id++;
+      buffer->in_use = true;
+      buffer->count = 0;
+    }
+  }
+  if (buffer) {
+    ThreadLocals::SetValue(kTraceBufferKey, buffer, &ReleaseBuffer);
+  } else {
+    ThreadLocals::SetValue(kTraceBufferKey, &no_buffer, NULL);
+  }
+  return buffer;
+}
+
+static int GetProcessId() {
+#ifdef WIN32
+  return static_cast<int>(::GetCurrentProcessId());
+#else
+  return static_cast<int>(getpid());
+#endif
+}
+
+static void DumpAtExit() {
+  const char *path = getenv("GEARS_TRACE_FILE");
+  if (!path || !path[0]) {
+    return;
+  }
+  std::string filename(path);
+  filename += ".";
+  filename += IntegerToString(GetProcessId());
+  TraceEvents::DumpToFile(UTF8ToString16(filename).c_str());
+}
+
+// static
+void TraceEvents::InitializeFromEnvironment() {
+  MutexLock lock(&buffers_mutex);
+  if (state_ != STATE_UNINITIALIZED) {
+    return;
+  }
+  const char *path = getenv("GEARS_TRACE_FILE");
+  if (path && path[0]) {
+    base_ticks = GetTicks();
+    base_time_millis = GetCurrentTimeMillis();
+    atexit(DumpAtExit);
+    state_ = STATE_ENABLED;
+  } else {
+    state_ = STATE_DISABLED;
+  }
+}
+
+// static
+void TraceEvents::SetEnabled(bool enabled) {
+  MutexLock lock(&buffers_mutex);
+  if (enabled && base_ticks == 0) {
+    base_ticks = GetTicks();
+    base_time_millis = GetCurrentTimeMillis();
+  }
+  state_ = enabled ? STATE_ENABLED : STATE_DISABLED;
+}
+
+// static
+void TraceEvents::Record(const char *category, const char *name,
+                         int64 start_ticks, int64 end_ticks, bool instant) {
+  TraceBuffer *buffer =
+      reinterpret_cast<TraceBuffer*>(ThreadLocals::GetValue(kTraceBufferKey));
+  if (!buffer) {
+    buffer = AcquireBuffer();
+    if (!buffer) {
+      return;
+    }
+  } else if (buffer == &no_buffer) {
+    return;
+  }
+
+  unsigned int count = buffer->count;
+  TraceRecord *record = &buffer->records[count & (kRecordsPerThread - 1)];
+  record->category = category;
+  record->name = name;
+  record->start_ticks = start_ticks;
+  record->end_ticks = end_ticks;
+  record->instant = instant;
+  buffer->count = count + 1;
+}
+
+static void AppendJsonString(const char *s, std::string *json) {
+  *json += '"';
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\') {
+      *json += '\\';
+    }
+    *json += *s;
+  }
+  *json += '"';
+}
+
+// static
+void TraceEvents::Dump(std::string *json) {
+  assert(json);
+  std::string pid(IntegerToString(GetProcessId()));
+
+  json->assign("{\"traceEvents\":[");
+  bool first = true;
+  MutexLock lock(&buffers_mutex);
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    const TraceBuffer *buffer = buffers[i];
+    unsigned int count = buffer->count;
+    unsigned int n = count < kRecordsPerThread ? count : kRecordsPerThread;
+    std::string tid(IntegerToString(buffer->thread_id));
+    for (unsigned int j = count - n; j != count; ++j) {
+      const TraceRecord &record = buffer->records[j & (kRecordsPerThread - 1)];
+      json->append(first ? "\n" : ",\n");
+      first = false;
+      json->append("{\"cat\":");
+      AppendJsonString(record.category, json);
+      json->append(",\"name\":");
+      AppendJsonString(record.name, json);
+      if (record.instant) {
+        json->append(",\"ph\":\"i\",\"s\":\"t\"");
+      } else {
+        json->append(",\"ph\":\"X\",\"dur\":");
+        json->append(Integer64ToString(
+            GetTickDeltaMicros(record.start_ticks, record.end_ticks)));
+      }
+      json->append(",\"ts\":");
+      json->append(Integer64ToString(
+          GetTickDeltaMicros(base_ticks, record.start_ticks)));
+      json->append(",\"pid\":");
+      json->append(pid);
+      json->append(",\"tid\":");
+      json->append(tid);
+      json->append("}");
+    }
+  }
+  json->append("\n],\"otherData\":{\"baseTimeMillis\":");
+  json->append(Integer64ToString(base_time_millis));
+  json->append("}}\n");
+}
+
+// static
+bool TraceEvents::DumpToFile(const char16 *full_filepath) {
+  std::string json;
+  Dump(&json);
+  if (!File::Exists(full_filepath) && !File::CreateNewFile(full_filepath)) {
+    return false;
+  }
+  return File::WriteBytesToFile(full_filepath,
+                                reinterpret_cast<const uint8*>(json.data()),
+                                static_cast<int>(json.size()));
+}
+
+// static
+void TraceEvents::Clear() {
+  MutexLock lock(&buffers_mutex);
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    buffers[i]->count = 0;
+  }
+}
+
+#endif  // ENABLE_TRACE_EVENTS
@@ -0,0 +1,147 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Low overhead tracing of timed events on hot paths, for finding out where
+// time goes in real sessions. Each thread records into its own fixed size
+// ring buffer, so recording takes no locks and only the most recent events
+// of each thread are kept.
+//
+// Tracing is off unless the GEARS_TRACE_FILE environment variable is set,
+// in which case events are written at exit to that path suffixed with the
+// process id, in the Trace Event Format that chrome://tracing and other
+// viewers load. Event timestamps are in microseconds after the time given
+// as otherData.baseTimeMillis, in milliseconds since the epoch like
+// GetCurrentTimeMillis(). While off, each TRACE_EVENT costs a test of a flag.
+// Building with DISABLE_TRACE_EVENTS defined removes the macros entirely.
+//
+// Usage:
+//   void Foo::Bar() {
+//     TRACE_EVENT("foo", "Foo.Bar");  // times the enclosing scope
+//     ...
+//     TRACE_EVENT_INSTANT("foo", "Foo.Ready");  // marks a point in time
+//   }
+// Categories and names must be string literals, only pointers to them are
+// recorded.
+
+#ifndef GEARS_BASE_COMMON_TRACE_EVENTS_H__
+#define GEARS_BASE_COMMON_TRACE_EVENTS_H__
+
+#if !defined(OS_WINCE) && !defined(DISABLE_TRACE_EVENTS)
+#define ENABLE_TRACE_EVENTS 1
+#endif
+
+#if ENABLE_TRACE_EVENTS
+
+#include <string>
+#include "gears/base/common/basictypes.h"
+#include "gears/base/common/stopwatch.h"
+#include "gears/base/common/string16.h"
+
+class TraceEvents {
+ public:
+  // Returns true if events are being recorded.
+  static bool IsEnabled() {
+    if (state_ == STATE_UNINITIALIZED) {
+      InitializeFromEnvironment();
+    }
+    return state_ == STATE_ENABLED;
+  }
+
+  // Turns recording on or off, regardless of the environment.
+  static void SetEnabled(bool enabled);
+
+  // Records an event on the current thread's buffer. The ticks are as
+  // returned by GetTicks(). Instant events have equal start and end ticks.
+  static void Record(const char *category, const char *name,
+                     int64 start_ticks, int64 end_ticks, bool instant);
+
+  // Formats the events recorded by all threads as Trace Event Format JSON.
+  // Events being recorded while this runs may come out garbled.
+  static void Dump(std::string *json);
+
+  // Writes the result of Dump() to the file, replacing its contents.
+  static bool DumpToFile(const char16 *full_filepath);
+
+  // Discards the events recorded so far.
+  static void Clear();
+
+ private:
+  enum State {
+    STATE_UNINITIALIZED,
+    STATE_ENABLED,
+    STATE_DISABLED
+  };
+
+  static void InitializeFromEnvironment();
+
+  static volatile int state_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TraceEvents);
+};
+
+// Records an event spanning the lifetime of the object. Use TRACE_EVENT.
+class ScopedTraceEvent {
+ public:
+  ScopedTraceEvent(const char *category, const char *name)
+      : category_(category), name_(name),
+        enabled_(TraceEvents::IsEnabled()),
+        start_ticks_(enabled_ ? GetTicks() : 0) {}
+
+  ~ScopedTraceEvent() {
+    if (enabled_) {
+      TraceEvents::Record(category_, name_, start_ticks_, GetTicks(), false);
+    }
+  }
+
+ private:
+  const char *category_;
+  const char *name_;
+  bool enabled_;
+  int64 start_ticks_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ScopedTraceEvent);
+};
+
+#define TRACE_EVENT_CONCAT_INNER(a, b) a##b
+#define TRACE_EVENT_CONCAT(a, b) TRACE_EVENT_CONCAT_INNER(a, b)
+
+#define TRACE_EVENT(category, name) \
+    ScopedTraceEvent TRACE_EVENT_CONCAT(trace_event_, __LINE__)(category, name)
+#define TRACE_EVENT_INSTANT(category, name) \
+    do { \
+      if (TraceEvents::IsEnabled()) { \
+        int64 trace_event_ticks = GetTicks(); \
+        TraceEvents::Record(category, name, trace_event_ticks, \
+                            trace_event_ticks, true); \
+      } \
+    } while (false)
+
+#else  // ENABLE_TRACE_EVENTS
+
+#define TRACE_EVENT(category, name)          do {} while (false)
+#define TRACE_EVENT_INSTANT(category, name)  do {} while (false)
+
+#endif  // ENABLE_TRACE_EVENTS
+#endif  // GEARS_BASE_COMMON_TRACE_EVENTS_H__
@@ -0,0 +1,145 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifdef USING_CCTESTS
+
+#include "gears/base/common/trace_events.h"
+
+#if ENABLE_TRACE_EVENTS
+
+#include "gears/base/common/common.h"
+#include "gears/base/common/stopwatch.h"
+#include "gears/base/common/string16.h"
+#include "gears/base/common/thread.h"
+
+static int CountOccurrences(const std::string &s, const char *pattern) {
+  int count = 0;
+  std::string::size_type pos = 0;
+  while ((pos = s.find(pattern, pos)) != std::string::npos) {
+    ++count;
+    ++pos;
+  }
+  return count;
+}
+
+class TraceEventsTestThread : public Thread {
+ protected:
+  virtual void Run() {
+    TRACE_EVENT("test", "TraceEventsTest.OtherThread");
+  }
+};
+
+static void TraceLoop(int count) {
+  for (int i = 0; i < count; ++i) {
+    TRACE_EVENT("test", "TraceEventsTest.Loop");
+  }
+}
+
+bool TestTraceEvents(std::string16 *error) {
+  bool was_enabled = TraceEvents::IsEnabled();
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestTraceEvents - failed (%d)\n", __LINE__)); \
+    TraceEvents::SetEnabled(was_enabled); \
+    assert(error); \
+    *error += STRING16(L"TestTraceEvents - failed. "); \
+    return false; \
+  } \
+}
+
+  // Nothing is recorded while disabled
+  TraceEvents::SetEnabled(false);
+  TraceEvents::Clear();
+  {
+    TRACE_EVENT("test", "TraceEventsTest.Disabled");
+  }
+  std::string json;
+  TraceEvents::Dump(&json);
+  TEST_ASSERT(json.find("TraceEventsTest.Disabled") == std::string::npos);
+
+  // Scoped events are recorded as complete events, instants as instants
+  TraceEvents::SetEnabled(true);
+  {
+    TRACE_EVENT("test", "TraceEventsTest.Scope");
+    TRACE_EVENT_INSTANT("test", "TraceEventsTest.Instant");
+  }
+  TraceEvents::Dump(&json);
+  TEST_ASSERT(json.find("{\"traceEvents\":[") == 0);
+  TEST_ASSERT(json.find("\"otherData\":{\"baseTimeMillis\":") !=
+              std::string::npos);
+  TEST_ASSERT(json.find("{\"cat\":\"test\",\"name\":\"TraceEventsTest.Scope\","
+                        "\"ph\":\"X\",\"dur\":") != std::string::npos);
+  TEST_ASSERT(json.find("{\"cat\":\"test\","
+                        "\"name\":\"TraceEventsTest.Instant\","
+                        "\"ph\":\"i\"") != std::string::npos);
+
+  // Each thread records into its own buffer, with its own tid
+  TraceEventsTestThread thread;
+  TEST_ASSERT(thread.Start());
+  thread.Join();
+  TraceEvents::Dump(&json);
+  std::string::size_type main_event = json.find("TraceEventsTest.Scope");
+  std::string::size_type other_event =
+      json.find("TraceEventsTest.OtherThread");
+  TEST_ASSERT(other_event != std::string::npos);
+  TEST_ASSERT(json.substr(json.find("\"tid\":", main_event), 10) !=
+              json.substr(json.find("\"tid\":", other_event), 10));
+
+  // Buffers are rings, the oldest events are overwritten
+  const int kLoopCount = 10000;
+  TraceLoop(kLoopCount);
+  TraceEvents::Dump(&json);
+  int recorded = CountOccurrences(json, "TraceEventsTest.Loop");
+  TEST_ASSERT(recorded > 0 && recorded < kLoopCount);
+  TEST_ASSERT(json.find("TraceEventsTest.Scope") == std::string::npos);
+
+  // Time the cost of an event when enabled and when disabled
+  int64 start = GetTicks();
+  TraceLoop(kLoopCount);
+  int64 enabled_micros = GetTickDeltaMicros(start, GetTicks());
+  TraceEvents::SetEnabled(false);
+  start = GetTicks();
+  TraceLoop(kLoopCount);
+  int64 disabled_micros = GetTickDeltaMicros(start, GetTicks());
+  LOG(("TestTraceEvents - %d events: %d us enabled, %d us disabled\n",
+       kLoopCount, static_cast<int>(enabled_micros),
+       static_cast<int>(disabled_micros)));
+
+  TraceEvents::Clear();
+  TraceEvents::SetEnabled(was_enabled);
+  LOG(("TestTraceEvents - passed\n"));
+  return true;
+}
+
+#else  // ENABLE_TRACE_EVENTS
+
+bool TestTraceEvents(std::string16 *error) {
+  return true;
+}
+
+#endif  // ENABLE_TRACE_EVENTS
+#endif  // USING_CCTESTS
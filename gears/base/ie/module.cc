@@ -23,6 +23,7 @@
 // OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
 // ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include "gears/base/common/background_thread.h"
 #include "gears/base/common/leak_counter.h"
 #include "gears/base/common/process_utils_win32.h"
 #include "gears/base/common/thread_locals.h"
@@ -78,7 +79,12 @@ BOOL WINAPI DllMain(HANDLE instance, DWORD reason, LPVOID reserved) {
 
 
 STDAPI DllCanUnloadNow(void) {
-  return atl_module.DllCanUnloadNow();
+  HRESULT hr = atl_module.DllCanUnloadNow();
+  if (hr == S_OK) {
+    // The DLL may be unloaded once we return.
+    BackgroundThread::StopAll();
+  }
+  return hr;
 }
 
 STDAPI DllGetClassObject(REFCLSID class_id, REFIID riid, LPVOID* ppv) {
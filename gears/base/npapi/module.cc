@@ -38,6 +38,7 @@
 //
 // Main plugin entry point implementation
 //
+#include "gears/base/common/background_thread.h"
 #include "gears/base/common/base_class.h"
 #ifdef BROWSER_WEBKIT
 #include "gears/base/common/common.h"
@@ -188,10 +189,12 @@ NPError STDCALL NP_Initialize(NPNetscapeFuncs* funcs)
 // void. Gecko defines this differently.
 #ifdef BROWSER_WEBKIT
 void STDCALL NP_Shutdown() {
+  BackgroundThread::StopAll();
   return;
 }
 #else
 NPError STDCALL NP_Shutdown() {
+  BackgroundThread::StopAll();
   return NPERR_NO_ERROR;
 }
 #endif
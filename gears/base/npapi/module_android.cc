@@ -40,6 +40,7 @@
 //
 
 #include <unistd.h>
+#include "gears/base/common/background_thread.h"
 #include "gears/base/common/base_class.h"
 #include "gears/base/common/common.h"
 #include "gears/base/common/file.h"
@@ -246,6 +247,8 @@ NPError NP_Shutdown() {
   LibUpdater::StopUpdateChecks();
   // Shutdown URL interception.
   UrlInterceptAndroid::Delete();
+  // Stop the background threads before the library is unloaded.
+  BackgroundThread::StopAll();
 #if 0  // Do not disable access - global destructors require JNI.
   // Disable JNI access.
   JniUnregisterMainThread();
@@ -25,6 +25,13 @@
 
 #include "gears/blob/blob.h"
 
+#include <algorithm>
+#include <deque>
+#include "gears/base/common/async_router.h"
+#include "gears/base/common/background_thread.h"
+#include "gears/base/common/message_queue.h"
+#include "gears/base/common/string_utils.h"
+#include "gears/blob/blob_utils.h"
 #include "gears/blob/slice_blob.h"
 
 DECLARE_DISPATCHER(GearsBlob);
@@ -35,12 +42,111 @@ void Dispatcher<GearsBlob>::Init() {
   RegisterMethod("hasSameContentsAs", &GearsBlob::HasSameContentsAs);
 #endif
   RegisterMethod("getBytes", &GearsBlob::GetBytes);
+  RegisterMethod("hash", &GearsBlob::Hash);
   RegisterMethod("slice", &GearsBlob::Slice);
   RegisterProperty("length", &GearsBlob::GetLength, NULL);
 }
 
 const std::string GearsBlob::kModuleName("GearsBlob");
 
+// A hash in progress. The owner and callback are only touched on the thread
+// that called hash(). The hash thread fills in the result, and then posts the
+// task back to that thread.
+class GearsBlob::HashTask : public RefCounted {
+ public:
+  HashTask(GearsBlob *owner, BlobHasher::Algorithm algorithm,
+           JsRootedCallback *callback)
+      : owner(owner), callback(callback), hasher(algorithm),
+        contents(owner->contents_), succeeded(false) {
+    owner_thread = ThreadMessageQueue::GetInstance()->GetCurrentThreadId();
+  }
+
+  scoped_refptr<GearsBlob> owner;
+  scoped_ptr<JsRootedCallback> callback;
+  ThreadId owner_thread;
+
+  BlobHasher hasher;
+  scoped_refptr<BlobInterface> contents;
+  bool succeeded;
+  std::string digest;
+
+  // Called on the hash thread.
+  void Run() {
+    succeeded = hasher.Hash(contents.get(), &digest);
+    AsyncRouter::GetInstance()->CallAsync(owner_thread, new Completion(this));
+  }
+
+ private:
+  // Run on the owner's thread. AsyncRouter deletes the functor, so it holds
+  // its own reference to the task.
+  class Completion : public AsyncFunctor {
+   public:
+    explicit Completion(HashTask *task) : task_(task) {}
+    virtual void Run() {
+      if (task_->owner.get()) {
+        scoped_refptr<GearsBlob> owner(task_->owner);
+        owner->OnHashComplete(task_.get());
+      }
+    }
+   private:
+    scoped_refptr<HashTask> task_;
+  };
+
+  DISALLOW_EVIL_CONSTRUCTORS(HashTask);
+};
+
+// Runs hashes one at a time. Hashing is bound by disk reads, so one thread is
+// enough. It is woken each time a hash is queued. A queued task holds its
+// GearsBlob, and so keeps the module loaded, until the task has run.
+class GearsBlob::HashThread : public BackgroundThread {
+ public:
+  static bool Schedule(HashTask *task) {
+    HashThread *thread = BackgroundThread::GetInstance<HashThread>();
+    if (!thread) {
+      return false;
+    }
+    MutexLock lock(&thread->tasks_mutex_);
+    thread->tasks_.push_back(scoped_refptr<HashTask>(task));
+    if (!thread->Wake()) {
+      thread->tasks_.pop_back();
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  friend class BackgroundThread;
+  HashThread() {}
+
+  virtual void DoWork() {
+    while (!IsStopping()) {
+      scoped_refptr<HashTask> task;
+      {
+        MutexLock lock(&tasks_mutex_);
+        if (tasks_.empty()) {
+          break;
+        }
+        task = tasks_.front();
+        tasks_.pop_front();
+      }
+      task->Run();
+    }
+  }
+
+  Mutex tasks_mutex_;
+  std::deque<scoped_refptr<HashTask> > tasks_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(HashThread);
+};
+
+GearsBlob::GearsBlob()
+    : ModuleImplBaseClass(kModuleName),
+      contents_(new EmptyBlob()) {
+}
+
+GearsBlob::~GearsBlob() {
+}
+
 #ifdef DEBUG
 void GearsBlob::HasSameContentsAs(JsCallContext *context) {
   ModuleImplBaseClass *other_module = NULL;
@@ -167,6 +273,78 @@ void GearsBlob::GetLength(JsCallContext *context) {
   context->SetReturnValue(JSPARAM_INT64, &length);
 }
 
+void GearsBlob::Hash(JsCallContext *context) {
+  std::string16 algorithm_name;
+  JsRootedCallback *callback = NULL;
+  JsArgument argv[] = {
+    { JSPARAM_REQUIRED, JSPARAM_STRING16, &algorithm_name },
+    { JSPARAM_REQUIRED, JSPARAM_FUNCTION, &callback },
+  };
+  context->GetArguments(ARRAYSIZE(argv), argv);
+  scoped_ptr<JsRootedCallback> scoped_callback(callback);
+  if (context->is_exception_set()) return;
+
+  BlobHasher::Algorithm algorithm;
+  if (!BlobHasher::ParseAlgorithm(algorithm_name, &algorithm)) {
+    context->SetException(
+        STRING16(L"Algorithm must be 'crc32', 'sha1' or 'sha256'."));
+    return;
+  }
+
+  // The result is posted back to this thread.
+  ThreadMessageQueue::GetInstance()->InitThreadMessageQueue();
+  if (!unload_monitor_.get()) {
+    unload_monitor_.reset(new JsEventMonitor(GetJsRunner(), JSEVENT_UNLOAD,
+                                             this));
+  }
+
+  scoped_refptr<HashTask> task(
+      new HashTask(this, algorithm, scoped_callback.release()));
+  if (!HashThread::Schedule(task.get())) {
+    task->owner.reset();
+    context->SetException(STRING16(L"Could not start hashing."));
+    return;
+  }
+  pending_hashes_.push_back(task);
+}
+
+void GearsBlob::OnHashComplete(HashTask *task) {
+  std::vector<scoped_refptr<HashTask> >::iterator iter =
+      std::find(pending_hashes_.begin(), pending_hashes_.end(), task);
+  if (iter == pending_hashes_.end()) {
+    return;
+  }
+  scoped_refptr<HashTask> hold(task);
+  pending_hashes_.erase(iter);
+  scoped_ptr<JsRootedCallback> callback(task->callback.release());
+  task->owner.reset();
+
+  std::string16 digest;
+  JsParamToSend send_argv[] = {
+    { JSPARAM_NULL, NULL }
+  };
+  if (task->succeeded && UTF8ToString16(task->digest.c_str(), &digest)) {
+    send_argv[0].type = JSPARAM_STRING16;
+    send_argv[0].value_ptr = &digest;
+  }
+  GetJsRunner()->InvokeCallback(callback.get(), NULL, ARRAYSIZE(send_argv),
+                                send_argv, NULL);
+}
+
+void GearsBlob::HandleEvent(JsEventType event_type) {
+  assert(event_type == JSEVENT_UNLOAD);
+
+  // Hold an extra reference to protect against deletion while clearing the
+  // tasks, which contain references to us.
+  scoped_refptr<GearsBlob> hold(this);
+  for (size_t i = 0; i < pending_hashes_.size(); ++i) {
+    pending_hashes_[i]->hasher.Cancel();
+    pending_hashes_[i]->callback.reset();
+    pending_hashes_[i]->owner.reset();
+  }
+  pending_hashes_.clear();
+}
+
 void GearsBlob::Slice(JsCallContext *context) {
   int64 offset = 0;
   int64 length = 0;
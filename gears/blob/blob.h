@@ -26,18 +26,21 @@
 #ifndef GEARS_BLOB_BLOB_H__
 #define GEARS_BLOB_BLOB_H__
 
+#include <vector>
 #include "gears/base/common/base_class.h"
 #include "gears/base/common/common.h"
+#include "gears/base/common/js_runner.h"
 #include "gears/base/common/scoped_refptr.h"
 #include "gears/blob/blob_interface.h"
+#include "third_party/scoped_ptr/scoped_ptr.h"
 
-class GearsBlob : public ModuleImplBaseClass {
+class GearsBlob : public ModuleImplBaseClass, public JsEventHandlerInterface {
  public:
   static const std::string kModuleName;
 
-  GearsBlob()
-      : ModuleImplBaseClass(kModuleName),
-        contents_(new EmptyBlob()) {}
+  // Defined out of line, where HashTask is a complete type.
+  GearsBlob();
+  virtual ~GearsBlob();
 
   // IN: int64 index, optional int64 length
   // OUT: array of int
@@ -47,6 +50,12 @@ class GearsBlob : public ModuleImplBaseClass {
   // OUT: int64
   void GetLength(JsCallContext *context);
 
+  // Computes a digest of the Blob on a background thread, and passes it to
+  // the callback as a hex string, or null if the Blob could not be read.
+  // IN: string algorithm, function callback
+  // OUT: nothing
+  void Hash(JsCallContext *context);
+
 #ifdef DEBUG
   // Returns whether or not this Blob has identical contents to another Blob.
   // IN: GearsBlob anotherBlob
@@ -68,8 +77,18 @@ class GearsBlob : public ModuleImplBaseClass {
 
   virtual MarshaledModule *AsMarshaledModule();
 
+  // Cancels pending hashes when the page unloads.
+  virtual void HandleEvent(JsEventType event_type);
+
  private:
+  class HashTask;
+  class HashThread;
+
+  void OnHashComplete(HashTask *task);
+
   scoped_refptr<BlobInterface> contents_;
+  std::vector<scoped_refptr<HashTask> > pending_hashes_;
+  scoped_ptr<JsEventMonitor> unload_monitor_;
 
   bool ReadOffsetAndLengthArgs(
       JsCallContext *context,
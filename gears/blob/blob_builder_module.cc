@@ -25,6 +25,7 @@
 
 #include "gears/blob/blob_builder_module.h"
 
+#include "gears/base/common/memory_accounting.h"
 #include "gears/blob/blob.h"
 #include "gears/blob/blob_builder.h"
 
@@ -135,6 +136,7 @@ void GearsBlobBuilder::Append(JsCallContext *context) {
         : L"Required argument 1 is missing."));
     return;
   }
+  ScopedMemoryOrigin memory_origin(EnvPageSecurityOrigin().url());
   const JsToken &token = context->GetArgument(0);
   JsContextPtr js_context = context->js_context();
   bool token_is_array = JsTokenGetType(token, js_context) == JSPARAM_ARRAY;
@@ -25,7 +25,7 @@
 
 #include "gears/blob/blob_interface.h"
 
-#include "gears/base/common/memory_buffer.h"
+#include "gears/base/common/buffer_pool.h"
 
 namespace {
 const int64 kTempBufferSize = 1024 * 1024;  // 1MB
@@ -33,14 +33,20 @@ const int64 kTempBufferSize = 1024 * 1024;  // 1MB
 
 // Default implementation of ReadDirect, for blobs that do not have an
 // internal data buffer from which to read (ex - files).
-// It creates a temporary buffer and calls Read() to fill it.
+// It takes a temporary buffer from the BufferPool and calls Read() to fill it.
 int64 BlobInterface::ReadDirect(Reader *reader, int64 offset,
                                 int64 max_bytes) const {
   int64 buffer_size(std::min(max_bytes, kTempBufferSize));
-  MemoryBuffer buffer(buffer_size);
+  if (buffer_size <= 0) {
+    return 0;
+  }
+  PooledBuffer buffer(buffer_size, MEMORY_ACCOUNTING_TYPE_MemoryBuffer);
+  if (!buffer.get()) {
+    return -1;
+  }
   int64 total_bytes_read(0);
   while (max_bytes > 0) {
-    int64 bytes_read1 = Read(buffer.Data(0), offset, buffer_size);
+    int64 bytes_read1 = Read(buffer.get(), offset, buffer_size);
     // Deal with error while reading.
     if (bytes_read1 < 0) {
       // Return the number of bytes successfully read before the error.
@@ -53,7 +59,7 @@ int64 BlobInterface::ReadDirect(Reader *reader, int64 offset,
     if (bytes_read1 == 0) {
       break;  // No more data available.
     }
-    int64 bytes_read = reader->ReadFromBuffer(buffer.Data(0), bytes_read1);
+    int64 bytes_read = reader->ReadFromBuffer(buffer.get(), bytes_read1);
     assert(bytes_read >= 0);
     if (bytes_read == 0) break;
     total_bytes_read += bytes_read;
@@ -583,6 +583,76 @@ static bool TestBlobUtils(std::string16 *error) {
   TEST_ASSERT(BlobToString16(blob6.get(), STRING16(L"UTF-8"), &utf16_6));
   TEST_ASSERT(utf16_6 == expected6);
 
+  // Test AppendBlobToString16 on a growing blob, one byte at a time, so that
+  // every multi-byte character is split.
+  const char data7[] = "1, 2 \xCF\x8F, 3 \xEF\xBF\xBD, 4 \xF4\x8F\xAF\xAF.";
+  const int64 length7 = strlen(data7);
+  std::string16 expected7;
+  TEST_ASSERT(UTF8ToString16(data7, &expected7));
+  std::string16 utf16_7;
+  int64 offset7 = 0;
+  for (int64 i = 0; i <= length7; ++i) {
+    scoped_refptr<BlobInterface> blob7(new BufferBlob(data7, i));
+    int64 bytes_converted;
+    TEST_ASSERT(AppendBlobToString16(blob7.get(), offset7, &utf16_7,
+                                     &bytes_converted));
+    offset7 += bytes_converted;
+    TEST_ASSERT(offset7 <= i && offset7 > i - 4);
+  }
+  TEST_ASSERT(offset7 == length7);
+  TEST_ASSERT(utf16_7 == expected7);
+
+  // Test AppendBlobToString16 on invalid UTF-8 data.
+  std::string16 utf16_8(STRING16(L"unchanged"));
+  int64 bytes_converted8;
+  TEST_ASSERT(!AppendBlobToString16(blob3.get(), 0, &utf16_8,
+                                    &bytes_converted8));
+  TEST_ASSERT(utf16_8 == STRING16(L"unchanged"));
+
+  // Test BlobHasher on a blob made of several parts.
+  const char data9_1[] = "The quick brown ";
+  const char data9_2[] = "fox jumps over the lazy dog";
+  std::vector<scoped_refptr<BlobInterface> > blob_list9;
+  blob_list9.push_back(scoped_refptr<BlobInterface>(
+                           new BufferBlob(data9_1, strlen(data9_1))));
+  blob_list9.push_back(scoped_refptr<BlobInterface>(
+                           new BufferBlob(data9_2, strlen(data9_2))));
+  scoped_refptr<BlobInterface> blob9(new JoinBlob(blob_list9));
+  const struct {
+    const char16 *name;
+    const char *digest;
+  } kDigests9[] = {
+    { STRING16(L"crc32"), "414fa339" },
+    { STRING16(L"sha1"), "2fd4e1c67a2d28fced849ee1bb76e7391b93eb12" },
+    { STRING16(L"sha256"), "d7a8fbb307d7809469ca9abcb0082e4f"
+                           "8d5651e46d3cdb762d02d0bf37c9e592" },
+  };
+  for (size_t i = 0; i < ARRAYSIZE(kDigests9); ++i) {
+    BlobHasher::Algorithm algorithm;
+    TEST_ASSERT(BlobHasher::ParseAlgorithm(kDigests9[i].name, &algorithm));
+    BlobHasher hasher(algorithm);
+    std::string hex;
+    TEST_ASSERT(hasher.Hash(blob9.get(), &hex));
+    TEST_ASSERT(hex == kDigests9[i].digest);
+  }
+  BlobHasher::Algorithm algorithm9;
+  TEST_ASSERT(!BlobHasher::ParseAlgorithm(STRING16(L"md5"), &algorithm9));
+
+  // The digests of an empty blob.
+  scoped_refptr<BlobInterface> blob10(new EmptyBlob);
+  std::string hex10;
+  BlobHasher crc32_hasher(BlobHasher::CRC32);
+  TEST_ASSERT(crc32_hasher.Hash(blob10.get(), &hex10));
+  TEST_ASSERT(hex10 == "00000000");
+  BlobHasher sha1_hasher(BlobHasher::SHA1);
+  TEST_ASSERT(sha1_hasher.Hash(blob10.get(), &hex10));
+  TEST_ASSERT(hex10 == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+
+  // A cancelled hasher fails.
+  BlobHasher cancelled_hasher(BlobHasher::SHA256);
+  cancelled_hasher.Cancel();
+  TEST_ASSERT(!cancelled_hasher.Hash(blob9.get(), &hex10));
+
   return true;
 }
 
@@ -26,19 +26,25 @@
 #include "gears/blob/blob_utils.h"
 
 #include "gears/base/common/basictypes.h"
+#include "gears/base/common/sha1.h"
+#include "gears/base/common/sha256.h"
 #include "gears/base/common/string16.h"
 #include "gears/blob/blob_interface.h"
 #include "third_party/convert_utf/ConvertUTF.h"
 #include "third_party/scoped_ptr/scoped_ptr.h"
+#include "third_party/zlib/zlib.h"
 
 namespace {
 
 class UTF8ToUTF16Reader : public BlobInterface::Reader {
  public:
-  explicit UTF8ToUTF16Reader(std::string16 *out_string)
-      : target_start_original_(reinterpret_cast<UTF16*>(&(*out_string)[0])),
+  // Converted characters are written to out_string from index 'start'.
+  UTF8ToUTF16Reader(std::string16 *out_string, size_t start)
+      : target_start_original_(
+            reinterpret_cast<UTF16*>(&(*out_string)[0]) + start),
         target_start_(target_start_original_),
-        target_end_(target_start_ + out_string->size()),
+        target_end_(reinterpret_cast<UTF16*>(&(*out_string)[0]) +
+                    out_string->size()),
         partial_pos_(0),
         result_(true) {
   }
@@ -153,7 +159,7 @@ bool BlobToString16(BlobInterface* blob, const std::string16 &charset,
   // If no charset is provided, assume UTF8.
   // A UTF-16 string has at most as many 'characters' as the equiv. UTF8 string.
   text->resize(static_cast<size_t>(blob_length));
-  UTF8ToUTF16Reader reader(text);
+  UTF8ToUTF16Reader reader(text, 0);
   int64 length = blob->ReadDirect(&reader, 0, blob_length);
   if (!reader.Success()) {
     text->clear();
@@ -164,6 +170,59 @@ bool BlobToString16(BlobInterface* blob, const std::string16 &charset,
   return (length == blob_length);
 }
 
+bool AppendBlobToString16(BlobInterface *blob, int64 offset,
+                          std::string16 *text, int64 *bytes_converted) {
+  assert(blob);
+  assert(text);
+  assert(bytes_converted);
+  int64 blob_length(blob->Length());
+  assert(offset >= 0 && offset <= blob_length);
+  assert(blob_length - offset <= static_cast<int64>(kuint32max));
+  int64 end(blob_length);
+
+  // Leave a trailing incomplete character for a later call. The lead byte of
+  // the last character is within the last four bytes.
+  uint8 tail[4];
+  int tail_length(static_cast<int>(std::min<int64>(4, end - offset)));
+  if (tail_length > 0 &&
+      blob->Read(tail, end - tail_length, tail_length) == tail_length) {
+    for (int i = tail_length - 1; i >= 0; --i) {
+      if ((tail[i] & 0xC0) == 0x80) {
+        continue;  // A continuation byte.
+      }
+      int char_length(1);
+      if (tail[i] >= 0xF0) {
+        char_length = 4;
+      } else if (tail[i] >= 0xE0) {
+        char_length = 3;
+      } else if (tail[i] >= 0xC0) {
+        char_length = 2;
+      }
+      if (i + char_length > tail_length) {
+        end -= tail_length - i;
+      }
+      break;
+    }
+  }
+
+  *bytes_converted = 0;
+  if (end == offset) {
+    return true;
+  }
+  // A UTF-16 string has at most as many 'characters' as the equiv. UTF8 string.
+  size_t original_size(text->size());
+  text->resize(original_size + static_cast<size_t>(end - offset));
+  UTF8ToUTF16Reader reader(text, original_size);
+  int64 length = blob->ReadDirect(&reader, offset, end - offset);
+  if (!reader.Success() || length != end - offset) {
+    text->resize(original_size);
+    return false;
+  }
+  text->resize(original_size + reader.FinalSize());
+  *bytes_converted = length;
+  return true;
+}
+
 bool BlobToString(BlobInterface *blob, std::string *string_out) {
   assert(blob);
   int64 blob_length(blob->Length());
@@ -202,3 +261,108 @@ bool BlobToVector(BlobInterface *blob, std::vector<uint8> *vector_out) {
   assert(length == blob_length);
   return (length == blob_length);
 }
+
+namespace {
+
+class HashReader : public BlobInterface::Reader {
+ public:
+  HashReader(BlobHasher::Algorithm algorithm, const BlobHasher *hasher)
+      : algorithm_(algorithm), hasher_(hasher),
+        crc32_(crc32(0L, Z_NULL, 0)) {}
+
+  virtual int64 ReadFromBuffer(const uint8 *buffer, int64 max_bytes) {
+    if (hasher_->IsCancelled()) {
+      return 0;
+    }
+    // Large in-memory blobs may hand us more than zlib's uInt can describe.
+    const int64 kMaxUpdate = 1 << 30;
+    for (int64 done = 0; done < max_bytes; done += kMaxUpdate) {
+      size_t length =
+          static_cast<size_t>(std::min(max_bytes - done, kMaxUpdate));
+      switch (algorithm_) {
+        case BlobHasher::CRC32:
+          crc32_ = crc32(crc32_, buffer + done, static_cast<uInt>(length));
+          break;
+        case BlobHasher::SHA1:
+          sha1_.Update(buffer + done, length);
+          break;
+        case BlobHasher::SHA256:
+          sha256_.Update(buffer + done, length);
+          break;
+      }
+    }
+    return max_bytes;
+  }
+
+  void FinalHex(std::string *hex) {
+    switch (algorithm_) {
+      case BlobHasher::CRC32: {
+        static const char kHexDigits[] = "0123456789abcdef";
+        hex->resize(8);
+        for (int i = 0; i < 8; ++i) {
+          (*hex)[i] = kHexDigits[(crc32_ >> (28 - i * 4)) & 0x0f];
+        }
+        break;
+      }
+      case BlobHasher::SHA1:
+        sha1_.FinalHex(hex);
+        break;
+      case BlobHasher::SHA256:
+        sha256_.FinalHex(hex);
+        break;
+    }
+  }
+
+ private:
+  BlobHasher::Algorithm algorithm_;
+  const BlobHasher *hasher_;
+  uLong crc32_;
+  Sha1 sha1_;
+  Sha256 sha256_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(HashReader);
+};
+
+}  // namespace
+
+// static
+bool BlobHasher::ParseAlgorithm(const std::string16 &name,
+                                Algorithm *algorithm) {
+  assert(algorithm);
+  if (name == STRING16(L"crc32")) {
+    *algorithm = CRC32;
+  } else if (name == STRING16(L"sha1")) {
+    *algorithm = SHA1;
+  } else if (name == STRING16(L"sha256")) {
+    *algorithm = SHA256;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool BlobHasher::Hash(BlobInterface *blob, std::string *hex) {
+  assert(blob);
+  assert(hex);
+  int64 blob_length(blob->Length());
+  if (blob_length < 0) {
+    return false;
+  }
+  HashReader reader(algorithm_, this);
+  int64 length = blob->ReadDirect(&reader, 0, blob_length);
+  if (length != blob_length || IsCancelled()) {
+    return false;
+  }
+  reader.FinalHex(hex);
+  return true;
+}
+
+void BlobHasher::Cancel() {
+  MutexLock lock(&lock_);
+  is_cancelled_ = true;
+}
+
+bool BlobHasher::IsCancelled() const {
+  MutexLock lock(&lock_);
+  return is_cancelled_;
+}
@@ -27,6 +27,7 @@
 #define GEARS_BLOB_BLOB_UTILS_H_
 
 #include <vector>
+#include "gears/base/common/mutex.h"
 #include "gears/base/common/string16.h"
 
 class BlobInterface;
@@ -38,6 +39,14 @@ class BlobInterface;
 bool BlobToString16(BlobInterface *blob, const std::string16 &charset,
                     std::string16 *text);
 
+// Converts the UTF8 contents of the blob from 'offset' onwards to UTF16 and
+// appends them to 'text'. Bytes at the end of the blob which form an
+// incomplete character are not converted. On success, 'bytes_converted' is
+// set to the number of bytes converted, so that the conversion of a growing
+// blob can be continued from 'offset + *bytes_converted'.
+bool AppendBlobToString16(BlobInterface *blob, int64 offset,
+                          std::string16 *text, int64 *bytes_converted);
+
 // Copy the blob's contents to a string. No assumptions are made about the data
 // type of the content, it is copied verbatim into the string.
 // The length of the blob must be smaller or equal to largest possible size
@@ -49,4 +58,38 @@ bool BlobToString(BlobInterface *blob, std::string *string_out);
 // of the vector, otherwise an assertion is triggered.
 bool BlobToVector(BlobInterface *blob, std::vector<uint8> *vector_out);
 
+// Computes a digest of a blob's contents. The contents are streamed through
+// ReadDirect, so they are never copied as a whole.
+class BlobHasher {
+ public:
+  enum Algorithm {
+    CRC32,
+    SHA1,
+    SHA256
+  };
+
+  // Looks up an algorithm by name: "crc32", "sha1" or "sha256".
+  static bool ParseAlgorithm(const std::string16 &name, Algorithm *algorithm);
+
+  explicit BlobHasher(Algorithm algorithm)
+      : algorithm_(algorithm), is_cancelled_(false) {}
+
+  // Returns the digest as lower case hex, most significant byte first.
+  // Returns false if the blob could not be read in full, or if Cancel() was
+  // called.
+  bool Hash(BlobInterface *blob, std::string *hex);
+
+  // Makes Hash() return early. May be called from any thread.
+  void Cancel();
+
+  bool IsCancelled() const;
+
+ private:
+  Algorithm algorithm_;
+  mutable Mutex lock_;
+  bool is_cancelled_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(BlobHasher);
+};
+
 #endif  // GEARS_BLOB_BLOB_UTILS_H_
@@ -26,6 +26,7 @@
 #include <algorithm>
 #include <cassert>
 #include <limits>
+#include "gears/base/common/trace_events.h"
 #include "gears/blob/buffer_blob.h"
 
 BufferBlob::BufferBlob(std::vector<uint8> *buffer) {
@@ -46,6 +47,7 @@ BufferBlob::BufferBlob(const void *source, int64 num_bytes)
 
 int64 BufferBlob::Read(uint8 *destination, int64 offset,
                        int64 max_bytes) const {
+  TRACE_EVENT("blob", "BufferBlob.Read");
   if (offset < 0 || max_bytes < 0) {
     return -1;
   }
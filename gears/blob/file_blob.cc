@@ -24,6 +24,7 @@
 // ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "gears/base/common/file.h"
+#include "gears/base/common/trace_events.h"
 #include "gears/blob/file_blob.h"
 
 
@@ -43,6 +44,7 @@ FileBlob::FileBlob(File *file)
 
 
 int64 FileBlob::Read(uint8 *destination, int64 offset, int64 max_bytes) const {
+  TRACE_EVENT("blob", "FileBlob.Read");
   MutexLock locker(&file_lock_);
   if (file_.get() && file_->Seek(offset, File::SEEK_FROM_START)) {
     int64 result = file_->Read(destination, max_bytes);
@@ -100,7 +100,8 @@ static bool ValidateWidthAndHeight(int w, int h, JsCallContext *context) {
 // Canvas 2D graphics (rendering_context_) and on-screen rendering
 // (rendering_element_) fields are not yet part of the official build.
 GearsCanvas::GearsCanvas()
-    : ModuleImplBaseClass(kModuleName) {
+    : ModuleImplBaseClass(kModuleName),
+      pixels_memory_(MEMORY_ACCOUNTING_TYPE_CanvasBitmap) {
   // Initial dimensions as per the HTML5 canvas spec.
   ResetCanvas(kDefaultWidth, kDefaultHeight);
 }
@@ -110,6 +111,7 @@ GearsCanvas::~GearsCanvas() {
 #else
 GearsCanvas::GearsCanvas()
     : ModuleImplBaseClass(kModuleName),
+      pixels_memory_(MEMORY_ACCOUNTING_TYPE_CanvasBitmap),
       rendering_context_(NULL) {
 #if BROWSER_IE
   rendering_element_ = NULL;
@@ -174,6 +176,19 @@ void GearsCanvas::EnsureBitmapPixelsAreAllocated() {
   if (!skia_bitmap_->getPixels()) {
     skia_bitmap_->allocPixels();
     skia_bitmap_->eraseARGB(0, 0, 0, 0);
+    UpdatePixelsMemory();
+  }
+}
+
+void GearsCanvas::UpdatePixelsMemory() {
+  // The module environment is not yet set up when the constructor resets
+  // the bitmap, but then there are no pixels to account for.
+  if (skia_bitmap_->getPixels()) {
+    pixels_memory_.SetOrigin(
+        MemoryAccounting::GetOriginId(EnvPageSecurityOrigin().url()));
+    pixels_memory_.SetBytes(skia_bitmap_->getSize());
+  } else {
+    pixels_memory_.SetBytes(0);
   }
 }
 
@@ -214,6 +229,7 @@ void GearsCanvas::Decode(JsCallContext *context) {
                                     SkImageDecoder::kDecodePixels_Mode)) {
     context->SetException(STRING16(L"Could not decode the Blob as an image."));
   }
+  UpdatePixelsMemory();
 }
 
 void GearsCanvas::Encode(JsCallContext *context) {
@@ -339,6 +355,7 @@ void GearsCanvas::Crop(JsCallContext *context) {
                        SkIntToScalar(height) };
   new_canvas.drawBitmapRect(*skia_bitmap_, &src_rect, dest_rect);
   new_bitmap.swap(*skia_bitmap_);
+  UpdatePixelsMemory();
 }
 
 static inline void accumulate(uint32 *buffer, int x_index, int y_index,
@@ -592,6 +609,7 @@ void GearsCanvas::Resize(JsCallContext *context) {
     }
   }
   new_bitmap.swap(*skia_bitmap_);
+  UpdatePixelsMemory();
 }
 
 void GearsCanvas::RotateCW(JsCallContext *context) {
@@ -634,6 +652,7 @@ void GearsCanvas::Rotate(int clockwiseTurns) {
       break;
   }
   new_bitmap.swap(*skia_bitmap_);
+  UpdatePixelsMemory();
 }
 
 void GearsCanvas::FlipHorizontal(JsCallContext *context) {
@@ -646,6 +665,7 @@ void GearsCanvas::FlipHorizontal(JsCallContext *context) {
   new_canvas.drawBitmap(*skia_bitmap_,
       SkIntToScalar(-GetWidth()), SkIntToScalar(0));
   new_bitmap.swap(*skia_bitmap_);
+  UpdatePixelsMemory();
 }
 
 void GearsCanvas::FlipVertical(JsCallContext *context) {
@@ -658,6 +678,7 @@ void GearsCanvas::FlipVertical(JsCallContext *context) {
   new_canvas.drawBitmap(*skia_bitmap_,
       SkIntToScalar(0), SkIntToScalar(-GetHeight()));
   new_bitmap.swap(*skia_bitmap_);
+  UpdatePixelsMemory();
 }
 
 void GearsCanvas::GetWidth(JsCallContext *context) {
@@ -847,6 +868,7 @@ void GearsCanvas::ResetCanvas(int width, int height) {
   // that its underlying bitmap has been deleted.
   skia_bitmap_.reset(new SkBitmap);
   skia_bitmap_->setConfig(skia_config, width, height);
+  UpdatePixelsMemory();
 }
 
 bool GearsCanvas::IsRectValid(const SkIRect &rect) {
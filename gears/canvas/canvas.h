@@ -28,6 +28,7 @@
 
 #include "gears/base/common/base_class.h"
 #include "gears/base/common/common.h"
+#include "gears/base/common/memory_accounting.h"
 #include "gears/base/common/scoped_refptr.h"
 #include "third_party/scoped_ptr/scoped_ptr.h"
 // Can't include any Skia header here, or factory.cc will fail to compile due
@@ -170,10 +171,16 @@ class GearsCanvas : public ModuleImplBaseClass {
   // pixels have been allocated.
   void EnsureBitmapPixelsAreAllocated();
 
+  // Brings pixels_memory_ up to date after the bitmap has changed.
+  void UpdatePixelsMemory();
+
   // Cannot embed objects directly due to compilation issues; see comment
   // at top of file.
   scoped_ptr<SkBitmap> skia_bitmap_;
 
+  // Accounts for the memory held by skia_bitmap_'s pixels.
+  MemoryAccountingTag pixels_memory_;
+
 #if !defined(OFFICIAL_BUILD)
   // Can't use a scoped_refptr since that will create a reference cycle.
   // Instead, use a plain pointer and clear it when the target is destroyed.
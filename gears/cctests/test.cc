@@ -30,6 +30,7 @@
 #include "gears/cctests/test.h"
 
 #include "gears/base/common/file.h"
+#include "gears/base/common/http_utils.h"
 #include "gears/base/common/js_types.h"
 #include "gears/base/common/js_runner.h"
 #include "gears/base/common/paths.h"
@@ -72,6 +73,7 @@ void Dispatcher<GearsTest>::Init() {
   RegisterMethod("getSystemTime", &GearsTest::GetSystemTime);
   RegisterMethod("startPerfTimer", &GearsTest::StartPerfTimer);
   RegisterMethod("stopPerfTimer", &GearsTest::StopPerfTimer);
+  RegisterMethod("getMemoryAccounting", &GearsTest::GetMemoryAccounting);
   RegisterMethod("testParseGeolocationOptions",
                  &GearsTest::TestParseGeolocationOptions);
   RegisterMethod("testGeolocationFormRequestBody",
@@ -121,11 +123,13 @@ void Dispatcher<GearsTest>::Init() {
 #include <sys/wait.h>
 #endif
 
+#include "gears/base/common/memory_accounting.h"
 #include "gears/base/common/name_value_table_test.h"
 #include "gears/base/common/permissions_db.h"
 #include "gears/base/common/permissions_db_test.h"
 #include "gears/base/common/sqlite_wrapper_test.h"
 #include "gears/base/common/stopwatch.h"
+#include "gears/base/common/thread.h"
 #include "gears/base/common/timed_call_test.h"
 #ifdef OS_WINCE
 #include "gears/base/common/url_utils.h"
@@ -133,6 +137,7 @@ void Dispatcher<GearsTest>::Init() {
 #endif
 #include "gears/database/database_utils_test.h"
 #include "gears/geolocation/device_data_provider.h"
+#include "gears/geolocation/geolocation_db.h"
 #include "gears/geolocation/geolocation_db_test.h"
 #include "gears/geolocation/geolocation_test.h"
 #include "gears/localserver/common/async_task_test.h"
@@ -153,24 +158,39 @@ bool TestBlobInputStreamFf(std::string16 *error);
 // from blob_input_stream_sf_test.cc
 bool TestBlobInputStreamSf(std::string16 *error);
 #endif
+// from background_thread_test.cc
+bool TestBackgroundThread(std::string16 *error);
+bool TestBufferPool(std::string16 *error);  // from buffer_pool_test.cc
 bool TestByteStore(std::string16 *error);  // from byte_store_test.cc
+bool TestByteStoreBudget(std::string16 *error);  // from byte_store_test.cc
 bool TestHttpCookies(BrowsingContext *context, std::string16 *error);
 bool TestHttpRequest(BrowsingContext *context, std::string16 *error);
 bool TestManifest(std::string16 *error);
+bool TestMemoryAccounting(std::string16 *error);  // memory_accounting_test.cc
 bool TestMemoryBuffer(std::string16 *error);  // from memory_buffer_test.cc
 bool TestMessageService(std::string16 *error);  // from message_service_test.cc
+bool TestDatabase2Interpreter(std::string16 *error);  // interpreter_test.cc
 bool TestLocalServerDB(BrowsingContext *context, std::string16 *error);
+bool TestLocalServerQuotas(BrowsingContext *context, std::string16 *error);
+bool TestDatabaseFirstUse(std::string16 *error);
 bool TestResourceStore(std::string16 *error);
 bool TestManagedResourceStore(std::string16 *error);
 bool TestParseHttpStatusLine(std::string16 *error);
+bool TestPayloadHeaders(std::string16 *error);
 bool TestSecurityModel(std::string16 *error);  // from security_model_test.cc
 bool TestFileUtils(std::string16 *error);  // from file_test.cc
 bool TestUrlUtils(std::string16 *error);  // from url_utils_test.cc
 bool TestStringUtils(std::string16 *error);  // from string_utils_test.cc
 bool TestSerialization(std::string16 *error);  // from serialization_test.cc
+bool TestTraceEvents(std::string16 *error);  // from trace_events_test.cc
 bool TestCircularBuffer(std::string16 *error);  // from circular_buffer_test.cc
+bool TestSha1(std::string16 *error);  // from sha1_test.cc
+bool TestSha256(std::string16 *error);  // from sha256_test.cc
+bool TestDispatcher(std::string16 *error);  // from dispatcher_test.cc
 bool TestRefCount(std::string16 *error);  // from scoped_refptr_test.cc
 bool TestBlob(std::string16 *error);  // from blob_test.cc
+// from worker_script_cache_test.cc
+bool TestWorkerScriptCache(std::string16 *error);
 #if (defined(BROWSER_IE) && !defined(OS_WINCE))
 bool TestIpcPeerQueue(std::string16 *error);  // from ipc_message_queue_test.cc
 #endif
@@ -279,6 +299,43 @@ void GearsTest::StopPerfTimer(JsCallContext *context) {
   context->SetReturnValue(JSPARAM_INT64, &elapsed);
 }
 
+void GearsTest::GetMemoryAccounting(JsCallContext *context) {
+  JsRunnerInterface *js_runner = GetJsRunner();
+  scoped_ptr<JsArray> result(js_runner->NewArray());
+  if (!result.get()) {
+    context->SetException(STRING16(L"Failed to create array."));
+    return;
+  }
+  std::vector<std::string16> origins;
+  MemoryAccounting::GetOrigins(&origins);
+  int index = 0;
+  for (int origin_id = 0; origin_id < static_cast<int>(origins.size());
+       ++origin_id) {
+    for (int i = 0; i < MAX_MEMORY_ACCOUNTING_TYPE; ++i) {
+      MemoryAccountingType type = static_cast<MemoryAccountingType>(i);
+      MemoryAccounting::Usage usage;
+      MemoryAccounting::GetUsage(origin_id, type, &usage);
+      if (usage.bytes == 0 && usage.allocations == 0) {
+        continue;
+      }
+      scoped_ptr<JsObject> entry(js_runner->NewObject());
+      if (!entry.get() ||
+          !entry->SetPropertyString(STRING16(L"origin"), origins[origin_id]) ||
+          !entry->SetPropertyString(STRING16(L"type"),
+                                    MemoryAccounting::GetTypeName(type)) ||
+          !entry->SetPropertyDouble(STRING16(L"bytes"),
+                                    static_cast<double>(usage.bytes)) ||
+          !entry->SetPropertyDouble(STRING16(L"allocations"),
+                                    static_cast<double>(usage.allocations)) ||
+          !result->SetElementObject(index++, entry.get())) {
+        context->SetException(STRING16(L"Failed to set return value."));
+        return;
+      }
+    }
+  }
+  context->SetReturnValue(JSPARAM_ARRAY, result.get());
+}
+
 void GearsTest::RunTests(JsCallContext *context) {
   bool is_worker = false;
   JsArgument argv[] = {
@@ -304,11 +361,14 @@ void GearsTest::RunTests(JsCallContext *context) {
   bool ok = true;
   BrowsingContext *browsing_context = EnvPageBrowsingContext();
   ok &= TestAllMutex(&error);
+  ok &= TestBackgroundThread(&error);
   ok &= TestByteStore(&error);
+  ok &= TestByteStoreBudget(&error);
   ok &= TestStringUtils(&error);
   ok &= TestFileUtils(&error);
   ok &= TestUrlUtils(&error);
   ok &= TestParseHttpStatusLine(&error);
+  ok &= TestPayloadHeaders(&error);
   ok &= TestHttpRequest(browsing_context, &error);
   ok &= TestHttpCookies(browsing_context, &error);
   ok &= TestSecurityModel(&error);
@@ -317,13 +377,23 @@ void GearsTest::RunTests(JsCallContext *context) {
   ok &= TestPermissionsDBAll(&error);
   ok &= TestDatabaseUtilsAll(&error);
   ok &= TestLocalServerDB(browsing_context, &error);
+  ok &= TestLocalServerQuotas(browsing_context, &error);
+  ok &= TestDatabaseFirstUse(&error);
   ok &= TestResourceStore(&error);
   ok &= TestManifest(&error);
   ok &= TestManagedResourceStore(&error);
+  ok &= TestMemoryAccounting(&error);
   ok &= TestMemoryBuffer(&error);
+  ok &= TestBufferPool(&error);
   ok &= TestMessageService(&error);
+  ok &= TestDatabase2Interpreter(&error);
   ok &= TestSerialization(&error);
+  ok &= TestTraceEvents(&error);
   ok &= TestCircularBuffer(&error);
+  ok &= TestSha1(&error);
+  ok &= TestSha256(&error);
+  ok &= TestWorkerScriptCache(&error);
+  ok &= TestDispatcher(&error);
   ok &= TestRefCount(&error);
   ok &= TestBlob(&error);
 
@@ -777,6 +847,40 @@ bool TestHttpCookies(BrowsingContext *context, std::string16 *error) {
   TEST_ASSERT(map.HasCookie(kCookie3));
   TEST_ASSERT(!map.HasCookie(kCookie3 + kName2));
 
+  // A snapshot must agree with CookieMap, including keeping only the first
+  // (most specific) value of a repeated name.
+  scoped_refptr<CookieSnapshot> snapshot(CookieSnapshot::Create(
+      STRING16(L"name=value; name 2 = value 2; cookie3 ;name=other;;=x")));
+  TEST_ASSERT(snapshot->size() == 3);
+  TEST_ASSERT(snapshot->GetCookie(kName, &value));
+  TEST_ASSERT(value == kValue);
+  TEST_ASSERT(snapshot->HasSpecificCookie(kName2, kValue2));
+  TEST_ASSERT(snapshot->GetCookie(kCookie3, &value));
+  TEST_ASSERT(value.empty());
+  TEST_ASSERT(!snapshot->HasCookie(kCookie3 + kName2));
+  TEST_ASSERT(snapshot->HasLocalServerRequiredCookie(STRING16(L"name=value"),
+                                                     &name, &value));
+  TEST_ASSERT(!snapshot->HasLocalServerRequiredCookie(
+      STRING16(L"name=other"), &name, &value));
+  TEST_ASSERT(snapshot->HasLocalServerRequiredCookie(
+      STRING16(L"missing=;NONE;"), &name, &value));
+
+  // Snapshots are reused while the cookie string is unchanged, and replaced
+  // as soon as it changes.
+  const char16 *kSnapshotUrl = STRING16(L"http://cc_tests/cookies/a.html");
+  scoped_refptr<CookieSnapshot> first, second;
+  ClearCookieSnapshotCache();
+  SetFakeCookieString(kSnapshotUrl, STRING16(L"a=1"));
+  TEST_ASSERT(CookieSnapshot::GetForUrl(kSnapshotUrl, context, &first));
+  TEST_ASSERT(CookieSnapshot::GetForUrl(kSnapshotUrl, context, &second));
+  TEST_ASSERT(first.get() == second.get());
+  SetFakeCookieString(kSnapshotUrl, STRING16(L"a=2"));
+  TEST_ASSERT(CookieSnapshot::GetForUrl(kSnapshotUrl, context, &second));
+  TEST_ASSERT(first.get() != second.get());
+  TEST_ASSERT(second->HasSpecificCookie(STRING16(L"a"), STRING16(L"2")));
+  SetFakeCookieString(NULL, NULL);
+  ClearCookieSnapshotCache();
+
   TEST_ASSERT(GetCookieString(STRING16(L"http://www.google.com/"),
               context, &cookie_string));
   ParseCookieString(cookie_string, &map);
@@ -866,6 +970,144 @@ bool TestManifest(std::string16 *error) {
   ok = manifest_should_not_parse.Parse(manifest_url, json_not_an_object);
   TEST_ASSERT(!ok);
 
+  // Stream the entries to a handler instead of collecting them.
+  class EntryCounter : public Manifest::EntryHandler {
+   public:
+    EntryCounter() : count(0), fail_at(-1) {}
+    virtual bool HandleEntry(const Manifest::Entry &entry) {
+      last_url = entry.url;
+      return count++ != fail_at;
+    }
+    int count;
+    int fail_at;
+    std::string16 last_url;
+  };
+  Manifest streamed;
+  TEST_ASSERT(streamed.ParseHeader(manifest_url, json8.c_str(),
+                                   json8.length()));
+  TEST_ASSERT(streamed.IsValid());
+  TEST_ASSERT(expected_version == streamed.GetVersion());
+  TEST_ASSERT(expected_redirect == streamed.GetRedirectUrl());
+  TEST_ASSERT(streamed.GetEntries()->empty());
+  EntryCounter counter;
+  TEST_ASSERT(streamed.ParseEntries(&counter));
+  TEST_ASSERT(counter.count == 5);
+  TEST_ASSERT(counter.last_url ==
+              STRING16(L"http://cc_tests/test_match_query"));
+  // A handler failure stops parsing but leaves the manifest valid.
+  counter.count = 0;
+  counter.fail_at = 1;
+  TEST_ASSERT(!streamed.ParseEntries(&counter));
+  TEST_ASSERT(counter.count == 2);
+  TEST_ASSERT(streamed.IsValid());
+
+  // After Parse, ParseEntries does not read the json data again, which may
+  // already be gone.
+  Manifest collected;
+  {
+    std::string json_copy(json8);
+    TEST_ASSERT(collected.Parse(manifest_url, json_copy.c_str(),
+                                json_copy.length()));
+    json_copy.assign(json_copy.length(), 'x');
+  }
+  counter.count = 0;
+  counter.fail_at = -1;
+  TEST_ASSERT(collected.ParseEntries(&counter));
+  TEST_ASSERT(counter.count == 5);
+  TEST_ASSERT(counter.last_url ==
+              STRING16(L"http://cc_tests/test_match_query"));
+
+  // Comments, escapes and member order are handled as jsoncpp handled them.
+  const char *json_unusual =
+      "\xEF\xBB\xBF// leading comment\n"
+      "{ \"entries\": [ { \"url\": \"a\\u0062c\\/d\", /* c */ \"src\": 1,"
+      "                 \"src\": \"e f\", \"other\": [ {}, [], null ] } ],"
+      "  \"version\": \"v\\\"1\", \"betaManifestVersion\": 1 }";
+  Manifest unusual;
+  TEST_ASSERT(unusual.Parse(manifest_url, json_unusual));
+  TEST_ASSERT(std::string16(STRING16(L"v\"1")) == unusual.GetVersion());
+  TEST_ASSERT(unusual.GetEntries()->size() == 1);
+  TEST_ASSERT(unusual.GetEntries()->at(0).url ==
+              STRING16(L"http://cc_tests/abc/d"));
+  TEST_ASSERT(unusual.GetEntries()->at(0).src ==
+              STRING16(L"http://cc_tests/e%20f"));
+
+  // Syntax errors anywhere, including inside the entries, fail ParseHeader.
+  const char *json_bad_syntax =
+      "{ \"betaManifestVersion\": 1, \"version\": \"v\","
+      "  \"entries\": [ { \"url\": \"a\" }, { \"url\" \"b\" } ] }";
+  Manifest bad_syntax;
+  TEST_ASSERT(!bad_syntax.ParseHeader(manifest_url, json_bad_syntax,
+                                      strlen(json_bad_syntax)));
+  TEST_ASSERT(std::string16(bad_syntax.GetErrorMessage()).find(
+                  STRING16(L"Line 1")) != std::string16::npos);
+
+  // Invalid entries are only found by ParseEntries, after the preceding
+  // entries have been handled.
+  const char *json_bad_entry =
+      "{ \"betaManifestVersion\": 1, \"version\": \"v\","
+      "  \"entries\": [ { \"url\": \"a\" }, { \"src\": \"b\" } ] }";
+  Manifest bad_entry;
+  TEST_ASSERT(bad_entry.ParseHeader(manifest_url, json_bad_entry,
+                                    strlen(json_bad_entry)));
+  counter.count = 0;
+  counter.fail_at = -1;
+  TEST_ASSERT(!bad_entry.ParseEntries(&counter));
+  TEST_ASSERT(counter.count == 1);
+  TEST_ASSERT(!bad_entry.IsValid());
+  TEST_ASSERT(std::string16(bad_entry.GetErrorMessage()) ==
+              STRING16(L"Invalid entry - missing 'url' attribute"));
+
+  // Compare against building a jsoncpp document and copying each entry out
+  // of it, which is how manifests were parsed before, on a manifest with
+  // 20000 entries.
+  std::string large_json("{ \"betaManifestVersion\": 1,"
+                         "  \"version\": \"large\", \"entries\": [\n");
+  const int kLargeEntryCount = 20000;
+  for (int i = 0; i < kLargeEntryCount; ++i) {
+    char line[128];
+    sprintf(line, "%s{ \"url\": \"static/images/icon_%d.png\","
+                  " \"ignoreQuery\": true }\n", i ? "," : "", i);
+    large_json += line;
+  }
+  large_json += "] }";
+
+  int64 start = GetTicks();
+  {
+    Json::Value root;
+    Json::Reader reader;
+    TEST_ASSERT(reader.parse(large_json.data(),
+                             large_json.data() + large_json.size(),
+                             root, false));
+    const Json::Value &entries = root["entries"];
+    std::vector<Manifest::Entry> copies;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      copies.push_back(Manifest::Entry());
+      TEST_ASSERT(UTF8ToString16(entries[i]["url"].asCString(),
+                                 &copies.back().url));
+      copies.back().ignore_query = entries[i]["ignoreQuery"].asBool();
+    }
+    for (size_t i = 0; i < copies.size(); ++i) {
+      std::string16 resolved;
+      TEST_ASSERT(ResolveAndNormalize(manifest_url, copies[i].url.c_str(),
+                                      &resolved));
+      copies[i].url = resolved;
+    }
+  }
+  int64 dom_micros = GetTickDeltaMicros(start, GetTicks());
+
+  start = GetTicks();
+  Manifest large;
+  TEST_ASSERT(large.ParseHeader(manifest_url, large_json.data(),
+                                large_json.size()));
+  counter.count = 0;
+  TEST_ASSERT(large.ParseEntries(&counter));
+  TEST_ASSERT(counter.count == kLargeEntryCount);
+  int64 streaming_micros = GetTickDeltaMicros(start, GetTicks());
+  LOG(("TestManifest - %d entries: jsoncpp document %dms, streaming %dms\n",
+       kLargeEntryCount, static_cast<int>(dom_micros / 1000),
+       static_cast<int>(streaming_micros / 1000)));
+
   LOG(("TestManifest - passed\n"));
   return true;
 }
@@ -1195,6 +1437,128 @@ bool TestLocalServerDB(BrowsingContext *context, std::string16 *error) {
   SetFakeCookieString(testurl_query.c_str(), required_cookie);
   TEST_ASSERT(db->CanService(testurl_query.c_str(), context));
 
+  // insert a payload with a body that is shared by entries in version3
+  // and in a downloading version4
+  WebCacheDB::PayloadInfo gc_payload;
+  gc_payload.status_code = HttpConstants::HTTP_OK;
+  gc_payload.status_line = STRING16(L"HTTP/1.1 200 OK");
+  gc_payload.headers = STRING16(L"Content-Type: text/plain\r\n\r\n");
+  gc_payload.data.reset(new std::vector<uint8>(16, 'x'));
+  TEST_ASSERT(db->InsertPayload(server.id, testurl, &gc_payload));
+
+  WebCacheDB::EntryInfo gc_entry3;
+  gc_entry3.version_id = version3.id;
+  gc_entry3.url = STRING16(L"http://cc_tests/gc_url");
+  gc_entry3.payload_id = gc_payload.id;
+  TEST_ASSERT(db->InsertEntry(&gc_entry3));
+
+  WebCacheDB::VersionInfo version4;
+  version4.server_id = server.id;
+  version4.version_string = STRING16(L"version_string4");
+  version4.ready_state = WebCacheDB::VERSION_DOWNLOADING;
+  TEST_ASSERT(db->InsertVersion(&version4));
+
+  WebCacheDB::EntryInfo gc_entry4;
+  gc_entry4.version_id = version4.id;
+  gc_entry4.url = gc_entry3.url;
+  gc_entry4.payload_id = gc_payload.id;
+  TEST_ASSERT(db->InsertEntry(&gc_entry4));
+
+  // a second payload with an identical body, only referenced by version4,
+  // shares the body of the first
+  WebCacheDB::PayloadInfo gc_payload2;
+  gc_payload2.status_code = HttpConstants::HTTP_OK;
+  gc_payload2.status_line = STRING16(L"HTTP/1.1 200 OK");
+  gc_payload2.headers = STRING16(L"Content-Type: text/html\r\n\r\n");
+  gc_payload2.data.reset(new std::vector<uint8>(16, 'x'));
+  TEST_ASSERT(db->InsertPayload(server.id, testurl, &gc_payload2));
+#ifdef USE_FILE_STORE
+  TEST_ASSERT(gc_payload2.cached_filepath == gc_payload.cached_filepath);
+#endif
+
+  WebCacheDB::EntryInfo gc_entry4b;
+  gc_entry4b.version_id = version4.id;
+  gc_entry4b.url = STRING16(L"http://cc_tests/gc_url2");
+  gc_entry4b.payload_id = gc_payload2.id;
+  TEST_ASSERT(db->InsertEntry(&gc_entry4b));
+
+  // deleting version4 only marks the payloads. Since version3 still refers
+  // to the first, collecting garbage must leave it and its body in place
+  TEST_ASSERT(db->DeleteVersion(version4.id));
+  bool gc_done = false;
+  while (!gc_done) {
+    TEST_ASSERT(db->CollectGarbage(1000, &gc_done));
+  }
+  WebCacheDB::PayloadInfo found_payload;
+  TEST_ASSERT(!db->FindPayload(gc_payload2.id, &found_payload, true));
+  TEST_ASSERT(db->FindPayload(gc_payload.id, &found_payload, false));
+  TEST_ASSERT(found_payload.data.get() && found_payload.data->size() == 16);
+
+  // once no entries refer to it, the payload and its body are collected
+  TEST_ASSERT(db->DeleteEntries(version3.id));
+  gc_done = false;
+  while (!gc_done) {
+    TEST_ASSERT(db->CollectGarbage(1000, &gc_done));
+  }
+  TEST_ASSERT(!db->FindPayload(gc_payload.id, &found_payload, true));
+#ifdef USE_FILE_STORE
+  TEST_ASSERT(!gc_payload.cached_filepath.empty());
+  TEST_ASSERT(!File::Exists(gc_payload.cached_filepath.c_str()));
+
+  // textual bodies are stored compressed, and inflated when read unless
+  // the reader accepts gzip encoding
+  WebCacheDB::PayloadInfo text_payload;
+  text_payload.status_code = HttpConstants::HTTP_OK;
+  text_payload.status_line = STRING16(L"HTTP/1.1 200 OK");
+  text_payload.headers = STRING16(L"Content-Type: text/plain\r\n"
+                                  L"Content-Length: 8192\r\n\r\n");
+  std::vector<uint8> text_body;
+  for (int i = 0; i < 8192; ++i) {
+    text_body.push_back('a' + (i % 26));
+  }
+  text_payload.data.reset(new std::vector<uint8>(text_body));
+  TEST_ASSERT(db->InsertPayload(server.id, testurl, &text_payload));
+  TEST_ASSERT(text_payload.is_body_compressed);
+  TEST_ASSERT(text_payload.cached_filepath.empty());
+
+  WebCacheDB::PayloadInfo inflated_payload;
+  TEST_ASSERT(db->FindPayload(text_payload.id, &inflated_payload, false));
+  TEST_ASSERT(inflated_payload.is_body_compressed);
+  TEST_ASSERT(inflated_payload.data.get());
+  TEST_ASSERT(*inflated_payload.data == text_body);
+
+  WebCacheDB::PayloadInfo encoded_payload;
+  encoded_payload.accepts_gzip_encoding = true;
+  TEST_ASSERT(db->FindPayload(text_payload.id, &encoded_payload, false));
+  TEST_ASSERT(encoded_payload.data.get());
+  TEST_ASSERT(encoded_payload.data->size() < text_body.size());
+  std::string16 content_encoding, content_length;
+  TEST_ASSERT(encoded_payload.GetHeader(HttpConstants::kContentEncodingHeader,
+                                        &content_encoding));
+  TEST_ASSERT(content_encoding == STRING16(L"gzip"));
+  TEST_ASSERT(encoded_payload.GetHeader(HttpConstants::kContentLengthHeader,
+                                        &content_length));
+  TEST_ASSERT(content_length ==
+              Integer64ToString16(encoded_payload.data->size()));
+#endif
+
+  // payloads are stored with an index of their headers
+  WebCacheDB::PayloadInfo indexed_payload;
+  indexed_payload.status_code = HttpConstants::HTTP_OK;
+  indexed_payload.status_line = STRING16(L"HTTP/1.1 200 OK");
+  indexed_payload.headers = STRING16(L"Content-Type: image/png\r\n"
+                                     L"Content-Length: 4\r\n\r\n");
+  indexed_payload.data.reset(new std::vector<uint8>(4, 0));
+  TEST_ASSERT(db->InsertPayload(server.id, testurl, &indexed_payload));
+  WebCacheDB::PayloadInfo found_indexed_payload;
+  TEST_ASSERT(db->FindPayload(indexed_payload.id, &found_indexed_payload,
+                              true));
+  TEST_ASSERT(!found_indexed_payload.header_index.empty());
+  std::string16 content_type;
+  TEST_ASSERT(found_indexed_payload.GetHeader(
+                  HttpConstants::kContentTypeHeader, &content_type));
+  TEST_ASSERT(content_type == STRING16(L"image/png"));
+
   // delete the server altogether
   TEST_ASSERT(db->DeleteServer(server.id));
 
@@ -1209,6 +1573,229 @@ bool TestLocalServerDB(BrowsingContext *context, std::string16 *error) {
   return true;
 }
 
+//------------------------------------------------------------------------------
+// TestLocalServerQuotas
+//------------------------------------------------------------------------------
+static bool InsertQuotaTestEntry(WebCacheDB *db, int64 server_id,
+                                 int64 version_id, const char16 *url,
+                                 WebCacheDB::EntryInfo *entry) {
+  WebCacheDB::PayloadInfo payload;
+  payload.status_code = HttpConstants::HTTP_OK;
+  payload.status_line = STRING16(L"HTTP/1.1 200 OK");
+  payload.headers = STRING16(L"Content-Type: text/plain\r\n\r\n");
+  payload.data.reset(new std::vector<uint8>(1024, 'q'));
+  if (!db->InsertPayload(server_id, url, &payload)) {
+    return false;
+  }
+  entry->version_id = version_id;
+  entry->url = url;
+  entry->payload_id = payload.id;
+  return db->InsertEntry(entry);
+}
+
+bool TestLocalServerQuotas(BrowsingContext *context, std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestLocalServerQuotas - failed (%d)\n", __LINE__)); \
+    if (restore_quotas) { \
+      db->SetQuotas(saved_origin_quota, saved_global_quota); \
+    } \
+    assert(error); \
+    *error += STRING16(L"TestLocalServerQuotas - failed. "); \
+    return false; \
+  } \
+}
+
+  const char16 *name = STRING16(L"quota_test");
+  const char16 *managed_url = STRING16(L"http://cc_tests_quota/managed");
+  const char16 *url_a = STRING16(L"http://cc_tests_quota/a");
+  const char16 *url_b = STRING16(L"http://cc_tests_quota/b");
+  const char16 *url_c = STRING16(L"http://cc_tests_quota/c");
+  const char16 *url_d = STRING16(L"http://cc_tests_quota/d");
+
+  bool restore_quotas = false;
+  int64 saved_origin_quota = 0;
+  int64 saved_global_quota = 0;
+
+  SecurityOrigin security_origin;
+  WebCacheDB *db = WebCacheDB::GetDB();
+  TEST_ASSERT(db);
+  TEST_ASSERT(security_origin.InitFromUrl(url_a));
+  TEST_ASSERT(db->GetQuotas(&saved_origin_quota, &saved_global_quota));
+  restore_quotas = true;
+
+  // delete existing info from a previous test run
+  TEST_ASSERT(db->DeleteServersForOrigin(security_origin));
+
+  // an origin with a managed store and a resource store, each with a
+  // current version
+  WebCacheDB::ServerInfo managed_server;
+  managed_server.server_type = WebCacheDB::MANAGED_RESOURCE_STORE;
+  managed_server.security_origin_url = security_origin.url();
+  managed_server.name = name;
+  managed_server.manifest_url = STRING16(L"http://cc_tests_quota/manifest");
+  TEST_ASSERT(db->InsertServer(&managed_server));
+  WebCacheDB::VersionInfo managed_version;
+  managed_version.server_id = managed_server.id;
+  managed_version.version_string = STRING16(L"version");
+  managed_version.ready_state = WebCacheDB::VERSION_CURRENT;
+  TEST_ASSERT(db->InsertVersion(&managed_version));
+
+  WebCacheDB::ServerInfo server;
+  server.server_type = WebCacheDB::RESOURCE_STORE;
+  server.security_origin_url = security_origin.url();
+  server.name = name;
+  TEST_ASSERT(db->InsertServer(&server));
+  WebCacheDB::VersionInfo version;
+  version.server_id = server.id;
+  version.version_string = STRING16(L"");
+  version.ready_state = WebCacheDB::VERSION_CURRENT;
+  TEST_ASSERT(db->InsertVersion(&version));
+
+  int64 origin_usage = -1;
+  int64 global_usage = -1;
+  TEST_ASSERT(db->GetUsage(security_origin, &origin_usage, &global_usage));
+  TEST_ASSERT(origin_usage == 0);
+
+  // inserts are accounted against the origin, headers included
+  WebCacheDB::EntryInfo managed_entry, entry_a, entry_b, entry_c, entry_d;
+  TEST_ASSERT(InsertQuotaTestEntry(db, managed_server.id, managed_version.id,
+                                   managed_url, &managed_entry));
+  int64 entry_size = 0;
+  TEST_ASSERT(db->GetUsage(security_origin, &entry_size, &global_usage));
+  TEST_ASSERT(entry_size > 1024);
+  TEST_ASSERT(InsertQuotaTestEntry(db, server.id, version.id, url_b,
+                                   &entry_b));
+  TEST_ASSERT(InsertQuotaTestEntry(db, server.id, version.id, url_a,
+                                   &entry_a));
+  TEST_ASSERT(db->GetUsage(security_origin, &origin_usage, &global_usage));
+  TEST_ASSERT(origin_usage == 3 * entry_size);
+
+  // serving 'a' makes 'b' the least recently served
+  WebCacheDB::PayloadInfo served_payload;
+  TEST_ASSERT(db->Service(url_a, context, false, &served_payload));
+
+  // with room for only three entries, inserting 'c' evicts 'b'
+  TEST_ASSERT(db->SetQuotas(4 * 1024, saved_global_quota));
+  TEST_ASSERT(InsertQuotaTestEntry(db, server.id, version.id, url_c,
+                                   &entry_c));
+  WebCacheDB::EntryInfo found_entry;
+  TEST_ASSERT(!db->FindEntry(version.id, url_b, &found_entry));
+  TEST_ASSERT(db->FindEntry(version.id, url_a, &found_entry));
+  TEST_ASSERT(db->FindEntry(version.id, url_c, &found_entry));
+  TEST_ASSERT(db->GetUsage(security_origin, &origin_usage, &global_usage));
+  TEST_ASSERT(origin_usage == 3 * entry_size);
+
+  // managed entries are pinned, so with room for only one entry there is
+  // no room for 'd' even after evicting everything else. The evictions are
+  // rolled back along with the failed insert.
+  TEST_ASSERT(db->SetQuotas(2 * 1024, saved_global_quota));
+  TEST_ASSERT(!InsertQuotaTestEntry(db, server.id, version.id, url_d,
+                                    &entry_d));
+  TEST_ASSERT(db->FindEntry(managed_version.id, managed_url, &found_entry));
+  TEST_ASSERT(db->FindEntry(version.id, url_a, &found_entry));
+  TEST_ASSERT(db->FindEntry(version.id, url_c, &found_entry));
+  TEST_ASSERT(!db->FindEntry(version.id, url_d, &found_entry));
+  TEST_ASSERT(db->GetUsage(security_origin, &origin_usage, &global_usage));
+  TEST_ASSERT(origin_usage == 3 * entry_size);
+
+  // deleting a version's entries takes their payloads out of the usage
+  // right away, ahead of garbage collection
+  TEST_ASSERT(db->DeleteEntries(version.id));
+  TEST_ASSERT(db->GetUsage(security_origin, &origin_usage, &global_usage));
+  TEST_ASSERT(origin_usage == entry_size);
+
+  TEST_ASSERT(db->SetQuotas(saved_origin_quota, saved_global_quota));
+  restore_quotas = false;
+  TEST_ASSERT(db->DeleteServersForOrigin(security_origin));
+  TEST_ASSERT(db->GetUsage(security_origin, &origin_usage, &global_usage));
+  TEST_ASSERT(origin_usage == 0);
+
+  LOG(("TestLocalServerQuotas - passed\n"));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// TestDatabaseFirstUse
+//------------------------------------------------------------------------------
+// Opens each of the per-thread databases for the first time, as every new
+// worker and AsyncTask thread does.
+class DatabaseFirstUseThread : public Thread {
+ public:
+  DatabaseFirstUseThread() : succeeded_(false), elapsed_micros_(0) {}
+
+  bool succeeded_;
+  int64 elapsed_micros_;
+
+ protected:
+  virtual void Run() {
+    int64 start_ticks = GetTicks();
+    succeeded_ = WebCacheDB::GetDB() != NULL &&
+                 PermissionsDB::GetDB() != NULL &&
+                 GeolocationDB::GetDB() != NULL;
+    elapsed_micros_ = GetTickDeltaMicros(start_ticks, GetTicks());
+  }
+};
+
+bool TestDatabaseFirstUse(std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestDatabaseFirstUse - failed (%d)\n", __LINE__)); \
+    assert(error); \
+    *error += STRING16(L"TestDatabaseFirstUse - failed. "); \
+    return false; \
+  } \
+}
+
+  WebCacheDB *db = WebCacheDB::GetDB();
+  TEST_ASSERT(db);
+
+  // The schema is current by now, so first use on a new thread must not
+  // need the write lock.  Hold it for the whole test to make sure; a thread
+  // that needed it would time out and fail to open its databases.
+  SQLTransaction transaction(db->GetSQLDatabase(), "TestDatabaseFirstUse");
+  TEST_ASSERT(transaction.Begin());
+
+  const int kNumThreads = 32;
+  DatabaseFirstUseThread threads[kNumThreads];
+  int64 start_ticks = GetTicks();
+  int num_started = 0;
+  for (; num_started < kNumThreads; ++num_started) {
+    if (!threads[num_started].Start()) {
+      break;
+    }
+  }
+  for (int i = 0; i < num_started; ++i) {
+    threads[i].Join();
+  }
+  int64 total_micros = GetTickDeltaMicros(start_ticks, GetTicks());
+  TEST_ASSERT(num_started == kNumThreads);
+
+  int64 sum_micros = 0;
+  int64 max_micros = 0;
+  for (int i = 0; i < kNumThreads; ++i) {
+    TEST_ASSERT(threads[i].succeeded_);
+    sum_micros += threads[i].elapsed_micros_;
+    if (threads[i].elapsed_micros_ > max_micros) {
+      max_micros = threads[i].elapsed_micros_;
+    }
+  }
+  LOG(("TestDatabaseFirstUse - %d threads in %d us, "
+       "per thread average %d us, max %d us\n",
+       kNumThreads, static_cast<int>(total_micros),
+       static_cast<int>(sum_micros / kNumThreads),
+       static_cast<int>(max_micros)));
+
+  TEST_ASSERT(transaction.Commit());
+
+  LOG(("TestDatabaseFirstUse - passed\n"));
+  return true;
+}
+
 bool TestParseHttpStatusLine(std::string16 *error) {
 #undef TEST_ASSERT
 #define TEST_ASSERT(b) \
@@ -1260,6 +1847,138 @@ bool TestParseHttpStatusLine(std::string16 *error) {
 }
 
 
+bool TestPayloadHeaders(std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestPayloadHeaders - failed (%d)\n", __LINE__)); \
+    assert(error); \
+    *error += STRING16(L"TestPayloadHeaders - failed. "); \
+    return false; \
+  } \
+}
+  // Values larger than an arena block, and lines too long to be copied
+  // onto the stack when const_cast is not allowed, parse as expected
+  std::string long_value(3000, 'x');
+  std::string raw("HTTP/1.1 200 OK\r\n"
+                  "Content-Type: text/html\r\n"
+                  "X-Dup: one\r\n"
+                  "X-Long: ");
+  raw += long_value;
+  raw += "\r\nX-Dup: two\r\n"
+         "X-Folded: first\r\n"
+         "  second\r\n"
+         "Set-Cookie: a=1\r\n"
+         "Set-Cookie: b=2\r\n"
+         "\r\n";
+  for (int allow_const_cast = 0; allow_const_cast < 2; ++allow_const_cast) {
+    HTTPHeaders parsed;
+    for (int pass = 0; pass < 2; ++pass) {  // the second reuses the arena
+      parsed.ClearHeaders();
+      const char *body = raw.c_str();
+      uint32 body_len = raw.length();
+      TEST_ASSERT(HTTPUtils::ParseHTTPHeaders(&body, &body_len, &parsed,
+                                              allow_const_cast != 0));
+      TEST_ASSERT(body_len == 0);
+      TEST_ASSERT(parsed.response_code() == 200);
+      TEST_ASSERT(parsed.HeaderIs("content-type", "text/html"));
+      TEST_ASSERT(parsed.HeaderIs("X-Dup", "one,two"));
+      TEST_ASSERT(parsed.HeaderIs("X-Folded", "first second"));
+      TEST_ASSERT(parsed.HeaderIs("X-Long", long_value.c_str()));
+      std::vector<const char*> cookies;
+      parsed.GetHeaders(HTTPHeaders::SET_COOKIE, &cookies);
+      TEST_ASSERT(cookies.size() == 2);
+    }
+  }
+
+  // Adjusted headers are indexed, lookups through the index agree with
+  // lookups that parse the headers
+  WebCacheDB::PayloadInfo payload;
+  payload.status_code = HttpConstants::HTTP_OK;
+  payload.status_line = STRING16(L"HTTP/1.1 200 OK");
+  UTF8ToString16(raw.c_str() + strlen("HTTP/1.1 200 OK\r\n"),
+                 &payload.headers);
+  payload.data.reset(new std::vector<uint8>(10, 'a'));
+  std::string16 adjusted_headers;
+  std::vector<uint16> adjusted_index;
+  TEST_ASSERT(payload.PassesValidationTests(&adjusted_headers,
+                                            &adjusted_index));
+  TEST_ASSERT(!adjusted_index.empty());
+  TEST_ASSERT(adjusted_index[0] == adjusted_headers.length());
+
+  WebCacheDB::PayloadInfo parsed_payload;
+  parsed_payload.headers = adjusted_headers;
+  WebCacheDB::PayloadInfo indexed_payload;
+  indexed_payload.headers = adjusted_headers;
+  std::vector<uint8> blob;
+  WebCacheDB::PayloadInfo::WriteHeaderIndex(adjusted_index, &blob);
+  TEST_ASSERT(WebCacheDB::PayloadInfo::ReadHeaderIndex(
+                  blob, &indexed_payload.header_index));
+  TEST_ASSERT(indexed_payload.header_index == adjusted_index);
+
+  const char16 *names[] = {
+    STRING16(L"Content-Type"),
+    STRING16(L"content-length"),
+    STRING16(L"X-DUP"),
+    STRING16(L"X-Folded"),
+    STRING16(L"X-Long"),
+    STRING16(L"Set-Cookie"),
+    STRING16(L"X-Missing"),
+    STRING16(L"X-Du"),
+  };
+  for (size_t i = 0; i < ARRAYSIZE(names); ++i) {
+    std::string16 parsed_value, indexed_value;
+    bool parsed_found = parsed_payload.GetHeader(names[i], &parsed_value);
+    bool indexed_found = indexed_payload.GetHeader(names[i], &indexed_value);
+    TEST_ASSERT(parsed_found == indexed_found);
+    TEST_ASSERT(parsed_value == indexed_value);
+  }
+  std::string16 value;
+  TEST_ASSERT(indexed_payload.GetHeader(STRING16(L"Content-Length"), &value));
+  TEST_ASSERT(value == STRING16(L"10"));
+  TEST_ASSERT(indexed_payload.GetHeader(STRING16(L"set-cookie"), &value));
+  TEST_ASSERT(value == STRING16(L"a=1"));
+
+  // A stale index is ignored
+  WebCacheDB::PayloadInfo stale_payload;
+  stale_payload.headers = STRING16(L"Content-Type: text/plain\r\n\r\n");
+  stale_payload.header_index = adjusted_index;
+  TEST_ASSERT(stale_payload.GetHeader(STRING16(L"Content-Type"), &value));
+  TEST_ASSERT(value == STRING16(L"text/plain"));
+  TEST_ASSERT(!stale_payload.GetHeader(STRING16(L"X-Dup"), &value));
+
+  // Malformed blobs are rejected
+  std::vector<uint16> index;
+  blob.resize(3);
+  TEST_ASSERT(!WebCacheDB::PayloadInfo::ReadHeaderIndex(blob, &index));
+  blob.resize(4);
+  TEST_ASSERT(!WebCacheDB::PayloadInfo::ReadHeaderIndex(blob, &index));
+  blob.clear();
+  TEST_ASSERT(WebCacheDB::PayloadInfo::ReadHeaderIndex(blob, &index));
+  TEST_ASSERT(index.empty());
+
+  // Compare the cost of the lookups made when serving a payload
+  const int kLookups = 10000;
+  int64 start = GetTicks();
+  for (int i = 0; i < kLookups; ++i) {
+    parsed_payload.GetHeader(HttpConstants::kContentTypeHeader, &value);
+  }
+  int64 parsed_micros = GetTickDeltaMicros(start, GetTicks());
+  start = GetTicks();
+  for (int i = 0; i < kLookups; ++i) {
+    indexed_payload.GetHeader(HttpConstants::kContentTypeHeader, &value);
+  }
+  int64 indexed_micros = GetTickDeltaMicros(start, GetTicks());
+  LOG(("TestPayloadHeaders - %d lookups: parsed %dms, indexed %dms\n",
+       kLookups, static_cast<int>(parsed_micros / 1000),
+       static_cast<int>(indexed_micros / 1000)));
+
+  LOG(("TestPayloadHeaders - passed\n"));
+  return true;
+}
+
+
 class TestHttpRequestListener : public HttpRequest::HttpListener {
  public:
   explicit TestHttpRequestListener(HttpRequest *request) : request_(request) {}
@@ -54,6 +54,11 @@ class GearsTest : public ModuleImplBaseClass {
   // OUT: int64 elapsed_microseconds
   void StopPerfTimer(JsCallContext *context);
 
+  // IN: nothing
+  // OUT: array of {origin, type, bytes, allocations}, one for each origin and
+  //      type that currently has memory accounted to it
+  void GetMemoryAccounting(JsCallContext *context);
+
   // IN: bool is_worker
   // OUT: nothing
   void RunTests(JsCallContext *context);
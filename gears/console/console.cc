@@ -25,8 +25,10 @@
 
 #include "gears/console/console.h"
 
+#include "gears/base/common/memory_accounting.h"
 #include "gears/base/common/message_service.h"
 #include "gears/console/log_event.h"
+#include "gears/console/log_queue.h"
 
 DECLARE_DISPATCHER(GearsConsole);
 
@@ -36,6 +38,7 @@ template<>
 void Dispatcher<GearsConsole>::Init() {
   RegisterMethod("log", &GearsConsole::Log);
   RegisterProperty("onlog", &GearsConsole::GetOnLog, &GearsConsole::SetOnLog);
+  RegisterMethod("getMemoryUsage", &GearsConsole::GetMemoryUsage);
 }
 
 void GearsConsole::Log(JsCallContext *context) {
@@ -66,13 +69,17 @@ void GearsConsole::Log(JsCallContext *context) {
     return;
   }
   
-  std::string16 msg = message;
+  // Skip the work of building the event if nobody will receive it.
+  if (!MessageService::GetInstance()->HasObservers(observer_topic_.c_str())) {
+    return;
+  }
+
+  std::vector<std::string16> arg_strings;
   if (argv[2].was_specified) {
-    InterpolateArgs(&message, args_array.get());
+    CoerceArgs(message, args_array.get(), &arg_strings);
   }
-  LogEvent *log_event = new LogEvent(message, type_str, EnvPageLocationUrl());
-  MessageService::GetInstance()->NotifyObservers(observer_topic_.c_str(),
-                                                 log_event);
+  LogQueue::Add(observer_topic_, new LogEvent(message, arg_strings, type_str,
+                                              EnvPageLocationUrl()));
 }
 
 void GearsConsole::GetOnLog(JsCallContext *context) {
@@ -101,6 +108,46 @@ void GearsConsole::SetOnLog(JsCallContext *context) {
   callback_backend_->SetCallback(scoped_function.release());
 }
 
+static bool SetMemoryUsageProperties(const MemoryAccounting::Usage &usage,
+                                     JsObject *object) {
+  return object->SetPropertyDouble(STRING16(L"bytes"),
+                                   static_cast<double>(usage.bytes)) &&
+         object->SetPropertyDouble(STRING16(L"allocations"),
+                                   static_cast<double>(usage.allocations));
+}
+
+void GearsConsole::GetMemoryUsage(JsCallContext *context) {
+  JsRunnerInterface *js_runner = GetJsRunner();
+  int origin_id = MemoryAccounting::GetOriginId(EnvPageSecurityOrigin().url());
+  MemoryAccounting::Usage usage;
+  MemoryAccounting::GetUsage(origin_id, MAX_MEMORY_ACCOUNTING_TYPE, &usage);
+
+  scoped_ptr<JsObject> result(js_runner->NewObject());
+  scoped_ptr<JsObject> types(js_runner->NewObject());
+  if (!result.get() || !types.get() ||
+      !SetMemoryUsageProperties(usage, result.get())) {
+    context->SetException(STRING16(L"Error reading memory usage."));
+    return;
+  }
+  for (int i = 0; i < MAX_MEMORY_ACCOUNTING_TYPE; ++i) {
+    MemoryAccountingType type = static_cast<MemoryAccountingType>(i);
+    MemoryAccounting::GetUsage(origin_id, type, &usage);
+    scoped_ptr<JsObject> type_usage(js_runner->NewObject());
+    if (!type_usage.get() ||
+        !SetMemoryUsageProperties(usage, type_usage.get()) ||
+        !types->SetPropertyObject(MemoryAccounting::GetTypeName(type),
+                                  type_usage.get())) {
+      context->SetException(STRING16(L"Error reading memory usage."));
+      return;
+    }
+  }
+  if (!result->SetPropertyObject(STRING16(L"types"), types.get())) {
+    context->SetException(STRING16(L"Error reading memory usage."));
+    return;
+  }
+  context->SetReturnValue(JSPARAM_OBJECT, result.get());
+}
+
 void GearsConsole::Initialize() {
   if (!callback_backend_.get()) {
     observer_topic_ =
@@ -117,22 +164,22 @@ void GearsConsole::Initialize() {
 }
 
 // static
-void GearsConsole::InterpolateArgs(std::string16 *message,
-                                   const JsArray *args) {
-  std::string16::size_type location = 0;
+void GearsConsole::CoerceArgs(const std::string16 &message,
+                              const JsArray *args,
+                              std::vector<std::string16> *arg_strings) {
   int args_length;
   if (!args->GetLength(&args_length)) return;
 
+  std::string16::size_type location = 0;
   for (int i = 0; i < args_length; i++) {
     // Find the _next_ occurance of %s
-    location = message->find(STRING16(L"%s"), location);
+    location = message.find(STRING16(L"%s"), location);
     if (location == std::string16::npos) break;
+    location += 2;
 
     std::string16 string_value(STRING16(L"<Error converting to string>"));
     args->GetElementAsStringWithCoercion(i, &string_value);
-
-    message->replace(location, 2, string_value);
-    location += string_value.size();
+    arg_strings->push_back(string_value);
   }
 }
 
@@ -26,6 +26,7 @@
 #ifndef GEARS_CONSOLE_CONSOLE_H__
 #define GEARS_CONSOLE_CONSOLE_H__
 
+#include <vector>
 #include "gears/base/common/base_class.h"
 #include "gears/base/common/common.h"
 #include "gears/base/common/js_runner.h"
@@ -52,12 +53,20 @@ class GearsConsole
   // IN: function callback
   // OUT: -
   void SetOnLog(JsCallContext *context);
+
+  // IN: -
+  // OUT: object {bytes, allocations, types}, the memory held on behalf of
+  //      this origin, broken down by the kind of object holding it
+  void GetMemoryUsage(JsCallContext *context);
   
  private:
   void Initialize();
 
-  // Replaces instances of _%s_ in message with elements from _args[]_
-  static void InterpolateArgs(std::string16 *message, const JsArray *args);
+  // Converts to strings as many elements of _args[]_ as there are instances
+  // of _%s_ in message for them to replace. The replacement itself is left to
+  // LogEvent, which does it only if the message is read.
+  static void CoerceArgs(const std::string16 &message, const JsArray *args,
+                         std::vector<std::string16> *arg_strings);
 
   // From JsEventHandlerInterface.
   virtual void HandleEvent(JsEventType event_type);
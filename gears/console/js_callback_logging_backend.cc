@@ -34,6 +34,7 @@ JsCallbackLoggingBackend::JsCallbackLoggingBackend(const std::string16 &topic,
                                                    GearsConsole *console)
     : observer_topic_(topic), js_runner_(js_runner), console_(console) {
   LogEvent::RegisterLogEventClass();
+  LogEventBatch::RegisterLogEventBatchClass();
 }
 
 JsCallbackLoggingBackend::~JsCallbackLoggingBackend() {
@@ -49,8 +50,17 @@ void JsCallbackLoggingBackend::OnNotify(MessageService *service,
   // its release, which deletes us.
   scoped_refptr<GearsConsole> hold(console_);
 
-  const LogEvent *log_event = static_cast<const LogEvent *>(data);
-  
+  const LogEventBatch *batch = static_cast<const LogEventBatch *>(data);
+  for (size_t i = 0; i < batch->size(); ++i) {
+    // The callback may have cleared itself while handling an earlier event.
+    if (!callback_.get()) return;
+    int dropped_count = (i == 0) ? batch->dropped_count() : 0;
+    InvokeCallback(batch->event(i), dropped_count);
+  }
+}
+
+void JsCallbackLoggingBackend::InvokeCallback(const LogEvent *log_event,
+                                              int dropped_count) {
   scoped_ptr<JsObject> callback_params;
   callback_params.reset(js_runner_->NewObject());
   if (!callback_params.get()) return;
@@ -61,6 +71,8 @@ void JsCallbackLoggingBackend::OnNotify(MessageService *service,
                                            log_event->type().c_str());
   callback_params.get()->SetPropertyString(STRING16(L"sourceUrl"),
                                            log_event->sourceUrl().c_str());
+  callback_params.get()->SetPropertyInt(STRING16(L"droppedCount"),
+                                        dropped_count);
   scoped_ptr<JsObject> date(js_runner_->NewDate(log_event->date()));
   if (date.get()) {
     callback_params.get()->SetPropertyObject(STRING16(L"date"),
@@ -55,6 +55,10 @@ class JsCallbackLoggingBackend : public MessageObserverInterface {
   void ClearCallback();
 
  private:
+  // Passes one event to the callback. 'dropped_count' is the number of events
+  // that were dropped immediately before this one.
+  void InvokeCallback(const LogEvent *log_event, int dropped_count);
+
   std::string16 observer_topic_;
 
   // A callback for receiving log messages
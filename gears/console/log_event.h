@@ -26,23 +26,41 @@
 #ifndef GEARS_CONSOLE_LOG_EVENT_H__
 #define GEARS_CONSOLE_LOG_EVENT_H__
 
+#include <vector>
 #include "gears/base/common/basictypes.h"
 #include "gears/base/common/message_service.h"
 #include "gears/base/common/stopwatch.h"
 #include "gears/base/common/string16.h"
+#include "third_party/linked_ptr/linked_ptr.h"
 
 
 // LogEvent is a simple class that encapsulates information about a single
 // log event.
 class LogEvent : public NotificationData {
  public:
+  // Instances of %s in 'message' are replaced with elements of 'args' when
+  // the message is read, so that events nobody reads are never formatted.
   LogEvent(const std::string16 &message,
+           const std::vector<std::string16> &args,
            const std::string16 &type,
            const std::string16 &source_url)
-   : message_(message), type_(type), source_url_(source_url),
+   : message_(message), args_(args), type_(type), source_url_(source_url),
      date_(GetCurrentTimeMillis()) { }
   
-  const std::string16& message() const { return message_; }
+  // Returns the message with its arguments interpolated. The result is not
+  // cached because an event may be read on several threads at once.
+  std::string16 message() const {
+    std::string16 result(message_);
+    std::string16::size_type location = 0;
+    for (size_t i = 0; i < args_.size(); ++i) {
+      // Find the _next_ occurance of %s
+      location = result.find(STRING16(L"%s"), location);
+      if (location == std::string16::npos) break;
+      result.replace(location, 2, args_[i]);
+      location += args_[i].size();
+    }
+    return result;
+  }
   const std::string16& type() const { return type_; }
   const std::string16& sourceUrl() const { return source_url_; }
   const int64& date() const { return date_; }
@@ -52,14 +70,29 @@ class LogEvent : public NotificationData {
   }
   virtual bool Serialize(Serializer *out) const {
     out->WriteString(message_.c_str());
+    out->WriteInt(static_cast<int>(args_.size()));
+    for (size_t i = 0; i < args_.size(); ++i) {
+      out->WriteString(args_[i].c_str());
+    }
     out->WriteString(type_.c_str());
     out->WriteString(source_url_.c_str());
     out->WriteInt64(date_);
     return true;
   }
   virtual bool Deserialize(Deserializer *in) {
-    return in->ReadString(&message_) &&
-           in->ReadString(&type_) &&
+    int args_size;
+    if (!in->ReadString(&message_) ||
+        !in->ReadInt(&args_size) ||
+        args_size < 0) {
+      return false;
+    }
+    args_.resize(args_size);
+    for (int i = 0; i < args_size; ++i) {
+      if (!in->ReadString(&args_[i])) {
+        return false;
+      }
+    }
+    return in->ReadString(&type_) &&
            in->ReadString(&source_url_) &&
            in->ReadInt64(&date_);
   }
@@ -67,7 +100,10 @@ class LogEvent : public NotificationData {
     Serializable::RegisterClass(SERIALIZABLE_CONSOLE_LOG_EVENT, New);
   }  
  private:
+  friend class LogEventBatch;
+
   std::string16 message_;
+  std::vector<std::string16> args_;
   std::string16 type_;        // 'debug', 'info', 'warn', 'error'
   std::string16 source_url_;  
   int64 date_;                // Time in milliseconds since 1/1/1970 UTC
@@ -79,4 +115,68 @@ class LogEvent : public NotificationData {
   }
 };
 
+
+// LogEventBatch carries consecutive events logged on one thread to the
+// observers of a log stream, so that a burst of logging costs a single
+// notification rather than one per event. See LogQueue.
+class LogEventBatch : public NotificationData {
+ public:
+  LogEventBatch() : dropped_count_(0) {}
+
+  // Takes ownership of 'event'.
+  void AddEvent(LogEvent *event) {
+    events_.push_back(linked_ptr<LogEvent>(event));
+  }
+  size_t size() const { return events_.size(); }
+  const LogEvent *event(size_t i) const { return events_[i].get(); }
+
+  // The number of events that were discarded, immediately before the first
+  // event in this batch, because they were logged faster than they could be
+  // delivered.
+  int dropped_count() const { return dropped_count_; }
+  void set_dropped_count(int dropped_count) { dropped_count_ = dropped_count; }
+
+  virtual SerializableClassId GetSerializableClassId() const {
+    return SERIALIZABLE_CONSOLE_LOG_EVENT_BATCH;
+  }
+  virtual bool Serialize(Serializer *out) const {
+    out->WriteInt(dropped_count_);
+    out->WriteInt(static_cast<int>(events_.size()));
+    for (size_t i = 0; i < events_.size(); ++i) {
+      if (!events_[i]->Serialize(out)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  virtual bool Deserialize(Deserializer *in) {
+    int size;
+    if (!in->ReadInt(&dropped_count_) ||
+        !in->ReadInt(&size) ||
+        size < 0) {
+      return false;
+    }
+    for (int i = 0; i < size; ++i) {
+      LogEvent *event = new LogEvent;
+      AddEvent(event);
+      if (!event->Deserialize(in)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  static void RegisterLogEventBatchClass() {
+    Serializable::RegisterClass(SERIALIZABLE_CONSOLE_LOG_EVENT_BATCH, New);
+  }
+ private:
+  std::vector<linked_ptr<LogEvent> > events_;
+  int dropped_count_;
+
+  static Serializable *New() {
+    return new LogEventBatch;
+  }
+
+  DISALLOW_EVIL_CONSTRUCTORS(LogEventBatch);
+};
+
 #endif // GEARS_CONSOLE_LOG_EVENT_H__
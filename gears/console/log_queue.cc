@@ -0,0 +1,219 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/console/log_queue.h"
+
+#include <deque>
+#include "gears/base/common/async_router.h"
+#include "gears/base/common/message_service.h"
+#include "gears/base/common/mutex.h"
+#include "gears/base/common/scoped_refptr.h"
+#include "gears/base/common/thread_locals.h"
+#include "gears/console/log_event.h"
+
+static const ThreadLocals::Slot kThreadLocalKey = ThreadLocals::Alloc();
+
+// Runs on a queue's thread to send the events waiting there.
+class LogQueue::FlushFunctor : public AsyncFunctor {
+ public:
+  virtual void Run() {
+    LogQueue *queue = LogQueue::GetCurrent(false);
+    if (queue) {
+      queue->flush_scheduled_ = false;
+      queue->Flush(false);
+    }
+  }
+};
+
+// Counts the batches from one thread and stream that have not yet been
+// delivered to every observer, and asks that thread to flush again when one
+// completes while events are held back. Batches are released on whichever
+// thread handles them last, so this is shared between threads.
+class LogQueue::FlowControl : public RefCounted {
+ public:
+  explicit FlowControl(ThreadId thread_id)
+      : thread_id_(thread_id), in_flight_(0), flush_wanted_(false) {}
+
+  // Counts a new batch as in flight and returns true if there is room for
+  // it, or if 'ignore_limit' is set.
+  bool BeginBatch(bool ignore_limit) {
+    MutexLock lock(&lock_);
+    if (!ignore_limit && in_flight_ >= kMaxBatchesInFlight) {
+      flush_wanted_ = true;
+      return false;
+    }
+    ++in_flight_;
+    return true;
+  }
+
+  void EndBatch() {
+    bool flush_wanted;
+    {
+      MutexLock lock(&lock_);
+      assert(in_flight_ > 0);
+      --in_flight_;
+      flush_wanted = flush_wanted_;
+      flush_wanted_ = false;
+    }
+    if (flush_wanted) {
+      // Fails harmlessly if the thread has gone away.
+      AsyncRouter::GetInstance()->CallAsync(thread_id_, new FlushFunctor);
+    }
+  }
+
+ private:
+  ThreadId thread_id_;
+  Mutex lock_;
+  int in_flight_;
+  bool flush_wanted_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(FlowControl);
+};
+
+// A batch that tells its FlowControl when the last observer is done with it.
+class LogQueue::TrackedBatch : public LogEventBatch {
+ public:
+  explicit TrackedBatch(FlowControl *flow_control)
+      : flow_control_(flow_control) {}
+  virtual ~TrackedBatch() {
+    flow_control_->EndBatch();
+  }
+
+ private:
+  scoped_refptr<FlowControl> flow_control_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TrackedBatch);
+};
+
+// The events waiting to be sent for one log stream.
+struct LogQueue::Stream {
+  Stream() : dropped_count(0) {}
+  std::deque<linked_ptr<LogEvent> > pending;
+  int dropped_count;  // Events dropped since the last batch was sent.
+  scoped_refptr<FlowControl> flow_control;
+};
+
+LogQueue::LogQueue()
+    : thread_id_(ThreadMessageQueue::GetInstance()->GetCurrentThreadId()),
+      can_schedule_flush_(
+          ThreadMessageQueue::GetInstance()->InitThreadMessageQueue()),
+      flush_scheduled_(false) {
+}
+
+LogQueue::~LogQueue() {
+  // The thread is going away, so send whatever is left regardless of how
+  // much is already in flight.
+  for (StreamMap::iterator iter = streams_.begin(); iter != streams_.end();
+       ++iter) {
+    FlushStream(iter->first, iter->second.get(), false, true);
+  }
+}
+
+// static
+LogQueue *LogQueue::GetCurrent(bool create_if_needed) {
+  LogQueue *queue =
+      reinterpret_cast<LogQueue*>(ThreadLocals::GetValue(kThreadLocalKey));
+  if (!queue && create_if_needed) {
+    queue = new LogQueue;
+    ThreadLocals::SetValue(kThreadLocalKey, queue, &DestroyQueue);
+  }
+  return queue;
+}
+
+// static
+void LogQueue::DestroyQueue(void *queue) {
+  delete reinterpret_cast<LogQueue*>(queue);
+}
+
+// static
+void LogQueue::Add(const std::string16 &topic, LogEvent *event) {
+  LogQueue *queue = GetCurrent(true);
+  linked_ptr<Stream> &stream_ptr = queue->streams_[topic];
+  if (!stream_ptr.get()) {
+    stream_ptr.reset(new Stream);
+    stream_ptr->flow_control = new FlowControl(queue->thread_id_);
+  }
+  Stream &stream = *stream_ptr;
+
+  stream.pending.push_back(linked_ptr<LogEvent>(event));
+  if (stream.pending.size() > static_cast<size_t>(kMaxPendingEvents)) {
+    if (stream.dropped_count == 0) {
+      LOG(("Log events are arriving too quickly, dropping the oldest\n"));
+    }
+    stream.pending.pop_front();
+    ++stream.dropped_count;
+  }
+
+  if (!queue->can_schedule_flush_) {
+    // There is no message loop to come back to, so send events right away.
+    queue->FlushStream(topic, &stream, false, false);
+    return;
+  }
+  queue->FlushStream(topic, &stream, true, false);
+  if (!stream.pending.empty()) {
+    queue->ScheduleFlush();
+  }
+}
+
+void LogQueue::ScheduleFlush() {
+  if (flush_scheduled_) {
+    return;
+  }
+  flush_scheduled_ = true;
+  if (!AsyncRouter::GetInstance()->CallAsync(thread_id_, new FlushFunctor)) {
+    flush_scheduled_ = false;
+    Flush(false);
+  }
+}
+
+void LogQueue::Flush(bool full_batches_only) {
+  for (StreamMap::iterator iter = streams_.begin(); iter != streams_.end();
+       ++iter) {
+    FlushStream(iter->first, iter->second.get(), full_batches_only, false);
+  }
+}
+
+void LogQueue::FlushStream(const std::string16 &topic, Stream *stream,
+                           bool full_batches_only, bool ignore_flow_control) {
+  while (!stream->pending.empty()) {
+    if (full_batches_only &&
+        stream->pending.size() < static_cast<size_t>(kMaxBatchSize)) {
+      return;
+    }
+    if (!stream->flow_control->BeginBatch(ignore_flow_control)) {
+      // FlowControl will schedule another flush when a batch completes.
+      return;
+    }
+    TrackedBatch *batch = new TrackedBatch(stream->flow_control.get());
+    batch->set_dropped_count(stream->dropped_count);
+    stream->dropped_count = 0;
+    while (!stream->pending.empty() &&
+           batch->size() < static_cast<size_t>(kMaxBatchSize)) {
+      batch->AddEvent(stream->pending.front().release());
+      stream->pending.pop_front();
+    }
+    MessageService::GetInstance()->NotifyObservers(topic.c_str(), batch);
+  }
+}
@@ -0,0 +1,87 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GEARS_CONSOLE_LOG_QUEUE_H__
+#define GEARS_CONSOLE_LOG_QUEUE_H__
+
+#include <map>
+#include "gears/base/common/basictypes.h"
+#include "gears/base/common/message_queue.h"
+#include "gears/base/common/string16.h"
+#include "third_party/linked_ptr/linked_ptr.h"
+
+class LogEvent;
+
+// LogQueue buffers the events logged on a thread and delivers them to the
+// observers of their log stream in batches, rather than sending a
+// notification per event. A batch is sent the next time the thread returns
+// to its message loop, or as soon as kMaxBatchSize events are waiting.
+//
+// To keep a thread that logs heavily from flooding the threads observing its
+// log stream, at most kMaxBatchesInFlight batches from one thread and stream
+// may be awaiting delivery at a time. Events logged while that many are
+// outstanding wait in the queue, and once kMaxPendingEvents are waiting the
+// oldest are dropped. The next batch delivered reports how many events were
+// dropped before it.
+class LogQueue {
+ public:
+  static const int kMaxBatchSize = 100;
+  static const int kMaxBatchesInFlight = 10;
+  static const int kMaxPendingEvents = 1000;
+
+  // Queues 'event' for delivery to the observers of 'topic' using the
+  // current thread's queue. Takes ownership of 'event'.
+  static void Add(const std::string16 &topic, LogEvent *event);
+
+ private:
+  class FlowControl;
+  class FlushFunctor;
+  class TrackedBatch;
+  struct Stream;
+  typedef std::map<std::string16, linked_ptr<Stream> > StreamMap;
+
+  LogQueue();
+  ~LogQueue();
+
+  // Returns the current thread's queue, creating it if 'create_if_needed'.
+  static LogQueue *GetCurrent(bool create_if_needed);
+  static void DestroyQueue(void *queue);
+
+  // Sends batches for each stream while its flow control allows. If
+  // 'full_batches_only', events that would not fill a batch are left waiting.
+  void Flush(bool full_batches_only);
+  void FlushStream(const std::string16 &topic, Stream *stream,
+                   bool full_batches_only, bool ignore_flow_control);
+  void ScheduleFlush();
+
+  ThreadId thread_id_;
+  bool can_schedule_flush_;
+  bool flush_scheduled_;
+  StreamMap streams_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(LogQueue);
+};
+
+#endif  // GEARS_CONSOLE_LOG_QUEUE_H__
@@ -34,6 +34,7 @@
 #include "gears/base/common/sqlite_wrapper.h"
 #include "gears/base/common/string16.h"
 #include "gears/base/common/string_utils.h"
+#include "gears/base/common/trace_events.h"
 #include "gears/database/database_utils.h"
 #include "gears/database/result_set.h"
 
@@ -140,6 +141,7 @@ void GearsDatabase::Execute(JsCallContext *context) {
 
 #ifdef DEBUG
   ScopedStopwatch scoped_stopwatch(&GearsDatabase::g_stopwatch_);
+  TRACE_EVENT("database", "Database.Execute");
 #endif // DEBUG
 
   if (!EnsureDatabaseIsOpen(context)) return;
@@ -39,6 +39,28 @@
 #define strncasecmp _strnicmp
 #endif
 
+// Virtual table modules that Gears callers may create tables with.  Only the
+// full-text search modules are compiled in, but this keeps anything added to
+// the SQLite build later from being exposed by accident.
+static const char *kAllowedVirtualTableModules[] = {
+  "fts1",
+  "fts2",
+  "fts3",
+};
+
+// The full-text search modules select a tokenizer by name when a table is
+// created, e.g. "CREATE VIRTUAL TABLE t USING fts3(body, tokenize porter)".
+// The names are looked up in a registry that holds only the built-in
+// "simple" and "porter" tokenizers (the ICU tokenizer is not compiled in).
+// The only way to add to the registry, or to read the tokenizer pointers
+// out of it, is the fts*_tokenizer() SQL function, so denying that function
+// restricts callers to the built-in tokenizers.
+static bool IsTokenizerFunction(const char *name) {
+  return !strcasecmp(name, "fts1_tokenizer") ||
+         !strcasecmp(name, "fts2_tokenizer") ||
+         !strcasecmp(name, "fts3_tokenizer");
+}
+
 int ForbidActions(void *userData, int iType,
                   const char *zPragma, const char *zArg,
                   const char *zDatabase, const char *zView) {
@@ -56,9 +78,19 @@ int ForbidActions(void *userData, int iType,
     // ATTACH the vacuum db.
     return SQLITE_DENY;
   }
+  if (iType == SQLITE_CREATE_VTABLE || iType == SQLITE_DROP_VTABLE) {
+    // zArg is the module name.
+    for (size_t i = 0; i < ARRAYSIZE(kAllowedVirtualTableModules); ++i) {
+      if (zArg && !strcasecmp(zArg, kAllowedVirtualTableModules[i])) {
+        return SQLITE_OK;
+      }
+    }
+    LOG(("Denying attempt to use virtual table module (%s)\n",
+         zArg ? zArg : "NULL"));
+    return SQLITE_DENY;
+  }
   if (iType == SQLITE_FUNCTION) {
-    if (!strcasecmp(zArg, "fts2_tokenizer")
-          || !strcasecmp(zArg, "fts3_tokenizer")) {
+    if (IsTokenizerFunction(zArg)) {
       LOG(("Denying attempt to use FTS tokenizer (%s)\n", zArg));
       return SQLITE_DENY;
     }
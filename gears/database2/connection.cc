@@ -289,9 +289,40 @@ void Database2BufferingRowHandler::HandleStats(int64 last_insert_rowid,
 
 bool Database2BufferingRowHandler::CopyTo(
                                        Database2RowHandlerInterface *target) {
-  // TODO(dimitri.glazkov): implement copying contents of this instance into
-  // target
-  return false;
+  // the target takes ownership of the column names
+  std::string16 *column_names = new std::string16[column_count_];
+  for (int i = 0; i < column_count_; ++i) {
+    column_names[i] = column_names_[i];
+  }
+  target->Init(column_count_, column_names);
+
+  for (unsigned int i = 0; i < rows_.size(); ++i) {
+    target->HandleNewRow();
+    Database2Variant *row = rows_[i];
+    for (int j = 0; j < column_count_; ++j) {
+      bool result;
+      switch (row[j].type) {
+        case JSPARAM_INT:
+          result = target->HandleColumnInt(j, row[j].int_value);
+          break;
+        case JSPARAM_DOUBLE:
+          result = target->HandleColumnDouble(j, row[j].double_value);
+          break;
+        case JSPARAM_STRING16:
+          result = target->HandleColumnString(j, *row[j].string_value);
+          break;
+        default:
+          result = target->HandleColumnNull(j);
+          break;
+      }
+      if (!result) {
+        return false;
+      }
+    }
+  }
+
+  target->HandleStats(last_insert_rowid_, rows_affected_);
+  return true;
 }
 
 void Database2Connection::Rollback() {
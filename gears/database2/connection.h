@@ -100,6 +100,9 @@ class Database2Connection : public RefCounted {
   void Rollback();
   bool Commit();
 
+  const SecurityOrigin &origin() const { return origin_; }
+  const std::string16 &filename() const { return filename_; }
+
   int error_code() const { return error_code_; }
   const std::string16 &error_message() const { return error_message_; }
 
@@ -128,7 +131,8 @@ class Database2Connection : public RefCounted {
 // method to apply the data to another row handler.
 class Database2BufferingRowHandler : public Database2RowHandlerInterface {
  public:
-  Database2BufferingRowHandler() : column_count_(0) {}
+  Database2BufferingRowHandler()
+      : rows_affected_(0), last_insert_rowid_(0), column_count_(0) {}
   ~Database2BufferingRowHandler() {
     // remove all rows
     for(unsigned int i = 0; i < rows_.size(); ++i) {
@@ -145,6 +149,8 @@ class Database2BufferingRowHandler : public Database2RowHandlerInterface {
   virtual bool HandleColumnNull(int index);
   virtual void HandleStats(int64 last_insert_rowid, int rows_affected);
 
+  // Applies the stored data to target, as if it had handled the results
+  // directly. Returns false if target fails to handle a column.
   bool CopyTo(Database2RowHandlerInterface *target);
  private:
 
@@ -56,6 +56,12 @@ bool GearsDatabase2::Create(ModuleEnvironment *module_environment,
 
   instance->get()->version_.assign(version);
   instance->get()->connection_.reset(connection);
+  // all instances for the same database file share the interpreter thread
+  std::string16 database_key(connection->origin().url());
+  database_key += STRING16(L"/");
+  database_key += connection->filename();
+  Database2ThreadedInterpreter::GetInstance(
+      database_key, &instance->get()->threaded_interpreter_);
   return true;
 }
 
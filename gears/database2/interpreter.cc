@@ -25,6 +25,9 @@
 
 #include "gears/database2/interpreter.h"
 
+#include <map>
+
+#include "gears/base/common/thread.h"
 #include "gears/database2/commands.h"
 
 void Database2Interpreter::Run(Database2Command *command) {
@@ -36,12 +39,198 @@ void Database2Interpreter::Run(Database2Command *command) {
   }
 }
 
+// A command waiting to be executed, along with the thread that ran it
+struct Database2ThreadedInterpreter::QueuedCommand {
+  QueuedCommand(Database2Command *cmd, ThreadId thread_id)
+      : command(cmd), reply_thread_id(thread_id) {}
+  scoped_ptr<Database2Command> command;
+  ThreadId reply_thread_id;
+};
+
+class Database2ThreadedInterpreter::InterpreterThread : public Thread {
+ public:
+  InterpreterThread(Database2ThreadedInterpreter *interpreter)
+      : interpreter_(interpreter) {}
+
+ protected:
+  virtual void Run() {
+    interpreter_->ProcessCommands();
+  }
+
+ private:
+  Database2ThreadedInterpreter *interpreter_;
+  DISALLOW_EVIL_CONSTRUCTORS(InterpreterThread);
+};
+
+// Carries an executed command back to the thread that ran it. The command
+// is always returned, even if it has no results, so that it (and the
+// transaction it refers to) is released on that thread.
+class Database2ResultsMessage : public MessageData {
+ public:
+  Database2ResultsMessage(Database2Command *command, bool has_results)
+      : command_(command), has_results_(has_results) {}
+
+  // If the thread went away before the message was delivered, the message
+  // queue deletes it on some other thread, where the command's JS objects
+  // can not be touched. The command is leaked rather than released there.
+  // Its transaction keeps the interpreter alive, which stays in use for
+  // later commands on the same database file.
+  ~Database2ResultsMessage() {
+    command_.release();
+  }
+
+  // Called on the thread that ran the command.
+  void HandleResults() {
+    if (has_results_) {
+      command_->HandleResults();
+    }
+    command_.reset(NULL);
+  }
+
+ private:
+  scoped_ptr<Database2Command> command_;
+  bool has_results_;
+  DISALLOW_EVIL_CONSTRUCTORS(Database2ResultsMessage);
+};
+
+class Database2ResultsHandler : public ThreadMessageQueue::HandlerInterface {
+ public:
+  virtual void HandleThreadMessage(int message_type,
+                                   MessageData *message_data) {
+    assert(message_type == kDatabase2Interpreter_Results);
+    static_cast<Database2ResultsMessage*>(message_data)->HandleResults();
+  }
+};
+
+// Message handlers can not be unregistered, so there is a single instance
+static Database2ResultsHandler g_results_handler;
+
+// The interpreters for each database file. The map does not hold a
+// reference, an interpreter removes itself when its last one is dropped.
+typedef std::map<std::string16, Database2ThreadedInterpreter*>
+    Database2InterpreterMap;
+static Mutex g_interpreters_mutex;  // guards g_interpreters and Unref()
+static Database2InterpreterMap g_interpreters;
+
+// static
+void Database2ThreadedInterpreter::GetInstance(
+    const std::string16 &database_key,
+    scoped_refptr<Database2ThreadedInterpreter> *instance) {
+  MutexLock lock(&g_interpreters_mutex);
+  Database2ThreadedInterpreter *&interpreter = g_interpreters[database_key];
+  if (!interpreter) {
+    interpreter = new Database2ThreadedInterpreter(
+                          ThreadMessageQueue::GetInstance());
+    interpreter->database_key_ = database_key;
+  }
+  instance->reset(interpreter);
+}
+
+void Database2ThreadedInterpreter::Unref() {
+  {
+    // References are only added by their holders or by GetInstance(), and
+    // only released here, so the count can not change under the lock
+    // unless a holder adds one. That needs a reference besides ours.
+    MutexLock lock(&g_interpreters_mutex);
+    if (GetRef() > 1) {
+      RefCounted::Unref();
+      return;
+    }
+    Database2InterpreterMap::iterator iter =
+        g_interpreters.find(database_key_);
+    if (iter != g_interpreters.end() && iter->second == this) {
+      g_interpreters.erase(iter);
+    }
+  }
+  // Shuts down the thread outside the lock, no one else can find us now
+  RefCounted::Unref();
+}
+
+Database2ThreadedInterpreter::Database2ThreadedInterpreter(
+    ThreadMessageQueue *message_queue)
+    : Database2Interpreter(false),
+      message_queue_(message_queue),
+      thread_id_(0),
+      is_stopping_(false),
+      current_reply_thread_id_(0) {
+  message_queue_->RegisterHandler(kDatabase2Interpreter_Results,
+                                  &g_results_handler);
+}
+
+Database2ThreadedInterpreter::~Database2ThreadedInterpreter() {
+  if (thread_.get()) {
+    assert(message_queue_->GetCurrentThreadId() != thread_id_);
+    {
+      MutexLock lock(&thread_mutex_);
+      is_stopping_ = true;
+    }
+    wake_event_.Signal();
+    thread_->Join();
+  }
+  // Commands hold a reference to us through their transaction, so there
+  // can not be any left
+  QueuedCommand *queued = commands_.Pop();
+  assert(!queued);
+  delete queued;
+}
+
 void Database2ThreadedInterpreter::Run(Database2Command *command) {
-  // get ThreadMessageQueue instance
-  // post item message
-  // on the background thread, invoke Execute, then
-  // if returned true,
-  // post item back to the foreground thread,
-  // when the message is received, invoke HandleResults
-  // delete command when we're done
+  ThreadId current_thread_id = message_queue_->GetCurrentThreadId();
+  ThreadId reply_thread_id = current_thread_id;
+  bool thread_started = true;
+  {
+    MutexLock lock(&thread_mutex_);
+    if (!thread_.get()) {
+      thread_.reset(new InterpreterThread(this));
+      thread_id_ = thread_->Start();
+      if (!thread_id_) {
+        LOG(("Database2ThreadedInterpreter failed to start thread\n"));
+        thread_.reset(NULL);
+        thread_started = false;
+      }
+    }
+    if (thread_started && current_thread_id == thread_id_) {
+      // A command that queues the next one, its results go to the same
+      // thread as those of the command being executed
+      reply_thread_id = current_reply_thread_id_;
+    }
+  }
+  if (!thread_started) {
+    // Fall back to running the command synchronously
+    Database2Interpreter::Run(command);
+    return;
+  }
+  if (reply_thread_id != thread_id_) {
+    message_queue_->InitThreadMessageQueue();
+  }
+  commands_.Push(new QueuedCommand(command, reply_thread_id), NULL);
+  wake_event_.Signal();
+}
+
+void Database2ThreadedInterpreter::ProcessCommands() {
+  while (true) {
+    wake_event_.Wait();
+    {
+      MutexLock lock(&thread_mutex_);
+      if (is_stopping_) {
+        return;
+      }
+    }
+
+    // Drain the queue, commands pushed while this runs are picked up too
+    QueuedCommand *queued;
+    while ((queued = commands_.Pop()) != NULL) {
+      scoped_ptr<QueuedCommand> queued_command(queued);
+      current_reply_thread_id_ = queued_command->reply_thread_id;
+      bool has_results = true;
+      queued_command->command->Execute(&has_results);
+      // HandleResults is invoked on the thread that ran the command, where
+      // the JS objects it touches live. If that thread has gone away, the
+      // message is dropped without releasing the command.
+      message_queue_->Send(
+          queued_command->reply_thread_id, kDatabase2Interpreter_Results,
+          new Database2ResultsMessage(queued_command->command.release(),
+                                      has_results));
+    }
+  }
 }
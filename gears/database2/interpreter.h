@@ -27,7 +27,13 @@
 #define GEARS_DATABASE2_INTERPRETER_H__
 
 #include "gears/base/common/common.h"
+#include "gears/base/common/event.h"
+#include "gears/base/common/message_queue.h"
+#include "gears/base/common/mutex.h"
 #include "gears/base/common/scoped_refptr.h"
+#include "gears/base/common/string16.h"
+#include "gears/database2/thread_safe_queue.h"
+#include "third_party/scoped_ptr/scoped_ptr.h"
 
 // forward class declarations
 class Database2Command;
@@ -35,38 +41,74 @@ class Database2Command;
 // simple (non-threaded) command interpreter
 class Database2Interpreter : public RefCounted {
  public:
-  // TODO(dimitri.glazkov): Because the sub-class depends on ref-counting to
-  // keep track of when to shut down a thread, this base class is also
-  // ref-counted. However, its counting is effectively rendered useless by
-  // Ref'ing in constructor. This is awkward. Must think of a better pattern
-  // here.
   Database2Interpreter() {
     // increment ref to prevent from ever being destroyed
-    if (!async()) Ref();
+    Ref();
   }
   ~Database2Interpreter() {}
 
+  // Virtual so that sub-classes can tell when the last reference goes.
+  virtual void Unref() { RefCounted::Unref(); }
+
   virtual void Run(Database2Command *command);
   virtual bool async() const { return false; }
 
- private:
-  bool async_;
+ protected:
+  // Sub-classes whose lifetime is controlled through reference-counting
+  // pass false, so that no extra reference is held.
+  explicit Database2Interpreter(bool hold_extra_ref) {
+    if (hold_extra_ref) {
+      Ref();
+    }
+  }
 
+ private:
   DISALLOW_EVIL_CONSTRUCTORS(Database2Interpreter);
 };
 
-// threaded interpreter
+// threaded interpreter, executes commands in order on a thread dedicated to
+// a database file and handles their results on the thread that ran them
 class Database2ThreadedInterpreter : public Database2Interpreter {
  public:
-  Database2ThreadedInterpreter() {}
-  ~Database2ThreadedInterpreter() {
-    // shut down thread, if started
-  }
+  // Returns the interpreter for the given database file, creating one if
+  // necessary. The thread is started when the first command is run, and
+  // stopped when the last reference to the interpreter is dropped.
+  static void GetInstance(const std::string16 &database_key,
+                          scoped_refptr<Database2ThreadedInterpreter> *instance);
+
+  // Results are delivered to the calling threads through message_queue.
+  explicit Database2ThreadedInterpreter(ThreadMessageQueue *message_queue);
+  // Shuts down the thread, if started. Must not be called on that thread.
+  ~Database2ThreadedInterpreter();
+
+  // Removes the interpreter from the map of database files before the
+  // last reference is dropped.
+  virtual void Unref();
 
   virtual void Run(Database2Command *command);
   virtual bool async() const { return true; }
 
  private:
+  class InterpreterThread;
+  struct QueuedCommand;
+
+  // Executes queued commands until asked to stop, called on the thread
+  void ProcessCommands();
+
+  ThreadMessageQueue *message_queue_;
+  std::string16 database_key_;  // empty if not created by GetInstance()
+  Database2ThreadSafeQueue<QueuedCommand> commands_;
+  Event wake_event_;
+
+  Mutex thread_mutex_;  // guards starting the thread and is_stopping_
+  scoped_ptr<InterpreterThread> thread_;
+  ThreadId thread_id_;
+  bool is_stopping_;
+
+  // The thread to which the results of the command being executed are
+  // delivered, only accessed on the interpreter thread
+  ThreadId current_reply_thread_id_;
+
   DISALLOW_EVIL_CONSTRUCTORS(Database2ThreadedInterpreter);
 };
 
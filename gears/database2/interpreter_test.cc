@@ -0,0 +1,146 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifdef USING_CCTESTS
+
+#include <assert.h>
+#include <vector>
+
+#include "gears/base/common/common.h"
+#include "gears/base/common/event.h"
+#include "gears/base/common/message_queue.h"
+#include "gears/base/common/stopwatch.h"
+#include "gears/database2/commands.h"
+#include "gears/database2/interpreter.h"
+
+// Stands in for a long-running query, records the order in which results
+// are handled and on which thread.
+class TestSlowCommand : public Database2Command {
+ public:
+  TestSlowCommand(int id, int execute_millis, bool has_results,
+                  MockThreadMessageQueue *message_queue,
+                  std::vector<int> *handled, int *deleted)
+      : Database2Command(NULL), id_(id), execute_millis_(execute_millis),
+        has_results_(has_results), message_queue_(message_queue),
+        handled_(handled), deleted_(deleted) {}
+  ~TestSlowCommand() { ++(*deleted_); }
+
+  virtual void Execute(bool *has_results) {
+    Event never_signalled;
+    never_signalled.WaitWithTimeout(execute_millis_);
+    *has_results = has_results_;
+  }
+
+  virtual void HandleResults() {
+    if (message_queue_->GetCurrentThreadId() == kPageThreadId) {
+      handled_->push_back(id_);
+    }
+  }
+
+  static const ThreadId kPageThreadId;
+
+ private:
+  int id_;
+  int execute_millis_;
+  bool has_results_;
+  MockThreadMessageQueue *message_queue_;
+  std::vector<int> *handled_;
+  int *deleted_;
+};
+
+const ThreadId TestSlowCommand::kPageThreadId((ThreadId)1);
+
+bool TestDatabase2Interpreter(std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestDatabase2Interpreter - failed (%d)\n", __LINE__)); \
+    assert(error); \
+    *error += STRING16(L"TestDatabase2Interpreter - failed. "); \
+    return false; \
+  } \
+}
+
+  const int kExecuteMillis = 100;
+  const int kNumCommands = 3;
+  MockThreadMessageQueue mock_message_queue;
+  mock_message_queue.SetMockCurrentThreadId(TestSlowCommand::kPageThreadId);
+  std::vector<int> handled;
+  int deleted = 0;
+
+  // The synchronous interpreter stalls the calling thread for the whole
+  // duration of the command
+  Database2Interpreter interpreter;
+  int64 start = GetTicks();
+  interpreter.Run(new TestSlowCommand(0, kExecuteMillis, true,
+                                      &mock_message_queue,
+                                      &handled, &deleted));
+  int64 sync_stall_micros = GetTickDeltaMicros(start, GetTicks());
+  TEST_ASSERT(handled.size() == 1 && deleted == 1);
+  handled.clear();
+  deleted = 0;
+
+  {
+    scoped_refptr<Database2ThreadedInterpreter> threaded_interpreter(
+        new Database2ThreadedInterpreter(&mock_message_queue));
+    TEST_ASSERT(threaded_interpreter->async());
+
+    // Commands are queued and the calling thread continues immediately
+    start = GetTicks();
+    for (int i = 0; i < kNumCommands; ++i) {
+      threaded_interpreter->Run(new TestSlowCommand(i, kExecuteMillis,
+                                                    i != 1,
+                                                    &mock_message_queue,
+                                                    &handled, &deleted));
+    }
+    int64 async_stall_micros = GetTickDeltaMicros(start, GetTicks());
+
+    // Results are handled in order on the calling thread, commands without
+    // results are still returned there to be deleted
+    int64 timeout_micros = kNumCommands * kExecuteMillis * 1000 * 10;
+    start = GetTicks();
+    while (deleted < kNumCommands &&
+           GetTickDeltaMicros(start, GetTicks()) < timeout_micros) {
+      Event never_signalled;
+      never_signalled.WaitWithTimeout(10);
+      mock_message_queue.DeliverMockMessages();
+    }
+    TEST_ASSERT(deleted == kNumCommands);
+    TEST_ASSERT(handled.size() == 2);
+    TEST_ASSERT(handled[0] == 0 && handled[1] == 2);
+
+    LOG(("TestDatabase2Interpreter - %d msec command: %d usec stall "
+         "synchronous, %d usec stall for %d commands threaded\n",
+         kExecuteMillis, static_cast<int>(sync_stall_micros),
+         static_cast<int>(async_stall_micros), kNumCommands));
+    TEST_ASSERT(async_stall_micros < sync_stall_micros);
+  }
+
+  LOG(("TestDatabase2Interpreter - passed\n"));
+  return true;
+}
+
+#endif  // USING_CCTESTS
@@ -153,7 +153,7 @@ void GearsDatabase2Transaction::ExecuteNextStatement(JsCallContext *context) {
   }
 
   if (interpreter_->async()) {
-  //     interpreter_->Run(new Database2AsyncExecuteCommand(this));
+    interpreter_->Run(new Database2AsyncExecuteCommand(this, statement));
   } else {
    assert(context);
    interpreter_->Run(new Database2SyncExecuteCommand(this, context,
@@ -25,12 +25,15 @@
 
 #include "gears/desktop/desktop.h"
 
+#include <list>
+
 #include "gears/base/common/common.h"
 #include "gears/base/common/file.h"
 #include "gears/base/common/http_utils.h"
 #include "gears/base/common/js_dom_element.h"
 #include "gears/base/common/js_runner.h"
 #include "gears/base/common/js_types.h"
+#include "gears/base/common/mutex.h"
 #include "gears/base/common/paths.h"
 #include "gears/base/common/permissions_db.h"
 #include "gears/base/common/png_utils.h"
@@ -90,6 +93,75 @@ static const PngUtils::ColorFormat kDesktopIconFormat = PngUtils::FORMAT_BGRA;
 static const PngUtils::ColorFormat kDesktopIconFormat = PngUtils::FORMAT_RGBA;
 #endif
 
+// Remembers recently decoded icons, so that shortcuts which share icons (an
+// application usually uses the same icons for all of its shortcuts) decode
+// each of them only once.  Entries are keyed by URL and are only reused when
+// the fetched PNG data is identical, so a changed icon is always decoded
+// again.  Icons are usually served from the browser cache the second time,
+// so fetching stays cheap.
+class DecodedIconCache {
+ public:
+  // Fills in the icon's raw data and dimensions from the cache.  Returns false
+  // if the icon is not cached.
+  static bool Lookup(Desktop::IconData *icon) {
+    MutexLock lock(&mutex_);
+    for (std::list<Entry>::iterator it = entries_.begin();
+         it != entries_.end(); ++it) {
+      if (it->url == icon->url && it->png_data == icon->png_data) {
+        icon->raw_data = it->raw_data;
+        icon->width = it->width;
+        icon->height = it->height;
+        // Keep the most recently used entries at the front.
+        entries_.splice(entries_.begin(), entries_, it);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static void Insert(const Desktop::IconData &icon) {
+    MutexLock lock(&mutex_);
+    for (std::list<Entry>::iterator it = entries_.begin();
+         it != entries_.end(); ++it) {
+      if (it->url == icon.url) {
+        entries_.erase(it);
+        break;
+      }
+    }
+    if (entries_.size() >= kMaxEntries) {
+      entries_.pop_back();
+    }
+    entries_.push_front(Entry());
+    Entry &entry = entries_.front();
+    entry.url = icon.url;
+    entry.png_data = icon.png_data;
+    entry.raw_data = icon.raw_data;
+    entry.width = icon.width;
+    entry.height = icon.height;
+  }
+
+ private:
+  struct Entry {
+    std::string16 url;
+    std::vector<uint8> png_data;
+    std::vector<uint8> raw_data;
+    int width;
+    int height;
+  };
+
+  // Enough for the four icon sizes of several applications.  A decoded
+  // 128x128 icon is 64KB.
+  static const size_t kMaxEntries = 32;
+
+  static Mutex mutex_;
+  static std::list<Entry> entries_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(DecodedIconCache);
+};
+
+Mutex DecodedIconCache::mutex_;
+std::list<DecodedIconCache::Entry> DecodedIconCache::entries_;
+
 bool DecodeIcon(Desktop::IconData *icon, int expected_size,
                 std::string16 *error) {
   // Icons are optional.  Only try to decode if one was provided.
@@ -97,14 +169,17 @@ bool DecodeIcon(Desktop::IconData *icon, int expected_size,
     return true;
   }
 
-  // Decode the png
-  if (!PngUtils::Decode(&icon->png_data.at(0), icon->png_data.size(),
-                        kDesktopIconFormat,
-                        &icon->raw_data, &icon->width, &icon->height)) {
-    *error = STRING16(L"Could not decode PNG data for icon ");
-    *error += icon->url;
-    *error += STRING16(L".");
-    return false;
+  // Decode the png, unless the same data was decoded recently.
+  if (!DecodedIconCache::Lookup(icon)) {
+    if (!PngUtils::Decode(&icon->png_data.at(0), icon->png_data.size(),
+                          kDesktopIconFormat,
+                          &icon->raw_data, &icon->width, &icon->height)) {
+      *error = STRING16(L"Could not decode PNG data for icon ");
+      *error += icon->url;
+      *error += STRING16(L".");
+      return false;
+    }
+    DecodedIconCache::Insert(*icon);
   }
 
   if (icon->width != expected_size || icon->height != expected_size) {
@@ -340,6 +415,94 @@ bool Desktop::HandleDialogResults(ShortcutInfo *shortcut_info,
   return true;
 }
 
+// Fetches all of a shortcut's icons at once, in the background, while the
+// shortcuts dialog is up.  Each fetch that completes fills in its icon's
+// png_data, which Desktop::FetchIcon() then treats as pre-fetched.  Fetches
+// that are still running when the prefetcher is aborted or destroyed are
+// cancelled, and SetShortcut() fetches those icons synchronously.
+class ShortcutIconPrefetcher {
+ public:
+  ShortcutIconPrefetcher(Desktop *desktop, Desktop::ShortcutInfo *shortcut)
+      : desktop_(desktop) {
+    handlers_[0].Init(&shortcut->icon16x16);
+    handlers_[1].Init(&shortcut->icon32x32);
+    handlers_[2].Init(&shortcut->icon48x48);
+    handlers_[3].Init(&shortcut->icon128x128);
+  }
+
+  ~ShortcutIconPrefetcher() {
+    Abort();
+  }
+
+  void Start() {
+    for (size_t i = 0; i < ARRAYSIZE(handlers_); ++i) {
+      Desktop::IconData *icon = handlers_[i].mutable_icon();
+      // Data URLs are decoded in place, so they gain nothing from this.
+      if (icon->url.empty() || !icon->png_data.empty() ||
+          IsDataUrl(icon->url.c_str())) {
+        continue;
+      }
+      std::string16 error;
+      if (!desktop_->FetchIcon(icon, &error, &handlers_[i])) {
+        // SetShortcut() will try again and report the error.
+        handlers_[i].set_abort_interface(NULL);
+      }
+    }
+  }
+
+  void Abort() {
+    for (size_t i = 0; i < ARRAYSIZE(handlers_); ++i) {
+      handlers_[i].Abort();
+    }
+  }
+
+ private:
+  class Handler : public Desktop::IconHandlerInterface {
+   public:
+    Handler() : icon_(NULL), abort_interface_(NULL) {}
+
+    void Init(Desktop::IconData *icon) {
+      icon_ = icon;
+    }
+
+    void Abort() {
+      if (abort_interface_) {
+        Desktop::AbortInterface *abort_interface = abort_interface_;
+        abort_interface_ = NULL;
+        abort_interface->Abort();
+        // A cancelled fetch must not leave partial data behind.
+        icon_->png_data.clear();
+      }
+    }
+
+    virtual void set_abort_interface(
+        Desktop::AbortInterface *abort_interface) {
+      abort_interface_ = abort_interface;
+    }
+
+    virtual Desktop::IconData *mutable_icon() {
+      return icon_;
+    }
+
+    virtual void ProcessIcon(bool success, const std::string16 &icon_error) {
+      if (!success) {
+        // Leave the icon unfetched, so that SetShortcut() tries again and
+        // reports the error.
+        icon_->png_data.clear();
+      }
+    }
+
+   private:
+    Desktop::IconData *icon_;
+    Desktop::AbortInterface *abort_interface_;
+    DISALLOW_EVIL_CONSTRUCTORS(Handler);
+  };
+
+  Desktop *desktop_;
+  Handler handlers_[4];
+  DISALLOW_EVIL_CONSTRUCTORS(ShortcutIconPrefetcher);
+};
+
 void GearsDesktop::CreateShortcut(JsCallContext *context) {
   if (EnvIsWorker()) {
     context->SetException(
@@ -400,9 +563,19 @@ void GearsDesktop::CreateShortcut(JsCallContext *context) {
   HtmlDialog shortcuts_dialog(EnvPageBrowsingContext());
   if (desktop.InitializeDialog(&shortcut_info, &shortcuts_dialog,
                                Desktop::DIALOG_STYLE_STANDARD)) {
+#ifndef BROWSER_WEBKIT
+    // Download the icons concurrently while the user reads the dialog.
+    // (FetchIcon() is always synchronous on WebKit, so there is nothing to
+    // overlap there.)
+    ShortcutIconPrefetcher icon_prefetcher(&desktop, &shortcut_info);
+    icon_prefetcher.Start();
+#endif
     HtmlDialogReturnValue dialog_result = shortcuts_dialog.DoModal(
         STRING16(L"shortcuts_dialog.html"), kShortcutsDialogWidth,
         kShortcutsDialogHeight);
+#ifndef BROWSER_WEBKIT
+    icon_prefetcher.Abort();
+#endif
     if (dialog_result == HTML_DIALOG_SUCCESS) {
       desktop.HandleDialogResults(&shortcut_info, &shortcuts_dialog);
     }
@@ -813,6 +986,10 @@ bool Desktop::FetchIcon(Desktop::IconData *icon, std::string16 *error,
     if (!request->Open(HttpConstants::kHttpGET, icon->url.c_str(),
                        async, browsing_context_.get()) ||
         !request->Send(NULL)) {
+      if (async) {
+        // The listener is deleted on return, so it can't be used to abort.
+        icon_handler->set_abort_interface(NULL);
+      }
       *error = STRING16(L"Could not load icon ");
       *error += icon->url.c_str();
       *error += STRING16(L".");
@@ -30,6 +30,7 @@
 
 #include "gears/base/common/base_class.h"
 #include "gears/base/common/detect_version_collision.h"
+#include "gears/base/common/permissions_cache.h"
 #include "gears/base/common/string16.h"
 #ifdef OS_WINCE
 #include "gears/base/common/wince_compatibility.h"
@@ -104,6 +105,9 @@ GearsFactoryImpl::GearsFactoryImpl()
 #endif
       is_creation_suspended_(false) {
   SetActiveUserFlag();
+  // Every thread that creates a factory services its message queue, so it
+  // can hear about permission changes made by other processes.
+  PermissionsCache::GetInstance()->ObserveRemoteChanges();
 }
 
 void GearsFactoryImpl::Create(JsCallContext *context) {
@@ -44,12 +44,12 @@ Mutex BackoffManager::servers_mutex_;
 void BackoffManager::ReportRequest(const std::string16 &url) {
   MutexLock lock(&servers_mutex_);
   ServerMap::iterator iter = servers_.find(url);
-  if (iter != servers_.end()) {
-    iter->second.first = GetCurrentTimeMillis();
-  } else {
-    servers_[url] = std::make_pair(GetCurrentTimeMillis(),
-                                   kBaselineMinimumRequestInterval);
+  if (iter == servers_.end()) {
+    iter = servers_.insert(std::make_pair(url, ServerState())).first;
+    iter->second.minimum_interval = kBaselineMinimumRequestInterval;
   }
+  iter->second.last_request_time = GetCurrentTimeMillis();
+  iter->second.is_awaiting_response = true;
 }
 
 // static
@@ -59,7 +59,12 @@ int64 BackoffManager::ReportResponse(const std::string16 &url,
   MutexLock lock(&servers_mutex_);
   ServerMap::iterator iter = servers_.find(url);
   assert(iter != servers_.end());
-  int64 *interval = &iter->second.second;
+  int64 *interval = &iter->second.minimum_interval;
+  if (!iter->second.is_awaiting_response) {
+    // A response to the last request has already been reported.
+    return iter->second.last_request_time + *interval;
+  }
+  iter->second.is_awaiting_response = false;
   if (server_error) {
     if (*interval < kMinimumRequestIntervalLimit) {
       // Increase interval by between 90% and 110%.
@@ -75,5 +80,5 @@ int64 BackoffManager::ReportResponse(const std::string16 &url,
   } else {
     *interval = kBaselineMinimumRequestInterval;
   }
-  return iter->second.first + *interval;
+  return iter->second.last_request_time + *interval;
 }
@@ -28,6 +28,10 @@
 // class when they make a request to or receive a response from a given url. The
 // BackoffManager class provides the earliest time at which subsequent requests
 // should be made.
+//
+// Several users may be waiting on a single request to a server, for example
+// when their requests are coalesced. The back-off is therefore only adjusted
+// by the first response reported after any number of requests.
 
 #ifndef GEARS_GEOLOCATION_BACKOFF_MANAGER_H__
 #define GEARS_GEOLOCATION_BACKOFF_MANAGER_H__
@@ -43,10 +47,14 @@ class BackoffManager {
   static int64 ReportResponse(const std::string16 &url, bool server_error);
 
  private:
-  // A map from server URL to a pair of integers representing the last request
-  // time and the current minimum interval between requests, both in
-  // milliseconds.
-  typedef std::map<std::string16, std::pair<int64, int64> > ServerMap;
+  struct ServerState {
+    int64 last_request_time;  // Milliseconds.
+    int64 minimum_interval;  // Milliseconds.
+    // Whether a request has been reported since the last response.
+    bool is_awaiting_response;
+  };
+  // A map from server URL to the state of requests to that server.
+  typedef std::map<std::string16, ServerState> ServerMap;
   static ServerMap servers_;
 
   // The mutex used to protect the map.
@@ -25,12 +25,17 @@
 
 #include "gears/geolocation/geolocation_db.h"
 
+#include "gears/base/common/trace_events.h"
+
 static const char16 *kDatabaseName = STRING16(L"geolocation.db");
 static const char16 *kVersionTableName = STRING16(L"VersionInfo");
 static const char16 *kAccessTokenTableName = STRING16(L"AccessTokens");
 static const char16 *kVersionKey = STRING16(L"Version");
 static const int kCurrentVersion = 2;
 
+// Set once a connection in this process has found the schema current.
+static SQLSchemaVerifiedFlag schema_verified;
+
 const ThreadLocals::Slot GeolocationDB::kThreadLocalKey =
     ThreadLocals::Alloc();
 
@@ -48,6 +53,7 @@ GeolocationDB *GeolocationDB::GetDB() {
         ThreadLocals::GetValue(kThreadLocalKey));
   }
 
+  TRACE_EVENT("database", "GeolocationDB.FirstUse");
   GeolocationDB *db = new GeolocationDB();
 
   // If we can't initialize, we store NULL in the map so that we don't keep
@@ -120,13 +126,20 @@ bool GeolocationDB::Init() {
     return false;
   }
 
+  // Another connection in this process has already checked the schema.
+  if (schema_verified.IsSet()) {
+    return true;
+  }
+
   // Examine the contents of the database and determine if we have to
-  // instantiate or updgrade the schema.
+  // instantiate or updgrade the schema.  This is a plain read, so the common
+  // case of an up to date schema takes no write lock.
   int version = 0;
   version_table_.GetInt(kVersionKey, &version);
 
   // If it's the version we're expecting, great.
   if (version == kCurrentVersion) {
+    schema_verified.Set();
     return true;
   }
 
@@ -141,6 +154,7 @@ bool GeolocationDB::Init() {
   // upgrade.
   version_table_.GetInt(kVersionKey, &version);
   if (version == kCurrentVersion) {
+    schema_verified.Set();
     return true;
   }
 
@@ -165,7 +179,11 @@ bool GeolocationDB::Init() {
     return false;
   }
 
-  return transaction.Commit();
+  if (!transaction.Commit()) {
+    return false;
+  }
+  schema_verified.Set();
+  return true;
 }
 
 // static
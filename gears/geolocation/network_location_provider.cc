@@ -455,8 +455,6 @@ bool NetworkLocationProvider::MakeRequest() {
 
   request_address_from_last_request_ = request_address_;
 
-  BackoffManager::ReportRequest(url_);
-
   std::string16 access_token;
   AccessTokenManager::GetInstance()->GetToken(url_, &access_token);
 
@@ -482,6 +480,7 @@ bool NetworkLocationProvider::MakeRequest() {
   }
 
   assert(request_);
+  BackoffManager::ReportRequest(url_);
   is_last_request_complete_ = false;
   MutexLock data_lock(&data_mutex_);
   return request_->MakeRequest(access_token,
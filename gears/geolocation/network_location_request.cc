@@ -73,6 +73,12 @@ static bool ParseServerResponse(const std::string &response_body,
 static void AddRadioData(const RadioData &radio_data, Json::Value *body_object);
 static void AddWifiData(const WifiData &wifi_data, Json::Value *body_object);
 
+// static
+NetworkLocationRequest::InFlightMap NetworkLocationRequest::in_flight_requests_;
+
+// static
+Mutex NetworkLocationRequest::in_flight_requests_mutex_;
+
 // static
 NetworkLocationRequest *NetworkLocationRequest::Create(
     BrowsingContext *browsing_context,
@@ -134,6 +140,36 @@ void NetworkLocationRequest::Run() {
 }
 
 void NetworkLocationRequest::MakeRequestImpl() {
+  // If an identical request is already in flight, wait for its response
+  // rather than making another HTTP request.
+  std::string in_flight_key;
+  std::string post_body;
+  if (String16ToUTF8(url_, &in_flight_key) &&
+      BlobToString(post_body_.get(), &post_body)) {
+    in_flight_key += '\n';
+    in_flight_key += post_body;
+    MutexLock lock(&in_flight_requests_mutex_);
+    InFlightMap::iterator iter = in_flight_requests_.find(in_flight_key);
+    if (iter != in_flight_requests_.end()) {
+      LOG(("NetworkLocationRequest::Run() : Coalescing with in-flight "
+           "request.\n"));
+      WaitingRequests *waiting_requests = &iter->second;
+      WaitingRequests::iterator waiting_iter = waiting_requests->begin();
+      for (; waiting_iter != waiting_requests->end(); ++waiting_iter) {
+        if (waiting_iter->first == this) {
+          waiting_iter->second = timestamp_;
+          return;
+        }
+      }
+      waiting_requests->push_back(std::make_pair(this, timestamp_));
+      return;
+    }
+    // Record that this request is in flight, with no requests waiting on it.
+    in_flight_requests_[in_flight_key];
+  } else {
+    in_flight_key.clear();
+  }
+
   WebCacheDB::PayloadInfo payload;
   // TODO(andreip): remove this once WebCacheDB::PayloadInfo.data is a Blob.
   scoped_refptr<BlobInterface> payload_data;
@@ -151,33 +187,93 @@ void NetworkLocationRequest::MakeRequestImpl() {
                          NULL,             // full_redirect_url
                          NULL);            // error_message
 
-  MutexLock lock(&is_processing_response_mutex_);
+  // Take the requests waiting for this response. We lock each of them before
+  // releasing the map's mutex, so that none can be deleted until we're done
+  // with it. See StopThreadAndDelete().
+  WaitingRequests waiting_requests;
+  if (!in_flight_key.empty()) {
+    MutexLock lock(&in_flight_requests_mutex_);
+    InFlightMap::iterator iter = in_flight_requests_.find(in_flight_key);
+    assert(iter != in_flight_requests_.end());
+    waiting_requests.swap(iter->second);
+    in_flight_requests_.erase(iter);
+    for (int i = 0; i < static_cast<int>(waiting_requests.size()); ++i) {
+      waiting_requests[i].first->is_processing_response_mutex_.Lock();
+    }
+  }
+
+  std::string response_body;
+  if (result) {
+    // If HttpPost succeeded, payload_data is guaranteed to be non-NULL.
+    assert(payload_data.get());
+    if (!payload_data->Length() ||
+        !BlobToString(payload_data.get(), &response_body)) {
+      LOG(("NetworkLocationRequest::Run() : Failed to get response body.\n"));
+    }
+  }
+
+  is_processing_response_mutex_.Lock();
   // is_aborted_ may be true even if HttpPost succeeded.
-  if (is_aborted_) {
+  bool is_aborted = is_aborted_;
+  if (is_aborted) {
     LOG(("NetworkLocationRequest::Run() : HttpPost request was cancelled.\n"));
+  } else {
+    DeliverResponse(this, timestamp_, result, payload.status_code,
+                    response_body);
+  }
+  is_processing_response_mutex_.Unlock();
+
+  for (int i = 0; i < static_cast<int>(waiting_requests.size()); ++i) {
+    NetworkLocationRequest *waiting_request = waiting_requests[i].first;
+    if (is_aborted) {
+      // Our request was cancelled, so the waiting requests must make their
+      // own.
+      waiting_request->thread_event_.Signal();
+    } else if (!waiting_request->is_aborted_) {
+      DeliverResponse(waiting_request, waiting_requests[i].second, result,
+                      payload.status_code, response_body);
+    }
+    waiting_request->is_processing_response_mutex_.Unlock();
+  }
+}
+
+void NetworkLocationRequest::DeliverResponse(
+    NetworkLocationRequest *request,
+    int64 timestamp,
+    bool http_post_result,
+    int status_code,
+    const std::string &response_body) {
+  assert(request);
+  if (!request->listener_) {
     return;
   }
+  Position position;
+  std::string16 access_token;
+  GetLocationFromResponse(http_post_result, status_code, response_body,
+                          timestamp, url_, is_reverse_geocode_,
+                          &position, &access_token);
+
+  LOG(("NetworkLocationRequest::Run() : Calling listener with position.\n"));
+  bool server_error =
+      !http_post_result || (status_code >= 500 && status_code < 600);
+  request->listener_->LocationResponseAvailable(position, server_error,
+                                                access_token);
+}
 
-  if (listener_) {
-    Position position;
-    std::string response_body;
-    if (result) {
-      // If HttpPost succeeded, payload_data is guaranteed to be non-NULL.
-      assert(payload_data.get());
-      if (!payload_data->Length() ||
-          !BlobToString(payload_data.get(), &response_body)) {
-        LOG(("NetworkLocationRequest::Run() : Failed to get response body.\n"));
+void NetworkLocationRequest::RemoveFromInFlightRequests() {
+  MutexLock lock(&in_flight_requests_mutex_);
+  for (InFlightMap::iterator iter = in_flight_requests_.begin();
+       iter != in_flight_requests_.end();
+       ++iter) {
+    WaitingRequests *waiting_requests = &iter->second;
+    WaitingRequests::iterator waiting_iter = waiting_requests->begin();
+    while (waiting_iter != waiting_requests->end()) {
+      if (waiting_iter->first == this) {
+        waiting_iter = waiting_requests->erase(waiting_iter);
+      } else {
+        ++waiting_iter;
       }
     }
-    std::string16 access_token;
-    GetLocationFromResponse(result, payload.status_code, response_body,
-                            timestamp_, url_, is_reverse_geocode_,
-                            &position, &access_token);
-
-    LOG(("NetworkLocationRequest::Run() : Calling listener with position.\n"));
-    bool server_error =
-        !result || (payload.status_code >= 500 && payload.status_code < 600);
-    listener_->LocationResponseAvailable(position, server_error, access_token);
   }
 }
 
@@ -206,7 +302,11 @@ bool NetworkLocationRequest::FormRequestBody(
   AddString("access_token", access_token, &body_object);
 
   body_object["request_address"] = request_address;
-  AddString("address_language", address_language, &body_object);
+  // The language is only used for the address. Omitting it otherwise allows
+  // requests from providers which differ only in language to be coalesced.
+  if (request_address) {
+    AddString("address_language", address_language, &body_object);
+  }
 
   if (is_reverse_geocode) {
     assert(request_address);
@@ -310,6 +410,9 @@ void NetworkLocationRequest::StopThreadAndDelete() {
   // return.
   is_shutting_down_ = true;
   thread_event_.Signal();
+  // Once we're no longer waiting on an in-flight request, locking our mutex
+  // guarantees that no other request is calling our listener.
+  RemoveFromInFlightRequests();
   is_processing_response_mutex_.Lock();
   Abort();
   is_processing_response_mutex_.Unlock();
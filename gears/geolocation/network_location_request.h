@@ -26,10 +26,12 @@
 #ifndef GEARS_GEOLOCATION_NETWORK_LOCATION_REQUEST_H__
 #define GEARS_GEOLOCATION_NETWORK_LOCATION_REQUEST_H__
 
+#include <map>
 #include <vector>
 #include "gears/base/common/basictypes.h"  // For int64
 #include "gears/base/common/common.h"
 #include "gears/base/common/event.h"
+#include "gears/base/common/mutex.h"
 #include "gears/blob/blob.h"
 #include "gears/geolocation/geolocation.h"
 #include "gears/geolocation/device_data_provider.h"
@@ -38,6 +40,10 @@
 // An implementation of an AsyncTask that takes a set of device data and sends
 // it to a server to get a position fix. It performs formatting of the request
 // and interpretation of the response.
+//
+// Requests to the same server with identical bodies which are in flight at the
+// same time are coalesced. Only the first makes an HTTP request and its
+// response is passed to the listeners of all of them.
 class NetworkLocationRequest : public AsyncTask {
  public:
   friend class scoped_ptr<NetworkLocationRequest>;  // For use in Create().
@@ -84,6 +90,17 @@ class NetworkLocationRequest : public AsyncTask {
   virtual ~NetworkLocationRequest() {}
 
   void MakeRequestImpl();
+  // Passes the response to the listener of either this request or a request
+  // that was coalesced with it. Must be called with that request's
+  // is_processing_response_mutex_ held.
+  void DeliverResponse(NetworkLocationRequest *request,
+                       int64 timestamp,
+                       bool http_post_result,
+                       int status_code,
+                       const std::string &response_body);
+  // Removes this request from the lists of requests waiting for the response
+  // to an in-flight request.
+  void RemoveFromInFlightRequests();
 
   // AsyncTask implementation.
   virtual void Run();
@@ -121,6 +138,17 @@ class NetworkLocationRequest : public AsyncTask {
   Event thread_event_;
   bool is_shutting_down_;
 
+  // A map from server URL and request body to the requests, and the
+  // timestamps of their data, that are waiting for the response to the
+  // in-flight HTTP request with that URL and body.
+  typedef std::vector<std::pair<NetworkLocationRequest*, int64> >
+      WaitingRequests;
+  typedef std::map<std::string, WaitingRequests> InFlightMap;
+  static InFlightMap in_flight_requests_;
+
+  // The mutex used to protect the map.
+  static Mutex in_flight_requests_mutex_;
+
 #ifdef USING_CCTESTS
   // Uses FormRequestBody for testing.
   friend void TestGeolocationFormRequestBody(JsCallContext *context);
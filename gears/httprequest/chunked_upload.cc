@@ -0,0 +1,236 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/httprequest/chunked_upload.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include "gears/base/common/stopwatch.h"
+#include "gears/blob/slice_blob.h"
+#include "gears/localserver/common/http_constants.h"
+
+ChunkedUpload::ChunkedUpload(Listener *listener)
+    : listener_(listener),
+      next_chunk_(0),
+      completed_chunks_(0),
+      completed_bytes_(0),
+      finished_(false) {
+  assert(listener_);
+}
+
+ChunkedUpload::~ChunkedUpload() {
+  Abort();
+}
+
+bool ChunkedUpload::Start(const std::string16 &method,
+                          const std::string16 &url,
+                          const HeaderList &headers,
+                          BrowsingContext *browsing_context,
+                          BlobInterface *blob,
+                          const Options &options) {
+  assert(blob && blob->Length() > 0);
+  assert(options.chunk_size > 0 && options.max_parallel > 0);
+  method_ = method;
+  url_ = url;
+  headers_ = headers;
+  browsing_context_ = browsing_context;
+  blob_ = blob;
+  options_ = options;
+
+  // The id only has to tell apart the uploads a server sees at one time.
+  upload_id_ = Integer64ToString16(GetCurrentTimeMillis());
+  upload_id_ += STRING16(L".");
+  upload_id_ += IntegerToString16(rand());
+
+  int64 length = blob_->Length();
+  for (int64 offset = 0; offset < length; offset += options_.chunk_size) {
+    Chunk chunk;
+    chunk.offset = offset;
+    chunk.length = std::min(options_.chunk_size, length - offset);
+    chunks_.push_back(chunk);
+  }
+
+  if (!StartMoreChunks()) {
+    Abort();
+    return false;
+  }
+  return true;
+}
+
+void ChunkedUpload::Abort() {
+  finished_ = true;
+  for (RequestMap::iterator iter = requests_.begin(); iter != requests_.end();
+       ++iter) {
+    Chunk &chunk = chunks_[iter->second];
+    chunk.request->SetListener(NULL, false);
+    chunk.request->Abort();
+    chunk.request.reset();
+  }
+  requests_.clear();
+}
+
+bool ChunkedUpload::StartMoreChunks() {
+  size_t last_chunk = chunks_.size() - 1;
+  while (!finished_ && next_chunk_ < last_chunk &&
+         static_cast<int>(requests_.size()) < options_.max_parallel) {
+    if (!StartChunk(next_chunk_++)) {
+      return false;
+    }
+  }
+  if (!finished_ && next_chunk_ == last_chunk &&
+      completed_chunks_ == last_chunk) {
+    return StartChunk(next_chunk_++);
+  }
+  return true;
+}
+
+bool ChunkedUpload::StartChunk(size_t index) {
+  Chunk &chunk = chunks_[index];
+  ++chunk.attempts;
+  chunk.sent = 0;
+
+  scoped_refptr<HttpRequest> request;
+  if (!HttpRequest::CreateSafeRequest(&request)) {
+    return false;
+  }
+  request->SetListener(this, false);
+  request->SetCachingBehavior(HttpRequest::USE_ALL_CACHES);
+  request->SetRedirectBehavior(HttpRequest::FOLLOW_WITHIN_ORIGIN);
+  if (!request->Open(method_.c_str(), url_.c_str(), true,
+                     browsing_context_.get())) {
+    request->SetListener(NULL, false);
+    return false;
+  }
+  for (size_t i = 0; i < headers_.size(); ++i) {
+    request->SetRequestHeader(headers_[i].first.c_str(),
+                              headers_[i].second.c_str());
+  }
+  std::string16 range(STRING16(L"bytes "));
+  range += Integer64ToString16(chunk.offset);
+  range += STRING16(L"-");
+  range += Integer64ToString16(chunk.offset + chunk.length - 1);
+  range += STRING16(L"/");
+  range += Integer64ToString16(blob_->Length());
+  request->SetRequestHeader(HttpConstants::kContentRangeHeader, range.c_str());
+  request->SetRequestHeader(HttpConstants::kXGearsUploadIdHeader,
+                            upload_id_.c_str());
+
+  chunk.request = request;
+  requests_[request.get()] = index;
+  scoped_refptr<BlobInterface> slice(
+      new SliceBlob(blob_.get(), chunk.offset, chunk.length));
+  if (!request->Send(slice.get())) {
+    request->SetListener(NULL, false);
+    requests_.erase(request.get());
+    chunk.request.reset();
+    return false;
+  }
+  return true;
+}
+
+void ChunkedUpload::ReadyStateChanged(HttpRequest *source) {
+  HttpRequest::ReadyState state;
+  if (finished_ || !source->GetReadyState(&state) ||
+      state != HttpRequest::COMPLETE) {
+    return;
+  }
+  RequestMap::iterator found = requests_.find(source);
+  if (found == requests_.end()) {
+    return;
+  }
+
+  // The listener may release us.
+  scoped_refptr<ChunkedUpload> reference(this);
+  scoped_refptr<HttpRequest> request(source);
+  size_t index = found->second;
+  Chunk &chunk = chunks_[index];
+  requests_.erase(found);
+  chunk.request.reset();
+  request->SetListener(NULL, false);
+
+  int status = 0;
+  bool has_status = request->GetStatus(&status);
+  if (has_status && status >= 200 && status < 300) {
+    chunk.sent = chunk.length;
+    completed_bytes_ += chunk.length;
+    ++completed_chunks_;
+    if (completed_chunks_ == chunks_.size()) {
+      ReportProgress();
+      Finish(request.get());
+      return;
+    }
+    ReportProgress();
+    if (!finished_ && !StartMoreChunks()) {
+      Finish(NULL);
+    }
+    return;
+  }
+
+  bool is_transient = !has_status ||
+                      status >= HttpConstants::HTTP_INTERNAL_ERROR;
+  if (!is_transient || chunk.attempts > options_.max_retries) {
+    Finish(request.get());
+    return;
+  }
+  LOG(("ChunkedUpload: retrying bytes %d-%d after status %d\n",
+       static_cast<int>(chunk.offset),
+       static_cast<int>(chunk.offset + chunk.length - 1), status));
+  ReportProgress();
+  if (!finished_ && !StartChunk(index)) {
+    Finish(NULL);
+  }
+}
+
+void ChunkedUpload::UploadProgress(HttpRequest *source,
+                                   int64 position, int64 total) {
+  if (finished_) {
+    return;
+  }
+  RequestMap::iterator found = requests_.find(source);
+  if (found == requests_.end()) {
+    return;
+  }
+  // The listener may release us.
+  scoped_refptr<ChunkedUpload> reference(this);
+  chunks_[found->second].sent = position;
+  ReportProgress();
+}
+
+void ChunkedUpload::ReportProgress() {
+  int64 position = completed_bytes_;
+  for (RequestMap::iterator iter = requests_.begin(); iter != requests_.end();
+       ++iter) {
+    position += chunks_[iter->second].sent;
+  }
+  listener_->ChunkedUploadProgress(position, blob_->Length());
+}
+
+void ChunkedUpload::Finish(HttpRequest *request) {
+  if (finished_) {
+    return;
+  }
+  Abort();
+  listener_->ChunkedUploadComplete(request);
+}
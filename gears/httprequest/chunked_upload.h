@@ -0,0 +1,140 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GEARS_HTTPREQUEST_CHUNKED_UPLOAD_H__
+#define GEARS_HTTPREQUEST_CHUNKED_UPLOAD_H__
+
+#include <map>
+#include <utility>
+#include <vector>
+#include "gears/base/common/browsing_context.h"
+#include "gears/base/common/scoped_refptr.h"
+#include "gears/base/common/string16.h"
+#include "gears/blob/blob_interface.h"
+#include "gears/localserver/common/http_request.h"
+
+// ChunkedUpload sends a blob as a series of requests that each carry one
+// slice of it, several at a time. Every request repeats the method, url and
+// headers of the upload and adds
+//   Content-Range: bytes <first>-<last>/<total>
+//   X-Gears-Upload-Id: <an id shared by the requests of one upload>
+// so that the server can reassemble the blob. The chunk at the end of the
+// blob is sent only once all of the others have succeeded, so the server
+// has seen every byte when it answers it, and its response is taken as the
+// response to the upload as a whole.
+//
+// A chunk whose request fails without a response, or gets a 5xx response,
+// is sent again up to 'max_retries' times. Any other response outside 2xx
+// fails the upload.
+class ChunkedUpload
+    : public RefCounted,
+      public HttpRequest::HttpListener {
+ public:
+  class Listener {
+   public:
+    virtual ~Listener() {}
+    // 'position' of the upload's 'total' bytes have been sent.
+    virtual void ChunkedUploadProgress(int64 position, int64 total) = 0;
+    // The upload is over. 'request' is the completed request for the final
+    // chunk, or for the chunk that failed, or NULL if a chunk could not be
+    // sent at all.
+    virtual void ChunkedUploadComplete(HttpRequest *request) = 0;
+  };
+
+  struct Options {
+    Options()
+        : chunk_size(kDefaultChunkSize),
+          max_parallel(kDefaultMaxParallel),
+          max_retries(kDefaultMaxRetries) {}
+    int64 chunk_size;
+    int max_parallel;
+    int max_retries;
+  };
+
+  static const int64 kDefaultChunkSize = 1024 * 1024;
+  static const int kDefaultMaxParallel = 4;
+  static const int kDefaultMaxRetries = 2;
+
+  typedef std::vector<std::pair<std::string16, std::string16> > HeaderList;
+
+  explicit ChunkedUpload(Listener *listener);
+
+  // Starts sending 'blob', which must not be empty. Returns false if the
+  // first requests could not be sent, in which case the listener will not be
+  // called.
+  bool Start(const std::string16 &method,
+             const std::string16 &url,
+             const HeaderList &headers,
+             BrowsingContext *browsing_context,
+             BlobInterface *blob,
+             const Options &options);
+
+  // Stops the upload. The listener will not be called again.
+  void Abort();
+
+ private:
+  struct Chunk {
+    Chunk() : offset(0), length(0), attempts(0), sent(0) {}
+    int64 offset;
+    int64 length;
+    int attempts;
+    int64 sent;  // Bytes of the current attempt sent so far.
+    scoped_refptr<HttpRequest> request;  // The current attempt, if any.
+  };
+  typedef std::map<HttpRequest*, size_t> RequestMap;
+
+  virtual ~ChunkedUpload();
+
+  // Sends chunks until 'max_parallel' are in flight. The final chunk waits
+  // until every other chunk has completed.
+  bool StartMoreChunks();
+  bool StartChunk(size_t index);
+  void Finish(HttpRequest *request);
+  void ReportProgress();
+
+  // HttpRequest::HttpListener implementation.
+  virtual void ReadyStateChanged(HttpRequest *source);
+  virtual void UploadProgress(HttpRequest *source,
+                              int64 position, int64 total);
+
+  Listener *listener_;
+  std::string16 method_;
+  std::string16 url_;
+  std::string16 upload_id_;
+  HeaderList headers_;
+  scoped_refptr<BrowsingContext> browsing_context_;
+  scoped_refptr<BlobInterface> blob_;
+  Options options_;
+  std::vector<Chunk> chunks_;
+  size_t next_chunk_;
+  size_t completed_chunks_;
+  int64 completed_bytes_;
+  RequestMap requests_;  // The requests in flight, and their chunks.
+  bool finished_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ChunkedUpload);
+};
+
+#endif  // GEARS_HTTPREQUEST_CHUNKED_UPLOAD_H__
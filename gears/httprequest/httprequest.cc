@@ -259,6 +259,53 @@ static bool IsValidMethod(const std::string16 &method) {
   return true;
 }
 
+// Reads an optional integer property in [min_value, max_value] from the
+// upload options passed to send(). Leaves *value untouched if it is absent.
+static bool ParseUploadOption(JsCallContext *context,
+                              const JsObject *options,
+                              const char16 *name,
+                              int min_value,
+                              int max_value,
+                              int *value) {
+  if (options->GetPropertyType(name) == JSPARAM_UNDEFINED) {
+    return true;
+  }
+  int parsed;
+  if (!options->GetPropertyAsInt(name, &parsed) ||
+      parsed < min_value || parsed > max_value) {
+    std::string16 error = STRING16(L"uploadOptions.");
+    error += name;
+    error += STRING16(L" should be an integer between ");
+    error += IntegerToString16(min_value);
+    error += STRING16(L" and ");
+    error += IntegerToString16(max_value);
+    error += STRING16(L".");
+    context->SetException(error);
+    return false;
+  }
+  *value = parsed;
+  return true;
+}
+
+static bool ParseUploadOptions(JsCallContext *context,
+                               const JsObject *options,
+                               ChunkedUpload::Options *parsed) {
+  assert(context);
+  assert(options);
+  assert(parsed);
+  int chunk_size = static_cast<int>(parsed->chunk_size);
+  if (!ParseUploadOption(context, options, STRING16(L"chunkSize"),
+                         1, kint32max, &chunk_size) ||
+      !ParseUploadOption(context, options, STRING16(L"maxParallel"),
+                         1, 16, &parsed->max_parallel) ||
+      !ParseUploadOption(context, options, STRING16(L"maxRetries"),
+                         0, 10, &parsed->max_retries)) {
+    return false;
+  }
+  parsed->chunk_size = chunk_size;
+  return true;
+}
+
 DECLARE_DISPATCHER(GearsHttpRequest);
 
 // static
@@ -292,7 +339,9 @@ GearsHttpRequest::GearsHttpRequest()
       content_type_header_was_set_(false),
       has_fired_completion_event_(false),
       length_computable_(false),
-      content_length_(-1) {
+      content_length_(-1),
+      response_text_length_(0),
+      is_response_text_complete_(false) {
 }
 
 GearsHttpRequest::~GearsHttpRequest() {
@@ -352,6 +401,9 @@ void GearsHttpRequest::Open(JsCallContext *context) {
   InitUnloadMonitor();
   content_type_header_was_set_ = false;
   has_fired_completion_event_ = false;
+  method_ = method;
+  url_ = full_url;
+  request_headers_.clear();
   if (!request_->Open(method.c_str(), full_url.c_str(), true,
                       EnvPageBrowsingContext())) {
     ReleaseRequest();
@@ -389,6 +441,7 @@ void GearsHttpRequest::SetRequestHeader(JsCallContext *context) {
     context->SetException(kInternalError);
     return;
   }
+  request_headers_.push_back(std::make_pair(name, value));
   if (StringCompareIgnoreCase(name.c_str(),
       HttpConstants::kContentTypeHeader) == 0) {
     content_type_header_was_set_ = true;
@@ -403,8 +456,13 @@ void GearsHttpRequest::Send(JsCallContext *context) {
 
   std::string16 post_data_string;
   ModuleImplBaseClass *post_data_module = NULL;
+  scoped_ptr<JsObject> upload_options;
 
   int post_data_type = context->GetArgumentType(0);
+  int options_type = context->GetArgumentType(1);
+  bool has_options = (options_type != JSPARAM_NULL) &&
+                     (options_type != JSPARAM_UNDEFINED) &&
+                     (options_type != JSPARAM_UNKNOWN);
   // The Gears JS API treats a (JavaScript) null and undefined the same.
   // Furthermore, if there is no arg at all (rather than an explicit null or
   // undefined arg) then GetArgumentType will return JSPARAM_UNKNOWN.
@@ -412,7 +470,8 @@ void GearsHttpRequest::Send(JsCallContext *context) {
       (post_data_type != JSPARAM_UNDEFINED) &&
       (post_data_type != JSPARAM_UNKNOWN)) {
     JsArgument argv[] = {
-      { JSPARAM_OPTIONAL, JSPARAM_UNKNOWN, NULL }
+      { JSPARAM_OPTIONAL, JSPARAM_UNKNOWN, NULL },
+      { JSPARAM_OPTIONAL, JSPARAM_OBJECT, as_out_parameter(upload_options) }
     };
     if (post_data_type == JSPARAM_STRING16) {
       argv[0].type = JSPARAM_STRING16;
@@ -441,6 +500,17 @@ void GearsHttpRequest::Send(JsCallContext *context) {
       return;
     }
   }
+  if (has_options && !post_data_module) {
+    context->SetException(
+        STRING16(L"Upload options may only be given with a Blob."));
+    return;
+  }
+  ChunkedUpload::Options chunked_upload_options;
+  if (upload_options.get() &&
+      !ParseUploadOptions(context, upload_options.get(),
+                          &chunked_upload_options)) {
+    return;
+  }
 
   scoped_refptr<HttpRequest> request_being_sent = request_;
 
@@ -458,10 +528,31 @@ void GearsHttpRequest::Send(JsCallContext *context) {
     if (!content_type_header_was_set_) {
       request_->SetRequestHeader(HttpConstants::kContentTypeHeader,
                                  HttpConstants::kMimeApplicationOctetStream);
+      request_headers_.push_back(
+          std::make_pair(std::string16(HttpConstants::kContentTypeHeader),
+                         std::string16(
+                             HttpConstants::kMimeApplicationOctetStream)));
     }
     static_cast<GearsBlob*>(post_data_module)->GetContents(&blob);
   }
 
+  // An empty blob has no chunks, so it is sent as usual.
+  if (upload_options.get() && blob->Length() > 0) {
+    chunked_upload_ = new ChunkedUpload(this);
+    if (!chunked_upload_->Start(method_, url_, request_headers_,
+                                EnvPageBrowsingContext(), blob.get(),
+                                chunked_upload_options)) {
+      chunked_upload_.reset();
+      onprogresshandler_.reset();
+      onreadystatechangehandler_.reset();
+      if (upload_.get()) {
+        upload_->ResetOnProgressHandler();
+      }
+      context->SetException(kInternalError);
+    }
+    return;
+  }
+
   HttpRequestLog::LogStart(request_.get());
 
   bool ok = request_->Send(blob.get());
@@ -630,9 +721,9 @@ void GearsHttpRequest::GetResponseText(JsCallContext *context) {
     context->SetReturnValue(JSPARAM_STRING16, &empty_string);
     return;
   }
-  // First, check the cached result (the response_text_ member variable).  It
-  // is only set if GetResponseText was previously called when IsComplete().
-  if (response_text_.get()) {
+  // First, check the cached result. It is only complete if GetResponseText
+  // was previously called when IsComplete().
+  if (is_response_text_complete_) {
     context->SetReturnValue(JSPARAM_STRING16, response_text_.get());
     return;
   }
@@ -641,16 +732,28 @@ void GearsHttpRequest::GetResponseText(JsCallContext *context) {
     // Exception set by GetResponseBlobImpl.
     return;
   }
-  scoped_ptr<std::string16> text(new std::string16);
-  if (!BlobToString16(blob.get(), request_->GetResponseCharset(), text.get())) {
+  // Decode only the bytes received since the last call. As with
+  // BlobToString16, the response is assumed to be UTF8.
+  if (!response_text_.get()) {
+    response_text_.reset(new std::string16);
+    response_text_length_ = 0;
+  }
+  int64 bytes_converted;
+  if (!AppendBlobToString16(blob.get(), response_text_length_,
+                            response_text_.get(), &bytes_converted)) {
     context->SetException(kInternalError);
     return;
   }
-  // Return and optionally cache the returned value.
-  context->SetReturnValue(JSPARAM_STRING16, text.get());
+  response_text_length_ += bytes_converted;
   if (IsComplete()) {
-    response_text_.swap(text);
+    if (response_text_length_ != blob->Length()) {
+      // The response ended with an incomplete character.
+      context->SetException(kInternalError);
+      return;
+    }
+    is_response_text_complete_ = true;
   }
+  context->SetReturnValue(JSPARAM_STRING16, response_text_.get());
 }
 
 bool GearsHttpRequest::GetResponseBlobImpl(JsCallContext *context,
@@ -710,6 +813,10 @@ void GearsHttpRequest::GetStatusText(JsCallContext *context) {
 }
 
 void GearsHttpRequest::AbortRequest() {
+  if (chunked_upload_.get()) {
+    chunked_upload_->Abort();
+    chunked_upload_.reset();
+  }
   if (request_.get()) {
     request_->SetListener(NULL, false);
     request_->Abort();
@@ -732,12 +839,17 @@ void GearsHttpRequest::ReleaseRequest() {
     request_.reset();
   }
   response_text_.reset();
+  response_text_length_ = 0;
+  is_response_text_complete_ = false;
   response_blob_.reset();
 }
 
 HttpRequest::ReadyState GearsHttpRequest::GetState() {
   HttpRequest::ReadyState state = HttpRequest::UNINITIALIZED;
-  if (request_.get()) {
+  if (chunked_upload_.get()) {
+    // The chunks are in flight. request_ was opened but is never sent.
+    state = HttpRequest::SENT;
+  } else if (request_.get()) {
     request_->GetReadyState(&state);
   }
   return state;
@@ -887,3 +999,41 @@ void GearsHttpRequest::UploadProgress(HttpRequest *source,
     upload_->ReportProgress(position, total);
   }
 }
+
+void GearsHttpRequest::ChunkedUploadProgress(int64 position, int64 total) {
+  if (upload_.get()) {
+    upload_->ReportProgress(position, total);
+  }
+}
+
+void GearsHttpRequest::ChunkedUploadComplete(HttpRequest *request) {
+  // Guard against being destroyed in the script callback.
+  scoped_refptr<GearsHttpRequest> reference(this);
+
+  // The ChunkedUpload holds a reference to itself while calling us.
+  chunked_upload_.reset();
+  ReleaseRequest();
+  if (request) {
+    // Present the response to the final chunk, or to the chunk that failed,
+    // as the response to this request.
+    request_ = request;
+    ReadyStateChanged(request_.get());
+    return;
+  }
+
+  // A chunk could not be sent at all, so there is no response to show.
+  LOG(("GearsHttpRequest: chunked upload failed to send a chunk\n"));
+  has_fired_completion_event_ = true;
+  onprogresshandler_.reset();
+  if (upload_.get()) {
+    upload_->ResetOnProgressHandler();
+  }
+  scoped_ptr<JsRootedCallback> handler(onreadystatechangehandler_.release());
+  if (handler.get()) {
+    JsRunnerInterface *runner = GetJsRunner();
+    assert(runner);
+    if (runner) {
+      runner->InvokeCallback(handler.get(), NULL, 0, NULL, NULL);
+    }
+  }
+}
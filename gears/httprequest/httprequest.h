@@ -30,6 +30,7 @@
 #include "gears/base/common/common.h"
 #include "gears/base/common/js_runner.h"
 #include "gears/blob/blob.h"
+#include "gears/httprequest/chunked_upload.h"
 #include "gears/localserver/common/http_request.h"
 #include "third_party/scoped_ptr/scoped_ptr.h"
 
@@ -38,7 +39,8 @@ class GearsHttpRequestUpload;
 class GearsHttpRequest
     : public ModuleImplBaseClass,
       public JsEventHandlerInterface,
-      public HttpRequest::HttpListener {
+      public HttpRequest::HttpListener,
+      public ChunkedUpload::Listener {
  public:
   static const std::string kModuleName;
 
@@ -93,8 +95,11 @@ class GearsHttpRequest
   // OUT: GearsHttpRequestUpload
   void GetUpload(JsCallContext *context);
 
-  // IN: optional string|GearsBlob postData
+  // IN: optional string|GearsBlob postData, optional object uploadOptions
   // OUT: -
+  // If uploadOptions is given with a Blob, the Blob is sent in chunks by a
+  // ChunkedUpload. uploadOptions may set chunkSize, maxParallel and
+  // maxRetries.
   void Send(JsCallContext *context);
 
   // IN: function
@@ -119,8 +124,19 @@ class GearsHttpRequest
   scoped_ptr<JsRootedCallback> onreadystatechangehandler_;
   scoped_ptr<JsEventMonitor> unload_monitor_;
   scoped_refptr<GearsHttpRequestUpload> upload_;
+  // The text decoded so far, and the number of bytes of the response body it
+  // was decoded from. While the response is arriving, only newly received
+  // bytes are decoded.
   scoped_ptr<std::string16> response_text_;
+  int64 response_text_length_;
+  bool is_response_text_complete_;
   scoped_refptr<GearsBlob> response_blob_;
+  // The method, url and headers given to Open and SetRequestHeader, which a
+  // ChunkedUpload repeats on each of its requests.
+  std::string16 method_;
+  std::string16 url_;
+  ChunkedUpload::HeaderList request_headers_;
+  scoped_refptr<ChunkedUpload> chunked_upload_;
 
   void AbortRequest();
   void CreateRequest();
@@ -149,6 +165,10 @@ class GearsHttpRequest
   virtual void ReadyStateChanged(HttpRequest *source);
   virtual void UploadProgress(HttpRequest *source, int64 position, int64 total);
 
+  // ChunkedUpload::Listener implementation.
+  virtual void ChunkedUploadProgress(int64 position, int64 total);
+  virtual void ChunkedUploadComplete(HttpRequest *request);
+
   // JsEventHandlerInterface implementation.
   virtual void HandleEvent(JsEventType event_type);
 
@@ -30,7 +30,8 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 var tools = [
   ['Console', 'console.html'],
   ['Database', 'database.html'],
-  ['LocalServer', 'localserver.html']
+  ['LocalServer', 'localserver.html'],
+  ['Memory', 'memory.html']
   //['WorkerPool', 'workerpool.html']
 ];
 
@@ -103,6 +103,8 @@ extern const unsigned char inspector_database_html[];
 extern const size_t        inspector_database_html_size;
 extern const unsigned char inspector_localserver_html[];
 extern const size_t        inspector_localserver_html_size;
+extern const unsigned char inspector_memory_html[];
+extern const size_t        inspector_memory_html_size;
 
 extern const unsigned char inspector_common_alert_35_png[];
 extern const size_t        inspector_common_alert_35_png_size;
@@ -158,6 +160,10 @@ const InspectorResource resource_list[] = {
     inspector_localserver_html,
     inspector_localserver_html_size,
     kContentTypeHTML },
+  { STRING16(L"memory.html"),
+    inspector_memory_html,
+    inspector_memory_html_size,
+    kContentTypeHTML },
 
   { STRING16(L"common/alert-35.png"),
     inspector_common_alert_35_png,
@@ -130,22 +130,23 @@ bool WebCacheBlobStore::DeleteBody(int64 payload_id) {
 }
   
 //------------------------------------------------------------------------------
-// DeleteUnreferencedBodies
+// DetachBody
 //------------------------------------------------------------------------------
-bool WebCacheBlobStore::DeleteUnreferencedBodies() {
+bool WebCacheBlobStore::DetachBody(int64 payload_id, std::string16 *filepath) {
   ASSERT_SINGLE_THREAD();
-  assert(db_);
+  assert(filepath);
 
-  // Delete the rows
-  const char16* sql = STRING16(
-                          L"DELETE FROM ResponseBodies WHERE BodyID NOT IN "
-                          L"(SELECT DISTINCT PayloadID FROM Payloads)");
-  SQLStatement delete_stmt;
-  int rv = delete_stmt.prepare16(db_->GetSQLDatabase(), sql);
-  if (rv != SQLITE_OK) {
-    LOG(("WebCacheDB.DeleteUnreferencedBodies failed\n"));
-    return false;
-  }
-  return (delete_stmt.step() == SQLITE_DONE);
+  // Bodies are stored in the database, there are no files to leave behind
+  filepath->clear();
+  return WebCacheBlobStore::DeleteBody(payload_id);
+}
+
+//------------------------------------------------------------------------------
+// DeleteDetachedFile
+//------------------------------------------------------------------------------
+bool WebCacheBlobStore::DeleteDetachedFile(const char16 *filepath) {
+  ASSERT_SINGLE_THREAD();
+  assert(!filepath || !filepath[0]);
+  return true;
 }
 
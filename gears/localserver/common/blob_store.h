@@ -63,8 +63,14 @@ class WebCacheBlobStore {
   // Deletes a body from the store
   virtual bool DeleteBody(int64 payload_id);
   
-  // Deletes all unreferenced bodies from the store
-  virtual bool DeleteUnreferencedBodies();
+  // Deletes a body from the store, leaving the removal of any file that
+  // backs it to the caller. The relative filepath of that file, or an
+  // empty string if there is none, is returned in filepath.
+  virtual bool DetachBody(int64 payload_id, std::string16 *filepath);
+
+  // Removes a file previously returned by DetachBody. This is not
+  // transactional, the file is deleted immediately.
+  virtual bool DeleteDetachedFile(const char16 *filepath);
 
   // The WebCacheDB that owns us
   WebCacheDB *db_;
@@ -33,11 +33,27 @@
 #include <time.h>
 #include <algorithm>
 #include "gears/base/common/file.h"
+#include "gears/base/common/mime_detect.h"
 #include "gears/base/common/paths.h"
+#include "gears/base/common/sha1.h"
 #include "gears/base/common/string_utils.h"
 #include "gears/localserver/common/localserver_db.h"
+#include "third_party/scoped_ptr/scoped_ptr.h"
+#include "third_party/zlib/zlib.h"
 
 const char16 *kGenericCacheFilename = STRING16(L"File");
+const char16 *kSharedBodiesDirectoryName = STRING16(L"shared_bodies");
+const char16 *kGzipEncoding = STRING16(L"gzip");
+
+// Bodies smaller than this are not worth compressing
+const size_t kMinCompressedBodySize = 512;
+// Compressed bodies are only kept if they shrink to at most this
+// fraction of their original size
+const int kMaxCompressedSizePercent = 90;
+// The size of the buffers used when compressing and decompressing
+const int kGzipChunkSize = 32 * 1024;
+const int kGzipHeaderSize = 10;
+const int kGzipTrailerSize = 8;
 const int kMaxFilesPerDirectory = 500;
 const int kMaxSubDirectoriesPerLevel = 100;
 
@@ -47,6 +63,11 @@ static bool CreateUniqueFile(const char16* full_dirpath,
                              std::string16 *full_filepath);
 static void AppendBracketedNumber(int number, std::string16 *str);
 static bool GetFileNameFromUrl(const char16 *url, std::string16 *filename);
+static bool IsCompressibleMimeType(const std::string16 &mime_type);
+static bool WriteGzipFile(File *file, const std::vector<uint8> &data,
+                          bool *compressed);
+static bool ReadGzipFile(const char16 *full_filepath,
+                         std::vector<uint8> *data);
 
 //------------------------------------------------------------------------------
 // Init
@@ -81,18 +102,54 @@ bool WebCacheFileStore::InsertBody(int64 server_id,
     return true;
   }
 
-  // Put a file on disk, the relative file path is returned in
-  // payload.cached_filepath. If the current transaction rollsback,
-  // the newly created file will be deleted.
-  if (!CreateAndWriteFile(server_id, url, payload)) {
+  // Bodies are content addressed. Identical bodies, such as a common
+  // script library captured by many stores, share a single file in the
+  // shared bodies directory which is reference counted.
+  std::string16 body_hash;
+  ComputeBodyHash(*payload, &body_hash);
+  bool found = false;
+  if (!AddRefSharedBody(body_hash, &payload->cached_filepath,
+                        &payload->is_body_compressed, &found)) {
     return false;
   }
 
+  if (!found) {
+    // Put a file on disk, the relative file path is returned in
+    // payload.cached_filepath. If the current transaction rollsback,
+    // the newly created file will be deleted.
+    std::string16 shared_dir;
+    GetSharedBodiesDirectory(&shared_dir);
+    if (!CreateAndWriteFile(shared_dir.c_str(), url, payload)) {
+      return false;
+    }
+
+    const char16* shared_sql = STRING16(L"INSERT INTO SharedBodies"
+                                        L" (BodyHash, FilePath, Encoding,"
+                                        L"  RefCount)"
+                                        L" VALUES (?, ?, ?, 1)");
+    SQLStatement shared_stmt;
+    int rv = shared_stmt.prepare16(db_->GetSQLDatabase(), shared_sql);
+    rv |= shared_stmt.bind_text16(0, body_hash.c_str());
+    rv |= shared_stmt.bind_text16(1, payload->cached_filepath.c_str());
+    if (payload->is_body_compressed) {
+      rv |= shared_stmt.bind_text16(2, kGzipEncoding);
+    } else {
+      rv |= shared_stmt.bind_null(2);
+    }
+    if (rv != SQLITE_OK) {
+      LOG(("WebCacheDB.InsertBody failed\n"));
+      return false;
+    }
+    if (shared_stmt.step() != SQLITE_DONE) {
+      return false;
+    }
+  }
+
   // Insert a row in the ResponseBodies table containing the filepath. Note
   // that BodyID is the same as PayloadID in the Payloads table.
   const char16* sql = STRING16(L"INSERT INTO ResponseBodies"
-                               L" (BodyID, FilePath)"
-                               L" VALUES (?, ?)");
+                               L" (BodyID, FilePath, BodyHash, Encoding)"
+                               L" VALUES (?, ?, ?, ?)");
   SQLStatement stmt;
   int rv = stmt.prepare16(db_->GetSQLDatabase(), sql);
   if (rv != SQLITE_OK) {
@@ -102,12 +159,23 @@ bool WebCacheFileStore::InsertBody(int64 server_id,
   int param = -1;
   rv = stmt.bind_int64(++param, payload->id);
   rv |= stmt.bind_text16(++param, payload->cached_filepath.c_str());
+  rv |= stmt.bind_text16(++param, body_hash.c_str());
+  if (payload->is_body_compressed) {
+    rv |= stmt.bind_text16(++param, kGzipEncoding);
+  } else {
+    rv |= stmt.bind_null(++param);
+  }
   if (rv != SQLITE_OK) {
     return false;
   }
 
-  // Return the full filepath to the caller
-  PrependRootFilePath(&payload->cached_filepath);
+  // Return the full filepath to the caller, unless the file does not
+  // contain the body as is
+  if (payload->is_body_compressed) {
+    payload->cached_filepath.clear();
+  } else {
+    PrependRootFilePath(&payload->cached_filepath);
+  }
 
   return (stmt.step() == SQLITE_DONE);
 }
@@ -124,11 +192,13 @@ bool WebCacheFileStore::ReadBody(WebCacheDB::PayloadInfo *payload,
   if (payload->status_code != HttpConstants::HTTP_OK) {
     payload->cached_filepath.clear();
     payload->data.reset(NULL);
+    payload->is_body_compressed = false;
     return true;
   }
 
   // Read the relative filepath from the ResponseBodies table
-  if (!GetFilePath(payload->id, &payload->cached_filepath)) {
+  if (!GetFilePath(payload->id, &payload->cached_filepath,
+                   &payload->is_body_compressed)) {
     return false;
   }
 
@@ -140,6 +210,13 @@ bool WebCacheFileStore::ReadBody(WebCacheDB::PayloadInfo *payload,
     }
   }
 
+  // The file of a compressed body is not handed out, callers expect to
+  // find the response body as is in cached_filepath
+  if (payload->is_body_compressed) {
+    payload->cached_filepath.clear();
+    return true;
+  }
+
   // We return the full filepath to the caller
   PrependRootFilePath(&payload->cached_filepath);
   return true;
@@ -154,9 +231,12 @@ bool WebCacheFileStore::DeleteBody(int64 payload_id) {
   assert(began_);
   if (!began_) return false;
 
-  // Read the filepath from the ResponseBodies table.
+  // Release our reference to the file.
   std::string16 filepath;
-  if (GetFilePath(payload_id, &filepath)) {
+  if (!ReleaseBody(payload_id, &filepath)) {
+    return false;
+  }
+  if (!filepath.empty()) {
     // Delete the file on disk. Note the file is not really deleted until
     // the current transaction commits.
     DeleteFile(filepath.c_str());
@@ -167,32 +247,34 @@ bool WebCacheFileStore::DeleteBody(int64 payload_id) {
 }
 
 //------------------------------------------------------------------------------
-// DeleteUnreferencedBodies
+// DetachBody
 //------------------------------------------------------------------------------
-bool WebCacheFileStore::DeleteUnreferencedBodies() {
+bool WebCacheFileStore::DetachBody(int64 payload_id, std::string16 *filepath) {
   ASSERT_SINGLE_THREAD();
   assert(db_);
-  assert(began_);
-  if (!began_) return false;
+  assert(filepath);
 
-  // Delete files, note the files aren't actually deleted until the current
-  // transaction is committed
-  const char16* sql = STRING16(L"SELECT FilePath FROM ResponseBodies "
-                               L"WHERE BodyID NOT IN "
-                               L"(SELECT DISTINCT PayloadID FROM Payloads)");
-  SQLStatement select_stmt;
-  int rv = select_stmt.prepare16(db_->GetSQLDatabase(), sql);
-  if (rv != SQLITE_OK) {
-    LOG(("WebCacheDB.DeleteUnreferencedBodies failed\n"));
+  if (!ReleaseBody(payload_id, filepath)) {
     return false;
   }
-  while (select_stmt.step() == SQLITE_ROW) {
-    DeleteFile(select_stmt.column_text16(0));
-  }
-  sqlite3_finalize(select_stmt.release());
 
-  // Now delete the rows
-  return WebCacheBlobStore::DeleteUnreferencedBodies();
+  // Delete the row from the response bodies table, but not the file.
+  return WebCacheBlobStore::DeleteBody(payload_id);
+}
+
+//------------------------------------------------------------------------------
+// DeleteDetachedFile
+//------------------------------------------------------------------------------
+bool WebCacheFileStore::DeleteDetachedFile(const char16 *filepath) {
+  ASSERT_SINGLE_THREAD();
+  if (!filepath || !filepath[0]) return false;
+  std::string16 full_filepath(filepath);
+  PrependRootFilePath(&full_filepath);
+
+  // The file may already be gone if we crashed after deleting it but
+  // before recording that fact, that's not an error.
+  return File::Delete(full_filepath.c_str()) ||
+         !File::Exists(full_filepath.c_str());
 }
 
 //------------------------------------------------------------------------------
@@ -273,9 +355,10 @@ bool WebCacheFileStore::GetDirectoryPathForServer(int64 server_id,
 //------------------------------------------------------------------------------
 // Read the relative filepath from the ResponseBodies table
 //------------------------------------------------------------------------------
-bool WebCacheFileStore::GetFilePath(int64 payload_id, std::string16 *filepath) {
-  const char16* sql = STRING16(L"SELECT FilePath FROM ResponseBodies "
-                               L"WHERE BodyID=?");
+bool WebCacheFileStore::GetFilePath(int64 payload_id, std::string16 *filepath,
+                                    bool *is_compressed) {
+  const char16* sql = STRING16(L"SELECT FilePath, Encoding "
+                               L"FROM ResponseBodies WHERE BodyID=?");
   SQLStatement stmt;
   int rv = stmt.prepare16(db_->GetSQLDatabase(), sql);
   if (rv != SQLITE_OK) {
@@ -290,6 +373,160 @@ bool WebCacheFileStore::GetFilePath(int64 payload_id, std::string16 *filepath) {
     return false;
   }
   *filepath = stmt.column_text16_safe(0);
+  *is_compressed = (stmt.column_text16_safe(1) == std::string16(kGzipEncoding));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// GetSharedBodiesDirectory
+//------------------------------------------------------------------------------
+void WebCacheFileStore::GetSharedBodiesDirectory(std::string16 *shared_dir) {
+  // <data_dir>/shared_bodies#localserver, the suffix keeps this from
+  // colliding with the directory for any origin's host
+  *shared_dir = root_dir_.substr(0, root_dir_.length() - 1);
+  AppendDataName(kSharedBodiesDirectoryName, kDataSuffixForLocalServer,
+                 shared_dir);
+}
+
+//------------------------------------------------------------------------------
+// ComputeBodyHash
+//------------------------------------------------------------------------------
+// static
+void WebCacheFileStore::ComputeBodyHash(const WebCacheDB::PayloadInfo &payload,
+                                        std::string16 *body_hash) {
+  Sha1 sha1;
+  const std::vector<uint8> *data = payload.data.get();
+  if (data && !data->empty()) {
+    sha1.Update(&(*data)[0], data->size());
+  }
+  std::string hex;
+  sha1.FinalHex(&hex);
+  *body_hash = UTF8ToString16(hex);
+}
+
+//------------------------------------------------------------------------------
+// AddRefSharedBody
+//------------------------------------------------------------------------------
+bool WebCacheFileStore::AddRefSharedBody(const std::string16 &body_hash,
+                                         std::string16 *filepath,
+                                         bool *is_compressed,
+                                         bool *found) {
+  *found = false;
+  const char16* select_sql = STRING16(L"SELECT FilePath, Encoding "
+                                      L"FROM SharedBodies WHERE BodyHash=?");
+  SQLStatement select_stmt;
+  int rv = select_stmt.prepare16(db_->GetSQLDatabase(), select_sql);
+  rv |= select_stmt.bind_text16(0, body_hash.c_str());
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheFileStore.AddRefSharedBody failed\n"));
+    return false;
+  }
+  rv = select_stmt.step();
+  if (rv == SQLITE_DONE) {
+    return true;
+  } else if (rv != SQLITE_ROW) {
+    return false;
+  }
+  *filepath = select_stmt.column_text16_safe(0);
+  *is_compressed = (select_stmt.column_text16_safe(1) ==
+                    std::string16(kGzipEncoding));
+  select_stmt.finalize();
+
+  const char16* update_sql = STRING16(L"UPDATE SharedBodies "
+                                      L"SET RefCount=RefCount+1 "
+                                      L"WHERE BodyHash=?");
+  SQLStatement update_stmt;
+  rv = update_stmt.prepare16(db_->GetSQLDatabase(), update_sql);
+  rv |= update_stmt.bind_text16(0, body_hash.c_str());
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheFileStore.AddRefSharedBody failed\n"));
+    return false;
+  }
+  if (update_stmt.step() != SQLITE_DONE) {
+    return false;
+  }
+  *found = true;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// ReleaseBody
+//------------------------------------------------------------------------------
+bool WebCacheFileStore::ReleaseBody(int64 payload_id,
+                                    std::string16 *unreferenced_filepath) {
+  unreferenced_filepath->clear();
+
+  const char16* select_sql = STRING16(L"SELECT FilePath, BodyHash "
+                                      L"FROM ResponseBodies WHERE BodyID=?");
+  SQLStatement select_stmt;
+  int rv = select_stmt.prepare16(db_->GetSQLDatabase(), select_sql);
+  rv |= select_stmt.bind_int64(0, payload_id);
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheFileStore.ReleaseBody failed\n"));
+    return false;
+  }
+  rv = select_stmt.step();
+  if (rv == SQLITE_DONE) {
+    // Bodyless responses have no row in the ResponseBodies table
+    return true;
+  } else if (rv != SQLITE_ROW) {
+    return false;
+  }
+  std::string16 filepath(select_stmt.column_text16_safe(0));
+  std::string16 body_hash(select_stmt.column_text16_safe(1));
+  select_stmt.finalize();
+
+  // Bodies stored prior to schema version 15 are not shared
+  if (body_hash.empty()) {
+    *unreferenced_filepath = filepath;
+    return true;
+  }
+
+  const char16* update_sql = STRING16(L"UPDATE SharedBodies "
+                                      L"SET RefCount=RefCount-1 "
+                                      L"WHERE BodyHash=?");
+  SQLStatement update_stmt;
+  rv = update_stmt.prepare16(db_->GetSQLDatabase(), update_sql);
+  rv |= update_stmt.bind_text16(0, body_hash.c_str());
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheFileStore.ReleaseBody failed\n"));
+    return false;
+  }
+  if (update_stmt.step() != SQLITE_DONE) {
+    return false;
+  }
+
+  const char16* count_sql = STRING16(L"SELECT RefCount FROM SharedBodies "
+                                     L"WHERE BodyHash=?");
+  SQLStatement count_stmt;
+  rv = count_stmt.prepare16(db_->GetSQLDatabase(), count_sql);
+  rv |= count_stmt.bind_text16(0, body_hash.c_str());
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheFileStore.ReleaseBody failed\n"));
+    return false;
+  }
+  rv = count_stmt.step();
+  if (rv == SQLITE_ROW && count_stmt.column_int64(0) > 0) {
+    // Still in use by other payloads
+    return true;
+  } else if (rv != SQLITE_ROW && rv != SQLITE_DONE) {
+    return false;
+  }
+  count_stmt.finalize();
+
+  const char16* delete_sql = STRING16(L"DELETE FROM SharedBodies "
+                                      L"WHERE BodyHash=?");
+  SQLStatement delete_stmt;
+  rv = delete_stmt.prepare16(db_->GetSQLDatabase(), delete_sql);
+  rv |= delete_stmt.bind_text16(0, body_hash.c_str());
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheFileStore.ReleaseBody failed\n"));
+    return false;
+  }
+  if (delete_stmt.step() != SQLITE_DONE) {
+    return false;
+  }
+  *unreferenced_filepath = filepath;
   return true;
 }
 
@@ -303,23 +540,32 @@ bool WebCacheFileStore::ReadFile(WebCacheDB::PayloadInfo *payload) {
   std::string16 full_filepath(payload->cached_filepath);
   PrependRootFilePath(&full_filepath);
   scoped_ptr< std::vector<uint8> > data(new std::vector<uint8>);
-  if (!File::ReadFileToVector(full_filepath.c_str(), data.get())) {
-    return false;
+  if (payload->is_body_compressed && !payload->accepts_gzip_encoding) {
+    if (!ReadGzipFile(full_filepath.c_str(), data.get())) {
+      return false;
+    }
+  } else {
+    if (!File::ReadFileToVector(full_filepath.c_str(), data.get())) {
+      return false;
+    }
   }
   payload->data.reset(data.release());
+  if (payload->is_body_compressed && payload->accepts_gzip_encoding) {
+    return payload->SetGzipEncodedHeaders();
+  }
   return true;
 }
 
 //------------------------------------------------------------------------------
 // Creates and writes a new cached file on disk. The filename is determined
 // by first examining the payload.headers for a filename. If that fails,
-// the filename is based on the url.  The file is created in the directory for
-// the given server_id. The relative filepath is returned in
+// the filename is based on the url.  The file is created within parent_dir.
+// The relative filepath is returned in
 // payload.cached_filepath. The contents of the file are determined by
 // payload.data. If Rollback() is called prior to Commit(), the newly
 // created file will be deleted.
 //------------------------------------------------------------------------------
-bool WebCacheFileStore::CreateAndWriteFile(int64 server_id,
+bool WebCacheFileStore::CreateAndWriteFile(const char16 *parent_dir,
                                            const char16 *url,
                                            WebCacheDB::PayloadInfo *payload) {
   ASSERT_SINGLE_THREAD();
@@ -328,20 +574,15 @@ bool WebCacheFileStore::CreateAndWriteFile(int64 server_id,
   assert(began_);
   if (!began_) return false;
 
-  std::string16 server_dir;
-  if (!GetDirectoryPathForServer(server_id, &server_dir)) {
-    return false;
-  }
-
-  // Find a directory with space available within server_dir
-  // This may be server_dir or a subdirectory of server_dir
+  // Find a directory with space available within parent_dir
+  // This may be parent_dir or a subdirectory of parent_dir
   // TODO(michaeln): Perhaps revisit. Should we hash the 'url'
   // to a 32 bit number and use the four octets as the subdirectory
   // path instead of enumerating directory items to count them?
   // Our current scheme has the nice characteristic of all files
   // for a given store appearing in a single directory.
   std::string16 available_dir;
-  FindDirectoryWithSpaceAvailable(server_dir.c_str(), &available_dir);
+  FindDirectoryWithSpaceAvailable(parent_dir, &available_dir);
   if (!File::RecursivelyCreateDir(available_dir.c_str())) {
     return false;
   }
@@ -363,8 +604,18 @@ bool WebCacheFileStore::CreateAndWriteFile(int64 server_id,
   // If the transaction fails, we will delete this file
   delete_on_rollback_.push_back(full_filepath);
 
-  // Write the file
-  if (!File::WriteVectorToFile(full_filepath.c_str(), payload->data.get())) {
+  // Write the file, compressing the body if worthwhile
+  payload->is_body_compressed = false;
+  const std::vector<uint8> *data = payload->data.get();
+  if (data && data->size() >= kMinCompressedBodySize &&
+      ShouldCompressBody(payload, filename)) {
+    scoped_ptr<File> file(File::Open(full_filepath.c_str(), File::WRITE,
+                                     File::FAIL_IF_NOT_EXISTS));
+    if (!file.get() ||
+        !WriteGzipFile(file.get(), *data, &payload->is_body_compressed)) {
+      return false;
+    }
+  } else if (!File::WriteVectorToFile(full_filepath.c_str(), data)) {
     return false;
   }
 
@@ -374,6 +625,20 @@ bool WebCacheFileStore::CreateAndWriteFile(int64 server_id,
   return true;
 }
 
+//------------------------------------------------------------------------------
+// Determines whether a body is likely to compress well based on its
+// Content-Type, falling back to the type implied by its file name.
+//------------------------------------------------------------------------------
+bool WebCacheFileStore::ShouldCompressBody(WebCacheDB::PayloadInfo *payload,
+                                           const std::string16 &filename) {
+  std::string16 mime_type;
+  payload->GetHeader(HttpConstants::kContentTypeHeader, &mime_type);
+  if (mime_type.empty()) {
+    mime_type = DetectMimeTypeOfFile(filename);
+  }
+  return IsCompressibleMimeType(mime_type);
+}
+
 //------------------------------------------------------------------------------
 // Deletes a cached file from disk. The delete doesn't actually occur until
 // Commit() is called. If Rollback() is called prior to Commit(), the file
@@ -670,3 +935,172 @@ static bool GetFileNameFromUrl(const char16 *url, std::string16 *filename) {
 
   return !filename->empty();
 }
+
+//------------------------------------------------------------------------------
+// Returns true for types of textual content that typically compress well.
+// The parameters following a ';' in a Content-Type header are ignored.
+//------------------------------------------------------------------------------
+static bool IsCompressibleMimeType(const std::string16 &mime_type) {
+  std::string16 type(mime_type.substr(0, mime_type.find(L';')));
+  LowerString(type);
+  const char16 *kCompressibleTypes[] = {
+    STRING16(L"application/javascript"),
+    STRING16(L"application/x-javascript"),
+    STRING16(L"application/json"),
+    STRING16(L"application/xml"),
+    STRING16(L"application/xhtml+xml"),
+    STRING16(L"image/svg+xml")
+  };
+  if (StartsWith(type, std::string16(STRING16(L"text/")))) {
+    return true;
+  }
+  for (size_t i = 0; i < ARRAYSIZE(kCompressibleTypes); ++i) {
+    if (type == kCompressibleTypes[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+// Writes data to an empty file in the gzip format (RFC 1952), deflating it
+// a chunk at a time. If the result is not sufficiently smaller than the
+// original, the file is rewritten with the data as is and compressed is set
+// to false.
+//------------------------------------------------------------------------------
+static bool WriteGzipFile(File *file, const std::vector<uint8> &data,
+                          bool *compressed) {
+  *compressed = false;
+
+  // A minimal header: no file name, modification time or extra flags
+  const uint8 kHeader[kGzipHeaderSize] =
+      { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 0xff };
+  if (file->Write(kHeader, kGzipHeaderSize) != kGzipHeaderSize) {
+    return false;
+  }
+
+  // Negative window bits produce raw deflate data, we write the gzip
+  // wrapper ourselves as zlib is built without gzip support
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                   8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  stream.next_in = const_cast<Bytef*>(&data[0]);
+  stream.avail_in = data.size();
+
+  int64 max_size = static_cast<int64>(data.size()) *
+                   kMaxCompressedSizePercent / 100;
+  int64 compressed_size = kGzipHeaderSize + kGzipTrailerSize;
+  uint8 buffer[kGzipChunkSize];
+  int rv = Z_OK;
+  while (rv == Z_OK && compressed_size <= max_size) {
+    stream.next_out = buffer;
+    stream.avail_out = kGzipChunkSize;
+    rv = deflate(&stream, Z_FINISH);
+    if (rv != Z_OK && rv != Z_STREAM_END && rv != Z_BUF_ERROR) {
+      break;
+    }
+    int64 count = kGzipChunkSize - stream.avail_out;
+    if (file->Write(buffer, count) != count) {
+      deflateEnd(&stream);
+      return false;
+    }
+    compressed_size += count;
+    if (rv == Z_BUF_ERROR) {
+      rv = Z_OK;  // no progress was possible, more output space is needed
+    }
+  }
+  deflateEnd(&stream);
+
+  if (rv == Z_STREAM_END && compressed_size <= max_size) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, &data[0], data.size());
+    uint32 length = static_cast<uint32>(data.size());
+    uint8 trailer[kGzipTrailerSize];
+    for (int i = 0; i < 4; ++i) {
+      trailer[i] = static_cast<uint8>(crc >> (i * 8));
+      trailer[4 + i] = static_cast<uint8>(length >> (i * 8));
+    }
+    if (file->Write(trailer, kGzipTrailerSize) != kGzipTrailerSize) {
+      return false;
+    }
+    *compressed = true;
+    return true;
+  }
+
+  // Not worth it, or deflate failed, store the data as is
+  if (!file->Seek(0) || !file->Truncate(0)) {
+    return false;
+  }
+  int64 size = data.size();
+  return file->Write(&data[0], size) == size;
+}
+
+//------------------------------------------------------------------------------
+// Reads a file written by WriteGzipFile, inflating it a chunk at a time
+// directly into data.
+//------------------------------------------------------------------------------
+static bool ReadGzipFile(const char16 *full_filepath,
+                         std::vector<uint8> *data) {
+  scoped_ptr<File> file(File::Open(full_filepath, File::READ,
+                                   File::FAIL_IF_NOT_EXISTS));
+  if (!file.get()) {
+    return false;
+  }
+  int64 file_size = file->Size();
+  if (file_size < kGzipHeaderSize + kGzipTrailerSize) {
+    return false;
+  }
+
+  // The trailer holds the crc and the size of the original data
+  uint8 trailer[kGzipTrailerSize];
+  if (!file->Seek(file_size - kGzipTrailerSize) ||
+      file->Read(trailer, kGzipTrailerSize) != kGzipTrailerSize) {
+    return false;
+  }
+  uint32 expected_crc = 0;
+  uint32 length = 0;
+  for (int i = 3; i >= 0; --i) {
+    expected_crc = (expected_crc << 8) | trailer[i];
+    length = (length << 8) | trailer[4 + i];
+  }
+  if (!file->Seek(kGzipHeaderSize)) {
+    return false;
+  }
+
+  data->resize(length);
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    return false;
+  }
+  stream.next_out = length ? &(*data)[0] : NULL;
+  stream.avail_out = length;
+
+  int64 remaining = file_size - kGzipHeaderSize - kGzipTrailerSize;
+  uint8 buffer[kGzipChunkSize];
+  int rv = Z_OK;
+  while (rv == Z_OK && remaining > 0) {
+    int64 count = remaining < kGzipChunkSize ? remaining : kGzipChunkSize;
+    if (file->Read(buffer, count) != count) {
+      break;
+    }
+    remaining -= count;
+    stream.next_in = buffer;
+    stream.avail_in = static_cast<uInt>(count);
+    rv = inflate(&stream, Z_NO_FLUSH);
+  }
+  bool ok = (rv == Z_STREAM_END) && (stream.total_out == length);
+  inflateEnd(&stream);
+  if (!ok) {
+    return false;
+  }
+
+  uLong crc = crc32(0L, Z_NULL, 0);
+  if (length) {
+    crc = crc32(crc, &(*data)[0], length);
+  }
+  return crc == expected_crc;
+}
@@ -64,8 +64,13 @@ class WebCacheFileStore : public WebCacheBlobStore {
   // Deletes a body from the store
   virtual bool DeleteBody(int64 payload_id);
   
-  // Deletes all unreferenced bodies from the store
-  virtual bool DeleteUnreferencedBodies();
+  // Deletes a body from the store without deleting its file, the relative
+  // filepath is returned so the caller can remove the file once the
+  // deletion has been committed
+  virtual bool DetachBody(int64 payload_id, std::string16 *filepath);
+
+  // Removes a file previously returned by DetachBody
+  virtual bool DeleteDetachedFile(const char16 *filepath);
 
   // Starts a transaction.
   void BeginTransaction();
@@ -98,23 +103,54 @@ class WebCacheFileStore : public WebCacheBlobStore {
 
   // Returns the relative filepath of the file containing the body
   // for the payload_id
-  bool GetFilePath(int64 payload_id, std::string16 *filepath);
+  bool GetFilePath(int64 payload_id, std::string16 *filepath,
+                   bool *is_compressed);
+
+  // Determines the full path of the directory containing bodies that are
+  // shared by all servers.
+  void GetSharedBodiesDirectory(std::string16 *shared_dir);
+
+  // Computes the content hash used to identify identical bodies.
+  static void ComputeBodyHash(const WebCacheDB::PayloadInfo &payload,
+                              std::string16 *body_hash);
+
+  // Looks for a shared body with the given hash, and if found, adds a
+  // reference to it and returns its relative filepath and whether the
+  // file is compressed.
+  bool AddRefSharedBody(const std::string16 &body_hash,
+                        std::string16 *filepath,
+                        bool *is_compressed,
+                        bool *found);
+
+  // Releases the reference held by the ResponseBodies row for payload_id.
+  // If no references to the file remain, its relative filepath is returned
+  // in unreferenced_filepath, otherwise that is cleared. Does not delete
+  // the ResponseBodies row itself.
+  bool ReleaseBody(int64 payload_id, std::string16 *unreferenced_filepath);
 
   // Reads the contents of a cached file into memory. The file to read
   // is determined by payload.cached_filepath. The file data is read into
-  // a new vector and a reference to that vector is placed in payload.data
+  // a new vector and a reference to that vector is placed in payload.data.
+  // Compressed files are inflated while being read, unless the payload
+  // accepts gzip encoding.
   bool ReadFile(WebCacheDB::PayloadInfo *payload);
 
+  // Determines whether the body of the payload should be compressed when
+  // stored, based on its Content-Type or the type implied by filename.
+  bool ShouldCompressBody(WebCacheDB::PayloadInfo *payload,
+                          const std::string16 &filename);
+
   // Creates and writes a new cached file on disk. The filename is determined
   // by first examining the payload.headers for a Content-Disposition header
   // that contains a filename. If that fails, the filename is based on the
-  // filename part of the url.  The file is created in the directory for
-  // the given server_id. The relative filepath is returned in 
+  // filename part of the url.  The file is created within the directory
+  // parent_dir. The relative filepath is returned in
   // payload.cached_filepath. The contents of the file are determined by
-  // payload.data. If a transaction has been started and Rollback() is
-  // called prior to Commit(), the newly  created file will be deleted.
-  // See BeginTransaction()
-  bool CreateAndWriteFile(int64 server_id,
+  // payload.data, compressed if ShouldCompressBody() indicates so, in
+  // which case payload.is_body_compressed is set. If a transaction has
+  // been started and Rollback() is called prior to Commit(), the newly
+  // created file will be deleted. See BeginTransaction()
+  bool CreateAndWriteFile(const char16 *parent_dir,
                           const char16 *url,
                           WebCacheDB::PayloadInfo *payload);
   
@@ -33,10 +33,12 @@ const char16 *HttpConstants::kContentDispositionHeader
 const char16 *HttpConstants::kContentEncodingHeader
                                             = STRING16(L"Content-Encoding");
 const char16 *HttpConstants::kContentLengthHeader = STRING16(L"Content-Length");
+const char16 *HttpConstants::kContentRangeHeader = STRING16(L"Content-Range");
 const char16 *HttpConstants::kContentTypeHeader = STRING16(L"Content-Type");
 const char16 *HttpConstants::kCookieHeader = STRING16(L"Cookie");
 const char16 *HttpConstants::kCrLf = STRING16(L"\r\n");
 const char   *HttpConstants::kCrLfAscii = "\r\n";
+const char16 *HttpConstants::kETagHeader = STRING16(L"ETag");
 const char16 *HttpConstants::kExpiresHeader = STRING16(L"Expires");
 const char16 *HttpConstants::kFileScheme = STRING16(L"file");
 const char   *HttpConstants::kFileSchemeAscii =      "file";
@@ -76,6 +78,8 @@ const char16 *HttpConstants::kXGearsSafariCapturedMimeType =
                                  STRING16(L"X-Gears-Safari-MimeType");
 const char16 *HttpConstants::kXGearsReasonHeader =
                                  STRING16(L"X-Gears-Reason");
+const char16 *HttpConstants::kXGearsUploadIdHeader =
+                                 STRING16(L"X-Gears-Upload-Id");
 const char16 *HttpConstants::kXGearsReason_ValidateManifest =
                                  STRING16(L"validate-manifest");
 const char   *HttpConstants::kXGearsDecodedContentLengthAscii =
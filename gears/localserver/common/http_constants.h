@@ -48,10 +48,12 @@ class HttpConstants {
   static const char16 *kContentDispositionHeader;
   static const char16 *kContentEncodingHeader;
   static const char16 *kContentLengthHeader;
+  static const char16 *kContentRangeHeader;
   static const char16 *kContentTypeHeader;
   static const char16 *kCookieHeader;
   static const char16 *kCrLf;
   static const char   *kCrLfAscii;
+  static const char16 *kETagHeader;
   static const char16 *kExpiresHeader;
   static const char16 *kHttpScheme;
   static const char   *kHttpSchemeAscii;
@@ -84,6 +86,7 @@ class HttpConstants {
   static const char16 *kXGoogleGearsBypassLocalServer;
   static const char16 *kXGearsSafariCapturedMimeType;
   static const char16 *kXGearsReasonHeader;
+  static const char16 *kXGearsUploadIdHeader;
   static const char16 *kXGearsReason_ValidateManifest;
   static const char   *kXGearsDecodedContentLengthAscii;
   static const char16 *kXGoogleGearsHeader;
@@ -24,7 +24,10 @@
 // ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
 #include <vector>
+#include "gears/base/common/mutex.h"
 #include "gears/base/common/string_utils.h"
 #include "gears/localserver/common/http_cookies.h"
 
@@ -36,19 +39,63 @@ const std::string16 kNegatedRequiredCookieValue(STRING16(L";NONE;"));
 
 static const std::string16 kCookieDelimiter(STRING16(L";"));
 
+// Strips whitespace from the range [*start, *start + *length) of str.
+static void StripSpan(const char16 *str, int *start, int *length) {
+  const char16 *begin = str + *start;
+  StripWhiteSpace(&begin, length);
+  *start = static_cast<int>(begin - str);
+}
+
+// Splits a cookie string into name/value spans, in the order they appear.
+// This does the same thing as tokenizing at ';' and calling
+// ParseCookieNameAndValue on each token, but without copying anything.
+// Tokens with empty names are dropped.
+static void ParseCookieSpans(const std::string16 &cookies,
+                             std::vector<CookieSnapshot::Span> *spans) {
+  const char16 *str = cookies.c_str();
+  const int length = static_cast<int>(cookies.length());
+  int pos = 0;
+  while (pos < length) {
+    int token_end = pos;
+    int equal_pos = -1;
+    while (token_end < length && str[token_end] != ';') {
+      if (equal_pos < 0 && str[token_end] == '=') {
+        equal_pos = token_end;
+      }
+      ++token_end;
+    }
+
+    CookieSnapshot::Span span;
+    span.name_start = pos;
+    if (equal_pos < 0) {
+      span.name_length = token_end - pos;
+      span.value_start = token_end;
+      span.value_length = 0;
+    } else {
+      span.name_length = equal_pos - pos;
+      span.value_start = equal_pos + 1;
+      span.value_length = token_end - span.value_start;
+    }
+    StripSpan(str, &span.name_start, &span.name_length);
+    StripSpan(str, &span.value_start, &span.value_length);
+    if (span.name_length > 0) {
+      spans->push_back(span);
+    }
+    pos = token_end + 1;
+  }
+}
+
 void ParseCookieString(const std::string16 &cookies, CookieMap *map) {
   map->clear();
-  std::vector<std::string16> tokens;
-  Tokenize(cookies, kCookieDelimiter, &tokens);
-  for (int i = 0; i < static_cast<int>(tokens.size()); ++i) {
-    std::string16 name, value;
-    ParseCookieNameAndValue(tokens[i], &name, &value);
-    if (!name.empty()) {
-      // If the map already has a more specific entry for this name, don't
-      // add this less specific value
-      if (!map->HasCookie(name)) {
-        (*map)[name] = value;
-      }
+  std::vector<CookieSnapshot::Span> spans;
+  ParseCookieSpans(cookies, &spans);
+  for (size_t i = 0; i < spans.size(); ++i) {
+    std::string16 name(cookies, spans[i].name_start, spans[i].name_length);
+    // If the map already has a more specific entry for this name, don't
+    // add this less specific value
+    if (!map->HasCookie(name)) {
+      (*map)[name].assign(cookies, spans[i].value_start,
+                          spans[i].value_length);
     }
   }
 }
@@ -98,6 +145,224 @@ bool CookieMap::HasLocalServerRequiredCookie(
                        ? !HasCookie(*name) : HasSpecificCookie(*name, *value);
 }
 
+//------------------------------------------------------------------------------
+// CookieSnapshot
+//------------------------------------------------------------------------------
+
+// Orders spans by name length, then by name contents. This is not
+// lexicographic, but lookups only need a consistent order.
+class CookieSnapshot::SpanOrder {
+ public:
+  explicit SpanOrder(const char16 *str) : str_(str) {}
+
+  bool operator()(const Span &a, const Span &b) const {
+    return Compare(a, str_ + b.name_start, b.name_length) < 0;
+  }
+
+  bool Equal(const Span &a, const Span &b) const {
+    return Compare(a, str_ + b.name_start, b.name_length) == 0;
+  }
+
+  int Compare(const Span &a, const char16 *name, int name_length) const {
+    if (a.name_length != name_length) {
+      return a.name_length < name_length ? -1 : 1;
+    }
+    return memcmp(str_ + a.name_start, name, name_length * sizeof(char16));
+  }
+
+ private:
+  const char16 *str_;
+};
+
+CookieSnapshot::CookieSnapshot(const std::string16 &cookies)
+    : cookies_(cookies), hash_(HashCookieString(cookies)) {
+  ParseCookieSpans(cookies_, &spans_);
+
+  // Cookies are listed from most to least specific, so keep only the first
+  // occurrence of each name. stable_sort preserves that order among equal
+  // names, and the loop below keeps the first of each run.
+  SpanOrder order(cookies_.c_str());
+  std::stable_sort(spans_.begin(), spans_.end(), order);
+  size_t kept = 0;
+  for (size_t i = 0; i < spans_.size(); ++i) {
+    if (kept == 0 || !order.Equal(spans_[kept - 1], spans_[i])) {
+      spans_[kept++] = spans_[i];
+    }
+  }
+  spans_.resize(kept);
+}
+
+// static
+CookieSnapshot *CookieSnapshot::Create(const std::string16 &cookies) {
+  return new CookieSnapshot(cookies);
+}
+
+// static
+uint32 CookieSnapshot::HashCookieString(const std::string16 &cookies) {
+  // FNV-1a
+  uint32 hash = 2166136261U;
+  for (size_t i = 0; i < cookies.length(); ++i) {
+    hash ^= static_cast<uint32>(cookies[i]);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+const CookieSnapshot::Span *CookieSnapshot::Find(
+    const std::string16 &cookie_name) const {
+  SpanOrder order(cookies_.c_str());
+  const int name_length = static_cast<int>(cookie_name.length());
+  int low = 0;
+  int high = static_cast<int>(spans_.size());
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    int cmp = order.Compare(spans_[mid], cookie_name.c_str(), name_length);
+    if (cmp == 0) {
+      return &spans_[mid];
+    } else if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return NULL;
+}
+
+bool CookieSnapshot::GetCookie(const std::string16 &cookie_name,
+                               std::string16 *cookie_value) const {
+  const Span *span = Find(cookie_name);
+  if (!span)
+    return false;
+  cookie_value->assign(cookies_, span->value_start, span->value_length);
+  return true;
+}
+
+bool CookieSnapshot::HasCookie(const std::string16 &cookie_name) const {
+  return Find(cookie_name) != NULL;
+}
+
+bool CookieSnapshot::HasSpecificCookie(
+                         const std::string16 &cookie_name,
+                         const std::string16 &cookie_value) const {
+  const Span *span = Find(cookie_name);
+  if (!span)
+    return false;
+  return cookies_.compare(span->value_start, span->value_length,
+                          cookie_value) == 0;
+}
+
+bool CookieSnapshot::HasLocalServerRequiredCookie(
+                         const std::string16 &required_cookie,
+                         std::string16 *name, std::string16 *value) const {
+  assert(name && value);
+  if (required_cookie.empty())
+    return true;
+
+  ParseCookieNameAndValue(required_cookie, name, value);
+  if (name->empty())
+    return false;
+
+  return (*value == kNegatedRequiredCookieValue)
+                       ? !HasCookie(*name) : HasSpecificCookie(*name, *value);
+}
+
+// The snapshot cache. Entries are keyed by BrowsingContext and by the url up
+// to and including the last '/' of its path, since cookies are scoped by host
+// and path. The context pointer is only used as a key and never dereferenced,
+// so it does not matter if it dangles; every hit is verified against the
+// current cookie string anyway.
+struct CachedCookieSnapshot {
+  BrowsingContext *context;
+  std::string16 location;
+  scoped_refptr<CookieSnapshot> snapshot;
+};
+
+static const size_t kMaxCachedCookieSnapshots = 16;
+static Mutex g_snapshot_cache_lock;
+static std::vector<CachedCookieSnapshot> g_snapshot_cache;
+
+static void GetCookieLocation(const char16 *url, std::string16 *location) {
+  const char16 *end = url;
+  while (*end && *end != '?' && *end != '#') {
+    ++end;
+  }
+  const char16 *path = url;
+  const char16 *scheme_end = NULL;
+  for (const char16 *p = url; p + 2 < end; ++p) {
+    if (p[0] == ':' && p[1] == '/' && p[2] == '/') {
+      scheme_end = p + 3;
+      break;
+    }
+  }
+  if (scheme_end) {
+    path = scheme_end;
+    while (path < end && *path != '/') {
+      ++path;
+    }
+  }
+  const char16 *last_slash = end;
+  while (last_slash > path && *(last_slash - 1) != '/') {
+    --last_slash;
+  }
+  location->assign(url, last_slash > path ? last_slash : path);
+}
+
+// static
+bool CookieSnapshot::GetForUrl(const char16 *url, BrowsingContext *context,
+                               scoped_refptr<CookieSnapshot> *snapshot) {
+  assert(url);
+  assert(snapshot);
+  std::string16 cookies;
+  if (!GetCookieString(url, context, &cookies))
+    return false;
+
+  const uint32 hash = HashCookieString(cookies);
+  std::string16 location;
+  GetCookieLocation(url, &location);
+
+  CachedCookieSnapshot *entry = NULL;
+  {
+    MutexLock locker(&g_snapshot_cache_lock);
+    for (size_t i = 0; i < g_snapshot_cache.size(); ++i) {
+      CachedCookieSnapshot *candidate = &g_snapshot_cache[i];
+      if (candidate->context == context && candidate->location == location) {
+        if (candidate->snapshot->hash() == hash &&
+            candidate->snapshot->cookie_string() == cookies) {
+          *snapshot = candidate->snapshot;
+          return true;
+        }
+        break;
+      }
+    }
+  }
+
+  // Parse outside of the lock. If another thread races us here, one of the
+  // two equivalent snapshots simply wins.
+  scoped_refptr<CookieSnapshot> fresh(new CookieSnapshot(cookies));
+
+  MutexLock locker(&g_snapshot_cache_lock);
+  for (size_t i = 0; i < g_snapshot_cache.size(); ++i) {
+    if (g_snapshot_cache[i].context == context &&
+        g_snapshot_cache[i].location == location) {
+      entry = &g_snapshot_cache[i];
+      break;
+    }
+  }
+  if (!entry) {
+    if (g_snapshot_cache.size() >= kMaxCachedCookieSnapshots) {
+      g_snapshot_cache.erase(g_snapshot_cache.begin());
+    }
+    g_snapshot_cache.push_back(CachedCookieSnapshot());
+    entry = &g_snapshot_cache.back();
+    entry->context = context;
+    entry->location = location;
+  }
+  entry->snapshot = fresh;
+  *snapshot = fresh;
+  return true;
+}
+
+
 void ParseCookieNameAndValue(const std::string16 &name_and_value,
                              std::string16 *name,
                              std::string16 *value) {
@@ -132,7 +397,6 @@ void ParseCookieNameAndValue(const std::string16 &name_and_value,
 
 
 #ifdef USING_CCTESTS
-#include "gears/base/common/mutex.h"
 static Mutex g_fake_lock;
 static std::string16 g_fake_url;
 static std::string16 g_fake_cookies;
@@ -143,6 +407,11 @@ void SetFakeCookieString(const char16* url, const char16 *cookies) {
   g_fake_url = url ? url : kEmptyString;
   g_fake_cookies = cookies ? cookies : kEmptyString;
 }
+
+void ClearCookieSnapshotCache() {
+  MutexLock locker(&g_snapshot_cache_lock);
+  g_snapshot_cache.clear();
+}
 #endif
 
 #ifdef USING_CCTESTS
@@ -42,6 +42,9 @@
 #define GEARS_LOCALSERVER_COMMON_HTTP_COOKIES_H__
 
 #include <map>
+#include <vector>
+#include "gears/base/common/basictypes.h"
+#include "gears/base/common/scoped_refptr.h"
 #include "gears/base/common/string16.h"
 
 extern const std::string16 kNegatedRequiredCookieValue;
@@ -123,6 +126,68 @@ class CookieMap : public std::map<std::string16, std::string16> {
                                     std::string16 *name, std::string16 *value);
 };
 
+// An immutable, parsed copy of the cookie string for a url. Unlike CookieMap,
+// names and values are not copied out of the cookie string; the snapshot
+// keeps a flat array of (offset, length) spans into its own copy of the
+// string, sorted for binary search.
+//
+// Snapshots are cached per BrowsingContext and url directory, so a page that
+// loads many resources from the LocalServer parses its cookies once rather
+// than once per request. The browser's cookie string is still read for every
+// lookup, and a cached snapshot is only reused if that string is unchanged.
+class CookieSnapshot : public RefCounted {
+ public:
+  // Retrieves the cookies for the specified URL, returning a cached snapshot
+  // if the cookie string has not changed since it was parsed. If the cookie
+  // string cannot be retrieved, returns false and 'snapshot' is not modified.
+  static bool GetForUrl(const char16 *url, BrowsingContext *context,
+                        scoped_refptr<CookieSnapshot> *snapshot);
+
+  // Parses 'cookies' into a new snapshot without consulting the cache.
+  static CookieSnapshot *Create(const std::string16 &cookies);
+
+  // Same semantics as the CookieMap methods of the same names.
+  bool GetCookie(const std::string16 &cookie_name,
+                 std::string16 *cookie_value) const;
+  bool HasCookie(const std::string16 &cookie_name) const;
+  bool HasSpecificCookie(const std::string16 &cookie_name,
+                         const std::string16 &cookie_value) const;
+  bool HasLocalServerRequiredCookie(const std::string16 &required_cookie,
+                                    std::string16 *name,
+                                    std::string16 *value) const;
+
+  // The number of distinct cookie names in the snapshot.
+  size_t size() const { return spans_.size(); }
+
+  const std::string16 &cookie_string() const { return cookies_; }
+
+  // A hash of cookie_string(), used to cheaply reject stale snapshots.
+  uint32 hash() const { return hash_; }
+
+  static uint32 HashCookieString(const std::string16 &cookies);
+
+  // Locates the name and value within a single cookie string token.
+  struct Span {
+    int name_start;
+    int name_length;
+    int value_start;
+    int value_length;
+  };
+
+ private:
+  explicit CookieSnapshot(const std::string16 &cookies);
+
+  class SpanOrder;
+
+  const Span *Find(const std::string16 &cookie_name) const;
+
+  const std::string16 cookies_;
+  const uint32 hash_;
+  std::vector<Span> spans_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(CookieSnapshot);
+};
+
 #ifdef USING_CCTESTS
 // For use by internal unit tests cases.
 // Sets a fake cookie string for a particular url.
@@ -131,6 +196,9 @@ class CookieMap : public std::map<std::string16, std::string16> {
 // There can only be one fake cookie string set at a time. To clear the
 // fake data call SetFakeCookieString(NULL, NULL)
 void SetFakeCookieString(const char16* url, const char16 *cookies);
+
+// Discards all cached CookieSnapshots.
+void ClearCookieSnapshotCache();
 #endif
 
 #endif  // GEARS_LOCALSERVER_COMMON_HTTP_COOKIES_H__
@@ -30,8 +30,10 @@
 
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "gears/base/common/background_thread.h"
 #include "gears/base/common/exception_handler.h"  // For ExceptionManager
 #include "gears/base/common/file.h"
 #include "gears/base/common/mutex.h"
@@ -42,6 +44,7 @@
 #include "gears/base/common/stopwatch.h"
 #include "gears/base/common/string_utils.h"
 #include "gears/base/common/thread_locals.h"
+#include "gears/base/common/trace_events.h"
 #include "gears/base/common/url_utils.h"
 #ifdef BROWSER_IEMOBILE
 #include "gears/base/common/wince_compatibility.h"  // For BrowserCache
@@ -68,6 +71,9 @@ const char *kVersionsTable = "Versions";
 const char *kEntriesTable = "Entries";
 const char *kPayloadsTable = "Payloads";
 const char *kResponseBodiesTable = "ResponseBodies";
+const char *kPayloadTombstonesTable = "PayloadTombstones";
+const char *kSharedBodiesTable = "SharedBodies";
+const char *kServerUsageTable = "ServerUsage";
 
 // Key used to store WebCacheDB instances in ThreadLocals
 const ThreadLocals::Slot kThreadLocalKey = ThreadLocals::Alloc();
@@ -123,13 +129,35 @@ static const struct {
         " CreationDate INTEGER,"
         " Headers TEXT,"
         " StatusCode INTEGER,"
-        " StatusLine TEXT)" },
+        " StatusLine TEXT,"
+        " HeaderIndex BLOB,"  // Pre-parsed index into Headers
+        " ServerID INTEGER,"  // The server that inserted the payload
+        " BodySize INTEGER DEFAULT 0,"  // Bytes accounted against quotas
+        " LastServedTime INTEGER DEFAULT 0)" },  // Used for LRU eviction
 
       { kResponseBodiesTable,
         "(BodyID INTEGER PRIMARY KEY,"  // This is the same ID as the payloadID
         " FilePath TEXT,"  // With USE_FILE_STORE, bodies are stored as
-        " Data BLOB)" }    // discrete files, otherwise as blobs in the DB
-    };
+        " Data BLOB,"      // discrete files, otherwise as blobs in the DB
+        " BodyHash TEXT,"  // Non-NULL if the file is in SharedBodies
+        " Encoding TEXT)" },  // 'gzip' if the file is compressed
+
+      { kSharedBodiesTable,
+        "(BodyHash TEXT PRIMARY KEY,"  // SHA-1 of the body
+        " FilePath TEXT,"
+        " Encoding TEXT,"
+        " RefCount INTEGER)" },  // The number of ResponseBodies referring
+                                 // to this body
+
+      { kPayloadTombstonesTable,
+        "(PayloadID INTEGER PRIMARY KEY,"  // Possibly unreferenced payload
+        " FilePath TEXT)" },  // Non-NULL once the payload row is deleted and
+                              // only its file remains to be removed
+
+      { kServerUsageTable,
+        "(ServerID INTEGER PRIMARY KEY,"  // 0 for payloads of no known server
+        " BodySize INTEGER DEFAULT 0)" }  // Sum of the BodySize of the
+    };                                    // server's unmarked payloads
 
 static const int kWebCacheTableCount = SIMPLEARRAYSIZE(kWebCacheTables);
 
@@ -166,6 +194,11 @@ static const struct {
       { "EntriesPayloadIndex",
         kEntriesTable,
         "(PayloadID)",
+        false },
+
+      { "PayloadsServerIndex",
+        kPayloadsTable,
+        "(ServerID)",
         false }
     };
 
@@ -199,6 +232,18 @@ static const int kWebCacheIndexCount = SIMPLEARRAYSIZE(kWebCacheIndexes);
   version 12: Added indexes
   version 13: Added MatchQuery related columns to Entries
               (MatchAll, MatchSome, MatchNone)
+  version 14: Added the PayloadTombstones table, unreferenced payloads are
+              now deleted incrementally by a background thread
+  version 15: Added the SharedBodies table and the BodyHash column to
+              ResponseBodies, identical bodies are stored only once
+  version 16: Added the Encoding column to ResponseBodies and SharedBodies,
+              textual bodies may be stored compressed
+  version 17: Added the HeaderIndex column to Payloads, headers are
+              pre-parsed when stored so serving does not re-parse them
+  version 18: Added the ServerID, BodySize and LastServedTime columns to
+              Payloads and the ServerUsage table, storage is now subject to
+              quotas with least recently served ResourceStore entries being
+              evicted
 */
 
 // The names of values stored in the system_info table
@@ -206,7 +251,10 @@ static const char16 *kSchemaVersionName = STRING16(L"version");
 static const char16 *kSchemaBrowserName = STRING16(L"browser");
 
 // The values stored in the system_info table
-const int kCurrentVersion = 13;
+const int kCurrentVersion = 18;
+
+// Set once a connection in this process has found the schema current.
+static SQLSchemaVerifiedFlag schema_verified;
 #if BROWSER_IE || BROWSER_IEMOBILE
 static const char16 *kCurrentBrowser = STRING16(L"ie");
 #elif BROWSER_FF
@@ -225,6 +273,67 @@ static const char16 *kCurrentBrowser = STRING16(L"npapi");
 // Used to serialize transactions on the localserver.db file
 static Mutex global_transaction_mutex;
 
+// Garbage collection of unreferenced payloads is done in batches of this
+// many payloads per transaction, in slices of at most this many
+// milliseconds, pausing between slices to let other threads and
+// processes at the database.
+static const int kGarbageCollectionBatchSize = 25;
+static const int kGarbageCollectionSliceMillis = 50;
+static const int kGarbageCollectionPauseMillis = 200;
+
+// Storage quotas, in kilobytes, used when none have been set in the
+// SystemInfo table. Payload headers and bodies are accounted per security
+// origin and in total. When an insert would exceed a quota, ResourceStore
+// entries are evicted, least recently served first, in batches of this size.
+static const char16 *kOriginQuotaName = STRING16(L"originQuotaKB");
+static const char16 *kGlobalQuotaName = STRING16(L"globalQuotaKB");
+static const int kDefaultOriginQuotaKB = 100 * 1024;
+static const int kDefaultGlobalQuotaKB = 500 * 1024;
+static const int kEvictionBatchSize = 25;
+
+// Last served times are held in memory and written to the database in the
+// background once this many are pending, or the oldest has been pending
+// for this long.
+static const size_t kLastServedFlushCount = 64;
+static const int64 kLastServedFlushMillis = 5 * 60 * 1000;
+
+
+//------------------------------------------------------------------------------
+// LastServedTimes records when payloads are served. Writing to the database
+// each time a response is served would slow down serving and contend for
+// the database lock, so times are collected here, across all threads, and
+// written in one transaction by the garbage collector thread. They are
+// only used to choose what to evict, losing some on exit is harmless.
+//------------------------------------------------------------------------------
+class LastServedTimes {
+ public:
+  // Returns true if the pending times should be flushed
+  static bool Record(int64 payload_id, int64 now) {
+    MutexLock lock(&mutex_);
+    if (times_.empty()) {
+      oldest_time_ = now;
+    }
+    times_[payload_id] = now;
+    return times_.size() >= kLastServedFlushCount ||
+           now - oldest_time_ >= kLastServedFlushMillis;
+  }
+
+  static void TakeAll(std::map<int64, int64> *times) {
+    MutexLock lock(&mutex_);
+    times->swap(times_);
+    times_.clear();
+  }
+
+ private:
+  static Mutex mutex_;
+  static std::map<int64, int64> times_;
+  static int64 oldest_time_;
+};
+
+Mutex LastServedTimes::mutex_;
+std::map<int64, int64> LastServedTimes::times_;
+int64 LastServedTimes::oldest_time_ = 0;
+
 
 //------------------------------------------------------------------------------
 // ServiceLog developer utility to log cache hits
@@ -296,11 +405,57 @@ ServiceLog ServiceLog::instance_;
 #endif
 
 
+//------------------------------------------------------------------------------
+// GarbageCollectorThread deletes payloads marked in the PayloadTombstones
+// table, and afterwards records last served times and evicts entries if
+// over quota. Deleting thousands of response bodies can take seconds, so rather
+// than doing so in the transaction that orphans them, the work is done
+// here in short slices with pauses in between, during which other threads
+// may intercept requests. Each ScheduleGarbageCollection() wakes it for
+// another pass. A pass cut short when the thread is stopped is harmless, the
+// tombstones are persistent and collection resumes the next time the thread
+// is woken.
+//------------------------------------------------------------------------------
+class GarbageCollectorThread : public BackgroundThread {
+ private:
+  friend class BackgroundThread;
+  GarbageCollectorThread() {}
+
+  virtual void DoWork() {
+    WebCacheDB *db = WebCacheDB::GetDB();
+    if (!db) {
+      return;
+    }
+    bool done = false;
+    while (!done) {
+      if (!db->CollectGarbage(kGarbageCollectionSliceMillis, &done)) {
+        LOG(("WebCacheDB.CollectGarbage failed\n"));
+        break;
+      }
+      // A wake received while pausing only means there is more work, which
+      // we already know.
+      if (!done && !Pause(kGarbageCollectionPauseMillis)) {
+        return;
+      }
+    }
+    if (!db->FlushLastServedTimes()) {
+      LOG(("WebCacheDB.FlushLastServedTimes failed\n"));
+    }
+    if (!db->EnforceQuotas()) {
+      LOG(("WebCacheDB.EnforceQuotas failed\n"));
+    }
+  }
+
+  DISALLOW_EVIL_CONSTRUCTORS(GarbageCollectorThread);
+};
+
+
 //------------------------------------------------------------------------------
 // constructor
 //------------------------------------------------------------------------------
 WebCacheDB::WebCacheDB()
-    : system_info_table_(&db_, kSystemInfoTableName),
+    : garbage_marked_(false),
+      system_info_table_(&db_, kSystemInfoTableName),
       response_bodies_store_(NULL) {
   // When parameter binding multiple parameters, we frequently use a scheme
   // of OR'ing return values together for testing for an error once after
@@ -326,17 +481,24 @@ bool WebCacheDB::Init() {
   // Initialize the storage for bodies
 #ifdef USE_FILE_STORE
   response_bodies_store_ = new WebCacheFileStore;
-  db_.SetTransactionListener(this);
 #else
   response_bodies_store_ = new WebCacheBlobStore;
 #endif
+  db_.SetTransactionListener(this);
   if (!response_bodies_store_ || !response_bodies_store_->Init(this)) {
     return false;
   }
 
+  // Another connection in this process has already checked the schema and
+  // resumed garbage collection, so there is nothing more to do.
+  if (schema_verified.IsSet()) {
+    return true;
+  }
+
   // Examine the contents of the database and determine if we have to
   // instantiate or updgrade the schema.  Also ensure that the database
-  // file is for the browser we're running under.
+  // file is for the browser we're running under.  These are plain reads,
+  // so the common case of an up to date schema takes no write lock.
 
   int version = 0;
   std::string16 browser;
@@ -349,16 +511,20 @@ bool WebCacheDB::Init() {
   // still be dbs with erroneous values in the wild, and the test
   // doesn't seem too important, so think twice before reimplementing.
   
-  // if its the version we're expecting and browser is valid, great
-  if ((version == kCurrentVersion) && !browser.empty()) {
-    return true;
+  // if its the version we're expecting and browser is valid, great,
+  // otherwise we have to either create or upgrade the database
+  if ((version != kCurrentVersion) || browser.empty()) {
+    if (!CreateOrUpgradeDatabase()) {
+      return false;
+    }
   }
-  
-  // We have to either create or upgrade the database
-  if (!CreateOrUpgradeDatabase()) {
-    return false;
+
+  // Resume collecting garbage left behind by a previous session
+  if (HasGarbage()) {
+    ScheduleGarbageCollection();
   }
 
+  schema_verified.Set();
   return true;
 }
 
@@ -440,6 +606,41 @@ bool WebCacheDB::CreateOrUpgradeDatabase() {
           return false;
         }
         // fallthru...
+      case 13:
+        if (!UpgradeFrom13To14()) {
+          LOG(("WebCache: UpgradeFrom13To14 failed\n"));
+          db_.Close();
+          return false;
+        }
+        // fallthru...
+      case 14:
+        if (!UpgradeFrom14To15()) {
+          LOG(("WebCache: UpgradeFrom14To15 failed\n"));
+          db_.Close();
+          return false;
+        }
+        // fallthru...
+      case 15:
+        if (!UpgradeFrom15To16()) {
+          LOG(("WebCache: UpgradeFrom15To16 failed\n"));
+          db_.Close();
+          return false;
+        }
+        // fallthru...
+      case 16:
+        if (!UpgradeFrom16To17()) {
+          LOG(("WebCache: UpgradeFrom16To17 failed\n"));
+          db_.Close();
+          return false;
+        }
+        // fallthru...
+      case 17:
+        if (!UpgradeFrom17To18()) {
+          LOG(("WebCache: UpgradeFrom17To18 failed\n"));
+          db_.Close();
+          return false;
+        }
+        // fallthru...
 
       // additional upgrades here...
     }
@@ -712,6 +913,111 @@ bool WebCacheDB::UpgradeFrom12To13() {
   return ExecuteSqlCommands(kUpgradeCommands, kUpgradeCommandsCount);
 }
 
+//------------------------------------------------------------------------------
+// UpgradeFrom13To14
+//------------------------------------------------------------------------------
+bool WebCacheDB::UpgradeFrom13To14() {
+  assert(db_.IsInTransaction());
+  const char *kUpgradeCommands[] = {
+      "CREATE TABLE PayloadTombstones "
+          "(PayloadID INTEGER PRIMARY KEY,"
+          " FilePath TEXT)",
+      // Mark any payloads that earlier versions left unreferenced
+      "INSERT INTO PayloadTombstones (PayloadID) "
+          "SELECT PayloadID FROM Payloads WHERE PayloadID NOT IN "
+          "(SELECT PayloadID FROM Entries WHERE PayloadID IS NOT NULL)",
+      "UPDATE SystemInfo SET value=14 WHERE name='version'"
+  };
+  const int kUpgradeCommandsCount = ARRAYSIZE(kUpgradeCommands);
+  if (!ExecuteSqlCommands(kUpgradeCommands, kUpgradeCommandsCount)) {
+    return false;
+  }
+  garbage_marked_ = true;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// UpgradeFrom14To15
+//------------------------------------------------------------------------------
+bool WebCacheDB::UpgradeFrom14To15() {
+  assert(db_.IsInTransaction());
+  // Existing bodies are left where they are, unshared
+  const char *kUpgradeCommands[] = {
+      "ALTER TABLE ResponseBodies ADD BodyHash TEXT",
+      "CREATE TABLE SharedBodies "
+          "(BodyHash TEXT PRIMARY KEY,"
+          " FilePath TEXT,"
+          " RefCount INTEGER)",
+      "UPDATE SystemInfo SET value=15 WHERE name='version'"
+  };
+  const int kUpgradeCommandsCount = ARRAYSIZE(kUpgradeCommands);
+  return ExecuteSqlCommands(kUpgradeCommands, kUpgradeCommandsCount);
+}
+
+//------------------------------------------------------------------------------
+// UpgradeFrom15To16
+//------------------------------------------------------------------------------
+bool WebCacheDB::UpgradeFrom15To16() {
+  assert(db_.IsInTransaction());
+  // Existing bodies are left uncompressed, a NULL Encoding means as is
+  const char *kUpgradeCommands[] = {
+      "ALTER TABLE ResponseBodies ADD Encoding TEXT",
+      "ALTER TABLE SharedBodies ADD Encoding TEXT",
+      "UPDATE SystemInfo SET value=16 WHERE name='version'"
+  };
+  const int kUpgradeCommandsCount = ARRAYSIZE(kUpgradeCommands);
+  return ExecuteSqlCommands(kUpgradeCommands, kUpgradeCommandsCount);
+}
+
+//------------------------------------------------------------------------------
+// UpgradeFrom16To17
+//------------------------------------------------------------------------------
+bool WebCacheDB::UpgradeFrom16To17() {
+  assert(db_.IsInTransaction());
+  // Existing payloads have a NULL HeaderIndex, their headers are parsed
+  // on lookup as before
+  const char *kUpgradeCommands[] = {
+      "ALTER TABLE Payloads ADD HeaderIndex BLOB",
+      "UPDATE SystemInfo SET value=17 WHERE name='version'"
+  };
+  const int kUpgradeCommandsCount = ARRAYSIZE(kUpgradeCommands);
+  return ExecuteSqlCommands(kUpgradeCommands, kUpgradeCommandsCount);
+}
+
+//------------------------------------------------------------------------------
+// UpgradeFrom17To18
+//------------------------------------------------------------------------------
+bool WebCacheDB::UpgradeFrom17To18() {
+  assert(db_.IsInTransaction());
+  // Existing payloads are attributed to the server of an entry referring to
+  // them. Their size is taken from the blob store, bodies held in files are
+  // not accounted until they are next replaced. Payloads that have never
+  // been served are treated as if served when created.
+  const char *kUpgradeCommands[] = {
+      "ALTER TABLE Payloads ADD ServerID INTEGER",
+      "ALTER TABLE Payloads ADD BodySize INTEGER DEFAULT 0",
+      "ALTER TABLE Payloads ADD LastServedTime INTEGER DEFAULT 0",
+      "UPDATE Payloads SET "
+      " ServerID = (SELECT v.ServerID FROM Entries e, Versions v"
+      "             WHERE e.PayloadID = Payloads.PayloadID"
+      "             AND e.VersionID = v.VersionID LIMIT 1),"
+      " BodySize = IFNULL(length(Headers), 0) +"
+      "            IFNULL((SELECT length(b.Data) FROM ResponseBodies b"
+      "                    WHERE b.BodyID = Payloads.PayloadID), 0),"
+      " LastServedTime = CreationDate",
+      "CREATE INDEX PayloadsServerIndex ON Payloads (ServerID)",
+      "CREATE TABLE ServerUsage"
+      " (ServerID INTEGER PRIMARY KEY, BodySize INTEGER DEFAULT 0)",
+      "INSERT INTO ServerUsage (ServerID, BodySize)"
+      " SELECT IFNULL(ServerID, 0), SUM(BodySize) FROM Payloads"
+      " WHERE PayloadID NOT IN (SELECT PayloadID FROM PayloadTombstones)"
+      " GROUP BY IFNULL(ServerID, 0)",
+      "UPDATE SystemInfo SET value=18 WHERE name='version'"
+  };
+  const int kUpgradeCommandsCount = ARRAYSIZE(kUpgradeCommands);
+  return ExecuteSqlCommands(kUpgradeCommands, kUpgradeCommandsCount);
+}
+
 //------------------------------------------------------------------------------
 // ExecuteSqlCommandsInTransaction
 //------------------------------------------------------------------------------
@@ -758,10 +1064,16 @@ bool WebCacheDB::Service(const char16 *url, BrowsingContext *context,
   ASSERT_SINGLE_THREAD();
   assert(url);
   assert(payload);
+  TRACE_EVENT("localserver", "WebCacheDB.Service");
 
   bool ok = ServiceImpl(url, context, payload, head_only);
   if (ok && !head_only) {
     ServiceLog::LogHit(url, payload->status_code);
+    // Synthesized responses have no payload id
+    if (payload->id != kUnknownID &&
+        LastServedTimes::Record(payload->id, GetCurrentTimeMillis())) {
+      ScheduleGarbageCollection();
+    }
   }
   return ok;
 }
@@ -981,7 +1293,7 @@ class WebCacheDB::ServiceQuery {
   BrowsingContext *context_;
   bool loaded_cookie_map_;  // we defer reading cookies until needed
   bool loaded_cookie_map_ok_;
-  CookieMap cookie_map_;
+  scoped_refptr<CookieSnapshot> cookies_;
 
   // outputs
   std::string16 possible_session_redirect_;
@@ -1097,8 +1409,8 @@ bool WebCacheDB::ServiceQuery::CheckRequiredCookie(const ResultRow &result) {
   assert(result.is_cookie_required);
   if (!loaded_cookie_map_) {
     loaded_cookie_map_ = true;
-    loaded_cookie_map_ok_ = cookie_map_.LoadMapForUrl(requested_url_,
-                                                      context_);
+    loaded_cookie_map_ok_ = CookieSnapshot::GetForUrl(requested_url_,
+                                                      context_, &cookies_);
     if (!loaded_cookie_map_ok_) {
       LOG(("WebCacheDB.Service failed to read cookies\n"));
     }
@@ -1111,13 +1423,13 @@ bool WebCacheDB::ServiceQuery::CheckRequiredCookie(const ResultRow &result) {
   std::string16 required_cookie(result.required_cookie);
   std::string16 cookie_name;
   std::string16 cookie_value;
-  bool has_required_cookie = cookie_map_.HasLocalServerRequiredCookie(
+  bool has_required_cookie = cookies_->HasLocalServerRequiredCookie(
                                               required_cookie,
                                               &cookie_name,
                                               &cookie_value);
   if (!has_required_cookie && result.session_redirect[0] &&
       (cookie_value != kNegatedRequiredCookieValue) &&
-      !cookie_map_.HasCookie(cookie_name)) {
+      !cookies_->HasCookie(cookie_name)) {
     if (!possible_session_redirect_.empty() &&
         (possible_session_redirect_ != result.session_redirect)) {
       LOG(("WebCacheDB.Service conflicting possible session redirects\n"));
@@ -1240,6 +1552,7 @@ bool WebCacheDB::ServiceInspectorUrl(const char16 *url_char16,
   payload->id = kUnknownID;
   payload->creation_date = 0;
   payload->headers = headers;
+  payload->header_index.clear();
   payload->status_line = STRING16(L"HTTP/1.0 200 OK");
   payload->status_code = HttpConstants::HTTP_OK;
   payload->is_synthesized_http_redirect = false;
@@ -1285,24 +1598,48 @@ bool WebCacheDB::InsertPayload(int64 server_id,
   }
 
   std::string16 adjusted_headers;
-  if (!payload->PassesValidationTests(&adjusted_headers)) {
+  std::vector<uint16> adjusted_header_index;
+  if (!payload->PassesValidationTests(&adjusted_headers,
+                                      &adjusted_header_index)) {
     assert(false);
     return false;
   }
+  std::vector<uint8> header_index_blob;
+  PayloadInfo::WriteHeaderIndex(adjusted_header_index, &header_index_blob);
+
+  // The size accounted against quotas. Bodies that end up stored compressed
+  // or shared with other payloads are still accounted at their full size.
+  int64 body_size = adjusted_headers.length();
+  if (payload->data.get()) {
+    body_size += payload->data->size();
+  }
+
+  ServerInfo server;
+  if (!FindServer(server_id, &server)) {
+    LOG(("WebCacheDB.InsertPayload failed, no such server\n"));
+    return false;
+  }
 
   SQLTransaction transaction(&db_, "InsertPayload");
   if (!transaction.Begin()) {
     return false;
   }
 
+  if (!EvictForQuota(server.security_origin_url.c_str(), body_size)) {
+    LOG(("WebCacheDB.InsertPayload failed, over quota\n"));
+    return false;
+  }
+
   payload->creation_date = GetCurrentTimeMillis();
 
   // First, insert a row into the Payloads table to get a payload_id (rowid),
   // this same id is used as the primary key into the ResponseBodies table
 
   const char16* sql = STRING16(
-      L"INSERT INTO Payloads (CreationDate, Headers, StatusLine, StatusCode) "
-      L"VALUES (?, ?, ?, ?)");
+      L"INSERT INTO Payloads (CreationDate, Headers, StatusLine, StatusCode, "
+      L"                      HeaderIndex, ServerID, BodySize, "
+      L"                      LastServedTime) "
+      L"VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
   SQLStatement stmt;
   int rv = stmt.prepare16(&db_, sql);
   if (rv != SQLITE_OK) {
@@ -1314,6 +1651,10 @@ bool WebCacheDB::InsertPayload(int64 server_id,
   rv |= stmt.bind_text16(++param, adjusted_headers.c_str());
   rv |= stmt.bind_text16(++param, payload->status_line.c_str());
   rv |= stmt.bind_int(++param, payload->status_code);
+  rv |= stmt.bind_blob(++param, &header_index_blob);
+  rv |= stmt.bind_int64(++param, server_id);
+  rv |= stmt.bind_int64(++param, body_size);
+  rv |= stmt.bind_int64(++param, payload->creation_date);
   if (rv != SQLITE_OK) {
     return false;
   }
@@ -1323,6 +1664,10 @@ bool WebCacheDB::InsertPayload(int64 server_id,
 
   payload->id = stmt.last_insert_rowid();
 
+  if (!AddToUsage(server_id, body_size)) {
+    return false;
+  }
+
   // Save the body in the bodies store. The full path of the file
   // created is returned in payload->cached_filepath
   if (!response_bodies_store_->InsertBody(server_id, url, payload)) {
@@ -1343,7 +1688,7 @@ bool WebCacheDB::FindPayload(int64 id,
   assert(payload);
 
   const char16* sql = STRING16(L"SELECT ?, CreationDate, Headers, "
-                               L"       StatusLine, StatusCode "
+                               L"       StatusLine, StatusCode, HeaderIndex "
                                L"FROM Payloads "
                                L"WHERE PayloadID=?");
 
@@ -1379,6 +1724,12 @@ bool WebCacheDB::ReadPayloadInfo(SQLStatement &stmt,
   payload->headers = stmt.column_text16_safe(++col);
   payload->status_line = stmt.column_text16_safe(++col);
   payload->status_code = stmt.column_int(++col);
+  std::vector<uint8> header_index_blob;
+  if (!stmt.column_blob_as_vector(++col, &header_index_blob) ||
+      !PayloadInfo::ReadHeaderIndex(header_index_blob,
+                                    &payload->header_index)) {
+    payload->header_index.clear();  // lookups will parse the headers
+  }
   payload->is_synthesized_http_redirect = payload->IsHttpRedirect();
   return response_bodies_store_->ReadBody(payload, info_only);
 }
@@ -2029,8 +2380,17 @@ bool WebCacheDB::DeleteVersions(std::vector<int64> *version_ids) {
 //------------------------------------------------------------------------------
 // InsertEntry
 //------------------------------------------------------------------------------
-bool WebCacheDB::InsertEntry(EntryInfo *entry) {
-  ASSERT_SINGLE_THREAD();
+static const char16 *kInsertEntrySql =
+    STRING16(L"INSERT INTO Entries"
+             L" (VersionID, Url, Src, PayloadID,"
+             L"  Redirect, IgnoreQuery,"
+             L"  MatchAll, MatchSome, MatchNone)"
+             L" VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)");
+
+// Binds entry to a statement prepared from kInsertEntrySql and executes it.
+// The statement is reset afterwards so that it can be reused.
+static bool BindAndInsertEntry(SQLStatement &stmt,
+                               WebCacheDB::EntryInfo *entry) {
   assert(entry);
   assert(!entry->url.empty());
   assert(!(entry->ignore_query && entry->match_query));
@@ -2038,18 +2398,7 @@ bool WebCacheDB::InsertEntry(EntryInfo *entry) {
   assert(!entry->match_query || (entry->url.find('?') == std::string16::npos));
   assert(entry->url.find('#') == std::string16::npos);
 
-  const char16* sql = STRING16(L"INSERT INTO Entries"
-                               L" (VersionID, Url, Src, PayloadID,"
-                               L"  Redirect, IgnoreQuery,"
-                               L"  MatchAll, MatchSome, MatchNone)"
-                               L" VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)");
-
-  SQLStatement stmt;
-  int rv = stmt.prepare16(&db_, sql);
-  if (rv != SQLITE_OK) {
-    LOG(("WebCacheDB.InsertEntry failed\n"));
-    return false;
-  }
+  int rv = SQLITE_OK;
   int param = -1;
   rv |= stmt.bind_int64(++param, entry->version_id);
   rv |= stmt.bind_text16(++param, entry->url.c_str());
@@ -2058,7 +2407,7 @@ bool WebCacheDB::InsertEntry(EntryInfo *entry) {
   } else {
     rv |= stmt.bind_null(++param);
   }
-  if (entry->payload_id != kUnknownID) {
+  if (entry->payload_id != WebCacheDB::kUnknownID) {
     rv |= stmt.bind_int64(++param, entry->payload_id);
   } else {
     rv |= stmt.bind_null(++param);
@@ -2093,12 +2442,59 @@ bool WebCacheDB::InsertEntry(EntryInfo *entry) {
   }
 
   if (stmt.step() != SQLITE_DONE) {
+    stmt.reset();
     return false;
   }
 
   entry->id = stmt.last_insert_rowid();
 
-  return true;
+  return stmt.reset() == SQLITE_OK;
+}
+
+bool WebCacheDB::InsertEntry(EntryInfo *entry) {
+  ASSERT_SINGLE_THREAD();
+
+  SQLStatement stmt;
+  int rv = stmt.prepare16(&db_, kInsertEntrySql);
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheDB.InsertEntry failed\n"));
+    return false;
+  }
+  return BindAndInsertEntry(stmt, entry);
+}
+
+//------------------------------------------------------------------------------
+// InsertEntries
+//------------------------------------------------------------------------------
+bool WebCacheDB::InsertEntries(std::vector<EntryInfo> *entries) {
+  ASSERT_SINGLE_THREAD();
+  assert(entries);
+
+  if (entries->empty()) {
+    return true;
+  }
+
+  SQLTransaction transaction(&db_, "InsertEntries");
+  if (!transaction.Begin()) {
+    return false;
+  }
+
+  // The statement is compiled once for the whole batch, which is most of the
+  // cost of inserting a row.
+  SQLStatement stmt;
+  int rv = stmt.prepare16(&db_, kInsertEntrySql);
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheDB.InsertEntries failed\n"));
+    return false;
+  }
+  for (std::vector<EntryInfo>::iterator iter = entries->begin();
+       iter != entries->end(); ++iter) {
+    if (!BindAndInsertEntry(stmt, &(*iter))) {
+      return false;
+    }
+  }
+
+  return transaction.Commit();
 }
 
 //------------------------------------------------------------------------------
@@ -2189,37 +2585,100 @@ bool WebCacheDB::DeleteEntries(std::vector<int64> *version_ids) {
     return false;
   }
 
-  // Delete all Entries table rows for version_ids
-
-  std::string16 sql(STRING16(L"DELETE FROM Entries WHERE VersionID IN ("));
+  std::string16 version_id_list(STRING16(L"("));
   for (unsigned int i = 0; i < version_ids->size(); ++i) {
     if (i == version_ids->size() - 1)
-      sql += STRING16(L"?");
+      version_id_list += STRING16(L"?");
     else
-      sql += STRING16(L"?, ");
+      version_id_list += STRING16(L"?, ");
   }
-  sql += STRING16(L")");
+  version_id_list += STRING16(L")");
 
-  SQLStatement stmt;
-  int rv = stmt.prepare16(&db_, sql.c_str());
+  // Marked payloads are no longer accounted against quotas, so first take
+  // the payloads about to be marked out of the usage of their servers.
+
+  std::string16 usage_sql(STRING16(
+      L"SELECT IFNULL(ServerID, 0), SUM(BodySize) FROM Payloads "
+      L"WHERE PayloadID NOT IN (SELECT PayloadID FROM PayloadTombstones) "
+      L"AND PayloadID IN (SELECT PayloadID FROM Entries "
+      L"                  WHERE VersionID IN "));
+  usage_sql += version_id_list;
+  usage_sql += STRING16(L") GROUP BY IFNULL(ServerID, 0)");
+
+  SQLStatement usage_stmt;
+  int rv = usage_stmt.prepare16(&db_, usage_sql.c_str());
   if (rv != SQLITE_OK) {
     LOG(("WebCacheDB.DeleteEntries failed\n"));
     return false;
   }
   for (unsigned int i = 0; i < version_ids->size(); ++i) {
-    rv |= stmt.bind_int64(i, (*version_ids)[i]);
+    rv |= usage_stmt.bind_int64(i, (*version_ids)[i]);
   }
   if (rv != SQLITE_OK) {
     return false;
   }
+  std::vector<std::pair<int64, int64> > server_sizes;
+  while ((rv = usage_stmt.step()) == SQLITE_ROW) {
+    server_sizes.push_back(std::make_pair(usage_stmt.column_int64(0),
+                                          usage_stmt.column_int64(1)));
+  }
+  if (rv != SQLITE_DONE) {
+    return false;
+  }
+  usage_stmt.finalize();
+  for (size_t i = 0; i < server_sizes.size(); ++i) {
+    if (!AddToUsage(server_sizes[i].first, -server_sizes[i].second)) {
+      return false;
+    }
+  }
 
-  if (stmt.step() != SQLITE_DONE) {
+  // Mark the payloads referenced by these entries as possibly unreferenced,
+  // they are deleted later by the garbage collector if no other entries
+  // refer to them. Deleting them here would hold the database locked
+  // while potentially thousands of files are removed.
+
+  std::string16 mark_sql(STRING16(
+      L"INSERT OR IGNORE INTO PayloadTombstones (PayloadID) "
+      L"SELECT DISTINCT PayloadID FROM Entries "
+      L"WHERE PayloadID IS NOT NULL AND VersionID IN "));
+  mark_sql += version_id_list;
+
+  SQLStatement mark_stmt;
+  rv = mark_stmt.prepare16(&db_, mark_sql.c_str());
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheDB.DeleteEntries failed\n"));
+    return false;
+  }
+  for (unsigned int i = 0; i < version_ids->size(); ++i) {
+    rv |= mark_stmt.bind_int64(i, (*version_ids)[i]);
+  }
+  if (rv != SQLITE_OK) {
+    return false;
+  }
+  if (mark_stmt.step() != SQLITE_DONE) {
     return false;
   }
+  garbage_marked_ = true;
+
+  // Delete all Entries table rows for version_ids
+
+  std::string16 sql(STRING16(L"DELETE FROM Entries WHERE VersionID IN "));
+  sql += version_id_list;
 
-  // Now delete all unreferenced payloads
+  SQLStatement stmt;
+  rv = stmt.prepare16(&db_, sql.c_str());
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheDB.DeleteEntries failed\n"));
+    return false;
+  }
+  for (unsigned int i = 0; i < version_ids->size(); ++i) {
+    rv |= stmt.bind_int64(i, (*version_ids)[i]);
+  }
+  if (rv != SQLITE_OK) {
+    return false;
+  }
 
-  if (!DeleteUnreferencedPayloads()) {
+  if (stmt.step() != SQLITE_DONE) {
     return false;
   }
 
@@ -2531,7 +2990,7 @@ bool WebCacheDB::FindMostRecentPayload(int64 server_id,
   // TODO(michaeln): This looks like a full table scan!
   const char16* sql = STRING16(
       L"SELECT p.PayloadID, p.CreationDate, p.Headers, "
-      L"       p.StatusLine, p.StatusCode "
+      L"       p.StatusLine, p.StatusCode, p.HeaderIndex "
       L"FROM Payloads p, Entries e, Versions v "
       L"WHERE v.ServerID=? AND v.VersionID=e.VersionID AND "
       L"      e.PayloadID=p.PayloadID AND "
@@ -2560,41 +3019,6 @@ bool WebCacheDB::FindMostRecentPayload(int64 server_id,
 }
 
 
-//------------------------------------------------------------------------------
-// DeleteUnreferencedPayload
-// TODO(michaeln): This is terribly inefficient. In general, deleting stale
-// payloads could be done lazily. Even if done lazily, these SQL operations
-// are not good. Make this better.
-//------------------------------------------------------------------------------
-bool WebCacheDB::DeleteUnreferencedPayloads() {
-  ASSERT_SINGLE_THREAD();
-
-  SQLTransaction transaction(&db_, "DeleteUnreferencedPayloads");
-  if (!transaction.Begin()) {
-    return false;
-  }
-
-  // Delete from the Payloads table
-  const char16 *sql = STRING16(L"DELETE FROM Payloads WHERE PayloadID NOT IN "
-                               L"(SELECT DISTINCT PayloadID FROM Entries)");
-  SQLStatement delete_stmt;
-  int rv = delete_stmt.prepare16(&db_, sql);
-  if (rv != SQLITE_OK) {
-    LOG(("WebCacheDB.DeleteUnreferencedPayloads failed\n"));
-    return false;
-  }
-  if (delete_stmt.step() != SQLITE_DONE) {
-    return false;
-  }
-
-  // Now delete the response bodies
-  if (!response_bodies_store_->DeleteUnreferencedBodies()) {
-    return false;
-  }
-
-  return transaction.Commit();
-}
-
 //------------------------------------------------------------------------------
 // MaybeDeletePayload
 //------------------------------------------------------------------------------
@@ -2640,10 +3064,33 @@ bool WebCacheDB::DeletePayload(int64 payload_id) {
     return false;
   }
 
+  // Marked payloads have already been taken out of the usage
+  const char16 *usage_sql = STRING16(
+      L"SELECT IFNULL(ServerID, 0), BodySize FROM Payloads "
+      L"WHERE PayloadID=? "
+      L"AND PayloadID NOT IN (SELECT PayloadID FROM PayloadTombstones)");
+  SQLStatement usage_stmt;
+  int rv = usage_stmt.prepare16(&db_, usage_sql);
+  rv |= usage_stmt.bind_int64(0, payload_id);
+  if (SQLITE_OK != rv) {
+    LOG(("WebCacheDB.DeletePayload failed\n"));
+    return false;
+  }
+  rv = usage_stmt.step();
+  if (SQLITE_ROW == rv) {
+    if (!AddToUsage(usage_stmt.column_int64(0),
+                    -usage_stmt.column_int64(1))) {
+      return false;
+    }
+  } else if (SQLITE_DONE != rv) {
+    LOG(("WebCacheDB.DeletePayload failed\n"));
+    return false;
+  }
+
   const char16 *sql = STRING16(L"DELETE FROM Payloads "
                                L"WHERE PayloadID=?");
   SQLStatement delete_stmt;
-  int rv = delete_stmt.prepare16(&db_, sql);
+  rv = delete_stmt.prepare16(&db_, sql);
   rv |= delete_stmt.bind_int64(0, payload_id);
   if (SQLITE_OK != rv) {
     LOG(("WebCacheDB.DeletePayload failed\n"));
@@ -2662,19 +3109,533 @@ bool WebCacheDB::DeletePayload(int64 payload_id) {
   return transaction.Commit();
 }
 
-#ifdef USE_FILE_STORE
 //------------------------------------------------------------------------------
-// Called after a top transaction has begun
+// CollectGarbage
 //------------------------------------------------------------------------------
-void WebCacheDB::OnBegin() {
-  response_bodies_store_->BeginTransaction();
+bool WebCacheDB::CollectGarbage(int budget_millis, bool *done) {
+  ASSERT_SINGLE_THREAD();
+  assert(done);
+  assert(!db_.IsInTransaction());
+
+  int64 start_time = GetCurrentTimeMillis();
+  do {
+    if (!CollectGarbageBatch(done)) {
+      return false;
+    }
+  } while (!*done &&
+           (GetCurrentTimeMillis() - start_time) < budget_millis);
+  return true;
 }
 
 //------------------------------------------------------------------------------
-// Called after a top transaction has been commited
-//------------------------------------------------------------------------------
-void WebCacheDB::OnCommit() {
-  response_bodies_store_->CommitTransaction();
+// CollectGarbageBatch
+//
+// Collection of a tombstoned payload happens in two steps to remain
+// consistent if we crash part way through. First, if the payload is not
+// referenced, its Payloads and ResponseBodies rows are deleted and the
+// path of its file is recorded in the tombstone, all in one transaction.
+// Then after that commits, the file is deleted and finally the tombstone.
+// Tombstones found with a FilePath have only the second step remaining.
+//------------------------------------------------------------------------------
+bool WebCacheDB::CollectGarbageBatch(bool *done) {
+  ASSERT_SINGLE_THREAD();
+  assert(done);
+
+  std::vector<int64> payload_ids;
+  std::vector<std::string16> filepaths;
+  {
+    SQLTransaction transaction(&db_, "CollectGarbageBatch");
+    if (!transaction.Begin()) {
+      return false;
+    }
+
+    const char16 *select_sql = STRING16(L"SELECT PayloadID, FilePath "
+                                        L"FROM PayloadTombstones LIMIT ?");
+    SQLStatement select_stmt;
+    int rv = select_stmt.prepare16(&db_, select_sql);
+    rv |= select_stmt.bind_int(0, kGarbageCollectionBatchSize);
+    if (rv != SQLITE_OK) {
+      LOG(("WebCacheDB.CollectGarbageBatch failed\n"));
+      return false;
+    }
+    std::vector<int64> tombstone_ids;
+    std::vector<std::string16> tombstone_filepaths;
+    while ((rv = select_stmt.step()) == SQLITE_ROW) {
+      tombstone_ids.push_back(select_stmt.column_int64(0));
+      tombstone_filepaths.push_back(select_stmt.column_text16_safe(1));
+    }
+    if (rv != SQLITE_DONE) {
+      return false;
+    }
+    select_stmt.finalize();
+
+    *done = (tombstone_ids.size() <
+             static_cast<size_t>(kGarbageCollectionBatchSize));
+
+    const char16 *count_sql = STRING16(L"SELECT COUNT(*) FROM Entries "
+                                       L"WHERE PayloadID=?");
+    const char16 *update_sql = STRING16(L"UPDATE PayloadTombstones "
+                                        L"SET FilePath=? WHERE PayloadID=?");
+    const char16 *delete_sql = STRING16(L"DELETE FROM PayloadTombstones "
+                                        L"WHERE PayloadID=?");
+    const char16 *delete_payload_sql = STRING16(L"DELETE FROM Payloads "
+                                                L"WHERE PayloadID=?");
+    const char16 *size_sql = STRING16(L"SELECT IFNULL(ServerID, 0), BodySize "
+                                      L"FROM Payloads WHERE PayloadID=?");
+    SQLStatement count_stmt;
+    SQLStatement update_stmt;
+    SQLStatement delete_stmt;
+    SQLStatement delete_payload_stmt;
+    SQLStatement size_stmt;
+    rv = count_stmt.prepare16(&db_, count_sql);
+    rv |= update_stmt.prepare16(&db_, update_sql);
+    rv |= delete_stmt.prepare16(&db_, delete_sql);
+    rv |= delete_payload_stmt.prepare16(&db_, delete_payload_sql);
+    rv |= size_stmt.prepare16(&db_, size_sql);
+    if (rv != SQLITE_OK) {
+      LOG(("WebCacheDB.CollectGarbageBatch failed\n"));
+      return false;
+    }
+
+    for (size_t i = 0; i < tombstone_ids.size(); ++i) {
+      int64 payload_id = tombstone_ids[i];
+
+      // Left behind by an earlier batch that did not run to completion
+      if (!tombstone_filepaths[i].empty()) {
+        payload_ids.push_back(payload_id);
+        filepaths.push_back(tombstone_filepaths[i]);
+        continue;
+      }
+
+      // The payload may have been referenced again since it was marked
+      if (count_stmt.reset() != SQLITE_OK ||
+          count_stmt.bind_int64(0, payload_id) != SQLITE_OK ||
+          count_stmt.step() != SQLITE_ROW) {
+        return false;
+      }
+      bool referenced = count_stmt.column_int64(0) > 0;
+
+      std::string16 filepath;
+      if (!referenced) {
+        if (delete_payload_stmt.reset() != SQLITE_OK ||
+            delete_payload_stmt.bind_int64(0, payload_id) != SQLITE_OK ||
+            delete_payload_stmt.step() != SQLITE_DONE) {
+          return false;
+        }
+        if (!response_bodies_store_->DetachBody(payload_id, &filepath)) {
+          return false;
+        }
+      } else {
+        // Unmarking the payload puts it back into the usage
+        if (size_stmt.reset() != SQLITE_OK ||
+            size_stmt.bind_int64(0, payload_id) != SQLITE_OK) {
+          return false;
+        }
+        rv = size_stmt.step();
+        if (rv == SQLITE_ROW) {
+          if (!AddToUsage(size_stmt.column_int64(0),
+                          size_stmt.column_int64(1))) {
+            return false;
+          }
+        } else if (rv != SQLITE_DONE) {
+          return false;
+        }
+      }
+
+      if (filepath.empty()) {
+        // Nothing more to do for this payload
+        if (delete_stmt.reset() != SQLITE_OK ||
+            delete_stmt.bind_int64(0, payload_id) != SQLITE_OK ||
+            delete_stmt.step() != SQLITE_DONE) {
+          return false;
+        }
+      } else {
+        if (update_stmt.reset() != SQLITE_OK ||
+            update_stmt.bind_text16(0, filepath.c_str()) != SQLITE_OK ||
+            update_stmt.bind_int64(1, payload_id) != SQLITE_OK ||
+            update_stmt.step() != SQLITE_DONE) {
+          return false;
+        }
+        payload_ids.push_back(payload_id);
+        filepaths.push_back(filepath);
+      }
+    }
+
+    if (!transaction.Commit()) {
+      return false;
+    }
+  }
+
+  if (payload_ids.empty()) {
+    return true;
+  }
+
+  // Remove the files outside of any transaction, and then the tombstones
+  // of those that were successfully removed. A file that could not be
+  // removed, perhaps because it is pinned open, will be retried later.
+
+  SQLTransaction transaction(&db_, "CollectGarbageBatch");
+  if (!transaction.Begin()) {
+    return false;
+  }
+  const char16 *delete_sql = STRING16(L"DELETE FROM PayloadTombstones "
+                                      L"WHERE PayloadID=?");
+  SQLStatement delete_stmt;
+  if (delete_stmt.prepare16(&db_, delete_sql) != SQLITE_OK) {
+    LOG(("WebCacheDB.CollectGarbageBatch failed\n"));
+    return false;
+  }
+  for (size_t i = 0; i < payload_ids.size(); ++i) {
+    if (!response_bodies_store_->DeleteDetachedFile(filepaths[i].c_str())) {
+      // Don't spin on it, stop for now and try again next time around
+      LOG(("WebCacheDB.CollectGarbageBatch failed to delete file\n"));
+      *done = true;
+      continue;
+    }
+    if (delete_stmt.reset() != SQLITE_OK ||
+        delete_stmt.bind_int64(0, payload_ids[i]) != SQLITE_OK ||
+        delete_stmt.step() != SQLITE_DONE) {
+      return false;
+    }
+  }
+  return transaction.Commit();
+}
+
+//------------------------------------------------------------------------------
+// HasGarbage
+//------------------------------------------------------------------------------
+bool WebCacheDB::HasGarbage() {
+  ASSERT_SINGLE_THREAD();
+
+  const char16 *sql = STRING16(L"SELECT 1 FROM PayloadTombstones LIMIT 1");
+  SQLStatement stmt;
+  if (stmt.prepare16(&db_, sql) != SQLITE_OK) {
+    return false;
+  }
+  return stmt.step() == SQLITE_ROW;
+}
+
+//------------------------------------------------------------------------------
+// ScheduleGarbageCollection
+//------------------------------------------------------------------------------
+// static
+void WebCacheDB::ScheduleGarbageCollection() {
+  GarbageCollectorThread *thread =
+      BackgroundThread::GetInstance<GarbageCollectorThread>();
+  if (thread) {
+    thread->Wake();
+  }
+}
+
+//------------------------------------------------------------------------------
+// GetQuotas
+//------------------------------------------------------------------------------
+bool WebCacheDB::GetQuotas(int64 *origin_quota, int64 *global_quota) {
+  ASSERT_SINGLE_THREAD();
+  assert(origin_quota);
+  assert(global_quota);
+
+  int origin_quota_kb = kDefaultOriginQuotaKB;
+  int global_quota_kb = kDefaultGlobalQuotaKB;
+  bool found = false;
+  if (!system_info_table_.LookupInt(kOriginQuotaName, &found,
+                                    &origin_quota_kb) ||
+      !system_info_table_.LookupInt(kGlobalQuotaName, &found,
+                                    &global_quota_kb)) {
+    LOG(("WebCacheDB.GetQuotas failed\n"));
+    return false;
+  }
+  *origin_quota = static_cast<int64>(origin_quota_kb) * 1024;
+  *global_quota = static_cast<int64>(global_quota_kb) * 1024;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// SetQuotas
+//------------------------------------------------------------------------------
+bool WebCacheDB::SetQuotas(int64 origin_quota, int64 global_quota) {
+  ASSERT_SINGLE_THREAD();
+
+  const int64 kMaxQuota = static_cast<int64>(kint32max) * 1024;
+  if (origin_quota <= 0 || global_quota <= 0 ||
+      origin_quota > kMaxQuota || global_quota > kMaxQuota) {
+    LOG(("WebCacheDB.SetQuotas failed, invalid quota\n"));
+    return false;
+  }
+
+  SQLTransaction transaction(&db_, "SetQuotas");
+  if (!transaction.Begin()) {
+    return false;
+  }
+  if (!system_info_table_.SetInt(kOriginQuotaName,
+                                 static_cast<int>(origin_quota / 1024)) ||
+      !system_info_table_.SetInt(kGlobalQuotaName,
+                                 static_cast<int>(global_quota / 1024))) {
+    LOG(("WebCacheDB.SetQuotas failed\n"));
+    return false;
+  }
+  if (!transaction.Commit()) {
+    return false;
+  }
+
+  // Lowered quotas are enforced in the background
+  ScheduleGarbageCollection();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// GetUsage
+//------------------------------------------------------------------------------
+bool WebCacheDB::GetUsage(const SecurityOrigin &origin,
+                          int64 *origin_usage,
+                          int64 *global_usage) {
+  return GetUsage(origin.url().c_str(), origin_usage, global_usage);
+}
+
+bool WebCacheDB::GetUsage(const char16 *origin_url,
+                          int64 *origin_usage,
+                          int64 *global_usage) {
+  ASSERT_SINGLE_THREAD();
+  assert(origin_url);
+  assert(origin_usage);
+  assert(global_usage);
+
+  // There is one row per server, so this is cheap enough to repeat after
+  // each eviction
+  const char16 *sql = STRING16(
+      L"SELECT IFNULL(SUM(u.BodySize), 0), "
+      L"       IFNULL(SUM(CASE WHEN s.SecurityOriginUrl=? "
+      L"                  THEN u.BodySize END), 0) "
+      L"FROM ServerUsage u LEFT JOIN Servers s ON u.ServerID=s.ServerID");
+  SQLStatement stmt;
+  int rv = stmt.prepare16(&db_, sql);
+  rv |= stmt.bind_text16(0, origin_url);
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheDB.GetUsage failed\n"));
+    return false;
+  }
+  if (stmt.step() != SQLITE_ROW) {
+    LOG(("WebCacheDB.GetUsage failed\n"));
+    return false;
+  }
+  *global_usage = stmt.column_int64(0);
+  *origin_usage = stmt.column_int64(1);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// AddToUsage
+//
+// Adjusts the bytes accounted to a server in the ServerUsage table. Payloads
+// count towards the usage of the server that inserted them from when they
+// are inserted until they are marked in PayloadTombstones or deleted.
+//------------------------------------------------------------------------------
+bool WebCacheDB::AddToUsage(int64 server_id, int64 bytes) {
+  ASSERT_SINGLE_THREAD();
+  if (bytes == 0) {
+    return true;
+  }
+
+  const char16 *insert_sql = STRING16(L"INSERT OR IGNORE INTO ServerUsage "
+                                      L"(ServerID, BodySize) VALUES (?, 0)");
+  SQLStatement insert_stmt;
+  int rv = insert_stmt.prepare16(&db_, insert_sql);
+  rv |= insert_stmt.bind_int64(0, server_id);
+  if (rv != SQLITE_OK || insert_stmt.step() != SQLITE_DONE) {
+    LOG(("WebCacheDB.AddToUsage failed\n"));
+    return false;
+  }
+
+  const char16 *update_sql = STRING16(L"UPDATE ServerUsage "
+                                      L"SET BodySize=BodySize+? "
+                                      L"WHERE ServerID=?");
+  SQLStatement update_stmt;
+  rv = update_stmt.prepare16(&db_, update_sql);
+  rv |= update_stmt.bind_int64(0, bytes);
+  rv |= update_stmt.bind_int64(1, server_id);
+  if (rv != SQLITE_OK || update_stmt.step() != SQLITE_DONE) {
+    LOG(("WebCacheDB.AddToUsage failed\n"));
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// EnforceQuotas
+//------------------------------------------------------------------------------
+bool WebCacheDB::EnforceQuotas() {
+  ASSERT_SINGLE_THREAD();
+  return EvictForQuota(STRING16(L""), 0);
+}
+
+//------------------------------------------------------------------------------
+// EvictForQuota
+//
+// Deletes ResourceStore entries, least recently served first, until
+// additional_bytes can be added to the usage of origin_url without either
+// quota being exceeded. Deleting an entry only frees space once no other
+// entries refer to its payload, so usage is rechecked after each one.
+// Only the global quota is considered if origin_url is empty. When called
+// within a transaction that is later rolled back, so are the evictions.
+//------------------------------------------------------------------------------
+bool WebCacheDB::EvictForQuota(const char16 *origin_url,
+                               int64 additional_bytes) {
+  ASSERT_SINGLE_THREAD();
+  assert(origin_url);
+
+  int64 origin_quota = 0;
+  int64 global_quota = 0;
+  if (!GetQuotas(&origin_quota, &global_quota)) {
+    return false;
+  }
+  bool check_origin = origin_url[0] != 0;
+
+  bool flushed = false;
+  std::vector<int64> entry_ids;
+  size_t next_entry = 0;
+  while (true) {
+    int64 origin_usage = 0;
+    int64 global_usage = 0;
+    if (!GetUsage(origin_url, &origin_usage, &global_usage)) {
+      return false;
+    }
+    bool over_origin = check_origin &&
+                       origin_usage + additional_bytes > origin_quota;
+    bool over_global = global_usage + additional_bytes > global_quota;
+    if (!over_origin && !over_global) {
+      return true;
+    }
+
+    // Make sure the eviction order reflects recent use
+    if (!flushed) {
+      if (!FlushLastServedTimes()) {
+        return false;
+      }
+      flushed = true;
+    }
+
+    if (next_entry == entry_ids.size()) {
+      if (!FindEvictionCandidates(over_origin ? origin_url : NULL,
+                                  &entry_ids)) {
+        return false;
+      }
+      next_entry = 0;
+      if (entry_ids.empty()) {
+        LOG(("WebCacheDB.EvictForQuota - nothing left to evict\n"));
+        return false;
+      }
+    }
+    if (!DeleteEntry(entry_ids[next_entry++])) {
+      return false;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// FindEvictionCandidates
+//
+// Returns a batch of ResourceStore entries, least recently served first. If
+// origin_url is not NULL, only entries of that origin are returned. The
+// entries of ManagedResourceStores are never evicted, an application's
+// current version must remain complete to be served.
+//------------------------------------------------------------------------------
+bool WebCacheDB::FindEvictionCandidates(const char16 *origin_url,
+                                        std::vector<int64> *entry_ids) {
+  ASSERT_SINGLE_THREAD();
+  assert(entry_ids);
+
+  std::string16 sql(STRING16(
+      L"SELECT e.EntryID "
+      L"FROM Entries e, Versions v, Servers s, Payloads p "
+      L"WHERE e.VersionID=v.VersionID AND v.ServerID=s.ServerID "
+      L"      AND e.PayloadID=p.PayloadID AND s.ServerType=? "));
+  if (origin_url) {
+    sql += STRING16(L"AND s.SecurityOriginUrl=? ");
+  }
+  sql += STRING16(L"ORDER BY p.LastServedTime, e.EntryID LIMIT ?");
+
+  SQLStatement stmt;
+  int rv = stmt.prepare16(&db_, sql.c_str());
+  int param = -1;
+  rv |= stmt.bind_int(++param, RESOURCE_STORE);
+  if (origin_url) {
+    rv |= stmt.bind_text16(++param, origin_url);
+  }
+  rv |= stmt.bind_int(++param, kEvictionBatchSize);
+  if (rv != SQLITE_OK) {
+    LOG(("WebCacheDB.FindEvictionCandidates failed\n"));
+    return false;
+  }
+
+  entry_ids->clear();
+  while ((rv = stmt.step()) == SQLITE_ROW) {
+    entry_ids->push_back(stmt.column_int64(0));
+  }
+  if (rv != SQLITE_DONE) {
+    LOG(("WebCacheDB.FindEvictionCandidates failed\n"));
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// FlushLastServedTimes
+//------------------------------------------------------------------------------
+bool WebCacheDB::FlushLastServedTimes() {
+  ASSERT_SINGLE_THREAD();
+
+  std::map<int64, int64> times;
+  LastServedTimes::TakeAll(&times);
+  if (times.empty()) {
+    return true;
+  }
+
+  SQLTransaction transaction(&db_, "FlushLastServedTimes");
+  if (!transaction.Begin()) {
+    return false;
+  }
+
+  const char16 *sql = STRING16(L"UPDATE Payloads SET LastServedTime=? "
+                               L"WHERE PayloadID=?");
+  SQLStatement stmt;
+  if (stmt.prepare16(&db_, sql) != SQLITE_OK) {
+    LOG(("WebCacheDB.FlushLastServedTimes failed\n"));
+    return false;
+  }
+  for (std::map<int64, int64>::const_iterator iter = times.begin();
+       iter != times.end(); ++iter) {
+    int rv = stmt.reset();
+    rv |= stmt.bind_int64(0, iter->second);
+    rv |= stmt.bind_int64(1, iter->first);
+    if (rv != SQLITE_OK || stmt.step() != SQLITE_DONE) {
+      LOG(("WebCacheDB.FlushLastServedTimes failed\n"));
+      return false;
+    }
+  }
+
+  return transaction.Commit();
+}
+
+//------------------------------------------------------------------------------
+// Called after a top transaction has begun
+//------------------------------------------------------------------------------
+void WebCacheDB::OnBegin() {
+#ifdef USE_FILE_STORE
+  response_bodies_store_->BeginTransaction();
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Called after a top transaction has been commited
+//------------------------------------------------------------------------------
+void WebCacheDB::OnCommit() {
+#ifdef USE_FILE_STORE
+  response_bodies_store_->CommitTransaction();
+#endif
+  if (garbage_marked_) {
+    garbage_marked_ = false;
+    ScheduleGarbageCollection();
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -2682,9 +3643,11 @@ void WebCacheDB::OnCommit() {
 //------------------------------------------------------------------------------
 void WebCacheDB::OnRollback() {
   LOG(("WebCacheDB.OnRollback\n"));
+#ifdef USE_FILE_STORE
   response_bodies_store_->RollbackTransaction();
-}
 #endif
+  garbage_marked_ = false;
+}
 
 
 //------------------------------------------------------------------------------
@@ -2697,6 +3660,8 @@ WebCacheDB *WebCacheDB::GetDB() {
       (ThreadLocals::GetValue(kThreadLocalKey));
   }
 
+  // Times this thread's first use, see tools/perf/measure_startup.
+  TRACE_EVENT("database", "WebCacheDB.FirstUse");
   WebCacheDB *db = new WebCacheDB();
 
   // If we can't initialize, we store NULL in the map so that we don't keep
@@ -2735,6 +3700,33 @@ bool WebCacheDB::PayloadInfo::GetHeader(const char16* name,
     return false;
   }
 
+  // Use the pre-parsed index if it describes the current headers
+  const size_t kFields = kHeaderIndexFieldsPerHeader;
+  if (!header_index.empty() && header_index[0] == headers.length()) {
+    const size_t name_length = std::char_traits<char16>::length(name);
+    bool is_corrupt = false;
+    for (size_t i = 1; i + kFields <= header_index.size(); i += kFields) {
+      size_t name_offset = header_index[i];
+      size_t value_offset = header_index[i + 2];
+      size_t value_length = header_index[i + 3];
+      if (name_offset + header_index[i + 1] > headers.length() ||
+          value_offset + value_length > headers.length()) {
+        is_corrupt = true;
+        break;
+      }
+      if (header_index[i + 1] == name_length &&
+          memistr(headers.c_str() + name_offset, name_length,
+                  name, name_length)) {
+        value->assign(headers, value_offset, value_length);
+        return true;
+      }
+    }
+    if (!is_corrupt) {
+      return false;
+    }
+    // Fall back to parsing the headers
+  }
+
   std::string headers_ascii;
   String16ToUTF8(headers.c_str(), headers.length(), &headers_ascii);
   const char *body = headers_ascii.c_str();
@@ -2782,6 +3774,7 @@ void WebCacheDB::PayloadInfo::SynthesizeHtmlRedirect(const char16 *location,
   status_line = STRING16(L"HTTP/1.0 200 OK");
   status_code = HttpConstants::HTTP_OK;
   headers = kHeaders;
+  header_index.clear();
   data.reset();
 #ifdef USE_FILE_STORE
   cached_filepath.clear();
@@ -2851,6 +3844,7 @@ WebCacheDB::PayloadInfo::SynthesizeHttpRedirect(const char16 *base_url,
   headers += full_location;
   headers += HttpConstants::kCrLf;
   headers += HttpConstants::kCrLf;
+  header_index.clear();
   data.reset(new std::vector<uint8>);
 #ifdef USE_FILE_STORE
   cached_filepath.clear();
@@ -2859,8 +3853,13 @@ WebCacheDB::PayloadInfo::SynthesizeHttpRedirect(const char16 *base_url,
   return true;
 }
 
+static bool FormatHeaders(const HTTPHeaders &parsed_headers,
+                          std::string16 *headers,
+                          std::vector<uint16> *header_index);
+
 bool WebCacheDB::PayloadInfo::PassesValidationTests(
-                                  std::string16 *adjusted_headers) {
+                                  std::string16 *adjusted_headers,
+                                  std::vector<uint16> *adjusted_header_index) {
   int status_line_status_code;
   if (!IsValidResponseCode(status_code) ||
       !ParseHttpStatusLine(status_line, NULL, &status_line_status_code, NULL) ||
@@ -2925,23 +3924,106 @@ bool WebCacheDB::PayloadInfo::PassesValidationTests(
                              HTTPHeaders::OVERWRITE);
     parsed_headers.ClearHeader(HTTPHeaders::CONTENT_ENCODING);
 
-    std::string header_str;
-    for (HTTPHeaders::const_iterator hdr = parsed_headers.begin();
-         hdr != parsed_headers.end();
-         ++hdr) {
-      if (hdr->second != NULL) {  // NULL means do not output
-        header_str += hdr->first;
-        header_str += ": ";
-        header_str += hdr->second;
-        header_str += HttpConstants::kCrLfAscii;
+    if (!FormatHeaders(parsed_headers, adjusted_headers,
+                       adjusted_header_index)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool WebCacheDB::PayloadInfo::SetGzipEncodedHeaders() {
+  std::string headers_ascii;
+  String16ToUTF8(headers.c_str(), headers.length(), &headers_ascii);
+  const char *body = headers_ascii.c_str();
+  uint32 body_len = headers_ascii.length();
+  HTTPHeaders parsed_headers;
+  if (!HTTPUtils::ParseHTTPHeaders(&body, &body_len, &parsed_headers,
+                                   true /* allow_const_cast */)) {
+    return false;
+  }
+
+  int64 encoded_data_size = data.get() ? data->size() : 0;
+  parsed_headers.SetHeader(HTTPHeaders::CONTENT_LENGTH,
+                           Integer64ToString(encoded_data_size).c_str(),
+                           HTTPHeaders::OVERWRITE);
+  parsed_headers.SetHeader(HTTPHeaders::CONTENT_ENCODING, "gzip",
+                           HTTPHeaders::OVERWRITE);
+  return FormatHeaders(parsed_headers, &headers, &header_index);
+}
+
+// Formats parsed headers as a string terminated with a blank line. If
+// header_index is not NULL, it is set to the index of the formatted headers,
+// or cleared if they are too long to be indexed.
+static bool FormatHeaders(const HTTPHeaders &parsed_headers,
+                          std::string16 *headers,
+                          std::vector<uint16> *header_index) {
+  std::string16 header_str;
+  std::vector<uint16> index;
+  index.push_back(0);  // the length, set below
+  for (HTTPHeaders::const_iterator hdr = parsed_headers.begin();
+       hdr != parsed_headers.end();
+       ++hdr) {
+    if (hdr->second != NULL) {  // NULL means do not output
+      size_t name_offset = header_str.length();
+      if (!AppendUTF8ToString16(hdr->first, strlen(hdr->first),
+                                &header_str)) {
+        return false;
       }
+      size_t name_length = header_str.length() - name_offset;
+      header_str += STRING16(L": ");
+      size_t value_offset = header_str.length();
+      if (!AppendUTF8ToString16(hdr->second, strlen(hdr->second),
+                                &header_str)) {
+        return false;
+      }
+      size_t value_length = header_str.length() - value_offset;
+      header_str += HttpConstants::kCrLf;
+      index.push_back(static_cast<uint16>(name_offset));
+      index.push_back(static_cast<uint16>(name_length));
+      index.push_back(static_cast<uint16>(value_offset));
+      index.push_back(static_cast<uint16>(value_length));
     }
-    header_str += HttpConstants::kCrLfAscii;  // blank line at the end
-    if (!UTF8ToString16(header_str.c_str(), header_str.length(),
-                        adjusted_headers)) {
-      return false;
+  }
+  header_str += HttpConstants::kCrLf;  // blank line at the end
+  if (header_index) {
+    if (header_str.length() <= kuint16max) {
+      index[0] = static_cast<uint16>(header_str.length());
+      header_index->swap(index);
+    } else {
+      header_index->clear();
     }
   }
+  headers->swap(header_str);
+  return true;
+}
+
+// static
+void WebCacheDB::PayloadInfo::WriteHeaderIndex(const std::vector<uint16> &index,
+                                               std::vector<uint8> *blob) {
+  blob->clear();
+  blob->reserve(index.size() * 2);
+  for (size_t i = 0; i < index.size(); ++i) {
+    blob->push_back(static_cast<uint8>(index[i] & 0xFF));
+    blob->push_back(static_cast<uint8>(index[i] >> 8));
+  }
+}
 
+// static
+bool WebCacheDB::PayloadInfo::ReadHeaderIndex(const std::vector<uint8> &blob,
+                                              std::vector<uint16> *index) {
+  index->clear();
+  if (blob.empty()) {
+    return true;
+  }
+  size_t count = blob.size() / 2;
+  if ((blob.size() % 2) != 0 || (count % kHeaderIndexFieldsPerHeader) != 1) {
+    return false;
+  }
+  index->resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    (*index)[i] = static_cast<uint16>(blob[2 * i] | (blob[2 * i + 1] << 8));
+  }
   return true;
 }
@@ -151,6 +151,13 @@ class WebCacheDB : SQLTransactionListener {
     std::string16 status_line;
     std::string16 headers;  // Must be terminated with a blank line
 
+    // A pre-parsed index of 'headers', see kHeaderIndexFieldsPerHeader. It
+    // is stored along with the payload so that header lookups when serving
+    // do not re-parse the headers. Empty if not available, in which case
+    // lookups parse 'headers'. Code that modifies 'headers' after the index
+    // has been populated must clear it.
+    std::vector<uint16> header_index;
+
     // The following fields are empty for info_only queries
     scoped_ptr< std::vector<uint8> > data;
 #ifdef USE_FILE_STORE
@@ -159,14 +166,40 @@ class WebCacheDB : SQLTransactionListener {
 
     bool is_synthesized_http_redirect;
 
+    // Set by callers prior to calling Service() if a gzip encoded body can
+    // be consumed. If the body is stored compressed, data will then contain
+    // the gzip encoded body and the headers will be adjusted to match.
+    bool accepts_gzip_encoding;
+
+    // True if the body is stored compressed. In that case cached_filepath
+    // is empty as the file does not contain the response body as is.
+    bool is_body_compressed;
+
     PayloadInfo() : id(kUnknownID),
                     creation_date(0),
                     status_code(0),
-                    is_synthesized_http_redirect(false) {}
+                    is_synthesized_http_redirect(false),
+                    accepts_gzip_encoding(false),
+                    is_body_compressed(false) {}
 
     // Returns a particular header value
     bool GetHeader(const char16* header, std::string16 *value);
 
+    // The header index holds the length of the headers it describes followed
+    // by the offset and length of each header name and value within them,
+    // in the order the headers appear. It can only describe headers that
+    // are formatted one "Name: value" line per name (as they are after
+    // passing validation) and are no longer than kuint16max.
+    static const size_t kHeaderIndexFieldsPerHeader = 4;
+
+    // Serializes the header index into a compact blob for storage.
+    static void WriteHeaderIndex(const std::vector<uint16> &index,
+                                 std::vector<uint8> *blob);
+
+    // Deserializes a header index, returns false if the blob is malformed.
+    static bool ReadHeaderIndex(const std::vector<uint8> &blob,
+                                std::vector<uint16> *index);
+
     // Returns true if the payload represents an HTTP redirect
     bool IsHttpRedirect();
 
@@ -195,7 +228,17 @@ class WebCacheDB : SQLTransactionListener {
     // header value if present.  'adjusted_headers' is an optional output
     // param. If non-NULL, it will be set to an adjusted set of headers
     // suitable for insertion into the LocalServer database.
-    bool PassesValidationTests(std::string16 *adjusted_headers);
+    // 'adjusted_header_index' is also optional, if non-NULL it will be set to
+    // the header index of the adjusted headers.
+    bool PassesValidationTests(std::string16 *adjusted_headers) {
+      return PassesValidationTests(adjusted_headers, NULL);
+    }
+    bool PassesValidationTests(std::string16 *adjusted_headers,
+                               std::vector<uint16> *adjusted_header_index);
+
+    // Re-writes the headers to describe a gzip encoded body held in data,
+    // with a "Content-Encoding" header and a matching "Content-Length".
+    bool SetGzipEncodedHeaders();
   };
 
   // Returns a pointer to the underlying SQLDatabase
@@ -291,6 +334,10 @@ class WebCacheDB : SQLTransactionListener {
   // parameter is updated with the id of the inserted row.
   bool InsertEntry(EntryInfo *entry);
 
+  // Inserts a batch of rows into the Entries table within one transaction,
+  // updating the id field of each. Either all are inserted or none are.
+  bool InsertEntries(std::vector<EntryInfo> *entries);
+
   // Deletes the entry with the given entry_id. Does not fail if there
   // is no matching entry.
   bool DeleteEntry(int64 entry_id);
@@ -349,11 +396,42 @@ class WebCacheDB : SQLTransactionListener {
   // validation tests (see Payload.PassesValidationTests) will be inserted.
   bool InsertPayload(int64 server_id, const char16 *url, PayloadInfo *payload);
 
-  bool DeleteUnreferencedPayloads();
   bool FindMostRecentPayload(int64 server_id,
                              const char16 *url,
                              PayloadInfo *payload);
 
+  // Deletes payloads that were marked as possibly unreferenced when their
+  // entries were deleted. Work is done in small transactions until
+  // budget_millis has elapsed, so the database is never locked for long.
+  // Upon return, done indicates whether any marked payloads remain.
+  // This is normally called on the garbage collection thread, see
+  // ScheduleGarbageCollection.
+  bool CollectGarbage(int budget_millis, bool *done);
+
+  // Storage quotas, in bytes. Payloads are accounted against the quota of
+  // the security origin of the server that inserted them and against the
+  // global quota. Inserting a payload that would exceed either quota first
+  // evicts ResourceStore entries, least recently served first. Entries of
+  // ManagedResourceStores are never evicted, so an insert fails if they
+  // alone exceed a quota. Quotas are stored with a granularity of 1KB.
+  bool GetQuotas(int64 *origin_quota, int64 *global_quota);
+  bool SetQuotas(int64 origin_quota, int64 global_quota);
+
+  // Returns the bytes accounted against the origin's quota and in total
+  bool GetUsage(const SecurityOrigin &origin,
+                int64 *origin_usage,
+                int64 *global_usage);
+
+  // Evicts entries until usage is within the global quota, for instance
+  // after the quota has been lowered. This is normally called on the
+  // garbage collection thread.
+  bool EnforceQuotas();
+
+  // Writes the times at which payloads were served, as recorded in memory
+  // by Service, to the database. This is normally called on the garbage
+  // collection thread.
+  bool FlushLastServedTimes();
+
  private:
   // Private constructor & destructor, callers must use GetDB()
   WebCacheDB();
@@ -403,6 +481,11 @@ class WebCacheDB : SQLTransactionListener {
   bool UpgradeFrom10To11();
   bool UpgradeFrom11To12();
   bool UpgradeFrom12To13();
+  bool UpgradeFrom13To14();
+  bool UpgradeFrom14To15();
+  bool UpgradeFrom15To16();
+  bool UpgradeFrom16To17();
+  bool UpgradeFrom17To18();
 
   bool ExecuteSqlCommandsInTransaction(const char *commands[], int count);
   bool ExecuteSqlCommands(const char *commands[], int count);
@@ -410,6 +493,23 @@ class WebCacheDB : SQLTransactionListener {
   bool MaybeDeletePayload(int64 payload_id);
   bool DeletePayload(int64 payload_id);
 
+  // Helpers for incremental garbage collection of payloads. Payloads
+  // are marked in the PayloadTombstones table within the transaction
+  // that removes their entries, and are later deleted in batches.
+  bool CollectGarbageBatch(bool *done);
+  bool HasGarbage();
+  static void ScheduleGarbageCollection();
+  bool garbage_marked_;
+
+  // Helpers for quotas, see GetQuotas
+  bool GetUsage(const char16 *origin_url,
+                int64 *origin_usage,
+                int64 *global_usage);
+  bool AddToUsage(int64 server_id, int64 bytes);
+  bool EvictForQuota(const char16 *origin_url, int64 additional_bytes);
+  bool FindEvictionCandidates(const char16 *origin_url,
+                              std::vector<int64> *entry_ids);
+
   SQLDatabase db_;
   NameValueTable system_info_table_;
 
@@ -417,21 +517,17 @@ class WebCacheDB : SQLTransactionListener {
   friend class WebCacheBlobStore;
   friend class WebCacheFileStore;
   class WebCacheFileStore *response_bodies_store_;
+#else
+  friend class WebCacheBlobStore;
+  class WebCacheBlobStore *response_bodies_store_;
+#endif  // USE_FILE_STORE
 
   // Implementation of SQLTransactionListener used to inform the file store
-  // of transactions
+  // of transactions, and to kick off garbage collection once payloads
+  // marked for deletion have been committed
   virtual void OnBegin();
   virtual void OnCommit();
   virtual void OnRollback();
-#else
-  friend class WebCacheBlobStore;
-  class WebCacheBlobStore *response_bodies_store_;
-
-  // These are a noop when everything is stored in the database
-  virtual void OnBegin() {}
-  virtual void OnCommit() {}
-  virtual void OnRollback() {}
-#endif  // USE_FILE_STORE
 
   static void DestroyDB(void* pvoid);
 
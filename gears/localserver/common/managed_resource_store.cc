@@ -125,6 +125,72 @@ bool ManagedResourceStore::SetManifestUrl(const char16 *manifest_url) {
   return true;
 }
 
+//------------------------------------------------------------------------------
+// ManifestEntryInserter
+//------------------------------------------------------------------------------
+
+// Adds manifest entries to the Entries table as ParseEntries produces them.
+// Rows are buffered and inserted kBatchSize at a time, so the insert
+// statement is compiled once per batch rather than once per row, without
+// holding the whole manifest in memory.
+class ManifestEntryInserter : public Manifest::EntryHandler {
+ public:
+  static const size_t kBatchSize = 256;
+
+  ManifestEntryInserter(WebCacheDB *db, int64 server_id, int64 version_id)
+      : db_(db), server_id_(server_id), version_id_(version_id) {
+    batch_.reserve(kBatchSize);
+  }
+
+  virtual bool HandleEntry(const Manifest::Entry &manifest_entry) {
+    batch_.push_back(WebCacheDB::EntryInfo());
+    WebCacheDB::EntryInfo &entry = batch_.back();
+    entry.version_id = version_id_;
+    entry.url = manifest_entry.url;
+    entry.src = manifest_entry.src;
+    entry.redirect = manifest_entry.redirect;
+    entry.ignore_query = manifest_entry.ignore_query;
+    entry.match_query = manifest_entry.match_query;
+    if (entry.match_query) {
+      entry.match_all = manifest_entry.match_all;
+      entry.match_some = manifest_entry.match_some;
+      entry.match_none = manifest_entry.match_none;
+    }
+
+    // If the entry has a redirect, synthesize a 302 response and store
+    // that as the payload for this entry. The redirect is expected to
+    // be a full url
+    if (!entry.redirect.empty()) {
+      WebCacheDB::PayloadInfo payload;
+      payload.SynthesizeHttpRedirect(NULL, entry.redirect.c_str());
+      if (!db_->InsertPayload(server_id_, entry.url.c_str(), &payload)) {
+        return false;
+      }
+      entry.payload_id = payload.id;
+    }
+
+    if (batch_.size() >= kBatchSize) {
+      return Flush();
+    }
+    return true;
+  }
+
+  // Inserts any buffered entries.
+  bool Flush() {
+    bool ok = db_->InsertEntries(&batch_);
+    batch_.clear();
+    return ok;
+  }
+
+ private:
+  WebCacheDB *db_;
+  int64 server_id_;
+  int64 version_id_;
+  std::vector<WebCacheDB::EntryInfo> batch_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ManifestEntryInserter);
+};
+
 //------------------------------------------------------------------------------
 // AddManifestAsDownloadingVersion
 //------------------------------------------------------------------------------
@@ -176,38 +242,11 @@ bool ManagedResourceStore::AddManifestAsDownloadingVersion(Manifest *manifest,
     return false;
   }
 
-  // Insert a new row in the Entries table for each Manifest entry
-  const std::vector<Manifest::Entry> *entries = manifest->GetEntries();
-  for (std::vector<Manifest::Entry>::const_iterator iter = entries->begin();
-       iter != entries->end(); ++iter) {
-    WebCacheDB::EntryInfo entry;
-    entry.version_id = version.id;
-    entry.url = iter->url;
-    entry.src = iter->src;
-    entry.redirect = iter->redirect;
-    entry.ignore_query = iter->ignore_query;
-    entry.match_query = iter->match_query;
-    if (entry.match_query) {
-      entry.match_all = iter->match_all;
-      entry.match_some = iter->match_some;
-      entry.match_none = iter->match_none;
-    }
-
-    // If the entry has a redirect, synthesize a 302 response and store
-    // that as the payload for this entry. The redirect is expected to
-    // be a full url
-    if (!entry.redirect.empty()) {
-      WebCacheDB::PayloadInfo payload;
-      payload.SynthesizeHttpRedirect(NULL, entry.redirect.c_str());
-      if (!db->InsertPayload(server_id_, entry.url.c_str(), &payload)) {
-        return false;
-      }
-      entry.payload_id = payload.id;
-    }
-
-    if (!db->InsertEntry(&entry)) {
-      return false;
-    }
+  // Insert a new row in the Entries table for each Manifest entry. Entries
+  // are read from the manifest one at a time and written in batches.
+  ManifestEntryInserter inserter(db, server_id_, version.id);
+  if (!manifest->ParseEntries(&inserter) || !inserter.Flush()) {
+    return false;
   }
 
   if (version_id) {
@@ -128,7 +128,8 @@ class ManagedResourceStore : public LocalServer {
 
   // Adds a new version to this application.  The new version is created
   // with the downloading ready state.  Any pre-existing version with the
-  // downloading ready state is deleted.
+  // downloading ready state is deleted. The manifest's entries are read
+  // with Manifest::ParseEntries, so the manifest data must still be valid.
   bool AddManifestAsDownloadingVersion(Manifest *manifest, int64 *version_id);
 
   // Transitions a version from the downloading ready state to the current
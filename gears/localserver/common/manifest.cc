@@ -24,7 +24,9 @@
 // ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <assert.h>
-#include <set>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "gears/localserver/common/manifest.h"
 
@@ -32,114 +34,513 @@
 #include "gears/base/common/string_utils.h"
 #include "gears/base/common/url_utils.h"
 #include "third_party/googleurl/src/gurl.h"
-#include "third_party/jsoncpp/json.h"
 
 //------------------------------------------------------------------------------
-// JsonUtils
+// JsonScanner
+//
+// Tokenizes JSON utf8 data in place, without building a document. Manifests
+// for large applications can list tens of thousands of entries, and holding
+// them all in a Json::Value costs far more than the data itself. This accepts
+// the same input as the jsoncpp Reader that was used before, comments
+// included, and reports syntax errors in the same format.
 //------------------------------------------------------------------------------
 
-class JsonUtils {
-public:
-  static int GetInteger(const Json::Value &object,
-                        const char *name) {
-    return GetInteger(object, name, 0);
-  }
+class JsonScanner {
+ public:
+  enum TokenType {
+    kObjectBegin,
+    kObjectEnd,
+    kArrayBegin,
+    kArrayEnd,
+    kString,
+    kNumber,
+    kTrue,
+    kFalse,
+    kNull,
+    kComma,
+    kColon,
+    kEndOfStream,
+    kError
+  };
+
+  JsonScanner(const char *begin, const char *end)
+      : begin_(begin), end_(end), current_(begin),
+        token_begin_(begin), token_end_(begin) {}
+
+  // Reads the next token, skipping whitespace and comments.
+  TokenType Next();
+
+  // Consumes the rest of the value whose first token is 'token', checking
+  // that it is well-formed.
+  bool SkipValue(TokenType token);
+
+  // Decodes the current string token into utf8. With a NULL out, only
+  // checks its escape sequences.
+  bool DecodeString(std::string *out);
+
+  // Decodes the current string token. Returns false if it has bad escape
+  // sequences or is not valid utf8.
+  bool GetString16(std::string16 *out);
+
+  // Checks the current number token. If it is an integer that fits in an
+  // int, is_int is set and value holds it.
+  bool DecodeNumber(bool *is_int, int *value);
+
+  // Records a syntax error at the current token. Always returns false.
+  bool SetError(const char *message);
+
+  const std::string &error() const { return error_; }
+  const char *token_begin() const { return token_begin_; }
+  const char *token_end() const { return token_end_; }
 
-  static int GetInteger(const Json::Value &object,
-                        const char *name,
-                        int default_value);
+ private:
+  char NextChar() { return current_ == end_ ? 0 : *current_++; }
+  bool Match(const char *pattern, int length);
+  bool ReadString();
+  bool ReadComment();
+  void ReadNumber();
+
+  const char *begin_;
+  const char *end_;
+  const char *current_;
+  const char *token_begin_;
+  const char *token_end_;
+  std::string error_;
+};
 
-  static bool GetString16(const Json::Value &object,
-                          const char *name,
-                          std::string16 *out);
+// Iterates over the members of an object whose opening '{' has been read.
+class JsonObjectReader {
+ public:
+  explicit JsonObjectReader(JsonScanner *scanner)
+      : scanner_(scanner), first_(true), failed_(false) {}
 
-  static bool GetBool(const Json::Value &object,
-                      const char *name,
-                      bool default_value);
+  // Advances to the next member. Returns false at the end of the object or
+  // on a syntax error, see failed(). Otherwise the scanner is left on the
+  // first token of the member's value, whose type is returned in value. The
+  // caller must consume the whole value before calling Next again.
+  bool Next(std::string *name, JsonScanner::TokenType *value);
+
+  bool failed() const { return failed_; }
 
-  static bool GetChildObject(const Json::Value &object,
-                             const char *name,
-                             const Json::Value **out);
  private:
-  static bool GetString(const Json::Value &object,
-                        const char *name,
-                        std::string *out);
+  bool Fail(const char *message) {
+    failed_ = true;
+    return scanner_->SetError(message);
+  }
+
+  JsonScanner *scanner_;
+  bool first_;
+  bool failed_;
 };
 
-int JsonUtils::GetInteger(const Json::Value &object,
-                          const char *name,
-                          int default_value) {
-  assert(object.isObject());
-  const Json::Value value = object.get(name, Json::Value::null);
-  if (value.isInt())
-    return value.asInt();
-  else
-    return default_value;
+JsonScanner::TokenType JsonScanner::Next() {
+  while (true) {
+    // jsoncpp also treats a latin-1 non-breaking space as whitespace.
+    while (current_ != end_ &&
+           (*current_ == ' ' || *current_ == '\t' || *current_ == '\r' ||
+            *current_ == '\n' || *current_ == static_cast<char>(0xA0))) {
+      ++current_;
+    }
+    token_begin_ = current_;
+    TokenType type;
+    char c = NextChar();
+    switch (c) {
+      case '{': type = kObjectBegin; break;
+      case '}': type = kObjectEnd; break;
+      case '[': type = kArrayBegin; break;
+      case ']': type = kArrayEnd; break;
+      case ',': type = kComma; break;
+      case ':': type = kColon; break;
+      case '"': type = ReadString() ? kString : kError; break;
+      case 't': type = Match("rue", 3) ? kTrue : kError; break;
+      case 'f': type = Match("alse", 4) ? kFalse : kError; break;
+      case 'n': type = Match("ull", 3) ? kNull : kError; break;
+      case 0: type = kEndOfStream; break;
+      case '/':
+        if (!ReadComment()) {
+          type = kError;
+          break;
+        }
+        continue;
+      default:
+        if ((c >= '0' && c <= '9') || c == '-') {
+          ReadNumber();
+          type = kNumber;
+        } else {
+          type = kError;
+        }
+        break;
+    }
+    token_end_ = current_;
+    return type;
+  }
 }
 
-bool JsonUtils::GetString(const Json::Value &object,
-                          const char *name,
-                          std::string *out) {
-  assert(object.isObject());
-  const Json::Value value = object.get(name, Json::Value::null);
-  if (!value.isString())
+bool JsonScanner::Match(const char *pattern, int length) {
+  if (end_ - current_ < length || memcmp(current_, pattern, length) != 0) {
     return false;
-  *out = value.asString();
+  }
+  current_ += length;
   return true;
 }
 
-bool JsonUtils::GetString16(const Json::Value &object,
-                            const char *name,
-                            std::string16 *out) {
-  assert(object.isObject());
-  const Json::Value value = object.get(name, Json::Value::null);
-  if (!value.isString())
+bool JsonScanner::ReadString() {
+  // Escaped characters are skipped here and checked by DecodeString.
+  const char *quote = current_;
+  while (true) {
+    quote = static_cast<const char*>(memchr(quote, '"', end_ - quote));
+    if (!quote) {
+      current_ = end_;
+      return false;
+    }
+    // The quote is escaped if an odd number of backslashes precede it.
+    const char *p = quote;
+    while (p > current_ && p[-1] == '\\') {
+      --p;
+    }
+    if ((quote - p) % 2 == 0) {
+      current_ = quote + 1;
+      return true;
+    }
+    ++quote;
+  }
+}
+
+bool JsonScanner::ReadComment() {
+  char c = NextChar();
+  if (c == '*') {
+    while (current_ != end_) {
+      if (NextChar() == '*' && current_ != end_ && *current_ == '/') {
+        break;
+      }
+    }
+    return NextChar() == '/';
+  } else if (c == '/') {
+    while (current_ != end_) {
+      c = NextChar();
+      if (c == '\r' || c == '\n') {
+        break;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+void JsonScanner::ReadNumber() {
+  while (current_ != end_) {
+    char c = *current_;
+    if (!(c >= '0' && c <= '9') &&
+        c != '.' && c != 'e' && c != 'E' && c != '+' && c != '-') {
+      break;
+    }
+    ++current_;
+  }
+}
+
+bool JsonScanner::SkipValue(TokenType token) {
+  switch (token) {
+    case kObjectBegin: {
+      JsonObjectReader members(this);
+      std::string name;
+      TokenType value;
+      while (members.Next(&name, &value)) {
+        if (!SkipValue(value)) {
+          return false;
+        }
+      }
+      return !members.failed();
+    }
+    case kArrayBegin: {
+      token = Next();
+      if (token == kArrayEnd) {
+        return true;
+      }
+      while (true) {
+        if (!SkipValue(token)) {
+          return false;
+        }
+        token = Next();
+        if (token == kArrayEnd) {
+          return true;
+        }
+        if (token != kComma) {
+          return SetError("Missing ',' or ']' in array declaration");
+        }
+        token = Next();
+      }
+    }
+    case kString:
+      return DecodeString(NULL);
+    case kNumber: {
+      bool is_int;
+      int value;
+      return DecodeNumber(&is_int, &value);
+    }
+    case kTrue:
+    case kFalse:
+    case kNull:
+      return true;
+    default:
+      return SetError("Syntax error: value, object or array expected.");
+  }
+}
+
+static void AppendUnicodeToUTF8(unsigned int c, std::string *utf8) {
+  // Each \u escape is encoded on its own, as jsoncpp does, so an escaped
+  // surrogate pair does not form valid utf8.
+  if (c < 0x80) {
+    *utf8 += static_cast<char>(c);
+  } else if (c < 0x800) {
+    *utf8 += static_cast<char>(0xC0 | (c >> 6));
+    *utf8 += static_cast<char>(0x80 | (c & 0x3F));
+  } else {
+    *utf8 += static_cast<char>(0xE0 | (c >> 12));
+    *utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+    *utf8 += static_cast<char>(0x80 | (c & 0x3F));
+  }
+}
+
+bool JsonScanner::DecodeString(std::string *out) {
+  assert(token_end_ - token_begin_ >= 2 && *token_begin_ == '"');
+  const char *p = token_begin_ + 1;
+  const char *end = token_end_ - 1;
+  if (out) {
+    out->clear();
+  }
+  while (p != end) {
+    const char *backslash =
+        static_cast<const char*>(memchr(p, '\\', end - p));
+    if (!backslash) {
+      backslash = end;
+    }
+    if (out) {
+      out->append(p, backslash);
+    }
+    p = backslash;
+    if (p == end) {
+      break;
+    }
+    if (++p == end) {
+      return SetError("Empty escape sequence in string");
+    }
+    char escaped = *p++;
+    char decoded;
+    switch (escaped) {
+      case '"': decoded = '"'; break;
+      case '/': decoded = '/'; break;
+      case '\\': decoded = '\\'; break;
+      case 'b': decoded = '\b'; break;
+      case 'f': decoded = '\f'; break;
+      case 'n': decoded = '\n'; break;
+      case 'r': decoded = '\r'; break;
+      case 't': decoded = '\t'; break;
+      case 'u': {
+        if (end - p < 4) {
+          return SetError("Bad unicode escape sequence in string: "
+                          "four digits expected.");
+        }
+        unsigned int unicode = 0;
+        for (int i = 0; i < 4; ++i) {
+          char c = *p++;
+          unicode *= 16;
+          if (c >= '0' && c <= '9') {
+            unicode += c - '0';
+          } else if (c >= 'a' && c <= 'f') {
+            unicode += c - 'a' + 10;
+          } else if (c >= 'A' && c <= 'F') {
+            unicode += c - 'A' + 10;
+          } else {
+            return SetError("Bad unicode escape sequence in string: "
+                            "hexadecimal digit expected.");
+          }
+        }
+        if (out) {
+          AppendUnicodeToUTF8(unicode, out);
+        }
+        continue;
+      }
+      default:
+        return SetError("Bad escape sequence in string");
+    }
+    if (out) {
+      *out += decoded;
+    }
+  }
+  return true;
+}
+
+bool JsonScanner::GetString16(std::string16 *out) {
+  const char *begin = token_begin_ + 1;
+  int len = static_cast<int>(token_end_ - token_begin_) - 2;
+  if (!memchr(begin, '\\', len)) {
+    // The common case: convert straight from the input.
+    return UTF8ToString16(begin, len, out);
+  }
+  std::string decoded;
+  if (!DecodeString(&decoded)) {
     return false;
-  return UTF8ToString16(value.asCString(), out);
+  }
+  return UTF8ToString16(decoded, out);
+}
+
+bool JsonScanner::DecodeNumber(bool *is_int, int *value) {
+  // Same rules as Json::Reader::decodeNumber: anything with a fraction or
+  // exponent is a double, as is an integer too large for an unsigned int.
+  const char *p = token_begin_;
+  bool is_double = false;
+  for (const char *inspect = p; inspect != token_end_; ++inspect) {
+    char c = *inspect;
+    if (c == '.' || c == 'e' || c == 'E' || c == '+' ||
+        (c == '-' && inspect != p)) {
+      is_double = true;
+      break;
+    }
+  }
+  *is_int = false;
+  if (!is_double) {
+    bool is_negative = (*p == '-');
+    if (is_negative) {
+      ++p;
+    }
+    unsigned int threshold =
+        (is_negative ? 0x80000000u : 0xFFFFFFFFu) / 10;
+    unsigned int number = 0;
+    for (; p != token_end_; ++p) {
+      if (number >= threshold) {
+        is_double = true;
+        break;
+      }
+      number = number * 10 + (*p - '0');
+    }
+    if (!is_double) {
+      if (is_negative) {
+        *is_int = true;
+        *value = -static_cast<int>(number);
+      } else if (number <= static_cast<unsigned int>(INT_MAX)) {
+        *is_int = true;
+        *value = static_cast<int>(number);
+      }
+      return true;
+    }
+  }
+  std::string buffer(token_begin_, token_end_);
+  double real;
+  if (sscanf(buffer.c_str(), "%lf", &real) != 1) {
+    std::string message("'");
+    message += buffer;
+    message += "' is not a number.";
+    return SetError(message.c_str());
+  }
+  return true;
 }
 
-bool JsonUtils::GetBool(const Json::Value &object,
-                        const char *name,
-                        bool default_value) {
-  assert(object.isObject());
-  const Json::Value value = object.get(name, Json::Value::null);
-  if (value.isBool())
-    return value.asBool();
-  else
-    return default_value;
+bool JsonScanner::SetError(const char *message) {
+  int line = 1;
+  const char *line_start = begin_;
+  for (const char *p = begin_; p < token_begin_; ++p) {
+    if (*p == '\r') {
+      if (p + 1 < token_begin_ && p[1] == '\n') {
+        ++p;
+      }
+      line_start = p + 1;
+      ++line;
+    } else if (*p == '\n') {
+      line_start = p + 1;
+      ++line;
+    }
+  }
+  char location[64];
+  sprintf(location, "* Line %d, Column %d\n",
+          line, static_cast<int>(token_begin_ - line_start) + 1);
+  error_ = location;
+  error_ += "  ";
+  error_ += message;
+  error_ += "\n";
+  return false;
 }
 
-bool JsonUtils::GetChildObject(const Json::Value &object,
-                               const char *name,
-                               const Json::Value **out) {
-  assert(object.isObject());
-  *out = &object[name];
-  // The isObject method returns true for nullValues which we want to exclude,
-  // so we test the type directly.
-  return (*out)->type() == Json::objectValue;
+bool JsonObjectReader::Next(std::string *name,
+                            JsonScanner::TokenType *value) {
+  if (failed_) {
+    return false;
+  }
+  JsonScanner::TokenType token = scanner_->Next();
+  if (first_) {
+    first_ = false;
+    if (token == JsonScanner::kObjectEnd) {
+      return false;
+    }
+  } else {
+    if (token == JsonScanner::kObjectEnd) {
+      return false;
+    }
+    if (token != JsonScanner::kComma) {
+      return Fail("Missing ',' or '}' in object declaration");
+    }
+    token = scanner_->Next();
+  }
+  if (token != JsonScanner::kString) {
+    return Fail("Missing '}' or object member name");
+  }
+  if (!scanner_->DecodeString(name)) {
+    failed_ = true;
+    return false;
+  }
+  if (scanner_->Next() != JsonScanner::kColon) {
+    return Fail("Missing ':' after object member name");
+  }
+  *value = scanner_->Next();
+  return true;
 }
 
 //------------------------------------------------------------------------------
 // Parse
 //------------------------------------------------------------------------------
-bool Manifest::Parse(const char16 *manifest_url, const char *json, int len) {
 #define MANIFEST_VERSION_FIELD "betaManifestVersion"
 #define L_MANIFEST_VERSION_FIELD L"betaManifestVersion"
-  static const char *kManifestVersionField = MANIFEST_VERSION_FIELD;
-  static const char *kVersionField = "version";
-  static const char *kRedirectUrlField = "redirectUrl";
-  static const char *kEntriesField = "entries";
-  static const char *kUrlField = "url";
-  static const char *kSrcField = "src";
-  static const char *kRedirectField = "redirect";
-  static const char *kIgnoreQueryField = "ignoreQuery";
-  static const char *kMatchQueryField = "matchQuery";
-  static const char *kMatchAllField = "hasAll";
-  static const char *kMatchSomeField = "hasSome";
-  static const char *kMatchNoneField = "hasNone";
-  static const int kManifestFormatVersion1 = 1;
-  static const int kManifestFormatVersion2 = 2;  // adds matchQuery
+static const char *kManifestVersionField = MANIFEST_VERSION_FIELD;
+static const char *kVersionField = "version";
+static const char *kRedirectUrlField = "redirectUrl";
+static const char *kEntriesField = "entries";
+static const char *kUrlField = "url";
+static const char *kSrcField = "src";
+static const char *kRedirectField = "redirect";
+static const char *kIgnoreQueryField = "ignoreQuery";
+static const char *kMatchQueryField = "matchQuery";
+static const char *kMatchAllField = "hasAll";
+static const char *kMatchSomeField = "hasSome";
+static const char *kMatchNoneField = "hasNone";
+static const int kManifestFormatVersion1 = 1;
+static const int kManifestFormatVersion2 = 2;  // adds matchQuery
+
+// Gathers entries into the vector returned by GetEntries.
+class Manifest::EntryCollector : public Manifest::EntryHandler {
+ public:
+  explicit EntryCollector(std::vector<Entry> *entries) : entries_(entries) {}
+  virtual bool HandleEntry(const Entry &entry) {
+    entries_->push_back(entry);
+    return true;
+  }
+ private:
+  std::vector<Entry> *entries_;
+};
 
+bool Manifest::Parse(const char16 *manifest_url, const char *json, int len) {
+  if (!ParseHeader(manifest_url, json, len)) {
+    return false;
+  }
+  EntryCollector collector(&entries_);
+  bool ok = ParseEntries(&collector);
+  // The json data need not outlive this call. Later calls to ParseEntries
+  // read entries_ instead.
+  entries_begin_ = NULL;
+  entries_end_ = NULL;
+  return ok;
+}
+
+bool Manifest::ParseHeader(const char16 *manifest_url,
+                           const char *json, int len) {
   assert(manifest_url && manifest_url[0]);
   assert(json);
   assert(len >= 0);
@@ -164,25 +565,70 @@ bool Manifest::Parse(const char16 *manifest_url, const char *json, int len) {
   entries_.clear();
   redirect_url_.clear();
   error_message_.clear();
+  format_version_ = 0;
+  entries_begin_ = NULL;
+  entries_end_ = NULL;
+
+  // Advance over a UTF-8 BOM if present
+  const char *json_end = json + len;
+  if (len >= 3 && memcmp(json, "\xEF\xBB\xBF", 3) == 0) {
+    json += 3;
+  }
 
-  // Parse the JSON data
-  Json::Value root;
-  Json::Reader reader;
-  bool ok = reader.parse(json, json + len, root, false);
-  if (!ok) {
-    UTF8ToString16(reader.getFormatedErrorMessages().c_str(),
-                   &error_message_);
+  // Scan the JSON data. This checks the syntax of the whole document, but
+  // only the top level values are kept. When a name repeats, the last value
+  // wins.
+  JsonScanner scanner(json, json_end);
+  JsonScanner::TokenType token = scanner.Next();
+  if (token != JsonScanner::kObjectBegin) {
+    if (scanner.SkipValue(token)) {
+      error_message_ = STRING16(L"Not an object");
+    } else {
+      UTF8ToString16(scanner.error(), &error_message_);
+    }
     return false;
   }
-  if (!root.isObject()) {
-    error_message_ = STRING16(L"Not an object");
+
+  bool has_version = false;
+  JsonObjectReader members(&scanner);
+  std::string name;
+  while (members.Next(&name, &token)) {
+    const char *value_begin = scanner.token_begin();
+    if (!scanner.SkipValue(token)) {
+      break;
+    }
+    if (name == kManifestVersionField) {
+      bool is_int = false;
+      if (token != JsonScanner::kNumber ||
+          !scanner.DecodeNumber(&is_int, &format_version_) || !is_int) {
+        format_version_ = 0;
+      }
+    } else if (name == kVersionField) {
+      has_version = (token == JsonScanner::kString) &&
+                    scanner.GetString16(&version_);
+    } else if (name == kRedirectUrlField) {
+      if (token != JsonScanner::kString ||
+          !scanner.GetString16(&redirect_url_)) {
+        redirect_url_.clear();
+      }
+    } else if (name == kEntriesField) {
+      if (token == JsonScanner::kArrayBegin) {
+        entries_begin_ = value_begin;
+        entries_end_ = scanner.token_end();
+      } else {
+        entries_begin_ = NULL;
+        entries_end_ = NULL;
+      }
+    }
+  }
+  if (!scanner.error().empty()) {
+    UTF8ToString16(scanner.error(), &error_message_);
     return false;
   }
 
   // Verify the data format is a version we know about
-  int format_version = JsonUtils::GetInteger(root, kManifestVersionField);
-  if ((format_version != kManifestFormatVersion1) &&
-      (format_version != kManifestFormatVersion2)) {
+  if ((format_version_ != kManifestFormatVersion1) &&
+      (format_version_ != kManifestFormatVersion2)) {
     error_message_ = STRING16(L"Invalid '"
                               L_MANIFEST_VERSION_FIELD
                               L"' attribute");
@@ -191,112 +637,218 @@ bool Manifest::Parse(const char16 *manifest_url, const char *json, int len) {
 
   // Get the values of interest
 
-  if (!JsonUtils::GetString16(root, kVersionField, &version_) ||
-      version_.empty()) {
+  if (!has_version || version_.empty()) {
+    version_.clear();
     error_message_ = STRING16(L"Missing 'version' attribute");
     return false;   // version is a required field
   }
-  JsonUtils::GetString16(root, 
-                         kRedirectUrlField,
-                         &redirect_url_);
 
-  // We use the array indexer to get a reference rather than a copy
-  // of the entries value
-  const Json::Value &entries = root[kEntriesField];
-  if (!entries.isArray()) {
+  if (!entries_begin_) {
     error_message_ = STRING16(L"Missing 'entries' array");
     return false;
   }
 
+  if (!redirect_url_.empty()) {
+    const bool kDontCheckOrigin = false;
+    if (!ResolveRelativeUrl(manifest_url_.c_str(), &redirect_url_,
+                            kDontCheckOrigin)) {
+      return false;
+    }
+  }
 
-  for (size_t i = 0; i < entries.size(); ++i) {
-    entries_.push_back(Entry());
-    Entry *entry = &entries_.back();
+  is_valid_ = true;
+  return true;
+}
+
+// Reads a string value into out and returns true. Other values are skipped,
+// leaving out empty. Syntax errors are left in the scanner's error().
+static bool ReadOptionalString16(JsonScanner *scanner,
+                                 JsonScanner::TokenType token,
+                                 std::string16 *out) {
+  if (token == JsonScanner::kString && scanner->GetString16(out)) {
+    return true;
+  }
+  out->clear();
+  scanner->SkipValue(token);
+  return false;
+}
+
+//------------------------------------------------------------------------------
+// ParseEntries
+//------------------------------------------------------------------------------
+bool Manifest::ParseEntries(EntryHandler *handler) {
+  // Only a manifest whose header parsed, and whose entries have not already
+  // failed to, has entries to read.
+  if (!is_valid_) {
+    if (error_message_.empty()) {
+      error_message_ = STRING16(L"Manifest has not been parsed");
+    }
+    return false;
+  }
+  if (!entries_begin_) {
+    // Parse has already collected the entries, and validated them.
+    if (handler) {
+      for (size_t i = 0; i < entries_.size(); ++i) {
+        if (!handler->HandleEntry(entries_[i])) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+  bool handler_failed = false;
+  bool ok = ReadEntries(handler, &handler_failed);
+  // The manifest itself is still valid if the handler was what failed.
+  is_valid_ = ok || handler_failed;
+  return ok;
+}
+
+bool Manifest::ReadEntries(EntryHandler *handler, bool *handler_failed) {
+  assert(entries_begin_);
+  *handler_failed = false;
+  JsonScanner scanner(entries_begin_, entries_end_);
+  JsonScanner::TokenType token = scanner.Next();
+  assert(token == JsonScanner::kArrayBegin);
+
+  // One Entry is reused throughout, so its strings are allocated once.
+  Entry entry;
+  std::string name;
+  token = scanner.Next();
+  while (token != JsonScanner::kArrayEnd) {
+    entry.url.clear();
+    entry.src.clear();
+    entry.redirect.clear();
+    entry.ignore_query = false;
+    entry.match_query = false;
+    entry.match_all.clear();
+    entry.match_some.clear();
+    entry.match_none.clear();
+
+    bool has_url = false;
+    if (token == JsonScanner::kObjectBegin) {
+      JsonObjectReader members(&scanner);
+      JsonScanner::TokenType value;
+      while (scanner.error().empty() && members.Next(&name, &value)) {
+        if (name == kUrlField) {
+          has_url = ReadOptionalString16(&scanner, value, &entry.url);
+        } else if (name == kSrcField) {
+          ReadOptionalString16(&scanner, value, &entry.src);
+        } else if (name == kRedirectField) {
+          ReadOptionalString16(&scanner, value, &entry.redirect);
+        } else if (name == kIgnoreQueryField) {
+          // ignoreQuery is an optional field (defaults to false)
+          entry.ignore_query = (value == JsonScanner::kTrue);
+          scanner.SkipValue(value);
+        } else if (name == kMatchQueryField &&
+                   format_version_ >= kManifestFormatVersion2) {
+          // TODO(michaeln): matchQuery was introduced in format version 2,
+          // would be really nice to output a warning message on the console
+          // when older manifests use it, to let developers know about
+          // bumping their manifest file format version.
+          entry.match_query = (value == JsonScanner::kObjectBegin);
+          entry.match_all.clear();
+          entry.match_some.clear();
+          entry.match_none.clear();
+          if (!entry.match_query) {
+            scanner.SkipValue(value);
+            continue;
+          }
+          JsonObjectReader match(&scanner);
+          while (scanner.error().empty() && match.Next(&name, &value)) {
+            if (name == kMatchAllField) {
+              ReadOptionalString16(&scanner, value, &entry.match_all);
+            } else if (name == kMatchSomeField) {
+              ReadOptionalString16(&scanner, value, &entry.match_some);
+            } else if (name == kMatchNoneField) {
+              ReadOptionalString16(&scanner, value, &entry.match_none);
+            } else {
+              scanner.SkipValue(value);
+            }
+          }
+        } else {
+          scanner.SkipValue(value);
+        }
+      }
+    } else {
+      scanner.SkipValue(token);
+    }
+    if (!scanner.error().empty()) {
+      // Not expected for data that ParseHeader accepted.
+      UTF8ToString16(scanner.error(), &error_message_);
+      return false;
+    }
 
     // url is a required field
-    if (!JsonUtils::GetString16(entries[i], kUrlField, &entry->url)) {
+    if (!has_url) {
       error_message_ = STRING16(L"Invalid entry - missing 'url' attribute");
       return false;
     }
-
-    // src and redirect are optional but mutually exclusive fields
-    JsonUtils::GetString16(entries[i], kSrcField, &entry->src);
-    JsonUtils::GetString16(entries[i], kRedirectField, &entry->redirect);
-    if (!entry->src.empty() && !entry->redirect.empty()) {
-      error_message_ = STRING16(L"Invalid entry - 'src' and 'redirect'"
-                                L" attributes cannot both be present");
+    if (!ValidateEntry(&entry) || !ResolveEntryUrls(&entry)) {
+      return false;
+    }
+    if (handler && !handler->HandleEntry(entry)) {
+      *handler_failed = true;
       return false;
     }
 
-    // ignoreQuery is an optional field (defaults to false)
-    entry->ignore_query = JsonUtils::GetBool(entries[i], kIgnoreQueryField,
-                                             false);
-    if (entry->ignore_query && (entry->url.find('?') != std::string16::npos)) {
-      error_message_ = STRING16(
-          L"Invalid entry - ignoreQuery will never match "
-          L"a url containing a '?'");
+    token = scanner.Next();
+    if (token == JsonScanner::kComma) {
+      token = scanner.Next();
+    } else if (token != JsonScanner::kArrayEnd) {
+      scanner.SetError("Missing ',' or ']' in array declaration");
+      UTF8ToString16(scanner.error(), &error_message_);
       return false;
     }
+  }
 
-    if (format_version >= kManifestFormatVersion2) {
-      // matchQuery is an optional field and mutually exclusive with ignoreQuery
-      const Json::Value *match = NULL;
-      entry->match_query = JsonUtils::GetChildObject(entries[i],
-                                                     kMatchQueryField,
-                                                     &match);
-      if (entry->match_query) {
-        assert(match && (match != &Json::Value::null));
-        if (entry->ignore_query) {
-          error_message_ = STRING16(
-              L"Invalid entry - 'ignoreQuery' and 'matchQuery' "
-              L"attributes cannot both be present");
-          return false;
-        }
-        if (entry->url.find('?') != std::string16::npos) {
-          error_message_ = STRING16(
-              L"Invalid entry - the 'url' for 'matchQuery' entries cannot "
-              L"contain a '?'");
-          return false;
-        }
+  return true;
+}
 
-        if (JsonUtils::GetString16(*match, kMatchAllField, &entry->match_all)
-            && !CanonicalizeMatchString(&entry->match_all)) {
-          return false;  // error_message_ set by ValidateMatchString
-        }
-        if (JsonUtils::GetString16(*match, kMatchSomeField, &entry->match_some)
-            && !CanonicalizeMatchString(&entry->match_some)) {
-          return false;
-        }
-        if (JsonUtils::GetString16(*match, kMatchNoneField, &entry->match_none)
-            && !CanonicalizeMatchString(&entry->match_none)) {
-          return false;
-        }
+bool Manifest::ValidateEntry(Entry *entry) {
+  // src and redirect are optional but mutually exclusive fields
+  if (!entry->src.empty() && !entry->redirect.empty()) {
+    error_message_ = STRING16(L"Invalid entry - 'src' and 'redirect'"
+                              L" attributes cannot both be present");
+    return false;
+  }
 
-        // An empty matchQuery is functionally equivalent to ignoreQuery, and
-        // since ignoreQuery handling is more efficient we use it in this case.
-        if (entry->match_all.empty() && entry->match_some.empty() &&
-            entry->match_none.empty()) {
-          entry->ignore_query = true;
-          entry->match_query = false;
-        }
-      }
-    } else {
-      // TODO(michaeln): matchQuery was introduced in format version 2,
-      // would be really nice to output a warning message on the console
-      // here to let developers know about bumping their manifest file
-      // format version.
-      /*
-      const Json::Value *match = NULL;
-      if (JsonUtils::GetChildObject(entries[i], kMatchQueryField, &match)) {
-        // Say something on the console
-      }
-      */
-    }
+  if (entry->ignore_query && (entry->url.find('?') != std::string16::npos)) {
+    error_message_ = STRING16(
+        L"Invalid entry - ignoreQuery will never match "
+        L"a url containing a '?'");
+    return false;
   }
 
-  is_valid_ = ResolveRelativeUrls();
+  // matchQuery is an optional field and mutually exclusive with ignoreQuery
+  if (entry->match_query) {
+    if (entry->ignore_query) {
+      error_message_ = STRING16(
+          L"Invalid entry - 'ignoreQuery' and 'matchQuery' "
+          L"attributes cannot both be present");
+      return false;
+    }
+    if (entry->url.find('?') != std::string16::npos) {
+      error_message_ = STRING16(
+          L"Invalid entry - the 'url' for 'matchQuery' entries cannot "
+          L"contain a '?'");
+      return false;
+    }
+
+    if (!CanonicalizeMatchString(&entry->match_all) ||
+        !CanonicalizeMatchString(&entry->match_some) ||
+        !CanonicalizeMatchString(&entry->match_none)) {
+      return false;  // error_message_ set by CanonicalizeMatchString
+    }
 
-  return is_valid_;
+    // An empty matchQuery is functionally equivalent to ignoreQuery, and
+    // since ignoreQuery handling is more efficient we use it in this case.
+    if (entry->match_all.empty() && entry->match_some.empty() &&
+        entry->match_none.empty()) {
+      entry->ignore_query = true;
+      entry->match_query = false;
+    }
+  }
+  return true;
 }
 
 bool Manifest::CanonicalizeMatchString(std::string16 *match) {
@@ -335,36 +887,26 @@ bool Manifest::CanonicalizeMatchString(std::string16 *match) {
 }
 
 //------------------------------------------------------------------------------
-// ResolveRelativeUrls
+// ResolveEntryUrls
 //------------------------------------------------------------------------------
-bool Manifest::ResolveRelativeUrls() {
+bool Manifest::ResolveEntryUrls(Entry *entry) {
   const bool kCheckOrigin = true;
   const bool kDontCheckOrigin = false;
   const char16 *base = manifest_url_.c_str();
 
-  if (!redirect_url_.empty()) {
-    if (!ResolveRelativeUrl(base, &redirect_url_, kDontCheckOrigin)) {
-      return false;
-    }
+  if (!ResolveRelativeUrl(base, &entry->url, kCheckOrigin)) {
+    return false;
+  }
+  if (!entry->src.empty() &&  // src is optional
+      !ResolveRelativeUrl(base, &entry->src, kCheckOrigin)) {
+    return false;
   }
 
-  for (std::vector<Entry>::iterator iter = entries_.begin();
-       iter != entries_.end();
-       ++iter) {
-    if (!ResolveRelativeUrl(base, &iter->url, kCheckOrigin)) {
-      return false;
-    }
-    if (!iter->src.empty() &&  // src is optional
-        !ResolveRelativeUrl(base, &iter->src, kCheckOrigin)) {
-      return false;
-    }
-
-    // TODO(michaeln): should we be stripping fragments here (as we are)
-    // or not (as i suspect)
-    if (!iter->redirect.empty() && // redirect is optional
-        !ResolveRelativeUrl(base, &iter->redirect, kDontCheckOrigin)) {
-      return false;
-    }
+  // TODO(michaeln): should we be stripping fragments here (as we are)
+  // or not (as i suspect)
+  if (!entry->redirect.empty() && // redirect is optional
+      !ResolveRelativeUrl(base, &entry->redirect, kDontCheckOrigin)) {
+    return false;
   }
 
   return true;
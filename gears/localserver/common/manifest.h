@@ -48,15 +48,42 @@ class Manifest {
     Entry() : ignore_query(false), match_query(false) {}
   };
 
-  Manifest() : is_valid_(false) {}
+  // Receives the entries of a manifest one at a time from ParseEntries.
+  // The urls in an entry have already been resolved against the manifest
+  // url. Returning false stops parsing.
+  class EntryHandler {
+   public:
+    virtual ~EntryHandler() {}
+    virtual bool HandleEntry(const Entry &entry) = 0;
+  };
+
+  Manifest()
+      : is_valid_(false), format_version_(0),
+        entries_begin_(NULL), entries_end_(NULL) {}
 
-  // Parses JSON utf8 encoded data populates the Manifest object's data members
+  // Parses JSON utf8 encoded data populates the Manifest object's data
+  // members, including the entries returned by GetEntries. The json data need
+  // not remain valid afterwards.
   bool Parse(const char16 *full_manifest_url, const char *json, int len);
   bool Parse(const char16 *full_manifest_url, const char *json) {
     return Parse(full_manifest_url, json, strlen(json));
   }
 
-  // Whether or not parsing was successful
+  // Parses everything but the individual entries, which are only checked to
+  // be well-formed JSON. Entries are read afterwards by ParseEntries without
+  // ever holding the whole list in memory, so the json data must remain
+  // valid until the last call to ParseEntries.
+  bool ParseHeader(const char16 *full_manifest_url, const char *json, int len);
+
+  // Validates each entry of a manifest accepted by ParseHeader or Parse, and
+  // passes it to handler, which may be NULL to only validate. Stops at the
+  // first invalid entry with the error message set, or when the handler
+  // returns false, which leaves the manifest valid. After Parse, the entries
+  // come from those it collected rather than from the json data.
+  bool ParseEntries(EntryHandler *handler);
+
+  // Whether or not parsing was successful. After ParseHeader this covers
+  // the entries parsed so far.
   bool IsValid() const { return is_valid_; }
 
   // Returns the manifest url passed into Parse
@@ -70,20 +97,30 @@ class Manifest {
     return redirect_url_.c_str();
   }
 
-  // Returns the array of entries from the Manifest
+  // Returns the array of entries from the Manifest. This is only populated
+  // by Parse.
   const std::vector<Entry> *GetEntries() { return &entries_; }
 
   // Returns an error message indicating why parsing failed
   const char16 *GetErrorMessage() { return error_message_.c_str(); }
 
  private:
+  class EntryCollector;
+
   bool CanonicalizeMatchString(std::string16 *match);
-  bool ResolveRelativeUrls();
+  bool ReadEntries(EntryHandler *handler, bool *handler_failed);
+  bool ValidateEntry(Entry *entry);
+  bool ResolveEntryUrls(Entry *entry);
   bool ResolveRelativeUrl(const char16 *base,
                           std::string16 *url,
                           bool check_origin);
 
   bool is_valid_;
+  int format_version_;
+  // The 'entries' array within the json data passed to ParseHeader. NULL
+  // after Parse, which keeps the entries in entries_ instead.
+  const char *entries_begin_;
+  const char *entries_end_;
   std::string16 manifest_url_;
   std::string16 version_;
   std::string16 redirect_url_;
@@ -392,10 +392,13 @@ bool UpdateTask::UpdateManifest(std::string16 *downloading_version,
       error_msg_ += kEmptyManifestErrorMessage;
       return false;
     }
-    if (!manifest.Parse(actual_manifest_url,
-                        reinterpret_cast<const char*>
-                            (&(*manifest_payload.data)[0]),
-                        manifest_payload.data->size())) {
+    // Only the header is parsed up front. The entries, which make up the
+    // bulk of a large manifest, are read one at a time as they are stored.
+    // manifest_payload holds the data they are read from until we return.
+    if (!manifest.ParseHeader(actual_manifest_url,
+                              reinterpret_cast<const char*>
+                                  (&(*manifest_payload.data)[0]),
+                              manifest_payload.data->size())) {
       LOG(("UpdateTask::UpdateManifest - manifest.Parse failed\n"));
       error_msg_ = kManifestParseErrorMessagePrefix;
       error_msg_ += manifest.GetErrorMessage();
@@ -441,6 +444,19 @@ bool UpdateTask::UpdateManifest(std::string16 *downloading_version,
     // Determine what action to take with the version represented in
     // the manifest file we've fetched
     const char16* manifest_version = manifest.GetVersion();
+    bool is_known_version =
+        (current_version_str && (*current_version_str == manifest_version)) ||
+        (downloading_version_str &&
+         (*downloading_version_str == manifest_version));
+
+    // The entries of a version we already have are not stored again, but a
+    // manifest with bad entries is still reported as an error.
+    if (is_known_version && !manifest.ParseEntries(NULL)) {
+      LOG(("UpdateTask::UpdateManifest - manifest.ParseEntries failed\n"));
+      error_msg_ = kManifestParseErrorMessagePrefix;
+      error_msg_ += manifest.GetErrorMessage();
+      return false;
+    }
 
     if (current_version_str && ((*current_version_str) == manifest_version)) {
       // We already have this version as current, so we can delete any others
@@ -464,6 +480,10 @@ bool UpdateTask::UpdateManifest(std::string16 *downloading_version,
       if (!store_.AddManifestAsDownloadingVersion(&manifest, NULL)) {
         LOG(("UpdateTask::UpdateManifest - "
              "AddManifestAsDownloadingVersion failed\n"));
+        if (!manifest.IsValid()) {
+          error_msg_ = kManifestParseErrorMessagePrefix;
+          error_msg_ += manifest.GetErrorMessage();
+        }
         return false;
       }
       std::string16 manifest_date;
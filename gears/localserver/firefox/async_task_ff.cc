@@ -29,6 +29,7 @@
 #endif
 #include <gecko_sdk/include/nspr.h> // for PR_*
 #include "gears/base/common/atomic_ops.h"
+#include "gears/base/common/trace_events.h"
 #include "gears/base/firefox/dom_utils.h"
 #include "gears/blob/blob_interface.h"
 #include "gears/localserver/common/http_constants.h"
@@ -105,6 +106,7 @@ void AsyncTask::SetListener(Listener *listener) {
 // Start
 //------------------------------------------------------------------------------
 bool AsyncTask::Start() {
+  TRACE_EVENT_INSTANT("localserver", "AsyncTask.Start");
   assert(!delete_when_done_);
   assert(IsListenerThread());
 
@@ -191,7 +193,10 @@ void AsyncTask::ThreadEntry(void *task) {
     CritSecLock locker(self->lock_);
     self->thread_id_ = ThreadMessageQueue::GetInstance()->GetCurrentThreadId();
   }
-  self->Run();
+  {
+    TRACE_EVENT("localserver", "AsyncTask.Run");
+    self->Run();
+  }
   self->thread_running_ = false;
   self->Unref();  // remove the reference added by the Start
 }
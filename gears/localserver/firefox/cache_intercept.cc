@@ -277,6 +277,9 @@ bool ReplayCacheEntry::LoadFromCache() {
     return false;
   }
 
+  // Firefox decodes the response body according to its Content-Encoding
+  // header, so a compressed body can be replayed without inflating it here
+  payload_.accepts_gzip_encoding = true;
   if (!db->Service(url.c_str(), NULL, false, &payload_)) {
     return false;  // we have no response for this url
   }
@@ -28,6 +28,7 @@
 #ifdef OS_WINCE
 #include "gears/base/common/wince_compatibility.h"
 #endif
+#include "gears/base/common/trace_events.h"
 #include "gears/base/ie/activex_utils.h"
 #include "gears/blob/blob_interface.h"
 #include "gears/localserver/common/critical_section.h"
@@ -96,6 +97,7 @@ void AsyncTask::SetListenerWindow(HWND listener_window,
 // Start
 //------------------------------------------------------------------------------
 bool AsyncTask::Start() {
+  TRACE_EVENT_INSTANT("localserver", "AsyncTask.Start");
   if (!is_initialized_ || thread_) {
     return false;
   }
@@ -158,7 +160,10 @@ unsigned int __stdcall AsyncTask::ThreadMain(void *task) {
 
   AsyncTask *self = reinterpret_cast<AsyncTask*>(task);
 
-  self->Run();
+  {
+    TRACE_EVENT("localserver", "AsyncTask.Run");
+    self->Run();
+  }
 
   {
     CritSecLock locker(self->lock_);
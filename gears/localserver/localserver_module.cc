@@ -25,6 +25,7 @@
 
 #include "gears/localserver/localserver_module.h"
 
+#include "gears/base/common/js_runner.h"
 #include "gears/base/common/paths.h"
 #include "gears/base/common/url_utils.h"
 #include "gears/localserver/common/http_request.h"
@@ -43,6 +44,7 @@ void Dispatcher<GearsLocalServer>::Init() {
   RegisterMethod("createStore", &GearsLocalServer::CreateStore);
   RegisterMethod("openStore", &GearsLocalServer::OpenStore);
   RegisterMethod("removeStore", &GearsLocalServer::RemoveStore);
+  RegisterMethod("getQuotaUsage", &GearsLocalServer::GetQuotaUsage);
 }
 
 const std::string GearsLocalServer::kModuleName("GearsLocalServer");
@@ -337,6 +339,38 @@ void GearsLocalServer::RemoveStore(JsCallContext *context) {
   }
 }
 
+//-----------------------------------------------------------------------------
+// GetQuotaUsage
+//-----------------------------------------------------------------------------
+void GearsLocalServer::GetQuotaUsage(JsCallContext *context) {
+  WebCacheDB *db = WebCacheDB::GetDB();
+  if (!db) {
+    context->SetException(STRING16(L"Error opening the database."));
+    return;
+  }
+
+  int64 origin_quota = 0;
+  int64 global_quota = 0;
+  int64 origin_usage = 0;
+  int64 global_usage = 0;
+  if (!db->GetQuotas(&origin_quota, &global_quota) ||
+      !db->GetUsage(EnvPageSecurityOrigin(), &origin_usage, &global_usage)) {
+    context->SetException(STRING16(L"Error reading quota usage."));
+    return;
+  }
+
+  scoped_ptr<JsObject> usage(module_environment_->js_runner_->NewObject());
+  if (!usage.get() ||
+      !usage->SetPropertyDouble(STRING16(L"usage"),
+                                static_cast<double>(origin_usage)) ||
+      !usage->SetPropertyDouble(STRING16(L"quota"),
+                                static_cast<double>(origin_quota))) {
+    context->SetException(STRING16(L"Error reading quota usage."));
+    return;
+  }
+  context->SetReturnValue(JSPARAM_OBJECT, usage.get());
+}
+
 //------------------------------------------------------------------------------
 // GetAndCheckParameters
 //------------------------------------------------------------------------------
@@ -67,6 +67,11 @@ class GearsLocalServer : public ModuleImplBaseClass {
   // OUT: -
   void RemoveStore(JsCallContext *context);
 
+  // IN: -
+  // OUT: object {usage, quota}, the bytes stored for the page's origin and
+  //      the most it may store
+  void GetQuotaUsage(JsCallContext *context);
+
  private:
   bool GetAndCheckParameters(JsCallContext *context, std::string16 *name,
                              std::string16 *required_cookie);
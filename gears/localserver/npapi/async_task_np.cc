@@ -30,6 +30,7 @@
 #endif
 #include "gears/base/common/async_router.h"
 #include "gears/base/common/atomic_ops.h"
+#include "gears/base/common/trace_events.h"
 #include "gears/base/npapi/browser_utils.h"
 #include "gears/blob/blob_interface.h"
 #include "gears/localserver/common/critical_section.h"
@@ -99,6 +100,7 @@ void AsyncTask::SetListener(Listener *listener) {
 // Start
 //------------------------------------------------------------------------------
 bool AsyncTask::Start() {
+  TRACE_EVENT_INSTANT("localserver", "AsyncTask.Start");
   if (!is_initialized_ || thread_) {
     return false;
   }
@@ -188,7 +190,10 @@ void *AsyncTask::ThreadMain(void *task) {
 
   ThreadMessageQueue::GetInstance()->InitThreadMessageQueue();
 
-  self->Run();
+  {
+    TRACE_EVENT("localserver", "AsyncTask.Run");
+    self->Run();
+  }
 
 #ifdef WIN32
   CloseHandle(self->thread_);
@@ -469,10 +469,19 @@ void GearsResourceStore::GetAsBlob(JsCallContext *context) {
     context->SetException(STRING16(L"Failed to get blob."));
     return;
   }
-  if (!item.payload.cached_filepath.empty())
+  if (!item.payload.cached_filepath.empty()) {
     blob.reset(new FileBlob(item.payload.cached_filepath));
-  else
+  } else if (item.payload.is_body_compressed) {
+    // The file holds a compressed body, so it has to be inflated in memory
+    if (!store_.GetItem(full_url.c_str(), &item) ||
+        !item.payload.data.get()) {
+      context->SetException(STRING16(L"Failed to get blob."));
+      return;
+    }
+    blob.reset(new BufferBlob(item.payload.data.get()));
+  } else {
     blob.reset(new EmptyBlob());
+  }
 #else
   if (!store_.GetItem(full_url.c_str(), &item)) {
     context->SetException(STRING16(L"Failed to get blob."));
@@ -203,3 +203,57 @@ function testBlobBuilderCanCallGetAsBlobTwice() {
   assertEqual(101, blob2.getBytes()[0]);
   assertEqual(102, blob2.getBytes()[1]);
 }
+
+function testBlobHash() {
+  var builder = google.gears.factory.create('beta.blobbuilder');
+  builder.append('The quick brown fox jumps over the lazy dog');
+  var blob = builder.getAsBlob();
+
+  var expected = {
+    'crc32': '414fa339',
+    'sha1': '2fd4e1c67a2d28fced849ee1bb76e7391b93eb12',
+    'sha256': 'd7a8fbb307d7809469ca9abcb0082e4f' +
+              '8d5651e46d3cdb762d02d0bf37c9e592'
+  };
+  var remaining = 0;
+  for (var algorithm in expected) {
+    ++remaining;
+  }
+  startAsync();
+  for (var algorithm in expected) {
+    (function(algorithm) {
+      blob.hash(algorithm, function(digest) {
+        assertEqual(expected[algorithm], digest,
+                    'Wrong ' + algorithm + ' digest');
+        if (--remaining == 0) {
+          completeAsync();
+        }
+      });
+    })(algorithm);
+  }
+}
+
+function testBlobHashInvalidArguments() {
+  var builder = google.gears.factory.create('beta.blobbuilder');
+  var blob = builder.getAsBlob();
+  assertError(function() {
+    blob.hash('md5', function() {});
+  }, "Algorithm must be 'crc32', 'sha1' or 'sha256'.");
+  assertError(function() {
+    blob.hash('sha1');
+  });
+}
+
+function testBlobHashReadError() {
+  if (!isDebug) {
+    // FailBlob only exists in debug builds
+    return;
+  }
+
+  var blob = google.gears.factory.create('beta.failblob', '1.0', 500);
+  startAsync();
+  blob.hash('sha1', function(digest) {
+    assertNull(digest, 'Expected no digest for an unreadable blob');
+    completeAsync();
+  });
+}
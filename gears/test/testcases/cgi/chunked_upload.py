@@ -0,0 +1,64 @@
+# Reassembles a Blob sent by HttpRequest.send(blob, uploadOptions).
+#
+# Each chunk carries 'Content-Range: bytes first-last/total' and an
+# 'X-Gears-Upload-Id' header. Chunks are kept on the server, keyed by upload
+# id, and answered with 202 until every byte has arrived. The request that
+# completes the upload gets a 200 whose body is the reassembled data.
+#
+# Query parameters:
+#   fail_once_at=<offset>  Answers 503 the first time the chunk starting at
+#                          <offset> arrives, to exercise retries.
+#
+# A request without Content-Range is answered with its own body.
+import re
+
+def send_reply(status, body, extra_headers=[]):
+  self.send_response(status)
+  self.send_header('Content-Type', 'application/octet-stream')
+  self.send_header('Content-Length', len(body))
+  self.send_header('echo-Content-Type',
+                   self.headers.getheader('content-type') or '')
+  for name, value in extra_headers:
+    self.send_header(name, value)
+  self.end_headers()
+  self.outgoing.append(body)
+  self.outgoing.append(None)
+
+if not hasattr(self.server, 'chunked_uploads'):
+  self.server.chunked_uploads = {}
+  self.server.chunked_upload_failures = {}
+uploads = self.server.chunked_uploads
+failures = self.server.chunked_upload_failures
+
+body = self.body or ''
+content_range = self.headers.getheader('content-range')
+upload_id = self.headers.getheader('x-gears-upload-id')
+match = content_range and \
+    re.match(r'^bytes (\d+)-(\d+)/(\d+)$', content_range)
+
+if self.command not in ('POST', 'PUT'):
+  send_reply(405, 'Request must be HTTP POST or PUT.')
+elif not content_range:
+  send_reply(200, body)
+elif not match or not upload_id:
+  send_reply(400, 'Malformed chunk headers.')
+else:
+  first, last, total = [int(x) for x in match.groups()]
+  query = getattr(self, 'query', {})
+  fail_once_at = query.get('fail_once_at', [None])[0]
+  if last < first or last >= total or len(body) != last - first + 1:
+    send_reply(400, 'Chunk does not match its Content-Range.')
+  elif fail_once_at is not None and int(fail_once_at) == first and \
+      not failures.has_key((upload_id, first)):
+    failures[(upload_id, first)] = True
+    send_reply(503, 'Failing this chunk once.')
+  else:
+    chunks = uploads.setdefault(upload_id, {})
+    chunks[first] = body
+    received = sum([len(data) for data in chunks.values()])
+    if received < total:
+      send_reply(202, 'Partial.')
+    else:
+      data = ''.join([chunks[offset] for offset in sorted(chunks.keys())])
+      del uploads[upload_id]
+      send_reply(200, data, [('chunk-Count', str(len(chunks)))])
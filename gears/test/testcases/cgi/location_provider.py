@@ -11,6 +11,8 @@ This script is used to simulate three test cases:
  - The network location provider returns a valid fix,
  - The network location provider can't find a position fix,
  - The request to the network location provider was malformed.
+It also counts requests, so that tests can check that identical requests made
+at the same time are coalesced.
 
 These cases are simulated by returning a populated response object, a null
 response object and a 400 error code respectively. The rules to this are as
@@ -26,8 +28,20 @@ follows:
 
  - For a fix request with a cell id 88 (int) an HTTP 400 error code is
    returned.
+
+ - For a fix request with a wifi tower mac address "counted_mac_address",
+   the request is counted and, after a delay to give identical requests time
+   to arrive, a good position response is returned.
+
+ - A GET request with the query "request_count" returns the number of counted
+   requests received so far, and resets the count.
 """
 
+import time
+
+# The delay before responding to a counted request, in seconds.
+COUNTED_REQUEST_DELAY = 1
+
 class FixRequest(object):
   """ A class to decode and inspect an incoming position fix request.
 
@@ -158,7 +172,12 @@ if self.command == 'POST':
       fix_request = FixRequest(self.body)
 
       # Hard-coded rules to return desired responses
-      if fix_request.HasMacAddress("good_mac_address"):
+      if fix_request.HasMacAddress("counted_mac_address"):
+        self.server.counted_location_requests = \
+            getattr(self.server, 'counted_location_requests', 0) + 1
+        time.sleep(COUNTED_REQUEST_DELAY)
+        send_response(self, 200, GOOD_JSON_RESPONSE)
+      elif fix_request.HasMacAddress("good_mac_address"):
         send_response(self, 200, GOOD_JSON_RESPONSE)
       elif fix_request.HasMacAddress("no_location_mac_address"):
         send_response(self, 200, NO_LOCATION_JSON_RESPONSE)
@@ -170,5 +189,10 @@ if self.command == 'POST':
       send_response(self, 400, "Empty request")
   else:
     send_response(self, 400, "Content-Type should be application/json")
+elif self.command == 'GET' and hasattr(self, 'query') and \
+    self.query.has_key('request_count'):
+  count = getattr(self.server, 'counted_location_requests', 0)
+  self.server.counted_location_requests = 0
+  send_response(self, 200, str(count))
 else:
   send_response(self, 405, "Request must be HTTP POST.")
@@ -168,6 +168,38 @@ function testCrossBoundaryLog() {
   }
 }
 
+// Test that a burst of logging larger than the console will queue is
+// delivered with an account of the events dropped from it.
+var floodSize = 5000;
+var floodReceived = 0;
+var floodDropped = 0;
+function testLogFlood() {
+  startAsync();
+  for (var i = 0; i < floodSize; ++i) {
+    console.log(from_worker + '#testLogFlood', '%s', [i]);
+  }
+}
+
+function testGetMemoryUsage() {
+  var before = console.getMemoryUsage();
+  assert(before.bytes >= 0, 'bytes should not be negative');
+  assert(before.allocations >= 0, 'allocations should not be negative');
+  assertEqual('number', typeof before.types.ByteStore.bytes);
+
+  // Data appended to a BlobBuilder is held in a ByteStore on behalf of this
+  // origin.
+  var builder = google.gears.factory.create('beta.blobbuilder');
+  var data = '0123456789';
+  for (var i = 0; i < 10; i++) {
+    data += data;
+  }
+  builder.append(data);
+  var after = console.getMemoryUsage();
+  assert(after.types.ByteStore.bytes >=
+         before.types.ByteStore.bytes + data.length,
+         'Appended data should be accounted for');
+}
+
 // Helper callback for testing console.onlog and logging functionality
 function handleEvent(log_event) {
   // Because these tests are also run in a WorkerPool process, this handler
@@ -277,6 +309,18 @@ function handleEvent(log_event) {
       }
     }
 
+    // Test overflow of the log queue
+    else if (test_name == 'testLogFlood') {
+      assertEqual('number', typeof log_event.droppedCount);
+      ++floodReceived;
+      floodDropped += log_event.droppedCount;
+      if (log_event.message == String(floodSize - 1)) {
+        assert(floodDropped > 0, 'Some events should have been dropped');
+        assertEqual(floodSize, floodReceived + floodDropped);
+        completeAsync();
+      }
+    }
+
     // Bad test name
     else {
       assert(false, 'No handler for test');
@@ -285,9 +285,9 @@ function testLoadableTokenizerDisabled() {
     }
   }
 
-  if (isAndroid) {
-    // Android actually implements FTS3 in its system SQLite and the
-    // tokenizer is compiled in. Check that the authorizer is catching
+  if (!isSafari) {
+    // FTS3 is compiled in (Android gets it from its system SQLite), and
+    // fts3_tokenizer() with it. Check that the authorizer is catching
     // its usage.
     try {
       db.execute('SELECT fts3_tokenizer(?)', ['test']).close();
@@ -304,3 +304,111 @@ function testLoadableTokenizerDisabled() {
     }
   }
 }
+
+function testFulltextIndexingFTS3() {
+  db.execute('drop table if exists foo3');
+  db.execute('create virtual table foo3 using fts3(content)');
+  db.execute('insert into foo3 (content) values ' +
+             '("to sleep perchance to dream")');
+  db.execute('insert into foo3 (content) values ("to be or not to be")');
+
+  handleResult(db.execute('select * from foo3 where content match "dream"'),
+               function(rs) {
+    assert(rs.isValidRow(), 'Fulltext match statement returned no results');
+    assertEqual('to sleep perchance to dream', rs.field(0));
+    rs.next();
+    assert(!rs.isValidRow(), 'Fulltext match returned too many results');
+  });
+}
+
+function testFulltextPorterTokenizerFTS3() {
+  db.execute('drop table if exists foo3');
+  db.execute('create virtual table foo3 using fts3(content, tokenize porter)');
+  db.execute('insert into foo3 (content) values ("the dreamers dreamed")');
+
+  // The porter stemmer maps "dreaming" and "dreamed" onto the same term.
+  handleResult(
+    db.execute('select content from foo3 where content match "dreaming"'),
+    function(rs) {
+      assert(rs.isValidRow(), 'Stemmed match returned no results');
+      assertEqual('the dreamers dreamed', rs.field(0),
+                  'Stemmed match returned wrong results');
+  });
+}
+
+function testFulltextOnlyBuiltinTokenizers() {
+  db.execute('drop table if exists foo3');
+  db.execute('create virtual table foo3 using fts3(content, tokenize simple)');
+  db.execute('drop table foo3');
+
+  assertError(function() {
+    db.execute('create virtual table foo3 using fts3(content, tokenize icu)');
+  }, 'unknown tokenizer', 'Only built-in tokenizers should be available');
+}
+
+function testVirtualTableModulesRestricted() {
+  // Only the full-text modules may be used to create virtual tables.
+  assertError(function() {
+    db.execute('create virtual table vt using rtree(id, minX, maxX)');
+  }, 'not authorized', 'Non-fulltext virtual table should be denied');
+}
+
+// The index maintenance pattern from the API documentation: rows live in an
+// ordinary table, and an fts3 table with the same rowids indexes their text.
+function testFulltextIndexMaintenanceFTS3() {
+  db.execute('drop table if exists notes');
+  db.execute('drop table if exists notes_fts');
+  db.execute('create table notes (id integer primary key, ' +
+             'title text, body text, modified integer)');
+  db.execute('create virtual table notes_fts using fts3(title, body)');
+
+  function save(id, title, body) {
+    db.execute('begin');
+    db.execute('insert or replace into notes values (?, ?, ?, ?)',
+               [id, title, body, 0]);
+    db.execute('delete from notes_fts where rowid = ?', [id]);
+    db.execute('insert into notes_fts (rowid, title, body) values (?, ?, ?)',
+               [id, title, body]);
+    db.execute('commit');
+  }
+
+  function remove(id) {
+    db.execute('begin');
+    db.execute('delete from notes where id = ?', [id]);
+    db.execute('delete from notes_fts where rowid = ?', [id]);
+    db.execute('commit');
+  }
+
+  function search(query) {
+    var ids = [];
+    handleResult(
+      db.execute('select notes.id from notes join notes_fts ' +
+                 'on notes.id = notes_fts.rowid ' +
+                 'where notes_fts match ? order by notes.id', [query]),
+      function(rs) {
+        for (; rs.isValidRow(); rs.next()) {
+          ids.push(rs.field(0));
+        }
+    });
+    return ids.join(',');
+  }
+
+  save(1, 'groceries', 'milk eggs bread');
+  save(2, 'travel', 'book train tickets');
+  save(3, 'reading', 'finish the train book');
+  assertEqual('2,3', search('train'), 'Initial index is wrong');
+  assertEqual('3', search('title:reading'), 'Column match is wrong');
+
+  save(2, 'travel', 'book flights');
+  assertEqual('3', search('train'), 'Updated row still indexed');
+  assertEqual('2', search('flights'), 'Updated row not indexed');
+
+  remove(3);
+  assertEqual('', search('train'), 'Removed row still indexed');
+}
+
+// SAFARI-TEMP - The Safari project file does not build fts3 yet.
+testFulltextIndexingFTS3._disable_in_safari = true;
+testFulltextPorterTokenizerFTS3._disable_in_safari = true;
+testFulltextOnlyBuiltinTokenizers._disable_in_safari = true;
+testFulltextIndexMaintenanceFTS3._disable_in_safari = true;
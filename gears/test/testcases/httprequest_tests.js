@@ -575,3 +575,111 @@ function testReadyStates() {
   request.send();
   isCallingSend = false;
 }
+
+// Returns a Blob of 'length' bytes whose contents differ from chunk to chunk,
+// so that a chunk stored at the wrong offset changes the reassembled data.
+function makeChunkedUploadTestData(length) {
+  var data = [];
+  for (var i = 0; i < length; ++i) {
+    data.push(String.fromCharCode(65 + (i * 7) % 26));
+  }
+  return data.join('');
+}
+
+function makeChunkedUploadTestBlob(data) {
+  var builder = google.gears.factory.create('beta.blobbuilder');
+  builder.append(data);
+  return builder.getAsBlob();
+}
+
+// Sends 'data' to chunked_upload.py in chunks and checks that the server
+// reassembled it, that upload progress was aggregated over all the chunks,
+// and that headers set on the request were sent with every chunk.
+function doChunkedUpload(query, options) {
+  startAsync();
+
+  var data = makeChunkedUploadTestData(10000);
+  var expectedChunks = Math.ceil(data.length / options.chunkSize);
+  var request = google.gears.factory.create('beta.httprequest');
+  var lastUploadPosition = 0;
+  request.upload.onprogress = function(event) {
+    assertEqual(data.length, event.total, 'Wrong total upload size');
+    assert(event.loaded >= 0 && event.loaded <= data.length,
+           'Upload position out of range');
+    lastUploadPosition = event.loaded;
+  };
+  request.onreadystatechange = function() {
+    if (request.readyState != 4) {
+      return;
+    }
+    assertEqual(200, request.status, 'Wrong value for status property');
+    assertEqual(data, request.responseText, 'Blob was not reassembled');
+    assertEqual(String(expectedChunks), request.getResponseHeader(
+        'chunk-Count'), 'Wrong number of chunks stored');
+    assertEqual('text/x-chunked', request.getResponseHeader(
+        'echo-Content-Type'), 'Request header not sent with the last chunk');
+    assertEqual(data.length, lastUploadPosition,
+                'Upload progress did not reach the end of the Blob');
+    completeAsync();
+  };
+  request.open('POST', '/testcases/cgi/chunked_upload.py' + query);
+  request.setRequestHeader('Content-Type', 'text/x-chunked');
+  request.send(makeChunkedUploadTestBlob(data), options);
+  assertEqual(2, request.readyState, 'Chunked upload should be in progress');
+}
+
+function testPostBlobChunked() {
+  doChunkedUpload('', {chunkSize: 1024, maxParallel: 3});
+}
+
+function testPostBlobChunkedSingleChunk() {
+  doChunkedUpload('', {chunkSize: 65536});
+}
+
+function testPostBlobChunkedRetry() {
+  // The chunk at offset 2048 fails once, and is sent again.
+  doChunkedUpload('?fail_once_at=2048',
+                  {chunkSize: 1024, maxParallel: 4, maxRetries: 1});
+}
+
+function testPostBlobChunkedNoRetry() {
+  startAsync();
+
+  var data = makeChunkedUploadTestData(4096);
+  var request = google.gears.factory.create('beta.httprequest');
+  request.onreadystatechange = function() {
+    if (request.readyState == 4) {
+      // Without retries the failed chunk's response ends the upload.
+      assertEqual(503, request.status, 'Failed chunk should end the upload');
+      completeAsync();
+    }
+  };
+  request.open('POST', '/testcases/cgi/chunked_upload.py?fail_once_at=1024');
+  request.send(makeChunkedUploadTestBlob(data),
+               {chunkSize: 1024, maxParallel: 2, maxRetries: 0});
+}
+
+function testPostBlobChunkedInvalidOptions() {
+  var blob = makeChunkedUploadTestBlob('hello');
+  var invalidOptions = [
+    {chunkSize: 0},
+    {chunkSize: 'big'},
+    {maxParallel: 0},
+    {maxParallel: 17},
+    {maxRetries: -1},
+    {maxRetries: 11}
+  ];
+  for (var i = 0; i < invalidOptions.length; ++i) {
+    var request = google.gears.factory.create('beta.httprequest');
+    request.open('POST', '/testcases/cgi/chunked_upload.py');
+    assertError(function() {
+      request.send(blob, invalidOptions[i]);
+    }, null, 'Options should be rejected: ' + i);
+  }
+
+  var request = google.gears.factory.create('beta.httprequest');
+  request.open('POST', '/testcases/cgi/chunked_upload.py');
+  assertError(function() {
+    request.send('hello', {chunkSize: 1024});
+  }, 'Upload options may only be given with a Blob.');
+}
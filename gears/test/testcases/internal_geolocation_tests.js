@@ -417,6 +417,60 @@ function testMockDeviceDataProvider() {
   }
 }
 
+function testCoalescedRequests() {
+  if (isUsingCCTests) {
+    // Providers that differ only in address language make identical requests
+    // when no address is requested. These should be coalesced into a single
+    // request to the server.
+    var geolocation = google.gears.factory.create('beta.geolocation');
+    var mockNetworkLocationProvider = '/testcases/cgi/location_provider.py';
+    internalTests.configureGeolocationWifiDataProviderForTest(
+        [{mac_address: 'counted_mac_address'}]);
+
+    var pendingCallbacks = 2;
+    function successCallback(position) {
+      assertEqual(51.59, position.latitude);
+      assertEqual(-1.49, position.longitude);
+      if (--pendingCallbacks == 0) {
+        checkRequestCount();
+      }
+    }
+    function errorCallback(error) {
+      assert(false, 'testCoalescedRequests failed: ' + error.message);
+    }
+
+    function checkRequestCount() {
+      var request = google.gears.factory.create('beta.httprequest');
+      request.onreadystatechange = function() {
+        if (request.readyState == 4) {
+          assertEqual(200, request.status);
+          assertEqual('1', request.responseText,
+                      'Identical requests were not coalesced.');
+          completeAsync();
+        }
+      };
+      request.open('GET', mockNetworkLocationProvider + '?request_count');
+      request.send();
+    }
+
+    startAsync();
+    geolocation.getCurrentPosition(
+        successCallback,
+        errorCallback,
+        {
+          gearsAddressLanguage: 'en-GB',
+          gearsLocationProviderUrls: [mockNetworkLocationProvider]
+        });
+    geolocation.getCurrentPosition(
+        successCallback,
+        errorCallback,
+        {
+          gearsAddressLanguage: 'fr',
+          gearsLocationProviderUrls: [mockNetworkLocationProvider]
+        });
+  }
+}
+
 function testMockProvider() {
   if (isUsingCCTests) {
     // Use mock location provider.
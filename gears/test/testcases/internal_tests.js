@@ -450,6 +450,23 @@ function testPerfTimer() {
   }
 }
 
+function testGetMemoryAccounting() {
+  if (isUsingCCTests) {
+    var builder = google.gears.factory.create('beta.blobbuilder');
+    builder.append('Memory accounting test data');
+    var entries = internalTests.getMemoryAccounting();
+    var found = false;
+    for (var i = 0; i < entries.length; i++) {
+      assert(entries[i].allocations >= 0,
+             'allocations should not be negative');
+      if (entries[i].type == 'ByteStore' && entries[i].bytes > 0) {
+        found = true;
+      }
+    }
+    assert(found, 'BlobBuilder data should be accounted to a ByteStore');
+  }
+}
+
 // SAFARI-TEMP - Disable tests that don't currently work on Safari.
 testCreateObject._disable_in_safari = true;
 testObjectProperties._disable_in_safari = true;
@@ -364,6 +364,24 @@ function testCaptureBlob() {
   });
 }
 
+function testGetQuotaUsage() {
+  var store = getFreshStore();
+  var before = localServer.getQuotaUsage();
+  assert(before.quota > 0, 'Quota should be positive');
+  assert(before.usage <= before.quota, 'Usage should be within the quota');
+
+  startAsync();
+  var captureUri = '/testcases/test_file_1024.txt';
+  store.capture(captureUri, function(url, success, id) {
+    assert(success, 'Capture should have succeeded');
+    var after = localServer.getQuotaUsage();
+    assert(after.usage >= before.usage + 1024,
+           'Usage should include the captured body');
+    assertEqual(before.quota, after.quota);
+    completeAsync();
+  });
+}
+
 function testGoodManifest() {
   startAsync();
 
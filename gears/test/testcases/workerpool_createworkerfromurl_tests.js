@@ -157,6 +157,29 @@ function testCreateWorkerFromUrl5() {
   wp.sendMessage('PING5', childId);
 }
 
+function testManyWorkersFromSameUrl() {
+  // Workers created from the same url while a fetch for it is outstanding
+  // share that fetch. Every one of them must still start and reply.
+  var numWorkers = 8;
+  var numReplies = 0;
+  var repliedTo = {};
+
+  var wp = google.gears.factory.create('beta.workerpool');
+  wp.onmessage = function(text, sender, m) {
+    assert(!repliedTo[sender], 'Worker ' + sender + ' replied twice');
+    repliedTo[sender] = true;
+    if (++numReplies == numWorkers) {
+      completeAsync();
+    }
+  };
+
+  startAsync();
+  for (var i = 0; i < numWorkers; ++i) {
+    var childId = wp.createWorkerFromUrl(sameOriginWorkerPath);
+    wp.sendMessage('MANY' + i, childId);
+  }
+}
+
 function testOneShotWorkerFromUrl() {
   // Not having a global reference to wp or any callbacks causes this
   // GearsWorkerPool instance to get GC'd before page unload. This found a bug
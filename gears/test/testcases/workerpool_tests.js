@@ -201,6 +201,38 @@ function testOnMessageTests() {
   wp1.sendMessage('PING1', childId);
 }
 
+function testModuleCallsFromWorker() {
+  // With NPAPI, each thread interns member names in its own JS runtime, so a
+  // worker must not dispatch through the ids of the thread that first used
+  // the same module classes, which this one has just done.
+  startAsync();
+  var buildInfo = google.gears.factory.getBuildInfo();
+  var db = google.gears.factory.create('beta.database');
+  db.open('workerpool_module_calls_test');
+  db.execute('SELECT 1').close();
+  db.close();
+
+  var wp = google.gears.factory.create('beta.workerpool');
+  wp.onmessage = function(text, sender, message) {
+    assertEqual(buildInfo + ',1', message.body,
+                'Unexpected results of module calls from worker');
+    completeAsync();
+  };
+  var childId = wp.createWorker(
+      'var wp = google.gears.workerPool;' +
+      'wp.onmessage = function(a, b, m) {' +
+      '  var db = google.gears.factory.create("beta.database");' +
+      '  db.open("workerpool_module_calls_test");' +
+      '  var rs = db.execute("SELECT 1");' +
+      '  var value = rs.isValidRow() ? rs.field(0) : "no row";' +
+      '  rs.close();' +
+      '  db.close();' +
+      '  wp.sendMessage(google.gears.factory.getBuildInfo() + "," + value,' +
+      '                 m.sender);' +
+      '};');
+  wp.sendMessage('go', childId);
+}
+
 function testLocation() {
   // This one cannot run in a worker.
   if (typeof document == 'undefined') {
@@ -274,11 +274,14 @@ OPERA_CPPFLAGS += -DBROWSER_NPAPI
 SQLITE_CFLAGS += -DSQLITE_CORE \
   -DSQLITE_ENABLE_FTS1 -DSQLITE_ENABLE_BROKEN_FTS1 \
   -DSQLITE_ENABLE_FTS2 -DSQLITE_ENABLE_BROKEN_FTS2 \
+  -DSQLITE_ENABLE_FTS3 \
   -DTHREADSAFE=1 -DSQLITE_DEFAULT_FILE_PERMISSIONS=0600 \
   -DSQLITE_OMIT_LOAD_EXTENSION=1 \
   -DSQLITE_TRANSACTION_DEFAULT_IMMEDIATE=1 \
   -DSQLITE_GEARS_DISABLE_SHELL_ICU \
-  -I../third_party/sqlite_google/src -I../third_party/sqlite_google/preprocessed
+  -I../third_party/sqlite_google/src \
+  -I../third_party/sqlite_google/preprocessed \
+  -I../third_party/sqlite_google/ext/fts3
 
 GTEST_CPPFLAGS += -I../third_party/gtest/include -I../third_party/gtest
 
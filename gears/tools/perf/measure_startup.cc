@@ -46,16 +46,42 @@
 #endif
 
 #include "gears/base/common/basictypes.h"
-int64 GetCurrentTimeMillis();
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
 
+// Returns the current time in milliseconds since the epoch, computed the same
+// way as GetCurrentTimeMillis() in base/common/stopwatch_*.cc, so that it can
+// be compared with the trace files Gears writes when GEARS_TRACE_FILE is set
+// (see base/common/trace_events.h). Their event timestamps are relative to
+// otherData.baseTimeMillis, and each thread's first use of a database is
+// recorded as an event such as "WebCacheDB.FirstUse".
 // TODO(cprince): Build against stopwatch.* instead, when it is OS-specific.
+int64 GetCurrentTimeMillis() {
+#ifdef WIN32
+  // The FILETIME structure counts 100-nanosecond intervals since January 1,
+  // 1601 (UTC).
+  const int64 kFiletimeTicksToEpoch = 116444736000000000LL;
+  SYSTEMTIME systemtime;
+  GetSystemTime(&systemtime);
+  FILETIME filetime;
+  SystemTimeToFileTime(&systemtime, &filetime);
+  ULARGE_INTEGER ticks;
+  ticks.LowPart = filetime.dwLowDateTime;
+  ticks.HighPart = filetime.dwHighDateTime;
+  return (static_cast<int64>(ticks.QuadPart) - kFiletimeTicksToEpoch) / 10000;
+#else
+  struct timeval t;
+  int ret = gettimeofday(&t, 0);
+  return ret == 0 ? (t.tv_sec * 1000LL) + (t.tv_usec / 1000) : 0;
+#endif
+}
+
 int64 GetTickValueMicros() {
   return 1000 * GetCurrentTimeMillis();
 }
-int64 GetCurrentTimeMillis() {
-  static int64 i = 0;
-  return ++i;
-}  
 
 
 // Returns the granularity successive timer reads.
@@ -122,7 +148,11 @@ int main(int argc, char** argv) {
   int64 start = GetTickValueMicros();
   // TODO(cprince): Should print time *after* starting child process, to avoid
   // introducing delay.  But that requires a function other than fork/exec.
-  printf("START TIMESTAMP: %" PRINTF_64BIT_SPECIFIER "d\n", start);
+  printf("START TIMESTAMP: %" PRINTF_64BIT_SPECIFIER "d us "
+         "(%" PRINTF_64BIT_SPECIFIER "d ms)\n",
+         static_cast<long long>(start), static_cast<long long>(start / 1000));
+  // exec discards anything still buffered, so flush before it.
+  fflush(stdout);
   execv(argv[0], &argv[0]);
   // On success, exec doesn't return; it *replaces* the current process!
   printf("\n");
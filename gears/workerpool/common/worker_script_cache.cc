@@ -0,0 +1,175 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gears/workerpool/common/worker_script_cache.h"
+
+#include <map>
+#include "gears/base/common/mutex.h"
+#include "gears/blob/blob_interface.h"
+#include "gears/blob/blob_utils.h"
+#include "gears/localserver/common/http_constants.h"
+#include "gears/localserver/common/http_request.h"
+
+namespace {
+
+// Scripts are typically a few hundred KB, so this holds the handful that a
+// page's pools load without growing without bound.
+const size_t kMaxEntries = 16;
+const size_t kMaxTotalChars = 4 * 1024 * 1024;  // 8MB of UTF-16
+
+struct CacheEntry {
+  std::string16 validator;
+  std::string16 charset;
+  int64 body_length;
+  std::string16 text;
+  int64 last_used;
+};
+
+typedef std::map<std::string16, CacheEntry> CacheMap;
+
+Mutex cache_lock;
+CacheMap cache;  // Keyed by final URL.
+size_t cache_total_chars = 0;
+int64 cache_clock = 0;
+
+void EraseEntry(CacheMap::iterator iter) {
+  cache_total_chars -= iter->second.text.size();
+  cache.erase(iter);
+}
+
+}  // namespace
+
+// static
+bool WorkerScriptCache::GetScriptText(HttpRequest *request,
+                                      const std::string16 &final_url,
+                                      BlobInterface *body,
+                                      std::string16 *text) {
+  std::string16 charset = request->GetResponseCharset();
+  std::string16 validator;
+  if (!request->GetResponseHeader(HttpConstants::kETagHeader, &validator) ||
+      validator.empty()) {
+    std::string16 last_modified;
+    if (request->GetResponseHeader(HttpConstants::kLastModifiedHeader,
+                                   &last_modified) &&
+        !last_modified.empty()) {
+      validator = STRING16(L"Last-Modified: ") + last_modified;
+    }
+  }
+  int64 body_length = body->Length();
+
+  if (!validator.empty() &&
+      Lookup(final_url, validator, charset, body_length, text)) {
+    return true;
+  }
+  if (!BlobToString16(body, charset, text)) {
+    return false;
+  }
+  if (!validator.empty()) {
+    Store(final_url, validator, charset, body_length, *text);
+  }
+  return true;
+}
+
+// static
+bool WorkerScriptCache::Lookup(const std::string16 &final_url,
+                               const std::string16 &validator,
+                               const std::string16 &charset,
+                               int64 body_length,
+                               std::string16 *text) {
+  MutexLock lock(&cache_lock);
+  CacheMap::iterator iter = cache.find(final_url);
+  if (iter == cache.end()) {
+    return false;
+  }
+  CacheEntry &entry = iter->second;
+  if (entry.validator != validator || entry.charset != charset ||
+      entry.body_length != body_length) {
+    // The script has changed, so this entry will not be used again.
+    EraseEntry(iter);
+    return false;
+  }
+  entry.last_used = ++cache_clock;
+  *text = entry.text;
+  return true;
+}
+
+// static
+void WorkerScriptCache::Store(const std::string16 &final_url,
+                              const std::string16 &validator,
+                              const std::string16 &charset,
+                              int64 body_length,
+                              const std::string16 &text) {
+  if (text.size() > kMaxTotalChars / 2) {
+    return;
+  }
+  MutexLock lock(&cache_lock);
+  CacheMap::iterator existing = cache.find(final_url);
+  if (existing != cache.end()) {
+    EraseEntry(existing);
+  }
+  // Evict the least recently used entries to make room.
+  while (!cache.empty() &&
+         (cache.size() >= kMaxEntries ||
+          cache_total_chars + text.size() > kMaxTotalChars)) {
+    CacheMap::iterator oldest = cache.begin();
+    for (CacheMap::iterator iter = cache.begin(); iter != cache.end();
+         ++iter) {
+      if (iter->second.last_used < oldest->second.last_used) {
+        oldest = iter;
+      }
+    }
+    EraseEntry(oldest);
+  }
+  CacheEntry &entry = cache[final_url];
+  entry.validator = validator;
+  entry.charset = charset;
+  entry.body_length = body_length;
+  entry.text = text;
+  entry.last_used = ++cache_clock;
+  cache_total_chars += text.size();
+}
+
+#ifdef USING_CCTESTS
+// static
+bool WorkerScriptCache::LookupForTest(const std::string16 &final_url,
+                                      const std::string16 &validator,
+                                      std::string16 *text) {
+  return Lookup(final_url, validator, std::string16(), 0, text);
+}
+
+// static
+void WorkerScriptCache::StoreForTest(const std::string16 &final_url,
+                                     const std::string16 &validator,
+                                     const std::string16 &text) {
+  Store(final_url, validator, std::string16(), 0, text);
+}
+
+// static
+void WorkerScriptCache::ClearForTest() {
+  MutexLock lock(&cache_lock);
+  cache.clear();
+  cache_total_chars = 0;
+}
+#endif
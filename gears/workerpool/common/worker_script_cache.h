@@ -0,0 +1,74 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GEARS_WORKERPOOL_COMMON_WORKER_SCRIPT_CACHE_H__
+#define GEARS_WORKERPOOL_COMMON_WORKER_SCRIPT_CACHE_H__
+
+#include "gears/base/common/string16.h"
+
+class BlobInterface;
+class HttpRequest;
+
+// Holds the decoded text of scripts loaded by createWorkerFromUrl, shared by
+// all worker pools in the process. Entries are keyed by the final URL of the
+// response and its validator (the ETag header, or failing that the
+// Last-Modified header), so a script is only reused while the server reports
+// it unchanged. Responses without a validator are never cached.
+class WorkerScriptCache {
+ public:
+  // Sets 'text' to the decoded body of a successful worker script response,
+  // reusing the text of an earlier identical response if there is one.
+  static bool GetScriptText(HttpRequest *request,
+                            const std::string16 &final_url,
+                            BlobInterface *body,
+                            std::string16 *text);
+
+#ifdef USING_CCTESTS
+  // Looks up and stores entries directly, bypassing the HttpRequest.
+  static bool LookupForTest(const std::string16 &final_url,
+                            const std::string16 &validator,
+                            std::string16 *text);
+  static void StoreForTest(const std::string16 &final_url,
+                           const std::string16 &validator,
+                           const std::string16 &text);
+  static void ClearForTest();
+#endif
+
+ private:
+  static bool Lookup(const std::string16 &final_url,
+                     const std::string16 &validator,
+                     const std::string16 &charset,
+                     int64 body_length,
+                     std::string16 *text);
+  static void Store(const std::string16 &final_url,
+                    const std::string16 &validator,
+                    const std::string16 &charset,
+                    int64 body_length,
+                    const std::string16 &text);
+
+  DISALLOW_EVIL_CONSTRUCTORS(WorkerScriptCache);
+};
+
+#endif  // GEARS_WORKERPOOL_COMMON_WORKER_SCRIPT_CACHE_H__
@@ -0,0 +1,97 @@
+// Copyright 2009, Google Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//  3. Neither the name of Google Inc. nor the names of its contributors may be
+//     used to endorse or promote products derived from this software without
+//     specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+// EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+// OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <assert.h>
+#include "gears/base/common/common.h"
+#include "gears/workerpool/common/worker_script_cache.h"
+
+#ifdef USING_CCTESTS
+
+bool TestWorkerScriptCache(std::string16 *error) {
+#undef TEST_ASSERT
+#define TEST_ASSERT(b) \
+{ \
+  if (!(b)) { \
+    LOG(("TestWorkerScriptCache - failed (%d)\n", __LINE__)); \
+    assert(error); \
+    *error += STRING16(L"TestWorkerScriptCache - failed. "); \
+    WorkerScriptCache::ClearForTest(); \
+    return false; \
+  } \
+}
+
+  const std::string16 kUrl(STRING16(L"http://a.com/worker.js"));
+  const std::string16 kScript(STRING16(L"var x = 1;"));
+  std::string16 text;
+
+  WorkerScriptCache::ClearForTest();
+  TEST_ASSERT(!WorkerScriptCache::LookupForTest(kUrl, STRING16(L"\"v1\""),
+                                                &text));
+
+  // A stored script is returned while its validator is unchanged.
+  WorkerScriptCache::StoreForTest(kUrl, STRING16(L"\"v1\""), kScript);
+  TEST_ASSERT(WorkerScriptCache::LookupForTest(kUrl, STRING16(L"\"v1\""),
+                                               &text));
+  TEST_ASSERT(text == kScript);
+
+  // A different validator misses, and drops the stale entry.
+  TEST_ASSERT(!WorkerScriptCache::LookupForTest(kUrl, STRING16(L"\"v2\""),
+                                                &text));
+  TEST_ASSERT(!WorkerScriptCache::LookupForTest(kUrl, STRING16(L"\"v1\""),
+                                                &text));
+
+  // Filling the cache evicts the least recently used entry.
+  const int kNumUrls = 17;
+  for (int i = 0; i < kNumUrls; ++i) {
+    std::string16 url(kUrl + IntegerToString16(i));
+    WorkerScriptCache::StoreForTest(url, STRING16(L"\"v1\""), kScript);
+    if (i == 0) {
+      continue;
+    }
+    // Keep the first url in use so that the second one is evicted instead.
+    TEST_ASSERT(WorkerScriptCache::LookupForTest(kUrl + STRING16(L"0"),
+                                                 STRING16(L"\"v1\""),
+                                                 &text));
+  }
+  TEST_ASSERT(WorkerScriptCache::LookupForTest(kUrl + STRING16(L"0"),
+                                               STRING16(L"\"v1\""), &text));
+  TEST_ASSERT(!WorkerScriptCache::LookupForTest(kUrl + STRING16(L"1"),
+                                                STRING16(L"\"v1\""), &text));
+  TEST_ASSERT(WorkerScriptCache::LookupForTest(
+      kUrl + IntegerToString16(kNumUrls - 1), STRING16(L"\"v1\""), &text));
+
+  // Scripts too large to share sensibly are not stored.
+  WorkerScriptCache::ClearForTest();
+  std::string16 huge(3 * 1024 * 1024, L'x');
+  WorkerScriptCache::StoreForTest(kUrl, STRING16(L"\"v1\""), huge);
+  TEST_ASSERT(!WorkerScriptCache::LookupForTest(kUrl, STRING16(L"\"v1\""),
+                                                &text));
+
+  WorkerScriptCache::ClearForTest();
+  LOG(("TestWorkerScriptCache - passed\n"));
+  return true;
+}
+
+#endif  // USING_CCTESTS
@@ -27,6 +27,7 @@
 #ifdef OS_MACOSX
 #include <pthread.h>
 #endif
+#include <map>
 #include <queue>
 
 #include "gears/workerpool/npapi/pool_threads_manager.h"
@@ -38,16 +39,17 @@
 #include "gears/base/common/event.h"
 #include "gears/base/common/leak_counter.h"
 #include "gears/base/common/mutex.h"
+#include "gears/base/common/trace_events.h"
 #ifdef WIN32
 #include "gears/base/common/scoped_win32_handles.h"
 #endif
 #include "gears/base/common/url_utils.h"
 #include "gears/base/npapi/browser_utils.h"
 #include "gears/blob/blob_interface.h"
-#include "gears/blob/blob_utils.h"
 #include "gears/factory/factory_impl.h"
 #include "gears/localserver/common/http_request.h"
 #include "third_party/scoped_ptr/scoped_ptr.h"
+#include "gears/workerpool/common/worker_script_cache.h"
 #include "gears/workerpool/common/workerpool_utils.h"
 #include "gears/workerpool/workerpool.h"
 
@@ -435,73 +437,130 @@ bool PoolThreadsManager::SetCurrentThreadErrorHandler(
   return true;
 }
 
+// Fetches the script of a worker created from a URL. Workers that the same
+// pool creates from the same URL while the fetch is in progress share it,
+// rather than each making a request and decoding the response.
 class CreateWorkerUrlFetchListener : public HttpRequest::HttpListener {
  public:
-  explicit CreateWorkerUrlFetchListener(JavaScriptWorkerInfo *wi) : wi_(wi) {}
+  CreateWorkerUrlFetchListener(JavaScriptWorkerInfo *wi,
+                               const std::string16 &url)
+      : key_(wi->threads_manager, url), is_pending_(true) {
+    workers_.push_back(wi);
+    MutexLock lock(&pending_fetches_lock_);
+    pending_fetches_[key_] = this;
+  }
+
+  virtual ~CreateWorkerUrlFetchListener() {
+    RemovePendingFetch();
+  }
+
+  // Adds the worker to a fetch of the URL already in progress for its pool.
+  // Returns false if there is none.
+  static bool JoinPendingFetch(JavaScriptWorkerInfo *wi,
+                               const std::string16 &url) {
+    MutexLock lock(&pending_fetches_lock_);
+    PendingFetchMap::iterator iter =
+        pending_fetches_.find(PendingFetchKey(wi->threads_manager, url));
+    if (iter == pending_fetches_.end()) {
+      return false;
+    }
+    iter->second->workers_.push_back(wi);
+    return true;
+  }
 
   virtual void ReadyStateChanged(HttpRequest *source) {
     HttpRequest::ReadyState ready_state = HttpRequest::UNINITIALIZED;
     source->GetReadyState(&ready_state);
     if (ready_state == HttpRequest::COMPLETE) {
-      // Fetch completed.  First, unregister this listener.
+      // Fetch completed.  First, unregister this listener, after which no
+      // more workers can join it.
       source->SetListener(NULL, false);
+      RemovePendingFetch();
 
       int status_code;
       scoped_refptr<BlobInterface> body;
       std::string16 final_url;
+      std::string16 error_message;
+      std::string16 text;
       if (!source->GetStatus(&status_code) ||
           status_code != HttpConstants::HTTP_OK ||
           !source->GetResponseBody(&body) ||
           !source->GetFinalUrl(&final_url)) {
-        // Throw an error, but don't return!  Continue and signal script_event
-        // so the worker doesn't wait forever in Event::Wait().
-        std::string16 message(STRING16(L"Failed to load script."));
+        error_message = STRING16(L"Failed to load script.");
         std::string16 status_line;
         if (source->GetStatusLine(&status_line)) {
-          message += STRING16(L" Status: ");
-          message += status_line;
+          error_message += STRING16(L" Status: ");
+          error_message += status_line;
         }
         std::string16 requested_url;
         if (source->GetInitialUrl(&requested_url)) {
-          message += STRING16(L" URL: ");
-          message += requested_url;
+          error_message += STRING16(L" URL: ");
+          error_message += requested_url;
         }
-        JsErrorInfo error_info = { 0, message };  // line, message
-        wi_->threads_manager->HandleError(error_info);
       } else if (IsCrossOrigin(source, final_url) &&
                  !HasGearsWorkerContentType(source)) {
-        JsErrorInfo error_info = {
-          0,
-          STRING16(L"Cross-origin worker has invalid content-type header.")
-        };
-        wi_->threads_manager->HandleError(error_info);
+        error_message =
+            STRING16(L"Cross-origin worker has invalid content-type header.");
       } else {
-        // These are purposely set before locking mutex, because they are still
-        // owned by the parent thread at this point.
-        wi_->script_ok = true;
-        std::string16 text;
-        bool result = BlobToString16(body.get(), source->GetResponseCharset(),
-                                     &text);
+        bool result = WorkerScriptCache::GetScriptText(source, final_url,
+                                                       body.get(), &text);
         if (!result) {
           assert(result);  // TODO(bgarcia): throw error on failure.
         }
-        wi_->script_text += text;
-        // Must use security origin of final url, in case there were redirects.
-        wi_->script_origin.InitFromUrl(final_url.c_str());
       }
 
-      wi_->script_event.Signal();
+      for (size_t i = 0; i < workers_.size(); ++i) {
+        JavaScriptWorkerInfo *wi = workers_[i];
+        if (!error_message.empty()) {
+          // Throw an error, but don't return!  Continue and signal
+          // script_event so the worker doesn't wait forever in Event::Wait().
+          JsErrorInfo error_info = { 0, error_message };  // line, message
+          wi->threads_manager->HandleError(error_info);
+        } else {
+          // These are purposely set before locking mutex, because they are
+          // still owned by the parent thread at this point.
+          wi->script_ok = true;
+          wi->script_text += text;
+          // Must use security origin of final url, in case there were
+          // redirects.
+          wi->script_origin.InitFromUrl(final_url.c_str());
+        }
+        wi->script_event.Signal();
+      }
     }
   }
  private:
+  typedef std::pair<PoolThreadsManager*, std::string16> PendingFetchKey;
+  typedef std::map<PendingFetchKey, CreateWorkerUrlFetchListener*>
+      PendingFetchMap;
+
   bool IsCrossOrigin(HttpRequest *source, const std::string16 &worker_url) {
-    return !wi_->threads_manager->page_security_origin().IsSameOriginAsUrl(
-                worker_url.c_str());
+    return !workers_[0]->threads_manager->page_security_origin().
+                IsSameOriginAsUrl(worker_url.c_str());
   }
 
-  JavaScriptWorkerInfo *wi_;
+  void RemovePendingFetch() {
+    MutexLock lock(&pending_fetches_lock_);
+    if (is_pending_) {
+      pending_fetches_.erase(key_);
+      is_pending_ = false;
+    }
+  }
+
+  PendingFetchKey key_;
+  bool is_pending_;  // Protected by pending_fetches_lock_.
+  // The first worker owns this listener.
+  std::vector<JavaScriptWorkerInfo*> workers_;
+
+  // Pages may run on different threads, so the map is shared between them.
+  static Mutex pending_fetches_lock_;
+  static PendingFetchMap pending_fetches_;
 };
 
+Mutex CreateWorkerUrlFetchListener::pending_fetches_lock_;
+CreateWorkerUrlFetchListener::PendingFetchMap
+    CreateWorkerUrlFetchListener::pending_fetches_;
+
 bool PoolThreadsManager::CreateThread(const std::string16 &url_or_full_script,
                                       bool is_param_script,
                                       int *worker_id) {
@@ -550,22 +609,28 @@ bool PoolThreadsManager::CreateThread(const std::string16 &url_or_full_script,
     // For URL params we start an async fetch here.  The created thread will
     // setup an incoming message queue, then Mutex::Await for the script to be
     // fetched, before finally pumping messages.
-    if (!HttpRequest::Create(&wi->http_request)) { return false; }
-    wi->http_request_listener.reset(new CreateWorkerUrlFetchListener(wi));
-    if (!wi->http_request_listener.get()) { return false; }
-
-    wi->http_request->SetListener(wi->http_request_listener.get(), false);
-    wi->http_request->SetCachingBehavior(HttpRequest::USE_ALL_CACHES);
-    wi->http_request->SetRedirectBehavior(HttpRequest::FOLLOW_ALL);
-
-    bool is_async = true;
-    if (!wi->http_request->Open(HttpConstants::kHttpGET,
-                                url_or_full_script.c_str(),
-                                is_async, browsing_context()) ||
-        !wi->http_request->Send(NULL)) {
-      wi->http_request->SetListener(NULL, false);
-      wi->http_request->Abort();
-      return false;
+    if (!CreateWorkerUrlFetchListener::JoinPendingFetch(wi,
+                                                        url_or_full_script)) {
+      if (!HttpRequest::Create(&wi->http_request)) { return false; }
+      wi->http_request_listener.reset(
+          new CreateWorkerUrlFetchListener(wi, url_or_full_script));
+      if (!wi->http_request_listener.get()) { return false; }
+
+      wi->http_request->SetListener(wi->http_request_listener.get(), false);
+      wi->http_request->SetCachingBehavior(HttpRequest::USE_ALL_CACHES);
+      wi->http_request->SetRedirectBehavior(HttpRequest::FOLLOW_ALL);
+
+      bool is_async = true;
+      if (!wi->http_request->Open(HttpConstants::kHttpGET,
+                                  url_or_full_script.c_str(),
+                                  is_async, browsing_context()) ||
+          !wi->http_request->Send(NULL)) {
+        wi->http_request->SetListener(NULL, false);
+        wi->http_request->Abort();
+        // So that no other worker waits for this fetch.
+        wi->http_request_listener.reset(NULL);
+        return false;
+      }
     }
 
     // 'script_event.Signal()' will be called when async fetch completes.
@@ -843,6 +908,7 @@ void PoolThreadsManager::OnReceiveThreadsEvent(ThreadsEvent *event) {
 
 void PoolThreadsManager::ProcessMessage(JavaScriptWorkerInfo *wi,
                                         const WorkerPoolMessage &msg) {
+  TRACE_EVENT("workerpool", "WorkerPool.ProcessMessage");
   assert(wi);
 
   // TODO(zork): Remove this with dump_on_error.  It is declared as volatile to
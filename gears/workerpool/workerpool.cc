@@ -28,7 +28,9 @@
 
 #include "gears/workerpool/workerpool.h"
 
+#include "gears/base/common/memory_accounting.h"
 #include "gears/base/common/permissions_db.h"
+#include "gears/base/common/trace_events.h"
 #include "gears/base/common/url_utils.h"
 #include "gears/localserver/common/http_request.h"
 #include "gears/workerpool/location.h"
@@ -264,6 +266,7 @@ void GearsWorkerPool::AllowCrossOrigin(JsCallContext *context) {
 }
 
 void GearsWorkerPool::SendMessage(JsCallContext *context) {
+  TRACE_EVENT("workerpool", "WorkerPool.SendMessage");
   Initialize();
 
   JsParamType message_body_type = context->GetArgumentType(0);
@@ -288,6 +291,7 @@ void GearsWorkerPool::SendMessage(JsCallContext *context) {
     return;
 
   std::string16 error;
+  ScopedMemoryOrigin memory_origin(EnvPageSecurityOrigin().url());
   MarshaledJsToken *mjt = MarshaledJsToken::Marshal(
       message_body, GetJsRunner(), &error);
   if (!mjt) {